@@ -95,6 +95,13 @@ BENCHMARK_DEFINE_F(StringFixture, RandomSet)(benchmark::State& state) {
 }
 
 BENCHMARK_DEFINE_F(StringFixture, Incr)(benchmark::State& state) {
+  db->Set("k", "0");
+  for (auto _ : state) {
+    db->Incr("k", nullptr);
+  }
+}
+
+BENCHMARK_DEFINE_F(StringFixture, IncrWithResult)(benchmark::State& state) {
   db->Set("k", "0");
   int64_t _r;
   for (auto _ : state) {
@@ -111,3 +118,4 @@ BENCHMARK_REGISTER_F(StringFixture, FixedSetLarge)->DenseRange(1 << 16, 1 << 20,
 BENCHMARK_REGISTER_F(StringFixture, RandomGet)->RangeMultiplier(2)->Range(1, 1 << 11)->DenseRange(1 << 12, 1 << 16, 1 << 12);
 BENCHMARK_REGISTER_F(StringFixture, RandomSet)->RangeMultiplier(2)->Range(1, 1 << 11)->DenseRange(1 << 12, 1 << 16, 1 << 12);
 BENCHMARK_REGISTER_F(StringFixture, Incr);
+BENCHMARK_REGISTER_F(StringFixture, IncrWithResult);
@@ -0,0 +1,238 @@
+#include "merodis/merodis.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "redis.h"
+#include "redis_string.h"
+#include "redis_list.h"
+#include "redis_hash.h"
+#include "redis_set.h"
+#include "redis_zset.h"
+
+#ifdef ROCKSDB
+#include "rocksdb/env.h"
+#include "rocksdb/sst_file_reader.h"
+#include "rocksdb/sst_file_writer.h"
+#endif
+
+namespace merodis {
+
+#ifdef ROCKSDB
+static const char* const kTypeNames[] = {"string", "list", "hash", "set", "zset"};
+#endif
+
+// Fails with InvalidArgument if db holds any of keys. The keys are sorted
+// and looked up in one forward pass of an iterator, which seeks only when
+// it falls behind, rather than by a point read each.
+static Status CheckNotStored(DB* db, std::vector<std::string>* keys) noexcept {
+  std::sort(keys->begin(), keys->end());
+  ReadOptions options;
+  options.fill_cache = false;
+#ifdef ROCKSDB
+  // The pass crosses prefixes, which the prefix extractor otherwise skips.
+  options.total_order_seek = true;
+#endif
+  Iterator* iter = db->NewIterator(options);
+  Status s;
+  bool positioned = false;
+  for (const auto& key: *keys) {
+    if (!positioned || iter->key().compare(key) < 0) {
+      iter->Seek(key);
+      positioned = true;
+    }
+    // No stored key is as large as this one, nor as the next ones.
+    if (!iter->Valid()) break;
+    if (iter->key() == key) {
+      s = Status::InvalidArgument("Key already stored", key);
+      break;
+    }
+  }
+  if (s.ok()) s = iter->status();
+  delete iter;
+  return s;
+}
+
+#ifdef ROCKSDB
+// Fails with InvalidArgument if a key is in more than one of the run files
+// of db, each sorted and free of duplicates itself. Only the runs whose key
+// ranges overlap are merged, in one pass over them.
+static Status CheckRunsDisjoint(DB* db, const std::vector<std::string>& files) noexcept {
+  struct Run {
+    std::unique_ptr<DB_ENGINE::SstFileReader> reader;
+    std::unique_ptr<Iterator> iter;
+    std::string smallest;
+    std::string largest;
+  };
+  std::vector<Run> runs(files.size());
+  for (size_t c = 0; c < files.size(); c++) {
+    Run& run = runs[c];
+    run.reader = std::make_unique<DB_ENGINE::SstFileReader>(db->GetOptions());
+    Status s = run.reader->Open(files[c]);
+    if (!s.ok()) return s;
+    run.iter.reset(run.reader->NewIterator(ReadOptions()));
+    run.iter->SeekToLast();
+    if (run.iter->Valid()) run.largest = run.iter->key().ToString();
+    run.iter->SeekToFirst();
+    if (!run.iter->Valid()) return run.iter->status();
+    run.smallest = run.iter->key().ToString();
+  }
+  std::sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) { return a.smallest < b.smallest; });
+
+  // The iterators of a group of overlapping runs, smallest key on top.
+  auto after = [](Iterator* a, Iterator* b) { return a->key().compare(b->key()) > 0; };
+  for (size_t begin = 0, end; begin < runs.size(); begin = end) {
+    std::string largest = runs[begin].largest;
+    for (end = begin + 1; end < runs.size() && runs[end].smallest <= largest; end++) {
+      largest = std::max(largest, runs[end].largest);
+    }
+    if (end - begin == 1) continue;
+    std::vector<Iterator*> heap;
+    for (size_t c = begin; c < end; c++) heap.push_back(runs[c].iter.get());
+    std::make_heap(heap.begin(), heap.end(), after);
+    std::string previous;
+    bool first = true;
+    while (!heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), after);
+      Iterator* iter = heap.back();
+      if (!first && iter->key() == previous) return Status::InvalidArgument("Key added twice", previous);
+      previous = iter->key().ToString();
+      first = false;
+      iter->Next();
+      if (iter->Valid()) {
+        std::push_heap(heap.begin(), heap.end(), after);
+      } else if (!iter->status().ok()) {
+        return iter->status();
+      } else {
+        heap.pop_back();
+      }
+    }
+  }
+  return Status::OK();
+}
+#endif
+
+BulkLoader::BulkLoader(Merodis* db, const std::string& work_path, size_t buffer_size) noexcept:
+  db_(db),
+  work_path_(work_path),
+  buffer_size_(buffer_size),
+  buffered_size_(0),
+  buffers_(kZSetType + 1),
+  files_(kZSetType + 1),
+  keys_(kZSetType + 1),
+  file_number_(0) {}
+
+BulkLoader::~BulkLoader() noexcept {
+#ifdef ROCKSDB
+  // Left behind by a load that did not finish.
+  for (const auto& files: files_) {
+    for (const auto& file: files) DB_ENGINE::Env::Default()->DeleteFile(file);
+  }
+#endif
+}
+
+Status BulkLoader::Add(const BulkRecord& record) noexcept {
+  if (record.type < kStringType || record.type > kZSetType) {
+    return Status::InvalidArgument("Unknown data type");
+  }
+  Redis* dbs[] = {db_->string_db_, db_->list_db_, db_->hash_db_, db_->set_db_, db_->zset_db_};
+  KeyValues& buffer = buffers_[record.type];
+  size_t bufferSize = buffer.size();
+  Status s = dbs[record.type]->EncodeRecord(record, &buffer);
+  if (!s.ok()) {
+    buffer.resize(bufferSize);
+    return s;
+  }
+  // Every record stores its meta value, or its string value, at its key,
+  // checked against the stored keys once the run is sorted.
+  keys_[record.type].push_back(record.key);
+  buffered_size_ += record.key.size();
+  for (size_t c = bufferSize; c < buffer.size(); c++) {
+    buffered_size_ += buffer[c].first.size() + buffer[c].second.size();
+  }
+  if (buffered_size_ < buffer_size_) return Status::OK();
+  return Flush();
+}
+
+Status BulkLoader::Finish() noexcept {
+  Status s = Flush();
+  if (!s.ok()) return s;
+#ifdef ROCKSDB
+  Redis* dbs[] = {db_->string_db_, db_->list_db_, db_->hash_db_, db_->set_db_, db_->zset_db_};
+  // Each run was checked against the stored keys, but not against the
+  // other runs, as none is ingested before all are checked.
+  for (int type = kStringType; type <= kZSetType; type++) {
+    s = CheckRunsDisjoint(dbs[type]->db_, files_[type]);
+    if (!s.ok()) return s;
+  }
+  DB_ENGINE::IngestExternalFileOptions options;
+  options.move_files = true;
+  for (int type = kStringType; type <= kZSetType; type++) {
+    // The runs of a data type may overlap, so each is ingested by itself.
+    for (const auto& file: files_[type]) {
+      s = dbs[type]->db_->IngestExternalFile({file}, options);
+      if (!s.ok()) return s;
+    }
+    for (const auto& file: files_[type]) DB_ENGINE::Env::Default()->DeleteFile(file);
+    files_[type].clear();
+  }
+#endif
+  return s;
+}
+
+Status BulkLoader::Flush() noexcept {
+  Redis* dbs[] = {db_->string_db_, db_->list_db_, db_->hash_db_, db_->set_db_, db_->zset_db_};
+  Status s;
+#ifdef ROCKSDB
+  s = DB_ENGINE::Env::Default()->CreateDirIfMissing(work_path_);
+  if (!s.ok()) return s;
+#endif
+  for (int type = kStringType; type <= kZSetType; type++) {
+    KeyValues& buffer = buffers_[type];
+    if (buffer.empty()) continue;
+    std::sort(buffer.begin(), buffer.end());
+    auto duplicate = std::adjacent_find(buffer.begin(), buffer.end(), [](const auto& a, const auto& b) {
+      return a.first == b.first;
+    });
+    if (duplicate != buffer.end()) return Status::InvalidArgument("Key added twice", duplicate->first);
+
+    DB* db = dbs[type]->db_;
+    // On LevelDB, also against the runs written before.
+    s = CheckNotStored(db, &keys_[type]);
+    if (!s.ok()) return s;
+    std::vector<std::string>().swap(keys_[type]);
+#ifdef ROCKSDB
+    std::string file = work_path_ + "/" + kTypeNames[type] + "-" + std::to_string(file_number_++) + ".sst";
+    // Built with the options of the data type, e.g. its filters and prefix
+    // extractor, as if the engine had flushed the run itself.
+    DB_ENGINE::SstFileWriter writer(DB_ENGINE::EnvOptions(), db->GetOptions());
+    s = writer.Open(file);
+    for (auto it = buffer.begin(); s.ok() && it != buffer.end(); it++) s = writer.Put(it->first, it->second);
+    if (s.ok()) s = writer.Finish();
+    if (!s.ok()) return s;
+    files_[type].push_back(file);
+#else
+    // Written in large sorted batches, which fill the memtable in order.
+    // The runs of different flushes overlap, so their tables are compacted
+    // together like those of any other writes.
+    WriteBatch updates;
+    for (const auto& [key, value]: buffer) {
+      updates.Put(key, value);
+      if (updates.ApproximateSize() < (4 << 20)) continue;
+      s = db->Write(WriteOptions(), &updates);
+      if (!s.ok()) return s;
+      updates.Clear();
+    }
+    s = db->Write(WriteOptions(), &updates);
+    if (!s.ok()) return s;
+#endif
+    KeyValues().swap(buffer);
+  }
+  buffered_size_ = 0;
+  return Status::OK();
+}
+
+}
@@ -0,0 +1,365 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef ROCKSDB
+#include "rocksdb/utilities/checkpoint.h"
+#endif
+
+namespace merodis {
+
+namespace fs = std::filesystem;
+
+static Status IOError(const fs::path& path, const std::error_code& ec) noexcept {
+  return Status::IOError(path.string(), ec.message());
+}
+
+static Status ListDirectory(const fs::path& dir, std::vector<std::string>* names) noexcept {
+  std::error_code ec;
+  for (fs::directory_iterator iter(dir, ec), end; !ec && iter != end; iter.increment(ec)) {
+    names->push_back(iter->path().filename().string());
+  }
+  if (ec) return IOError(dir, ec);
+  return Status::OK();
+}
+
+// Whether name is a table, or a sealed value log file, either never
+// rewritten under the same name.
+static bool IsImmutableFile(const std::string& name) noexcept {
+  for (const std::string suffix: {".ldb", ".sst", ".blob", ".vlog"}) {
+    if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static Status CopyFile(const fs::path& from, const fs::path& to) noexcept {
+  std::error_code ec;
+  fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+  if (ec) return IOError(from, ec);
+  return Status::OK();
+}
+
+#ifdef ROCKSDB
+Status CheckpointDB(DB* db, const std::string&, const std::string& checkpoint_path) noexcept {
+  DB_ENGINE::Checkpoint* checkpoint;
+  Status s = DB_ENGINE::Checkpoint::Create(db, &checkpoint);
+  if (!s.ok()) return s;
+  s = checkpoint->CreateCheckpoint(checkpoint_path);
+  delete checkpoint;
+  return s;
+}
+#else
+// Copies CURRENT, the manifest it names into *manifest, and the WAL, the
+// files LevelDB rewrites in place.
+static Status CopyMutableFiles(const fs::path& db_path, const fs::path& checkpoint_path, std::string* manifest) noexcept {
+  std::ifstream current(db_path / "CURRENT");
+  if (!std::getline(current, *manifest)) return Status::Corruption((db_path / "CURRENT").string(), "unreadable");
+  Status s = CopyFile(db_path / *manifest, checkpoint_path / *manifest);
+  if (!s.ok()) return s;
+  std::vector<std::string> names;
+  s = ListDirectory(db_path, &names);
+  if (!s.ok()) return s;
+  for (const auto& name: names) {
+    if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".log") != 0) continue;
+    s = CopyFile(db_path / name, checkpoint_path / name);
+    if (!s.ok()) return s;
+  }
+  return CopyFile(db_path / "CURRENT", checkpoint_path / "CURRENT");
+}
+
+static bool GetVarint64(std::string_view* input, uint64_t* value) noexcept {
+  *value = 0;
+  for (int shift = 0; shift < 64 && !input->empty(); shift += 7) {
+    auto byte = static_cast<unsigned char>(input->front());
+    input->remove_prefix(1);
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool GetLengthPrefixed(std::string_view* input) noexcept {
+  uint64_t length;
+  if (!GetVarint64(input, &length) || length > input->size()) return false;
+  input->remove_prefix(length);
+  return true;
+}
+
+// Reads the records of the LevelDB log at path, see LevelDB's
+// doc/log_format.md. Like LevelDB's reader, drops a record torn at the end.
+static Status ReadLogRecords(const fs::path& path, std::vector<std::string>* records) noexcept {
+  static constexpr size_t kBlockSize = 32768;
+  static constexpr size_t kHeaderSize = 7;
+  std::ifstream file(path, std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (file.bad()) return Status::IOError(path.string(), "unreadable");
+  std::string record;
+  bool fragmented = false;
+  size_t offset = 0;
+  while (offset + kHeaderSize <= contents.size()) {
+    // Blocks end in zeros where no header fits.
+    size_t left = kBlockSize - offset % kBlockSize;
+    if (left < kHeaderSize) {
+      offset += left;
+      continue;
+    }
+    auto header = reinterpret_cast<const unsigned char*>(contents.data() + offset);
+    size_t length = header[4] | (header[5] << 8);
+    if (offset + kHeaderSize + length > contents.size()) break;
+    std::string_view fragment(contents.data() + offset + kHeaderSize, length);
+    offset += kHeaderSize + length;
+    switch (header[6]) {
+      case 0: // Preallocated.
+        break;
+      case 1: // Full.
+        records->emplace_back(fragment);
+        fragmented = false;
+        break;
+      case 2: // First.
+        record.assign(fragment);
+        fragmented = true;
+        break;
+      case 3: // Middle.
+        if (fragmented) record.append(fragment);
+        break;
+      case 4: // Last.
+        if (fragmented) records->push_back(record.append(fragment));
+        fragmented = false;
+        break;
+      default:
+        return Status::Corruption(path.string(), "unknown record type");
+    }
+  }
+  return Status::OK();
+}
+
+// Collects the numbers of the tables the LevelDB manifest at path lists,
+// replaying the VersionEdit records, see LevelDB's db/version_edit.cc.
+static Status ManifestTables(const fs::path& path, std::set<uint64_t>* tables) noexcept {
+  std::vector<std::string> records;
+  Status s = ReadLogRecords(path, &records);
+  if (!s.ok()) return s;
+  // Tables at each level, a table moved to another level is listed twice.
+  std::set<std::pair<uint64_t, uint64_t>> live;
+  for (const auto& record: records) {
+    std::string_view input(record);
+    uint64_t tag, level, number, ignored;
+    while (!input.empty()) {
+      if (!GetVarint64(&input, &tag)) return Status::Corruption(path.string(), "torn edit");
+      bool ok;
+      switch (tag) {
+        case 1: // Comparator.
+          ok = GetLengthPrefixed(&input);
+          break;
+        case 2: // Log number.
+        case 3: // Next file number.
+        case 4: // Last sequence.
+        case 9: // Previous log number.
+          ok = GetVarint64(&input, &ignored);
+          break;
+        case 5: // Compaction pointer.
+          ok = GetVarint64(&input, &level) && GetLengthPrefixed(&input);
+          break;
+        case 6: // Deleted table.
+          ok = GetVarint64(&input, &level) && GetVarint64(&input, &number);
+          if (ok) live.erase({level, number});
+          break;
+        case 7: // New table.
+          ok = GetVarint64(&input, &level) && GetVarint64(&input, &number) && GetVarint64(&input, &ignored) &&
+               GetLengthPrefixed(&input) && GetLengthPrefixed(&input);
+          if (ok) live.insert({level, number});
+          break;
+        default:
+          ok = false;
+      }
+      if (!ok) return Status::Corruption(path.string(), "unreadable edit");
+    }
+  }
+  for (const auto& table: live) tables->insert(table.second);
+  return Status::OK();
+}
+
+// The name of the table numbered number in linked, under either of the
+// suffixes LevelDB opens, empty if none.
+static std::string LinkedTable(const std::set<std::string>& linked, uint64_t number) noexcept {
+  char name[32];
+  for (const char* suffix: {"ldb", "sst"}) {
+    std::snprintf(name, sizeof(name), "%06llu.%s", static_cast<unsigned long long>(number), suffix);
+    if (linked.count(name)) return name;
+  }
+  return std::string();
+}
+
+// LevelDB has no checkpoints of its own. Pausing the writes does not pause
+// its compactions, which may write new tables and delete others while they
+// are linked, so the manifest is copied again until a listing neither
+// linked a table nor missed one, and every table it lists was linked.
+//
+// LevelDB deletes a table only once its manifest dropped it, so a table
+// missing from a copy of the manifest means the manifest moved on since.
+Status CheckpointDB(DB*, const std::string& db_path, const std::string& checkpoint_path) noexcept {
+  std::error_code ec;
+  if (fs::exists(checkpoint_path, ec)) return Status::InvalidArgument(checkpoint_path, "exists");
+  fs::create_directories(checkpoint_path, ec);
+  if (ec) return IOError(checkpoint_path, ec);
+  std::set<std::string> linked;
+  std::string manifest;
+  // The name and size of the manifest copied last, and of the one found
+  // missing a table. LevelDB only appends to a manifest until it names
+  // another.
+  std::optional<std::pair<std::string, uintmax_t>> copied, missing;
+  while (true) {
+    std::vector<std::string> names;
+    Status s = ListDirectory(db_path, &names);
+    if (!s.ok()) return s;
+    bool changed = false;
+    for (const auto& name: names) {
+      if (!IsImmutableFile(name) || linked.count(name)) continue;
+      fs::create_hard_link(fs::path(db_path) / name, fs::path(checkpoint_path) / name, ec);
+      // Compacted away since listed, so a compaction ran since the copy.
+      if (ec && !fs::exists(fs::path(db_path) / name)) {
+        changed = true;
+        continue;
+      }
+      if (ec) return IOError(fs::path(db_path) / name, ec);
+      linked.insert(name);
+      changed = true;
+    }
+    if (copied && !changed) {
+      std::set<uint64_t> tables;
+      s = ManifestTables(fs::path(checkpoint_path) / manifest, &tables);
+      if (!s.ok()) return s;
+      auto table = std::find_if(tables.begin(), tables.end(), [&](uint64_t number) {
+        return LinkedTable(linked, number).empty();
+      });
+      if (table == tables.end()) return Status::OK();
+      // The same manifest again, so the table is missing from db_path itself.
+      if (missing == copied) return Status::Corruption(manifest, "lists missing table " + std::to_string(*table));
+      missing = copied;
+    }
+    s = CopyMutableFiles(db_path, checkpoint_path, &manifest);
+    if (!s.ok()) return s;
+    uintmax_t size = fs::file_size(fs::path(checkpoint_path) / manifest, ec);
+    if (ec) return IOError(fs::path(checkpoint_path) / manifest, ec);
+    copied.emplace(manifest, size);
+  }
+}
+#endif
+
+static fs::path BackupDirectory(const std::string& backup_path, uint64_t backup_id) noexcept {
+  return fs::path(backup_path) / std::to_string(backup_id);
+}
+
+static fs::path SharedDirectory(const std::string& backup_path) noexcept {
+  return fs::path(backup_path) / "shared";
+}
+
+Status AddBackup(const std::string& checkpoint_path, const std::string& backup_path, uint64_t* backup_id) noexcept {
+  std::error_code ec;
+  fs::create_directories(SharedDirectory(backup_path), ec);
+  if (ec) return IOError(SharedDirectory(backup_path), ec);
+  std::vector<std::string> backups;
+  Status s = ListDirectory(backup_path, &backups);
+  if (!s.ok()) return s;
+  *backup_id = 1;
+  for (const auto& name: backups) {
+    if (name.empty() || name.find_first_not_of("0123456789") != std::string::npos) continue;
+    *backup_id = std::max<uint64_t>(*backup_id, std::stoull(name) + 1);
+  }
+
+  // Built aside, so an interrupted backup never looks complete.
+  fs::path pending = fs::path(backup_path) / "pending";
+  fs::remove_all(pending, ec);
+  std::vector<std::string> dbNames;
+  s = ListDirectory(checkpoint_path, &dbNames);
+  if (!s.ok()) return s;
+  fs::create_directories(pending, ec);
+  if (ec) return IOError(pending, ec);
+  for (const auto& dbName: dbNames) {
+    fs::path from = fs::path(checkpoint_path) / dbName;
+    // Files next to the databases, such as the layout mark, are small.
+    if (!fs::is_directory(from, ec)) {
+      s = CopyFile(from, pending / dbName);
+      if (!s.ok()) return s;
+      continue;
+    }
+    fs::path shared = SharedDirectory(backup_path) / dbName;
+    fs::create_directories(pending / dbName, ec);
+    if (!ec) fs::create_directories(shared, ec);
+    if (ec) return IOError(pending / dbName, ec);
+    std::vector<std::string> names;
+    s = ListDirectory(from, &names);
+    if (!s.ok()) return s;
+    for (const auto& name: names) {
+      if (!IsImmutableFile(name)) {
+        s = CopyFile(from / name, pending / dbName / name);
+        if (!s.ok()) return s;
+        continue;
+      }
+      // Immutable files are never rewritten under the same name, an earlier
+      // backup of this instance holding one already holds its content.
+      if (!fs::exists(shared / name, ec)) {
+        s = CopyFile(from / name, shared / (name + ".tmp"));
+        if (!s.ok()) return s;
+        fs::rename(shared / (name + ".tmp"), shared / name, ec);
+        if (ec) return IOError(shared / name, ec);
+      } else if (fs::file_size(shared / name, ec) != fs::file_size(from / name)) {
+        return Status::Corruption((shared / name).string(), "belongs to another instance");
+      }
+      fs::create_hard_link(shared / name, pending / dbName / name, ec);
+      if (ec) return IOError(shared / name, ec);
+    }
+  }
+  fs::rename(pending, BackupDirectory(backup_path, *backup_id), ec);
+  if (ec) return IOError(pending, ec);
+  return Status::OK();
+}
+
+Status CopyBackup(const std::string& backup_path, uint64_t backup_id, const std::string& db_path) noexcept {
+  std::error_code ec;
+  fs::path backup = BackupDirectory(backup_path, backup_id);
+  if (!fs::exists(backup, ec)) return Status::NotFound(backup.string());
+  if (fs::exists(db_path, ec) && !fs::is_empty(db_path, ec)) return Status::InvalidArgument(db_path, "exists");
+  fs::copy(backup, db_path, fs::copy_options::recursive, ec);
+  if (ec) return IOError(backup, ec);
+  return Status::OK();
+}
+
+Status RemoveBackup(const std::string& backup_path, uint64_t backup_id) noexcept {
+  std::error_code ec;
+  fs::path backup = BackupDirectory(backup_path, backup_id);
+  if (!fs::exists(backup, ec)) return Status::NotFound(backup.string());
+  fs::remove_all(backup, ec);
+  if (ec) return IOError(backup, ec);
+  std::vector<std::string> dbNames;
+  Status s = ListDirectory(SharedDirectory(backup_path), &dbNames);
+  if (!s.ok()) return s;
+  for (const auto& dbName: dbNames) {
+    fs::path shared = SharedDirectory(backup_path) / dbName;
+    std::vector<std::string> names;
+    s = ListDirectory(shared, &names);
+    if (!s.ok()) return s;
+    for (const auto& name: names) {
+      // The only link left is the shared one.
+      if (fs::hard_link_count(shared / name, ec) == 1) fs::remove(shared / name, ec);
+      if (ec) return IOError(shared / name, ec);
+    }
+  }
+  return Status::OK();
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef MERODIS_CHECKPOINT_H
+#define MERODIS_CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+
+#include "merodis/merodis.h"
+
+namespace merodis {
+
+// Copies db, an engine instance stored at db_path, into checkpoint_path,
+// which must not exist yet. The immutable table files are hard linked
+// rather than copied, so both paths must be on the same file system. The
+// writes to db must be paused meanwhile, see Redis::PauseWrites.
+Status CheckpointDB(DB* db, const std::string& db_path, const std::string& checkpoint_path) noexcept;
+
+// Adds the checkpoint at checkpoint_path, a directory of engine instances,
+// to the backups at backup_path as a new backup numbered *backup_id. Only
+// the immutable files, tables and sealed value logs, that no earlier backup
+// holds are copied, the backups share the others.
+Status AddBackup(const std::string& checkpoint_path, const std::string& backup_path, uint64_t* backup_id) noexcept;
+// Copies the backup backup_id at backup_path into db_path, which must be
+// missing or empty.
+Status CopyBackup(const std::string& backup_path, uint64_t backup_id, const std::string& db_path) noexcept;
+// Deletes the backup backup_id at backup_path, along with the immutable
+// files no other backup holds.
+Status RemoveBackup(const std::string& backup_path, uint64_t backup_id) noexcept;
+
+}
+
+#endif //MERODIS_CHECKPOINT_H
@@ -0,0 +1,55 @@
+#include "counter_merge_operator.h"
+
+#ifdef ROCKSDB
+
+#include <cstdint>
+#include <deque>
+#include <string>
+
+#include "layout.h"
+#include "util/number.h"
+
+namespace merodis {
+
+bool CounterMergeOperator::FullMergeV2(const MergeOperationInput& input,
+                                       MergeOperationOutput* output) const {
+  TypedValue typedValue(int64_t{0});
+  if (input.existing_value) {
+    typedValue.parse(input.existing_value->ToString());
+    if (!std::holds_alternative<int64_t>(typedValue.value)) {
+      output->existing_operand = *input.existing_value;
+      return true;
+    }
+  }
+  int64_t n = std::get<int64_t>(typedValue.value);
+  for (const Slice& operand: input.operand_list) {
+    TypedValue increment;
+    increment.parse(operand.ToString());
+    if (!std::holds_alternative<int64_t>(increment.value)) return false;
+    int64_t delta = std::get<int64_t>(increment.value);
+    if (CheckAdditionRangeError(n, delta) == RangeError::kOK) n += delta;
+  }
+  output->new_value = TypedValue(n).Encode();
+  return true;
+}
+
+bool CounterMergeOperator::PartialMergeMulti(const Slice& key,
+                                             const std::deque<Slice>& operand_list,
+                                             std::string* new_value,
+                                             DB_ENGINE::Logger* logger) const {
+  int64_t sum = 0;
+  for (const Slice& operand: operand_list) {
+    TypedValue increment;
+    increment.parse(operand.ToString());
+    if (!std::holds_alternative<int64_t>(increment.value)) return false;
+    int64_t delta = std::get<int64_t>(increment.value);
+    if (CheckAdditionRangeError(sum, delta) != RangeError::kOK) return false;
+    sum += delta;
+  }
+  *new_value = TypedValue(sum).Encode();
+  return true;
+}
+
+}
+
+#endif
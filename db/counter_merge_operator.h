@@ -0,0 +1,39 @@
+#ifndef MERODIS_COUNTER_MERGE_OPERATOR_H
+#define MERODIS_COUNTER_MERGE_OPERATOR_H
+
+#ifdef ROCKSDB
+
+#include <deque>
+#include <string>
+
+#include "merodis/merodis.h"
+#include "rocksdb/merge_operator.h"
+
+namespace merodis {
+
+// Adds the kInt64 TypedValue operands to the TypedValue of a string, so
+// increments are written blindly and resolved on read. An increment that
+// would overflow the value, or lands on a value that is not an integer,
+// leaves the value untouched, as a failed IncrBy does.
+//
+// The operands of a key are summed into one as they pile up, so a read of
+// a hot counter adds a few. The sum applies as one increment, as if sent
+// by one IncrBy, and operands whose sum overflows are left apart.
+class CounterMergeOperator final : public DB_ENGINE::MergeOperator {
+public:
+  CounterMergeOperator() noexcept = default;
+  ~CounterMergeOperator() noexcept override = default;
+
+  const char* Name() const override { return "merodis.CounterMergeOperator"; }
+  bool FullMergeV2(const MergeOperationInput& input, MergeOperationOutput* output) const override;
+  bool PartialMergeMulti(const Slice& key,
+                         const std::deque<Slice>& operand_list,
+                         std::string* new_value,
+                         DB_ENGINE::Logger* logger) const override;
+};
+
+}
+
+#endif
+
+#endif //MERODIS_COUNTER_MERGE_OPERATOR_H
@@ -69,4 +69,29 @@ std::string TypedValue::ToString() const noexcept {
   return str;
 }
 
+std::string NodeKeysEnd(const Slice& key, char separator) noexcept {
+  std::string end = key.ToString();
+  end.push_back(separator);
+  while (!end.empty() && end.back() == '\xff') end.pop_back();
+  if (!end.empty()) end.back() = static_cast<char>(end.back() + 1);
+  return end;
 }
+
+NodeScanOptions::NodeScanOptions(const Slice& key,
+                                 const DB_ENGINE::Snapshot* snapshot,
+                                 bool bulk,
+                                 char separator) noexcept {
+  options_.snapshot = snapshot;
+  if (bulk) options_.fill_cache = false;
+#ifdef ROCKSDB
+  options_.prefix_same_as_start = true;
+  if (bulk) options_.readahead_size = 2 << 20;
+  upperBound_ = NodeKeysEnd(key, separator);
+  if (!upperBound_.empty()) {
+    upperBoundSlice_ = upperBound_;
+    options_.iterate_upper_bound = &upperBoundSlice_;
+  }
+#endif
+}
+
+}
\ No newline at end of file
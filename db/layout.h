@@ -12,6 +12,8 @@ namespace merodis {
 enum ValueType {
   kString = 0x00,
   kInt64 = 0x01,
+  // Points into the value log, see Redis::EncodeValue.
+  kValuePointer = 0x02,
 };
 
 union Value {
@@ -36,6 +38,40 @@ struct TypedValue {
   std::variant<Slice, int64_t> value;
 };
 
+// The shortest key above every key prefixed with key + separator, or empty
+// if there is none, as those bytes are all '\xff'.
+std::string NodeKeysEnd(const Slice& key, char separator) noexcept;
+
+// Read options of a forward scan over the meta and node keys of the hash,
+// set or zset at key, the node keys following key + separator. On RocksDB
+// the scan stays inside the prefix of the key it seeks, so the prefix bloom
+// skips the tables that do not hold the collection, and it stops at the end
+// of the node keys instead of reading on into the next collection. Backward
+// scans must seek with SeekForPrev. The scan reads at snapshot, or the
+// latest state if null.
+//
+// Bulk scans, over whole collections too large to be worth caching, leave
+// the block cache untouched and read ahead on RocksDB.
+//
+// The options point into this object, which must outlive the iterators.
+class NodeScanOptions {
+public:
+  explicit NodeScanOptions(const Slice& key,
+                           const DB_ENGINE::Snapshot* snapshot = nullptr,
+                           bool bulk = false,
+                           char separator = '\0') noexcept;
+  NodeScanOptions(const NodeScanOptions&) = delete;
+  NodeScanOptions& operator=(const NodeScanOptions&) = delete;
+  ~NodeScanOptions() noexcept = default;
+
+  operator const ReadOptions&() const noexcept { return options_; }
+
+private:
+  std::string upperBound_;
+  Slice upperBoundSlice_;
+  ReadOptions options_;
+};
+
 }
 
 #endif //MERODIS_LAYOUT_H
@@ -0,0 +1,27 @@
+#include "length_merge_operator.h"
+
+#ifdef ROCKSDB
+
+#include <cstdint>
+#include <string>
+
+#include "util/coding.h"
+
+namespace merodis {
+
+bool LengthMergeOperator::Merge(const Slice& key,
+                                const Slice* existing_value,
+                                const Slice& value,
+                                std::string* new_value,
+                                DB_ENGINE::Logger* logger) const {
+  if (value.size() != sizeof(uint64_t)) return false;
+  if (existing_value && existing_value->size() != sizeof(uint64_t)) return false;
+  uint64_t len = existing_value ? DecodeFixed64(existing_value->data()) : 0;
+  new_value->resize(sizeof(uint64_t));
+  EncodeFixed64(new_value->data(), len + DecodeFixed64(value.data()));
+  return true;
+}
+
+}
+
+#endif
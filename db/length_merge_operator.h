@@ -0,0 +1,31 @@
+#ifndef MERODIS_LENGTH_MERGE_OPERATOR_H
+#define MERODIS_LENGTH_MERGE_OPERATOR_H
+
+#ifdef ROCKSDB
+
+#include "merodis/merodis.h"
+#include "rocksdb/merge_operator.h"
+
+namespace merodis {
+
+// Adds the length deltas merged into the meta value of a hash, so adding
+// or deleting fields does not read the meta value first. Both the meta
+// value and the deltas are 8 byte integers, the deltas in two's complement.
+class LengthMergeOperator final : public DB_ENGINE::AssociativeMergeOperator {
+public:
+  LengthMergeOperator() noexcept = default;
+  ~LengthMergeOperator() noexcept override = default;
+
+  const char* Name() const override { return "merodis.LengthMergeOperator"; }
+  bool Merge(const Slice& key,
+             const Slice* existing_value,
+             const Slice& value,
+             std::string* new_value,
+             DB_ENGINE::Logger* logger) const override;
+};
+
+}
+
+#endif
+
+#endif //MERODIS_LENGTH_MERGE_OPERATOR_H
@@ -1,7 +1,17 @@
 #include "merodis/merodis.h"
 
+#include <chrono>
 #include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
+#include <system_error>
 #include <vector>
 
 #include "redis_string_basic_impl.h"
@@ -10,21 +20,60 @@
 #include "redis_hash_basic_impl.h"
 #include "redis_set_basic_impl.h"
 #include "redis_zset_basic_impl.h"
+#include "namespaced_db.h"
+#include "checkpoint.h"
+#include "transaction.h"
+#ifdef ROCKSDB
+#include "rocksdb/env.h"
+#include "counter_merge_operator.h"
+#include "length_merge_operator.h"
+#else
+#include "leveldb/env.h"
+// Built into the LevelDB library, but not among its public headers.
+#include "third_party/leveldb/helpers/memenv/memenv.h"
+#endif
 
 namespace merodis {
 
 static const std::vector<std::string> databases {
   "string", "list", "hash", "set", "zset"
 };
+static const std::string single_database = "single";
+// By Engine.
+static const std::vector<std::string> engines {
+  "leveldb", "rocksdb"
+};
+
+void Options::OptimizeForDataTypes() noexcept {
+  string_options.bloom_bits = 10;
+  list_options.block_size = 64 << 10;
+  hash_options.bloom_bits = 10;
+  hash_options.prefix_bloom = true;
+  set_options.bloom_bits = 10;
+  set_options.prefix_bloom = true;
+  set_options.compression = DB_ENGINE::kNoCompression;
+  zset_options.bloom_bits = 10;
+  zset_options.prefix_bloom = true;
+  zset_options.compression = DB_ENGINE::kNoCompression;
+}
 
 Merodis::Merodis() noexcept :
   string_db_(nullptr),
   list_db_(nullptr),
   hash_db_(nullptr),
   set_db_(nullptr),
-  zset_db_(nullptr) {}
+  zset_db_(nullptr),
+  closing_(false) {}
 
 Merodis::~Merodis() noexcept {
+  if (sync_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(sync_mutex_);
+      closing_ = true;
+    }
+    sync_cv_.notify_one();
+    sync_thread_.join();
+  }
   delete string_db_;
   delete list_db_;
   delete hash_db_;
@@ -32,9 +81,381 @@ Merodis::~Merodis() noexcept {
   delete zset_db_;
 }
 
+// Runs task for the indices below n on a thread each, returning the first
+// failure by index.
+static Status InParallel(int n, const std::function<Status(int)>& task) noexcept {
+  std::vector<Status> statuses(n);
+  std::vector<std::thread> threads;
+  for (int c = 0; c < n; c++) {
+    threads.emplace_back([&statuses, &task, c] { statuses[c] = task(c); });
+  }
+  for (auto& thread: threads) thread.join();
+  for (const auto& status: statuses) {
+    if (!status.ok()) return status;
+  }
+  return Status::OK();
+}
+
+static std::string ValueLogPath(const std::string& db_path, int c) noexcept {
+  return db_path + "/" + databases[c] + "_values";
+}
+
+// Present where the sets and zsets are stored with their versions. It also
+// names the engine storing the instance and each data type whose values
+// are stored tagged, on a line of its own, see TypeOptions::min_blob_size.
+static std::string LayoutPath(const std::string& db_path) noexcept {
+  return db_path + "/LAYOUT";
+}
+
+static std::string Layout(Redis* const dbs[], Engine engine) noexcept {
+  std::string layout("versioned\n");
+  layout += "engine " + engines[engine] + "\n";
+  for (int c = 0; c < databases.size(); c++) {
+    if (dbs[c]->TagsValues()) layout += "separated " + databases[c] + "\n";
+  }
+  return layout;
+}
+
+// Reads the LAYOUT file into *layout, NotFound if there is none.
+static Status ReadLayout(const std::string& db_path, std::string* layout) noexcept {
+  std::error_code ec;
+  if (!std::filesystem::exists(LayoutPath(db_path), ec)) return Status::NotFound(LayoutPath(db_path));
+  std::ifstream file(LayoutPath(db_path));
+  layout->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  if (file.bad()) return Status::IOError(LayoutPath(db_path), "unreadable");
+  return Status::OK();
+}
+
+// The engine the LAYOUT file at db_path names, if any.
+static std::optional<Engine> LayoutEngine(const std::string& db_path) noexcept {
+  std::string layout;
+  if (!ReadLayout(db_path, &layout).ok()) return std::nullopt;
+  for (int c = 0; c < engines.size(); c++) {
+    if (layout.find("engine " + engines[c] + "\n") != std::string::npos) return static_cast<Engine>(c);
+  }
+  return std::nullopt;
+}
+
+static Status WriteLayout(const std::string& db_path, const std::string& layout) noexcept {
+  std::ofstream file(LayoutPath(db_path));
+  file << layout;
+  file.close();
+  if (!file) return Status::IOError(LayoutPath(db_path), "unwritable");
+  return Status::OK();
+}
+
 Status Merodis::Open(const Options& options, const std::string& db_path) noexcept {
+  if (string_db_) return Status::InvalidArgument("The instance is already open", db_path_);
+  if (!SupportsEngine(options.engine)) return Status::NotSupported("Engine not built in", engines[options.engine]);
+  if (!options.in_memory) {
+    // The engines do not read the files of each other.
+    std::optional<Engine> engine = LayoutEngine(db_path);
+    if (engine && *engine != options.engine) return Status::InvalidArgument("Stored by another engine", engines[*engine]);
+  }
   Status s;
-  switch (options.string_impl) {
+  options_ = options;
+  db_path_ = db_path;
+  if (options.in_memory) {
+    // The WAL would only cost memory, as nothing survives a restart.
+    env_.reset(DB_ENGINE::NewMemEnv(DB_ENGINE::Env::Default()));
+    options_.env = env_.get();
+    options_.durability = kNoWALDurability;
+  }
+  NewDataTypes();
+  versions_ = std::make_shared<KeyVersions>();
+  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  for (Redis* db: dbs_) {
+    db->SetBulkReadThreshold(options_.bulk_read_threshold);
+    db->SetCommitInterval(options_.commit_interval);
+    db->SetDurability(options_.durability);
+#ifdef ROCKSDB
+    db->SetAsyncIO(options_.async_io);
+#endif
+  }
+  std::vector<TypeOptions> typeOptions {
+    options_.string_options,
+    options_.list_options,
+    options_.hash_options,
+    options_.set_options,
+    options_.zset_options
+  };
+#ifdef ROCKSDB
+  if (options_.string_impl != kStringBasicImpl) {
+    typeOptions[0].merge_operator = std::make_shared<CounterMergeOperator>();
+  }
+  typeOptions[2].merge_operator = std::make_shared<LengthMergeOperator>();
+#endif
+  std::string db_home(db_path + "/");
+  if (options_.single_db) {
+    std::vector<DB*> namespacedDBs;
+    s = OpenNamespacedDBs(options_, db_home + single_database, databases, typeOptions, &namespacedDBs);
+    if (!s.ok()) return s;
+    for (int c = 0; c < databases.size(); c++) {
+      s = dbs_[c]->Open(namespacedDBs[c]);
+      if (!s.ok()) return s;
+    }
+  } else {
+    // Each data type recovers its own WAL, so they are opened side by side.
+    s = InParallel(databases.size(), [&](int c) {
+      return dbs_[c]->Open(options_, typeOptions[c], db_home + databases[c]);
+    });
+    if (!s.ok()) return s;
+  }
+#ifndef ROCKSDB
+  for (int c = 0; c < databases.size(); c++) {
+    if (!typeOptions[c].min_blob_size || !dbs_[c]->SeparatesValues()) continue;
+    s = dbs_[c]->SeparateValues(*typeOptions[c].min_blob_size, options_.in_memory ? "" : ValueLogPath(db_path, c));
+    if (!s.ok()) return s;
+  }
+#endif
+  if (!options_.in_memory) {
+    std::string layout;
+    s = ReadLayout(db_path, &layout);
+    bool unversioned = s.IsNotFound();
+    if (!s.ok() && !unversioned) return s;
+    // Tagged values are read as untagged ones and the other way around, so
+    // a data type holding keys keeps tagging them or not.
+    for (int c = 0; c < databases.size(); c++) {
+      bool tagged = layout.find("separated " + databases[c] + "\n") != std::string::npos;
+      if (tagged == dbs_[c]->TagsValues()) continue;
+      bool empty;
+      s = dbs_[c]->IsEmpty(&empty);
+      if (!s.ok()) return s;
+      if (!empty) {
+        return Status::InvalidArgument(tagged ? "Values stored with min_blob_size set"
+                                              : "Values stored with min_blob_size unset", databases[c]);
+      }
+    }
+    // Instances written before sets and zsets carried versions are moved
+    // to version 0 once, before any request reads them.
+    if (unversioned) {
+      s = set_db_->UpgradeLayout();
+      if (s.ok()) s = zset_db_->UpgradeLayout();
+      if (!s.ok()) return s;
+    }
+    if (layout != Layout(dbs_, options_.engine)) s = WriteLayout(db_path, Layout(dbs_, options_.engine));
+    if (!s.ok()) return s;
+  }
+  if (options_.warm_up) {
+    s = InParallel(databases.size(), [&](int c) {
+      double cacheShare = typeOptions[c].cache_share.value_or(1.0 / databases.size());
+      return dbs_[c]->WarmUp(static_cast<uint64_t>(options_.block_cache_size * cacheShare));
+    });
+    if (!s.ok()) return s;
+  }
+  if (options_.durability == kPeriodicSyncDurability && !sync_thread_.joinable()) {
+    sync_thread_ = std::thread(&Merodis::SyncPeriodically, this);
+  }
+  return s;
+}
+
+Status Merodis::GetSnapshot(Merodis** snapshot) noexcept {
+  Merodis* view = new Merodis;
+  view->options_ = options_;
+  view->NewDataTypes();
+  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  Redis* viewDBs[] = {view->string_db_, view->list_db_, view->hash_db_, view->set_db_, view->zset_db_};
+  for (int c = 0; c < databases.size(); c++) {
+    Status s = viewDBs[c]->OpenSnapshot(*dbs_[c]);
+    if (!s.ok()) {
+      delete view;
+      return s;
+    }
+  }
+  *snapshot = view;
+  return Status::OK();
+}
+
+void Merodis::ReleaseSnapshot(Merodis* snapshot) noexcept {
+  delete snapshot;
+}
+
+Status Merodis::BeginTransaction(Merodis** transaction) noexcept {
+  if (!versions_ || transaction_) return Status::NotSupported("Transactions open on an instance only");
+  Merodis* view = new Merodis;
+  view->options_ = options_;
+  view->NewDataTypes();
+  view->versions_ = versions_;
+  view->transaction_ = std::make_unique<TransactionState>(this);
+  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  Redis* viewDBs[] = {view->string_db_, view->list_db_, view->hash_db_, view->set_db_, view->zset_db_};
+  for (int c = 0; c < databases.size(); c++) {
+    Status s = viewDBs[c]->OpenTransaction(*dbs_[c]);
+    if (!s.ok()) {
+      delete view;
+      return s;
+    }
+  }
+  *transaction = view;
+  return Status::OK();
+}
+
+void Merodis::ReleaseTransaction(Merodis* transaction) noexcept {
+  delete transaction;
+}
+
+Status Merodis::Watch(const Slice& key) noexcept {
+  if (!transaction_) return Status::NotSupported("Watch outside a transaction");
+  transaction_->Watch(*versions_, key, false);
+  return Status::OK();
+}
+
+Status Merodis::Commit() noexcept {
+  if (!transaction_) return Status::NotSupported("Commit outside a transaction");
+  Merodis* base = transaction_->base;
+  Redis* dbs_[] = {base->string_db_, base->list_db_, base->hash_db_, base->set_db_, base->zset_db_};
+  Redis* viewDBs[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  std::vector<Slice> keys, writtenKeys;
+  bool changed = false;
+  int writtenTypes = 0;
+  for (Redis* db: viewDBs) writtenTypes += db->HasBufferedWrites();
+  for (const auto& [key, watched]: transaction_->keys) {
+    keys.emplace_back(key);
+    if (watched.written) writtenKeys.emplace_back(key);
+  }
+  Status s;
+  {
+    std::shared_lock<std::shared_mutex> commits(versions_->commits);
+    std::vector<std::unique_lock<std::mutex>> locks = versions_->Lock(keys);
+    for (const auto& [key, watched]: transaction_->keys) {
+      changed = changed || versions_->Writing(key) || versions_->Version(key) != watched.version;
+    }
+    if (changed) {
+      s = Status::NotFound("Watched key changed");
+    } else if (writtenTypes > 1 && !options_.single_db) {
+      s = Status::NotSupported("Commits across data types need single_db");
+    } else if (!writtenKeys.empty()) {
+      if (options_.single_db) {
+        WriteBatch shared;
+        for (int c = 0; c < databases.size() && s.ok(); c++) s = dbs_[c]->AppendTransaction(viewDBs[c], &shared);
+        if (s.ok()) s = dbs_[0]->WriteShared(&shared);
+      } else {
+        for (int c = 0; c < databases.size() && s.ok(); c++) s = dbs_[c]->CommitTransaction(viewDBs[c]);
+      }
+      // Pushes buffered by the view reach the waiters only now.
+      for (const Slice& key: writtenKeys) {
+        if (s.ok()) s = base->list_db_->ServeWaiters(key);
+      }
+      // Bumped even if the write failed, as the engine may hold it still.
+      for (const Slice& key: writtenKeys) versions_->Bump(key);
+    }
+  }
+  for (Redis* db: viewDBs) db->DiscardTransaction();
+  transaction_->keys.clear();
+  return s;
+}
+
+static Status CopyDataTypes(Redis* const source[], Redis* const target[]) noexcept {
+  for (int c = 0; c < databases.size(); c++) {
+    Status s = source[c]->CopyTo(target[c]);
+    if (!s.ok()) return s;
+  }
+  return Status::OK();
+}
+
+Status Merodis::SaveTo(const std::string& db_path) noexcept {
+  Options options(options_);
+  if (options.in_memory) {
+    options.in_memory = false;
+    options.env = DB_ENGINE::Env::Default();
+    options.durability = kAsyncDurability;
+  }
+  options.create_if_missing = true;
+  options.error_if_exists = true;
+  Merodis saved;
+  Status s = saved.Open(options, db_path);
+  if (!s.ok()) return s;
+  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  Redis* savedDBs[] = {saved.string_db_, saved.list_db_, saved.hash_db_, saved.set_db_, saved.zset_db_};
+  return CopyDataTypes(dbs_, savedDBs);
+}
+
+Status Merodis::LoadFrom(const std::string& db_path) noexcept {
+  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  for (Redis* db: dbs_) {
+    bool empty;
+    Status s = db->IsEmpty(&empty);
+    if (!s.ok()) return s;
+    if (!empty) return Status::InvalidArgument("Cannot load into a non-empty instance", db_path_);
+  }
+  Options options(options_);
+  if (options.in_memory) {
+    options.in_memory = false;
+    options.env = DB_ENGINE::Env::Default();
+  }
+  options.create_if_missing = false;
+  options.error_if_exists = false;
+  Merodis saved;
+  Status s = saved.Open(options, db_path);
+  if (!s.ok()) return s;
+  Redis* savedDBs[] = {saved.string_db_, saved.list_db_, saved.hash_db_, saved.set_db_, saved.zset_db_};
+  return CopyDataTypes(savedDBs, dbs_);
+}
+
+Status Merodis::CreateCheckpoint(const std::string& checkpoint_path) noexcept {
+  if (options_.in_memory) return Status::NotSupported("An in_memory instance has no files to checkpoint");
+  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  // What is flushed beforehand is not flushed while the writes wait.
+  Status s = InParallel(databases.size(), [&](int c) {
+    return dbs_[c]->FlushMemTable();
+  });
+  if (!s.ok()) return s;
+  std::error_code ec;
+  std::filesystem::create_directories(checkpoint_path, ec);
+  if (ec) return Status::IOError(checkpoint_path, ec.message());
+  std::string db_home(db_path_ + "/");
+  std::string checkpoint_home(checkpoint_path + "/");
+  std::unique_lock<std::shared_mutex> commits(versions_->commits);
+  for (Redis* db: dbs_) db->PauseWrites();
+  if (options_.single_db) {
+    s = dbs_[0]->CreateCheckpoint(db_home + single_database, checkpoint_home + single_database);
+  } else {
+    for (int c = 0; c < databases.size() && s.ok(); c++) {
+      s = dbs_[c]->CreateCheckpoint(db_home + databases[c], checkpoint_home + databases[c]);
+    }
+  }
+  for (int c = 0; c < databases.size() && s.ok(); c++) {
+    s = dbs_[c]->CheckpointValueLog(ValueLogPath(checkpoint_path, c));
+  }
+  if (s.ok()) s = WriteLayout(checkpoint_path, Layout(dbs_, options_.engine));
+  for (Redis* db: dbs_) db->ResumeWrites();
+  return s;
+}
+
+Status Merodis::CreateBackup(const std::string& backup_path, uint64_t* backup_id) noexcept {
+  // The checkpoint is taken next to the instance, where its tables can be
+  // linked, and only then copied over to backup_path.
+  std::string checkpoint_path(db_path_ + "/backup_checkpoint");
+  std::error_code ec;
+  std::filesystem::remove_all(checkpoint_path, ec);
+  Status s = CreateCheckpoint(checkpoint_path);
+  if (s.ok()) s = AddBackup(checkpoint_path, backup_path, backup_id);
+  std::filesystem::remove_all(checkpoint_path, ec);
+  return s;
+}
+
+Status Merodis::RestoreBackup(const std::string& backup_path, uint64_t backup_id, const std::string& db_path) noexcept {
+  return CopyBackup(backup_path, backup_id, db_path);
+}
+
+Status Merodis::DeleteBackup(const std::string& backup_path, uint64_t backup_id) noexcept {
+  return RemoveBackup(backup_path, backup_id);
+}
+
+void Merodis::SyncPeriodically() noexcept {
+  std::unique_lock<std::mutex> lock(sync_mutex_);
+  while (!sync_cv_.wait_for(lock, std::chrono::milliseconds(options_.sync_interval), [this] { return closing_; })) {
+    // The data types share a single WAL in single_db mode.
+    Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+    for (Redis* db: dbs_) {
+      db->SyncWAL();
+      if (options_.single_db) break;
+    }
+  }
+}
+
+void Merodis::NewDataTypes() noexcept {
+  switch (options_.string_impl) {
     case kStringBasicImpl:
       string_db_ = new RedisStringBasicImpl;
       break;
@@ -42,43 +463,86 @@ Status Merodis::Open(const Options& options, const std::string& db_path) noexcep
     default:
       string_db_ = new RedisStringTypedImpl;
   }
-  switch (options.list_impl) {
+  switch (options_.list_impl) {
     case kListArrayImpl:
     default:
       list_db_ = new RedisListArrayImpl;
   }
-  switch (options.hash_impl) {
+  switch (options_.hash_impl) {
     case kHashBasicImpl:
     default:
       hash_db_ = new RedisHashBasicImpl;
   }
-  switch (options.set_impl) {
+  switch (options_.set_impl) {
     case kSetBasicImpl:
     default:
       set_db_ = new RedisSetBasicImpl;
   }
-  switch (options.zset_impl) {
+  switch (options_.zset_impl) {
     case kZSetBasicImpl:
     default:
       zset_db_ = new RedisZSetBasicImpl;
   }
-  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+}
+
+Status Merodis::DestroyDB(const std::string& db_path, Options options) noexcept {
+  Status s;
   std::string db_home(db_path + "/");
   for (int c = 0; c < databases.size(); c++) {
-    s = dbs_[c]->Open(options, db_home + databases[c]);
+    s = DB_ENGINE::DestroyDB(db_home + databases[c], options);
     if (!s.ok()) return s;
+    std::error_code ec;
+    std::filesystem::remove_all(ValueLogPath(db_path, c), ec);
+    if (ec) return Status::IOError(ValueLogPath(db_path, c), ec.message());
   }
+  s = DB_ENGINE::DestroyDB(db_home + single_database, options);
+  if (!s.ok()) return s;
+  std::error_code ec;
+  std::filesystem::remove(LayoutPath(db_path), ec);
+  if (ec) return Status::IOError(LayoutPath(db_path), ec.message());
   return s;
 }
 
-Status Merodis::DestroyDB(const std::string& db_path, Options options) noexcept {
-  Status s;
-  std::string db_home(db_path + "/");
-  for (const auto& db_name: databases) {
-    s = DB_ENGINE::DestroyDB(db_home + db_name, options);
+bool Merodis::SupportsEngine(Engine engine) noexcept {
+#ifdef ROCKSDB
+  return engine == kRocksDBEngine;
+#else
+  return engine == kLevelDBEngine;
+#endif
+}
+
+static thread_local const DurabilityScope* currentDurabilityScope = nullptr;
+
+DurabilityScope::DurabilityScope(Durability durability) noexcept:
+  durability_(durability),
+  outer_(currentDurabilityScope) {
+  currentDurabilityScope = this;
+}
+
+DurabilityScope::~DurabilityScope() noexcept {
+  currentDurabilityScope = outer_;
+}
+
+const Durability* DurabilityScope::Current() noexcept {
+  return currentDurabilityScope ? &currentDurabilityScope->durability_ : nullptr;
+}
+
+Status Merodis::CollectValueLogs(double max_live_share) noexcept {
+  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  for (Redis* db: dbs_) {
+    Status s = db->CollectValueLog(max_live_share, versions_ ? &versions_->commits : nullptr);
     if (!s.ok()) return s;
   }
-  return s;
+  return Status::OK();
+}
+
+Status Merodis::ReclaimStaleVersions() noexcept {
+  Redis* dbs_[] = {string_db_, list_db_, hash_db_, set_db_, zset_db_};
+  for (Redis* db: dbs_) {
+    Status s = db->ReclaimStaleVersions(versions_ ? &versions_->commits : nullptr);
+    if (!s.ok()) return s;
+  }
+  return Status::OK();
 }
 
 // String Operators
@@ -87,22 +551,27 @@ Status Merodis::Get(const Slice& key, std::string* value) noexcept {
 }
 
 Status Merodis::Set(const Slice& key, const Slice& value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return string_db_->Set(key, value);
 }
 
 Status Merodis::Incr(const Slice& key, int64_t* result) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return string_db_->Incr(key, result);
 }
 
 Status Merodis::IncrBy(const Slice& key, int64_t increment, int64_t* result) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return string_db_->IncrBy(key, increment, result);
 }
 
 Status Merodis::Decr(const Slice& key, int64_t* result) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return string_db_->Decr(key, result);
 }
 
 Status Merodis::DecrBy(const Slice& key, int64_t decrement, int64_t* result) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return string_db_->DecrBy(key, decrement, result);
 }
 
@@ -125,73 +594,122 @@ Status Merodis::LRange(const Slice& key, UserIndex from, UserIndex to, std::vect
 }
 
 Status Merodis::LSet(const Slice& key, UserIndex index, const Slice& value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->LSet(key, index, value);
 }
 
 Status Merodis::LPush(const Slice& key, const Slice& value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Push(key, value, true, kLeft);
 }
 
 Status Merodis::LPush(const Slice& key, const std::vector<Slice>& values) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Push(key, values, true, kLeft);
 }
 
 Status Merodis::LPushX(const Slice& key, const Slice& value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Push(key, value, false, kLeft);
 }
 
 Status Merodis::LPushX(const Slice& key, const std::vector<Slice>& values) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Push(key, values, false, kLeft);
 }
 
 Status Merodis::LPop(const Slice& key, std::string* value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Pop(key, value, kLeft);
 }
 
 Status Merodis::LPop(const Slice& key, uint64_t count, std::vector<std::string>* values) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Pop(key, count, values, kLeft);
 }
 
 Status Merodis::RPush(const Slice& key, const Slice& value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Push(key, value, true, kRight);
 }
 
 Status Merodis::RPush(const Slice& key, const std::vector<Slice>& values) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Push(key, values, true, kRight);
 }
 
 Status Merodis::RPushX(const Slice& key, const Slice& value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Push(key, value, false, kRight);
 }
 
 Status Merodis::RPushX(const Slice& key, const std::vector<Slice>& values) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Push(key, values, false, kRight);
 }
 
 Status Merodis::RPop(const Slice& key, std::string* value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Pop(key, value, kRight);
 }
 
 Status Merodis::RPop(const Slice& key, uint64_t count, std::vector<std::string>* values) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->Pop(key, count, values, kRight);
 }
 
 Status Merodis::LTrim(const Slice& key, UserIndex from, UserIndex to) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->LTrim(key, from, to);
 }
 
 Status Merodis::LInsert(const Slice& key, const BeforeOrAfter& beforeOrAfter, const Slice& pivotValue, const Slice& value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->LInsert(key, beforeOrAfter, pivotValue, value);
 }
 
 Status Merodis::LRem(const Slice& key, int64_t count, const Slice& value, uint64_t* removedCount) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return list_db_->LRem(key, count, value, removedCount);
 }
 
 Status Merodis::LMove(const Slice& srcKey, const Slice& dstKey, enum Side srcSide, enum Side dstSide, std::string* value) noexcept {
+  WriteScope scope(versions_.get(), transaction_.get(), {srcKey, dstKey});
   return list_db_->LMove(srcKey, dstKey, srcSide, dstSide, value);
 }
 
+Status Merodis::BLPop(const std::vector<Slice>& keys, uint64_t timeout, std::string* key, std::string* value) noexcept {
+  return BPop(keys, timeout, kLeft, key, value);
+}
+
+Status Merodis::BRPop(const std::vector<Slice>& keys, uint64_t timeout, std::string* key, std::string* value) noexcept {
+  return BPop(keys, timeout, kRight, key, value);
+}
+
+Status Merodis::BLMove(const Slice& srcKey, const Slice& dstKey, enum Side srcSide, enum Side dstSide, uint64_t timeout, std::string* value) noexcept {
+  if (transaction_) return Status::NotSupported("Blocking in a transaction");
+  if (!versions_) return Status::NotSupported("Blocking on a snapshot");
+  WriteScope scope(versions_.get(), nullptr, {srcKey, dstKey});
+  // The write of the keys ends while waiting, then starts again to move
+  // the element stored meanwhile.
+  return list_db_->BLMove(srcKey, dstKey, srcSide, dstSide, timeout, value,
+                          [&scope] { scope.Release(); }, [&scope] { scope.Reacquire(); });
+}
+
+uint64_t Merodis::BlockedOn(const Slice& key) noexcept {
+  return list_db_->Waiters(key);
+}
+
+Status Merodis::BPop(const std::vector<Slice>& keys, uint64_t timeout, enum Side side, std::string* key, std::string* value) noexcept {
+  if (transaction_) return Status::NotSupported("Blocking in a transaction");
+  // Nothing would wake a pop waiting on the list stripes of a snapshot.
+  if (!versions_) return Status::NotSupported("Blocking on a snapshot");
+  WriteScope scope(versions_.get(), nullptr, keys);
+  // The write of the keys ends once the pop starts waiting, as the push
+  // serving it writes them.
+  return list_db_->BPop(keys, timeout, side, key, value, [&scope] { scope.Release(); });
+}
+
 // Hash Operators
 Status Merodis::HLen(const Slice& key, uint64_t* len) {
   return hash_db_->HLen(key, len);
@@ -201,7 +719,7 @@ Status Merodis::HGet(const Slice& key, const Slice& hashKey, std::string* value)
   return hash_db_->HGet(key, hashKey, value);
 }
 
-Status Merodis::HMGet(const Slice& key, const std::vector<Slice>& hashKeys, std::vector<std::string>* values) {
+Status Merodis::HMGet(const Slice& key, const std::vector<Slice>& hashKeys, ValueOpts* values) {
   return hash_db_->HMGet(key, hashKeys, values);
 };
 
@@ -222,18 +740,22 @@ Status Merodis::HExists(const Slice& key, const Slice& hashKey, bool* exists) {
 }
 
 Status Merodis::HSet(const Slice& key, const Slice& hashKey, const Slice& value, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return hash_db_->HSet(key, hashKey, value, count);
 }
 
 Status Merodis::HSet(const Slice& key, const std::map<Slice, Slice>& kvs, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return hash_db_->HSet(key, kvs, count);
 }
 
 Status Merodis::HDel(const Slice& key, const Slice& hashKey, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return hash_db_->HDel(key, hashKey, count);
 }
 
 Status Merodis::HDel(const Slice& key, const std::set<Slice>& hashKeys, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return hash_db_->HDel(key, hashKeys, count);
 }
 
@@ -263,30 +785,37 @@ Status Merodis::SRandMember(const Slice& key, int64_t count, std::vector<std::st
 }
 
 Status Merodis::SAdd(const Slice& key, const Slice& setKey, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return set_db_->SAdd(key, setKey, count);
 }
 
 Status Merodis::SAdd(const Slice& key, const std::set<Slice>& keys, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return set_db_->SAdd(key, keys, count);
 }
 
 Status Merodis::SRem(const Slice& key, const Slice& member, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return set_db_->SRem(key, member, count);
 }
 
 Status Merodis::SRem(const Slice& key, const std::set<Slice>& members, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return set_db_->SRem(key, members, count);
 }
 
 Status Merodis::SPop(const Slice& key, std::string* member) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return set_db_->SPop(key, member);
 }
 
 Status Merodis::SPop(const Slice& key, uint64_t count, std::vector<std::string>* members) {
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return set_db_->SPop(key, count, members);
 }
 
 Status Merodis::SMove(const Slice& srcKey, const Slice& dstKey, const Slice& member, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {srcKey, dstKey});
   return set_db_->SMove(srcKey, dstKey, member, count);
 }
 
@@ -303,14 +832,17 @@ Status Merodis::SDiff(const std::vector<Slice>& keys, std::vector<std::string>*
 }
 
 Status Merodis::SUnionStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {dstKey});
   return set_db_->SUnionStore(keys, dstKey, count);
 }
 
 Status Merodis::SInterStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {dstKey});
   return set_db_->SInterStore(keys, dstKey, count);
 }
 
 Status Merodis::SDiffStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count) {
+  WriteScope scope(versions_.get(), transaction_.get(), {dstKey});
   return set_db_->SDiffStore(keys, dstKey, count);
 }
 
@@ -392,38 +924,47 @@ Status Merodis::ZRevRangeByLexWithScores(const Slice& key, const Slice& minLex,
 }
 
 Status Merodis::ZAdd(const Slice& key, const std::pair<Slice, int64_t>& scoredMember, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZAdd(key, scoredMember, count);
 }
 
 Status Merodis::ZAdd(const Slice& key, const std::map<Slice, int64_t>& scoredMembers, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZAdd(key, scoredMembers, count);
 }
 
 Status Merodis::ZRem(const Slice& key, const Slice& member, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZRem(key, member, count);
 }
 
 Status Merodis::ZRem(const Slice& key, const std::set<Slice>& members, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZRem(key, members, count);
 }
 
 Status Merodis::ZPopMax(const Slice& key, ScoredMember* scoredMember){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZPopMax(key, scoredMember);
 }
 
 Status Merodis::ZPopMin(const Slice& key, ScoredMember* scoredMember){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZPopMin(key, scoredMember);
 }
 
 Status Merodis::ZRemRangeByRank(const Slice& key, int64_t minRank, int64_t maxRank, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZRemRangeByRank(key, minRank, maxRank, count);
 }
 
 Status Merodis::ZRemRangeByScore(const Slice& key, int64_t minScore, int64_t maxScore, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZRemRangeByScore(key, minScore, maxScore, count);
 }
 
 Status Merodis::ZRemRangeByLex(const Slice& key, const Slice& minLex, const Slice& maxLex, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {key});
   return zset_db_->ZRemRangeByLex(key, minLex, maxLex, count);
 }
 
@@ -452,14 +993,17 @@ Status Merodis::ZDiffWithScores(const std::vector<Slice>& keys, ScoredMembers* s
 }
 
 Status Merodis::ZUnionStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {dstKey});
   return zset_db_->ZUnionStore(keys, dstKey, count);
 }
 
 Status Merodis::ZInterStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {dstKey});
   return zset_db_->ZInterStore(keys, dstKey, count);
 }
 
 Status Merodis::ZDiffStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count){
+  WriteScope scope(versions_.get(), transaction_.get(), {dstKey});
   return zset_db_->ZDiffStore(keys, dstKey, count);
 }
 
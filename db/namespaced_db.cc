@@ -0,0 +1,289 @@
+#include "namespaced_db.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "iterator_decorator.h"
+
+#ifdef ROCKSDB
+#include "rocksdb/cache.h"
+#include "rocksdb/table.h"
+#include "rocksdb/write_buffer_manager.h"
+#include "redis.h"
+#else
+#include "leveldb/cache.h"
+#include "leveldb/filter_policy.h"
+#endif
+
+namespace merodis {
+
+#ifdef ROCKSDB
+
+class FamilyRedirector : public WriteBatch::Handler {
+public:
+  FamilyRedirector(DB_ENGINE::ColumnFamilyHandle* family, WriteBatch* updates):
+    family_(family), updates_(updates) {}
+
+  Status PutCF(uint32_t, const Slice& key, const Slice& value) override {
+    return updates_->Put(family_, key, value);
+  }
+  Status DeleteCF(uint32_t, const Slice& key) override {
+    return updates_->Delete(family_, key);
+  }
+  Status SingleDeleteCF(uint32_t, const Slice& key) override {
+    return updates_->SingleDelete(family_, key);
+  }
+  Status DeleteRangeCF(uint32_t, const Slice& beginKey, const Slice& endKey) override {
+    return updates_->DeleteRange(family_, beginKey, endKey);
+  }
+  Status MergeCF(uint32_t, const Slice& key, const Slice& value) override {
+    return updates_->Merge(family_, key, value);
+  }
+
+private:
+  DB_ENGINE::ColumnFamilyHandle* family_;
+  WriteBatch* updates_;
+};
+
+NamespacedDB::NamespacedDB(std::shared_ptr<DB> base, DB_ENGINE::ColumnFamilyHandle* family) noexcept:
+  StackableDB(std::move(base)),
+  family_(family) {}
+
+NamespacedDB::~NamespacedDB() noexcept {
+  db_->DestroyColumnFamilyHandle(family_);
+}
+
+Iterator* NamespacedDB::NewIterator(const ReadOptions& options,
+                                    DB_ENGINE::ColumnFamilyHandle* family) {
+  // Scans over the key space are not confined to a single prefix unless the
+  // caller asks for it, so they must not be narrowed by the prefix bloom.
+  if (options.prefix_same_as_start) return db_->NewIterator(options, family);
+  ReadOptions totalOrderOptions(options);
+  totalOrderOptions.total_order_seek = true;
+  return db_->NewIterator(totalOrderOptions, family);
+}
+
+Status NamespacedDB::Write(const WriteOptions& options, WriteBatch* updates) {
+  WriteBatch redirected;
+  Status s = Translate(*updates, &redirected);
+  if (!s.ok()) return s;
+  return db_->Write(options, &redirected);
+}
+
+Status NamespacedDB::Translate(const WriteBatch& updates, WriteBatch* translated) const {
+  FamilyRedirector redirector(family_, translated);
+  return updates.Iterate(&redirector);
+}
+
+// Tunes the column family of a data type for its access pattern, keeping
+// the index and filter blocks of all of them in the shared block cache.
+static DB_ENGINE::ColumnFamilyOptions FamilyOptions(const Options& options,
+                                                    const TypeOptions& typeOptions,
+                                                    const std::shared_ptr<DB_ENGINE::Cache>& cache) {
+  DB_ENGINE::ColumnFamilyOptions familyOptions(options);
+  DB_ENGINE::BlockBasedTableOptions tableOptions = TableOptionsOf(options);
+  tableOptions.block_cache = cache;
+  tableOptions.cache_index_and_filter_blocks = true;
+  tableOptions.pin_l0_filter_and_index_blocks_in_cache = true;
+  ApplyTypeOptions(options, typeOptions, &familyOptions, &tableOptions);
+  familyOptions.table_factory.reset(DB_ENGINE::NewBlockBasedTableFactory(tableOptions));
+  return familyOptions;
+}
+
+Status OpenNamespacedDBs(const Options& options,
+                         const std::string& db_path,
+                         const std::vector<std::string>& names,
+                         const std::vector<TypeOptions>& typeOptions,
+                         std::vector<DB*>* dbs) noexcept {
+  std::shared_ptr<DB_ENGINE::Cache> cache = DB_ENGINE::NewLRUCache(options.block_cache_size);
+  DB_ENGINE::DBOptions dbOptions(options);
+  dbOptions.create_missing_column_families = true;
+  size_t writeBufferSize = dbOptions.db_write_buffer_size;
+  if (!writeBufferSize) writeBufferSize = options.write_buffer_size * options.max_write_buffer_number * names.size();
+  dbOptions.write_buffer_manager = std::make_shared<DB_ENGINE::WriteBufferManager>(writeBufferSize, cache);
+  std::vector<DB_ENGINE::ColumnFamilyDescriptor> families;
+  families.emplace_back(DB_ENGINE::kDefaultColumnFamilyName, DB_ENGINE::ColumnFamilyOptions(options));
+  for (size_t c = 0; c < names.size(); c++) {
+    families.emplace_back(names[c], FamilyOptions(options, typeOptions[c], cache));
+  }
+
+  DB* db;
+  std::vector<DB_ENGINE::ColumnFamilyHandle*> handles;
+  Status s = DB::Open(dbOptions, db_path, families, &handles, &db);
+  if (!s.ok()) return s;
+  db->DestroyColumnFamilyHandle(handles[0]);
+  std::shared_ptr<DB> base(db);
+  for (size_t c = 0; c < names.size(); c++) {
+    dbs->push_back(new NamespacedDB(base, handles[c + 1]));
+  }
+  return s;
+}
+
+#else
+
+class NamespacedIterator : public IteratorDecorator {
+public:
+  NamespacedIterator(Iterator* iter, const std::string& prefix, const std::string& limit):
+    IteratorDecorator(iter),
+    prefix_(prefix),
+    limit_(limit) {}
+
+  bool Valid() const override { return iter_->Valid() && iter_->key().starts_with(prefix_); }
+  void SeekToFirst() override { iter_->Seek(prefix_); }
+  void SeekToLast() override {
+    iter_->Seek(limit_);
+    iter_->Valid() ? iter_->Prev() : iter_->SeekToLast();
+  }
+  void Seek(const Slice& target) override {
+    target_.assign(prefix_).append(target.data(), target.size());
+    iter_->Seek(target_);
+  }
+  Slice key() const override {
+    Slice key = iter_->key();
+    key.remove_prefix(prefix_.size());
+    return key;
+  }
+
+private:
+  const std::string prefix_;
+  const std::string limit_;
+  std::string target_;
+};
+
+class PrefixingHandler : public WriteBatch::Handler {
+public:
+  PrefixingHandler(const std::string& prefix, WriteBatch* updates):
+    prefix_(prefix), updates_(updates) {}
+
+  void Put(const Slice& key, const Slice& value) override {
+    key_.assign(prefix_).append(key.data(), key.size());
+    updates_->Put(key_, value);
+  }
+  void Delete(const Slice& key) override {
+    key_.assign(prefix_).append(key.data(), key.size());
+    updates_->Delete(key_);
+  }
+
+private:
+  const std::string& prefix_;
+  WriteBatch* updates_;
+  std::string key_;
+};
+
+NamespacedDB::NamespacedDB(std::shared_ptr<DB> base, char tag) noexcept:
+  base_(std::move(base)),
+  prefix_(1, tag),
+  limit_(1, static_cast<char>(tag + 1)) {}
+
+Status NamespacedDB::Put(const WriteOptions& options, const Slice& key, const Slice& value) {
+  return base_->Put(options, Prefixed(key), value);
+}
+
+Status NamespacedDB::Delete(const WriteOptions& options, const Slice& key) {
+  return base_->Delete(options, Prefixed(key));
+}
+
+Status NamespacedDB::Write(const WriteOptions& options, WriteBatch* updates) {
+  WriteBatch prefixed;
+  Status s = Translate(*updates, &prefixed);
+  if (!s.ok()) return s;
+  return base_->Write(options, &prefixed);
+}
+
+Status NamespacedDB::Translate(const WriteBatch& updates, WriteBatch* translated) const {
+  PrefixingHandler handler(prefix_, translated);
+  return updates.Iterate(&handler);
+}
+
+Status NamespacedDB::Get(const ReadOptions& options, const Slice& key, std::string* value) {
+  return base_->Get(options, Prefixed(key), value);
+}
+
+Iterator* NamespacedDB::NewIterator(const ReadOptions& options) {
+  return new NamespacedIterator(base_->NewIterator(options), prefix_, limit_);
+}
+
+const DB_ENGINE::Snapshot* NamespacedDB::GetSnapshot() {
+  return base_->GetSnapshot();
+}
+
+void NamespacedDB::ReleaseSnapshot(const DB_ENGINE::Snapshot* snapshot) {
+  base_->ReleaseSnapshot(snapshot);
+}
+
+bool NamespacedDB::GetProperty(const Slice& property, std::string* value) {
+  return base_->GetProperty(property, value);
+}
+
+void NamespacedDB::GetApproximateSizes(const DB_ENGINE::Range* range, int n, uint64_t* sizes) {
+  std::vector<std::string> bounds;
+  bounds.reserve(2 * n);
+  std::vector<DB_ENGINE::Range> ranges;
+  ranges.reserve(n);
+  for (int c = 0; c < n; c++) {
+    bounds.push_back(Prefixed(range[c].start));
+    bounds.push_back(Prefixed(range[c].limit));
+    ranges.emplace_back(bounds[2 * c], bounds[2 * c + 1]);
+  }
+  base_->GetApproximateSizes(ranges.data(), n, sizes);
+}
+
+void NamespacedDB::CompactRange(const Slice* begin, const Slice* end) {
+  std::string first = begin ? Prefixed(*begin) : prefix_;
+  std::string last = end ? Prefixed(*end) : limit_;
+  Slice firstSlice(first), lastSlice(last);
+  base_->CompactRange(&firstSlice, &lastSlice);
+}
+
+std::string NamespacedDB::Prefixed(const Slice& key) const {
+  std::string prefixed(prefix_);
+  prefixed.append(key.data(), key.size());
+  return prefixed;
+}
+
+Status OpenNamespacedDBs(const Options& options,
+                         const std::string& db_path,
+                         const std::vector<std::string>& names,
+                         const std::vector<TypeOptions>& typeOptions,
+                         std::vector<DB*>* dbs) noexcept {
+  // The data types share the tables, so of their overrides only the
+  // largest bloom_bits applies, see TypeOptions.
+  Options sharedOptions(options);
+  const DB_ENGINE::FilterPolicy* filterPolicy = nullptr;
+  if (!sharedOptions.filter_policy) {
+    int bloomBits = 0;
+    for (const auto& t: typeOptions) bloomBits = std::max(bloomBits, t.bloom_bits.value_or(0));
+    if (bloomBits) filterPolicy = DB_ENGINE::NewBloomFilterPolicy(bloomBits);
+    sharedOptions.filter_policy = filterPolicy;
+  }
+  DB_ENGINE::Cache* blockCache = nullptr;
+  if (!sharedOptions.block_cache) {
+    blockCache = DB_ENGINE::NewLRUCache(options.block_cache_size);
+    sharedOptions.block_cache = blockCache;
+  }
+
+  DB* db;
+  Status s = DB::Open(sharedOptions, db_path, &db);
+  if (!s.ok()) {
+    delete filterPolicy;
+    delete blockCache;
+    return s;
+  }
+  // The filter policy and block cache must outlive the engine instance
+  // sharing them.
+  std::shared_ptr<DB> base(db, [filterPolicy, blockCache](DB* db) {
+    delete db;
+    delete filterPolicy;
+    delete blockCache;
+  });
+  for (size_t c = 0; c < names.size(); c++) {
+    dbs->push_back(new NamespacedDB(base, static_cast<char>(c)));
+  }
+  return s;
+}
+
+#endif
+
+}
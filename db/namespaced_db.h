@@ -0,0 +1,85 @@
+#ifndef MERODIS_NAMESPACED_DB_H
+#define MERODIS_NAMESPACED_DB_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "merodis/merodis.h"
+
+#ifdef ROCKSDB
+#include "rocksdb/utilities/stackable_db.h"
+#endif
+
+namespace merodis {
+
+// A view of one data type inside an engine instance shared by all types.
+//
+// On LevelDB every key is prefixed by a one byte type tag, so the data
+// types never collide with each other. On RocksDB each data type owns a
+// column family, tuned for the access pattern of that type, and the view
+// redirects everything addressed to the default column family into it.
+#ifdef ROCKSDB
+class NamespacedDB final : public DB_ENGINE::StackableDB {
+public:
+  NamespacedDB(std::shared_ptr<DB> base, DB_ENGINE::ColumnFamilyHandle* family) noexcept;
+  NamespacedDB(const NamespacedDB&) = delete;
+  NamespacedDB& operator=(const NamespacedDB&) = delete;
+  ~NamespacedDB() noexcept override;
+
+  using DB_ENGINE::StackableDB::NewIterator;
+  Iterator* NewIterator(const ReadOptions& options, DB_ENGINE::ColumnFamilyHandle* family) override;
+  using DB_ENGINE::StackableDB::Write;
+  Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  DB_ENGINE::ColumnFamilyHandle* DefaultColumnFamily() const override { return family_; }
+  // Appends to translated the updates Write writes into base() for updates.
+  Status Translate(const WriteBatch& updates, WriteBatch* translated) const;
+  DB* base() noexcept { return db_; }
+
+private:
+  DB_ENGINE::ColumnFamilyHandle* family_;
+};
+#else
+class NamespacedDB final : public DB {
+public:
+  NamespacedDB(std::shared_ptr<DB> base, char tag) noexcept;
+  NamespacedDB(const NamespacedDB&) = delete;
+  NamespacedDB& operator=(const NamespacedDB&) = delete;
+  ~NamespacedDB() noexcept override = default;
+
+  Status Put(const WriteOptions& options, const Slice& key, const Slice& value) override;
+  Status Delete(const WriteOptions& options, const Slice& key) override;
+  Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  Status Get(const ReadOptions& options, const Slice& key, std::string* value) override;
+  Iterator* NewIterator(const ReadOptions& options) override;
+  const DB_ENGINE::Snapshot* GetSnapshot() override;
+  void ReleaseSnapshot(const DB_ENGINE::Snapshot* snapshot) override;
+  bool GetProperty(const Slice& property, std::string* value) override;
+  void GetApproximateSizes(const DB_ENGINE::Range* range, int n, uint64_t* sizes) override;
+  void CompactRange(const Slice* begin, const Slice* end) override;
+  // Appends to translated the updates Write writes into base() for updates.
+  Status Translate(const WriteBatch& updates, WriteBatch* translated) const;
+  DB* base() noexcept { return base_.get(); }
+
+private:
+  std::string Prefixed(const Slice& key) const;
+
+  std::shared_ptr<DB> base_;
+  std::string prefix_;
+  std::string limit_;
+};
+#endif
+
+// Opens the engine instance at db_path and returns one view per name in
+// names, tuned by the overrides of the same position in typeOptions. The
+// views share the ownership of the engine instance, which is closed once
+// the last of them is deleted.
+Status OpenNamespacedDBs(const Options& options,
+                         const std::string& db_path,
+                         const std::vector<std::string>& names,
+                         const std::vector<TypeOptions>& typeOptions,
+                         std::vector<DB*>* dbs) noexcept;
+
+}
+
+#endif //MERODIS_NAMESPACED_DB_H
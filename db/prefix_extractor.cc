@@ -0,0 +1,16 @@
+#include "prefix_extractor.h"
+
+#ifdef ROCKSDB
+
+namespace merodis {
+
+Slice NodeKeyPrefixExtractor::Transform(const Slice& key) const {
+  for (size_t c = 0; c < key.size(); c++) {
+    if (key[c] == '\0' || key[c] == '\xff') return {key.data(), c};
+  }
+  return key;
+}
+
+}
+
+#endif
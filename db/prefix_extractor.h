@@ -0,0 +1,28 @@
+#ifndef MERODIS_PREFIX_EXTRACTOR_H
+#define MERODIS_PREFIX_EXTRACTOR_H
+
+#ifdef ROCKSDB
+
+#include "merodis/merodis.h"
+#include "rocksdb/slice_transform.h"
+
+namespace merodis {
+
+// Extracts the user key from the meta and node keys of hashes, sets and
+// zsets, i.e. everything before the first '\0' or '\xff' separator, so a
+// collection and all of its members share the same prefix.
+class NodeKeyPrefixExtractor final : public DB_ENGINE::SliceTransform {
+public:
+  NodeKeyPrefixExtractor() noexcept = default;
+  ~NodeKeyPrefixExtractor() noexcept override = default;
+
+  const char* Name() const override { return "merodis.NodeKeyPrefixExtractor"; }
+  Slice Transform(const Slice& key) const override;
+  bool InDomain(const Slice& key) const override { return true; }
+};
+
+}
+
+#endif
+
+#endif //MERODIS_PREFIX_EXTRACTOR_H
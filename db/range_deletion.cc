@@ -0,0 +1,53 @@
+#include "range_deletion.h"
+
+namespace merodis {
+
+#ifdef ROCKSDB
+RangeDeletion::RangeDeletion(WriteBatch* updates, bool ranges) noexcept:
+  updates_(updates),
+  ranges_(ranges) {}
+#else
+RangeDeletion::RangeDeletion(WriteBatch* updates, bool) noexcept:
+  updates_(updates) {}
+#endif
+
+RangeDeletion::~RangeDeletion() noexcept {
+  Finish();
+}
+
+#ifdef ROCKSDB
+
+void RangeDeletion::Delete(const Slice& key) noexcept {
+  if (!ranges_) {
+    updates_->Delete(key);
+    return;
+  }
+  if (begin_.empty()) begin_.assign(key.data(), key.size());
+  last_.assign(key.data(), key.size());
+}
+
+void RangeDeletion::Finish() noexcept {
+  if (begin_.empty()) return;
+  if (begin_ == last_) {
+    updates_->Delete(begin_);
+  } else {
+    // The end of a range is exclusive, and the smallest key after the last
+    // one deleted is the last one followed by '\0'.
+    last_.push_back('\0');
+    updates_->DeleteRange(begin_, last_);
+  }
+  begin_.clear();
+  last_.clear();
+}
+
+#else
+
+void RangeDeletion::Delete(const Slice& key) noexcept {
+  updates_->Delete(key);
+}
+
+void RangeDeletion::Finish() noexcept {}
+
+#endif
+
+}
@@ -0,0 +1,40 @@
+#ifndef MERODIS_RANGE_DELETION_H
+#define MERODIS_RANGE_DELETION_H
+
+#include <string>
+
+#include "merodis/merodis.h"
+
+namespace merodis {
+
+// Deletes runs of adjacent keys, i.e. keys with no live key between them.
+// Keys written since they were found adjacent fall inside the range too,
+// so a run must stay within keys only its owner writes, e.g. the nodes of
+// one version of one collection.
+// On RocksDB each run becomes a single range tombstone. Other engines fall
+// back to one tombstone per key, as do the batches of a transaction view,
+// whose buffer takes no range deletions.
+class RangeDeletion {
+public:
+  explicit RangeDeletion(WriteBatch* updates, bool ranges = true) noexcept;
+  RangeDeletion(const RangeDeletion&) = delete;
+  RangeDeletion& operator=(const RangeDeletion&) = delete;
+  ~RangeDeletion() noexcept;
+
+  // Deletes key, which must follow the keys deleted in the current run.
+  void Delete(const Slice& key) noexcept;
+  // Ends the current run, the next deleted key starts a new one.
+  void Finish() noexcept;
+
+private:
+  WriteBatch* updates_;
+#ifdef ROCKSDB
+  bool ranges_;
+  std::string begin_;
+  std::string last_;
+#endif
+};
+
+}
+
+#endif //MERODIS_RANGE_DELETION_H
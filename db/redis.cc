@@ -1,19 +1,946 @@
 #include "redis.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "merodis/merodis.h"
+#include "checkpoint.h"
+#include "layout.h"
+#include "namespaced_db.h"
+#include "range_deletion.h"
+#include "transaction.h"
+#include "value_log.h"
+#include "util/coding.h"
+
+#ifdef ROCKSDB
+#include "rocksdb/cache.h"
+#include "rocksdb/filter_policy.h"
+#include "prefix_extractor.h"
+#endif
 
 
 namespace merodis {
 
+// A caller of Redis::Write waiting in the queue for its batch to be
+// committed, either by itself as the leader or by an earlier leader.
+struct Redis::Writer {
+  Writer(WriteBatch* updates, const WriteOptions& options) noexcept: updates(updates), options(options) {}
+
+  WriteBatch* updates;
+  WriteOptions options;
+  Status status;
+  bool done = false;
+  std::condition_variable cv;
+};
+
+static WriteOptions DurableWriteOptions(Durability durability) noexcept {
+  WriteOptions options;
+  options.sync = durability == kSyncDurability;
+#ifdef ROCKSDB
+  options.disableWAL = durability == kNoWALDurability;
+#endif
+  return options;
+}
+
+// Whether a group led by a write of leader options also commits writes of
+// follower options as durably as they ask for.
+static bool CanJoinGroup(const WriteOptions& leader, const WriteOptions& follower) noexcept {
+  if (follower.sync && !leader.sync) return false;
+#ifdef ROCKSDB
+  if (follower.disableWAL != leader.disableWAL) return false;
+#endif
+  return true;
+}
+
+#ifdef ROCKSDB
+
+class BatchAppender : public WriteBatch::Handler {
+public:
+  explicit BatchAppender(WriteBatch* updates): updates_(updates) {}
+
+  Status PutCF(uint32_t, const Slice& key, const Slice& value) override {
+    return updates_->Put(key, value);
+  }
+  Status DeleteCF(uint32_t, const Slice& key) override {
+    return updates_->Delete(key);
+  }
+  Status SingleDeleteCF(uint32_t, const Slice& key) override {
+    return updates_->SingleDelete(key);
+  }
+  Status DeleteRangeCF(uint32_t, const Slice& beginKey, const Slice& endKey) override {
+    return updates_->DeleteRange(beginKey, endKey);
+  }
+  Status MergeCF(uint32_t, const Slice& key, const Slice& value) override {
+    return updates_->Merge(key, value);
+  }
+
+private:
+  WriteBatch* updates_;
+};
+
+static size_t BatchSize(const WriteBatch& updates) noexcept {
+  return updates.GetDataSize();
+}
+
+// Leaves updates unchanged if source can not be appended.
+static Status AppendBatch(const WriteBatch& source, WriteBatch* updates) noexcept {
+  BatchAppender appender(updates);
+  updates->SetSavePoint();
+  Status s = source.Iterate(&appender);
+  if (!s.ok()) {
+    updates->RollbackToSavePoint();
+    return s;
+  }
+  return updates->PopSavePoint();
+}
+
+#else
+
+static size_t BatchSize(const WriteBatch& updates) noexcept {
+  return updates.ApproximateSize();
+}
+
+static Status AppendBatch(const WriteBatch& source, WriteBatch* updates) noexcept {
+  updates->Append(source);
+  return Status::OK();
+}
+
+#endif
+
+typedef std::function<Status(const Slice& key, const Slice& value, std::string* raw)> ValueEncoding;
+
+// Copies a batch into updates, with the values put encoded by encode.
+class ValueEncoder : public WriteBatch::Handler {
+public:
+  ValueEncoder(ValueEncoding encode, WriteBatch* updates): encode_(std::move(encode)), updates_(updates) {}
+
+#ifdef ROCKSDB
+  Status PutCF(uint32_t, const Slice& key, const Slice& value) override {
+    std::string raw;
+    Status s = encode_(key, value, &raw);
+    if (!s.ok()) return s;
+    return updates_->Put(key, raw);
+  }
+  Status DeleteCF(uint32_t, const Slice& key) override {
+    return updates_->Delete(key);
+  }
+  Status SingleDeleteCF(uint32_t, const Slice& key) override {
+    return updates_->SingleDelete(key);
+  }
+  Status DeleteRangeCF(uint32_t, const Slice& beginKey, const Slice& endKey) override {
+    return updates_->DeleteRange(beginKey, endKey);
+  }
+  Status MergeCF(uint32_t, const Slice& key, const Slice& value) override {
+    return updates_->Merge(key, value);
+  }
+#else
+  void Put(const Slice& key, const Slice& value) override {
+    std::string raw;
+    if (status_.ok()) status_ = encode_(key, value, &raw);
+    if (status_.ok()) updates_->Put(key, raw);
+  }
+  void Delete(const Slice& key) override {
+    updates_->Delete(key);
+  }
+#endif
+
+  // The first error of encode_, which LevelDB handlers can not return.
+  Status status() const noexcept { return status_; }
+
+private:
+  ValueEncoding encode_;
+  WriteBatch* updates_;
+  Status status_;
+};
+
 Redis::Redis() noexcept :
-  db_(nullptr) {}
+  db_(nullptr),
+  snapshot_(nullptr),
+  bulk_read_threshold_(0),
+  commit_interval_(0),
+  durability_(kAsyncDurability) {}
 
 Redis::~Redis() noexcept {
+  if (snapshot_) {
+    db_->ReleaseSnapshot(snapshot_);
+    if (value_log_) value_log_->Unpin();
+    return;
+  }
   delete db_;
+#ifndef ROCKSDB
+  delete block_cache_;
+  delete filter_policy_;
+#endif
 };
 
-Status Redis::Open(const Options& options, const std::string& db_path) noexcept {
-  return DB::Open(options, db_path, &db_);
+#ifdef ROCKSDB
+
+DB_ENGINE::BlockBasedTableOptions TableOptionsOf(const Options& options) noexcept {
+  const auto* tableOptions = options.table_factory
+    ? options.table_factory->GetOptions<DB_ENGINE::BlockBasedTableOptions>()
+    : nullptr;
+  return tableOptions ? *tableOptions : DB_ENGINE::BlockBasedTableOptions();
+}
+
+static const size_t kMaxSuccessiveMerges = 16;
+
+void ApplyTypeOptions(const Options& options,
+                      const TypeOptions& typeOptions,
+                      DB_ENGINE::ColumnFamilyOptions* familyOptions,
+                      DB_ENGINE::BlockBasedTableOptions* tableOptions) noexcept {
+  if (typeOptions.compression) familyOptions->compression = *typeOptions.compression;
+  if (typeOptions.write_buffer_size) familyOptions->write_buffer_size = *typeOptions.write_buffer_size;
+  if (typeOptions.merge_operator) {
+    familyOptions->merge_operator = typeOptions.merge_operator;
+    // A write past this many merges of a key in the memtable stores the
+    // merged value instead, so reads of a hot key fold only a few.
+    familyOptions->max_successive_merges = kMaxSuccessiveMerges;
+  }
+  if (typeOptions.min_blob_size) {
+    familyOptions->enable_blob_files = true;
+    familyOptions->min_blob_size = *typeOptions.min_blob_size;
+    familyOptions->enable_blob_garbage_collection = true;
+  }
+  if (typeOptions.block_size) tableOptions->block_size = *typeOptions.block_size;
+  if (typeOptions.cache_share) {
+    tableOptions->block_cache = DB_ENGINE::NewLRUCache(options.block_cache_size * *typeOptions.cache_share);
+  }
+  if (typeOptions.bloom_bits) {
+    tableOptions->filter_policy.reset(*typeOptions.bloom_bits ? DB_ENGINE::NewBloomFilterPolicy(*typeOptions.bloom_bits) : nullptr);
+    tableOptions->whole_key_filtering = true;
+  }
+  if (typeOptions.prefix_bloom) {
+    familyOptions->prefix_extractor = std::make_shared<NodeKeyPrefixExtractor>();
+    familyOptions->memtable_prefix_bloom_size_ratio = 0.1;
+  }
+}
+
+Status Redis::Open(const Options& options, const TypeOptions& typeOptions, const std::string& db_path) noexcept {
+  Options typedOptions(options);
+  // The overrides go on top of the table options of the caller.
+  DB_ENGINE::BlockBasedTableOptions tableOptions = TableOptionsOf(options);
+  if (options.warm_up) {
+    // Kept in the cache once the warm-up reads them, rather than read
+    // again by the first lookups into each table.
+    tableOptions.cache_index_and_filter_blocks = true;
+    tableOptions.pin_l0_filter_and_index_blocks_in_cache = true;
+  }
+  ApplyTypeOptions(options, typeOptions, &typedOptions, &tableOptions);
+  if (options.warm_up || typeOptions.block_size || typeOptions.cache_share || typeOptions.bloom_bits) {
+    typedOptions.table_factory.reset(DB_ENGINE::NewBlockBasedTableFactory(tableOptions));
+  }
+  return DB::Open(typedOptions, db_path, &db_);
+}
+
+#else
+
+Status Redis::Open(const Options& options, const TypeOptions& typeOptions, const std::string& db_path) noexcept {
+  Options typedOptions(options);
+  if (typeOptions.compression) typedOptions.compression = *typeOptions.compression;
+  if (typeOptions.write_buffer_size) typedOptions.write_buffer_size = *typeOptions.write_buffer_size;
+  if (typeOptions.block_size) typedOptions.block_size = *typeOptions.block_size;
+  if (typeOptions.cache_share) {
+    block_cache_ = DB_ENGINE::NewLRUCache(options.block_cache_size * *typeOptions.cache_share);
+    typedOptions.block_cache = block_cache_;
+  }
+  if (typeOptions.bloom_bits) {
+    filter_policy_ = *typeOptions.bloom_bits ? DB_ENGINE::NewBloomFilterPolicy(*typeOptions.bloom_bits) : nullptr;
+    typedOptions.filter_policy = filter_policy_;
+  }
+  return DB::Open(typedOptions, db_path, &db_);
+}
+
+#endif
+
+Status Redis::Open(DB* db) noexcept {
+  db_ = db;
+  return Status::OK();
+}
+
+Status Redis::OpenSnapshot(const Redis& base) noexcept {
+  db_ = base.db_;
+  snapshot_ = db_->GetSnapshot();
+  bulk_read_threshold_ = base.bulk_read_threshold_;
+  commit_interval_ = base.commit_interval_;
+  durability_ = base.durability_;
+#ifdef ROCKSDB
+  async_io_ = base.async_io_;
+#endif
+  min_blob_size_ = base.min_blob_size_;
+  value_log_ = base.value_log_;
+  if (value_log_) value_log_->Pin();
+  return Status::OK();
+}
+
+Status Redis::OpenTransaction(const Redis& base) noexcept {
+  db_ = new TransactionDB(base.db_);
+  bulk_read_threshold_ = base.bulk_read_threshold_;
+  durability_ = base.durability_;
+#ifdef ROCKSDB
+  async_io_ = base.async_io_;
+#endif
+  min_blob_size_ = base.min_blob_size_;
+  value_log_ = base.value_log_;
+  defers_separation_ = true;
+  return Status::OK();
+}
+
+Status Redis::CommitTransaction(Redis* view) noexcept {
+  auto* buffer = static_cast<TransactionDB*>(view->db_);
+  if (buffer->empty()) return Status::OK();
+  if (!value_log_) return Write(buffer->updates());
+  WriteBatch updates;
+  Status s = SeparateBuffered(*view, &updates);
+  if (!s.ok()) return s;
+  return Write(&updates);
+}
+
+Status Redis::AppendTransaction(Redis* view, WriteBatch* shared) noexcept {
+  auto* buffer = static_cast<TransactionDB*>(view->db_);
+  if (buffer->empty()) return Status::OK();
+  if (!value_log_) return static_cast<NamespacedDB*>(db_)->Translate(*buffer->updates(), shared);
+  WriteBatch updates;
+  Status s = SeparateBuffered(*view, &updates);
+  // The values the commit points to must be as durable as the commit.
+  if (s.ok() && CurrentWriteOptions().sync) s = value_log_->Sync();
+  if (!s.ok()) return s;
+  return static_cast<NamespacedDB*>(db_)->Translate(updates, shared);
+}
+
+Status Redis::WriteShared(WriteBatch* shared) noexcept {
+  return static_cast<NamespacedDB*>(db_)->base()->Write(CurrentWriteOptions(), shared);
+}
+
+bool Redis::HasBufferedWrites() noexcept {
+  return !static_cast<TransactionDB*>(db_)->empty();
+}
+
+void Redis::DiscardTransaction() noexcept {
+  static_cast<TransactionDB*>(db_)->Clear();
+  deferred_keys_.clear();
+}
+
+Status Redis::SeparateValues(uint64_t minBlobSize, const std::string& valueLogPath) noexcept {
+  min_blob_size_ = minBlobSize;
+  if (valueLogPath.empty()) return Status::OK();
+  value_log_ = std::make_shared<ValueLog>();
+  return value_log_->Open(valueLogPath);
+}
+
+bool Redis::SeparatesValues() const noexcept {
+  return false;
+}
+
+Status Redis::EncodeRecord(const BulkRecord&, KeyValues*) noexcept {
+  return Status::NotSupported("Bulk load not supported by the data type");
+}
+
+Status Redis::FlushMemTable() noexcept {
+#ifdef ROCKSDB
+  return db_->Flush(DB_ENGINE::FlushOptions());
+#else
+  // LevelDB can not be asked to flush, its checkpoints copy the WAL.
+  return Status::OK();
+#endif
+}
+
+Status Redis::CreateCheckpoint(const std::string& db_path, const std::string& checkpoint_path) noexcept {
+  return CheckpointDB(db_, db_path, checkpoint_path);
+}
+
+Status Redis::CheckpointValueLog(const std::string& checkpoint_path) noexcept {
+  if (!value_log_) return Status::OK();
+  return value_log_->Checkpoint(checkpoint_path);
+}
+
+Status Redis::CollectValueLog(double maxLiveShare, std::shared_mutex* commits) noexcept {
+  if (snapshot_) return Status::NotSupported("Writes on a snapshot view");
+  if (!value_log_) return Status::OK();
+  Status s = value_log_->DeleteDropped();
+  if (!s.ok()) return s;
+  for (uint64_t number: value_log_->SealedFiles()) {
+    uint64_t size = 0, live = 0;
+    s = value_log_->Scan(number, [&](const Slice& key, const Slice& value, const Slice& pointer) {
+      bool isLive;
+      Status s = PointsTo(key, pointer, &isLive);
+      size += value.size();
+      if (isLive) live += value.size();
+      return s;
+    });
+    if (!s.ok()) return s;
+    if (live > size * maxLiveShare) continue;
+
+    // No write may replace a value between the check and the move.
+    std::unique_lock<std::shared_mutex> commitsLock;
+    if (commits) commitsLock = std::unique_lock<std::shared_mutex>(*commits);
+    PauseWrites();
+    WriteBatch updates;
+    s = value_log_->Scan(number, [&](const Slice& key, const Slice& value, const Slice& pointer) {
+      bool isLive;
+      Status s = PointsTo(key, pointer, &isLive);
+      if (!s.ok() || !isLive) return s;
+      std::string raw(1, kValuePointer), moved;
+      s = value_log_->Append(key, value, &moved);
+      raw.append(moved);
+      updates.Put(key, raw);
+      return s;
+    });
+    if (s.ok()) s = value_log_->Sync();
+    // The file is deleted once the pointers to it are gone for good.
+    WriteOptions options;
+    options.sync = true;
+    if (s.ok()) s = db_->Write(options, &updates);
+    ResumeWrites();
+    if (!s.ok()) return s;
+    value_log_->Drop(number);
+  }
+  return Status::OK();
+}
+
+Status Redis::WarmUp(uint64_t bytes) noexcept {
+  ReadOptions options;
+#ifdef ROCKSDB
+  options.readahead_size = 2 << 20;
+  // The scan crosses prefixes, which the prefix extractor otherwise skips.
+  options.total_order_seek = true;
+#endif
+  Iterator* iter = db_->NewIterator(options);
+  const std::string separators = NodeSeparators();
+  uint64_t read = 0;
+  // The meta keys prefixing the current key, shortest first.
+  std::vector<std::string> metas;
+  for (iter->SeekToFirst(); iter->Valid() && read < bytes;) {
+    Slice rawKey = iter->key();
+    read += rawKey.size() + iter->value().size();
+    while (!metas.empty() && !rawKey.starts_with(metas.back())) metas.pop_back();
+    size_t keySize = metas.empty() ? 0 : metas.back().size();
+    if (!metas.empty() && rawKey.size() > keySize && separators.find(rawKey[keySize]) != std::string::npos) {
+      // The first node of a run, whose blocks are left out, past the index
+      // and filter blocks of the tables the seek reaches.
+      std::string end = NodeKeysEnd(metas.back(), rawKey[keySize]);
+      if (end.empty()) break;
+      iter->Seek(end);
+      continue;
+    }
+    if (!separators.empty()) metas.push_back(rawKey.ToString());
+    iter->Next();
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+std::string Redis::NodeSeparators() const noexcept {
+  return "";
+}
+
+Status Redis::CopyTo(Redis* target) noexcept {
+  ScopedSnapshot snapshot(db_, snapshot_);
+  ReadOptions options = ReadOptionsAt(snapshot.get());
+  options.fill_cache = false;
+#ifdef ROCKSDB
+  // The scan crosses prefixes, which the prefix extractor otherwise skips.
+  options.total_order_seek = true;
+#endif
+  Iterator* iter = db_->NewIterator(options);
+  WriteBatch updates;
+  Status s;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    // Only the data types separating values have a value log, and their
+    // other values, e.g. the 8-byte meta values of hashes, are never as
+    // long as a tagged pointer.
+    Slice value = iter->value();
+    if (value_log_ && value.size() == 1 + ValueLog::kPointerSize && value[0] == kValuePointer) {
+      // The pointer only holds in the value log of this data type.
+      std::string raw(value.ToString()), targetRaw;
+      s = LoadValue(&raw);
+      if (s.ok()) s = target->EncodeValue(iter->key(), Slice(raw.data() + 1, raw.size() - 1), &targetRaw);
+      if (!s.ok()) break;
+      updates.Put(iter->key(), targetRaw);
+    } else {
+      updates.Put(iter->key(), value);
+    }
+    if (BatchSize(updates) < (4 << 20)) continue;
+    s = target->db_->Write(WriteOptions(), &updates);
+    if (!s.ok()) break;
+    updates.Clear();
+  }
+  if (s.ok()) s = iter->status();
+  delete iter;
+  if (!s.ok()) return s;
+  return target->db_->Write(WriteOptions(), &updates);
+}
+
+Status Redis::IsEmpty(bool* empty) noexcept {
+  ReadOptions options = ReadOptionsAt(snapshot_);
+  options.fill_cache = false;
+#ifdef ROCKSDB
+  options.total_order_seek = true;
+#endif
+  Iterator* iter = db_->NewIterator(options);
+  iter->SeekToFirst();
+  *empty = !iter->Valid();
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+Status Redis::ReclaimStaleVersions(std::shared_mutex*) noexcept {
+  return Status::OK();
+}
+
+Status Redis::IsNodeOf(const Slice&, const Slice&, const Slice&, bool, bool, const ReadOptions&, bool* isNode) noexcept {
+  *isNode = false;
+  return Status::OK();
+}
+
+Status Redis::ReclaimStaleNodes(std::shared_mutex* commits) noexcept {
+  ReadOptions options;
+  options.snapshot = db_->GetSnapshot();
+#ifdef ROCKSDB
+  options.total_order_seek = true;
+#endif
+  Iterator* iter = db_->NewIterator(options);
+  WriteBatch updates;
+  RangeDeletion deletion(&updates, !IsTransactionView());
+  Status s;
+  // The meta keys prefixing the current key, shortest first, each with
+  // the version of its meta value and whether it is of a deleted key none
+  // of whose nodes was kept so far.
+  struct Meta {
+    std::string key;
+    uint64_t version;
+    bool bare;
+  };
+  std::vector<Meta> metas;
+  // The deleted keys passed with none of their nodes kept, whose meta
+  // values go once the deletions of their nodes are written.
+  std::vector<std::pair<std::string, uint64_t>> bareMetas;
+  auto popMeta = [&]() {
+    if (metas.back().bare) bareMetas.emplace_back(std::move(metas.back().key), metas.back().version);
+    metas.pop_back();
+  };
+  // Nodes kept, and the keys skipped, may be of any meta key they extend.
+  auto keepNodes = [&]() {
+    for (auto& meta: metas) meta.bare = false;
+  };
+  // The key, separator and version of the nodes in the current run. A run
+  // spanning two of them would cover the keys created between them since
+  // the snapshot, e.g. of the zsets whose keys extend the key.
+  std::string runPrefix;
+  for (iter->SeekToFirst(); iter->Valid();) {
+    Slice rawKey = iter->key();
+    while (!metas.empty() && !rawKey.starts_with(metas.back().key)) popMeta();
+    // User keys may hold the separators too, so the node may be of any
+    // meta key it extends. Versions only grow, so a node older than each
+    // of them can never become reachable again.
+    bool isNode = false;
+    bool stale = true;
+    size_t prefixSize = 0;
+    std::optional<std::string> liveEnd;
+    for (const auto& meta: metas) {
+      const std::string& key = meta.key;
+      if (rawKey.size() <= key.size()) continue;
+      bool isNodeOfKey;
+      s = IsNodeOf(key, rawKey, iter->value(), true, false, options, &isNodeOfKey);
+      if (!s.ok()) break;
+      if (!isNodeOfKey) continue;
+      isNode = true;
+      prefixSize = key.size() + 1 + sizeof(uint64_t);
+      uint64_t nodeVersion = DecodeFixed64(rawKey.data() + key.size() + 1);
+      if (nodeVersion < meta.version) continue;
+      stale = false;
+      // The nodes of the current version are not read, seeking past them
+      // as WarmUp does, and neither are the collections whose keys extend
+      // the key with them, which keep their stale nodes.
+      if (nodeVersion == meta.version) liveEnd = NodeKeysEnd(Slice(rawKey.data(), prefixSize - 1), rawKey[prefixSize - 1]);
+      break;
+    }
+    if (!s.ok()) break;
+    if (!isNode) {
+      deletion.Finish();
+      if (iter->value().size() != sizeof(uint64_t) * 2) {
+        s = Status::Corruption("Neither a versioned meta value nor a node", rawKey);
+        break;
+      }
+      bool deleted = DecodeFixed64(iter->value().data()) == 0;
+      metas.push_back({rawKey.ToString(), DecodeFixed64(iter->value().data() + sizeof(uint64_t)), deleted});
+      iter->Next();
+      continue;
+    }
+    if (!stale) {
+      deletion.Finish();
+      keepNodes();
+      if (!liveEnd) {
+        iter->Next();
+      } else if (liveEnd->empty()) {
+        break;
+      } else {
+        iter->Seek(*liveEnd);
+      }
+      continue;
+    }
+    if (Slice(rawKey.data(), prefixSize) != Slice(runPrefix)) {
+      deletion.Finish();
+      runPrefix.assign(rawKey.data(), prefixSize);
+    }
+    deletion.Delete(rawKey);
+    iter->Next();
+    if (BatchSize(updates) < (4 << 20) && bareMetas.size() < 4096) continue;
+    deletion.Finish();
+    s = Write(&updates);
+    if (s.ok()) s = DeleteBareMetas(&bareMetas, commits);
+    if (!s.ok()) break;
+    updates.Clear();
+  }
+  deletion.Finish();
+  if (s.ok()) s = iter->status();
+  delete iter;
+  db_->ReleaseSnapshot(options.snapshot);
+  if (!s.ok()) return s;
+  while (!metas.empty()) popMeta();
+  s = Write(&updates);
+  if (!s.ok()) return s;
+  return DeleteBareMetas(&bareMetas, commits);
+}
+
+Status Redis::DeleteBareMetas(std::vector<std::pair<std::string, uint64_t>>* metas,
+                              std::shared_mutex* commits) noexcept {
+  if (metas->empty()) return Status::OK();
+  // No write may recreate a key between the check and the delete.
+  std::unique_lock<std::shared_mutex> commitsLock;
+  if (commits) commitsLock = std::unique_lock<std::shared_mutex>(*commits);
+  PauseWrites();
+  WriteBatch updates;
+  Status s;
+  for (const auto& [key, version]: *metas) {
+    std::string value;
+    s = db_->Get(ReadOptions(), key, &value);
+    if (s.IsNotFound()) {
+      s = Status::OK();
+      continue;
+    }
+    if (!s.ok()) break;
+    if (value.size() == sizeof(uint64_t) * 2 && DecodeFixed64(value.data()) == 0 &&
+        DecodeFixed64(value.data() + sizeof(uint64_t)) == version) {
+      updates.Delete(key);
+    }
+  }
+  if (s.ok()) s = db_->Write(CurrentWriteOptions(), &updates);
+  ResumeWrites();
+  metas->clear();
+  return s;
+}
+
+Status Redis::UpgradeLayout() noexcept {
+  return Status::OK();
+}
+
+Status Redis::AddNodeVersions() noexcept {
+  ReadOptions options;
+  options.snapshot = db_->GetSnapshot();
+#ifdef ROCKSDB
+  options.total_order_seek = true;
+#endif
+  Iterator* iter = db_->NewIterator(options);
+  WriteBatch updates;
+  Status s;
+  // The meta keys prefixing the current key, shortest first, each with
+  // whether its meta value still lacks the version.
+  std::vector<std::pair<std::string, bool>> metas;
+  const std::string version(sizeof(uint64_t), 0);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    Slice rawKey = iter->key();
+    while (!metas.empty() && !rawKey.starts_with(metas.back().first)) metas.pop_back();
+    // The innermost meta key the key is a node of, if any.
+    const std::pair<std::string, bool>* meta = nullptr;
+    for (auto it = metas.rbegin(); it != metas.rend() && !meta; it++) {
+      if (rawKey.size() <= it->first.size()) continue;
+      bool isNodeOfKey;
+      s = IsNodeOf(it->first, rawKey, iter->value(), !it->second, true, options, &isNodeOfKey);
+      if (!s.ok()) break;
+      if (isNodeOfKey) meta = &*it;
+    }
+    if (!s.ok()) break;
+    bool isNode = meta != nullptr;
+    if (isNode && meta->second) {
+      std::string nodeKey(rawKey.data(), meta->first.size() + 1);
+      nodeKey.append(version);
+      nodeKey.append(rawKey.data() + meta->first.size() + 1, rawKey.size() - meta->first.size() - 1);
+      updates.Delete(rawKey);
+      updates.Put(nodeKey, iter->value());
+    } else if (!isNode && iter->value().size() == sizeof(uint64_t)) {
+      metas.emplace_back(rawKey.ToString(), true);
+      std::string metaValue(iter->value().data(), iter->value().size());
+      metaValue.append(version);
+      updates.Put(rawKey, metaValue);
+    } else if (!isNode && iter->value().size() == sizeof(uint64_t) * 2) {
+      metas.emplace_back(rawKey.ToString(), false);
+    } else if (!isNode) {
+      s = Status::Corruption("Neither a meta value nor a node", rawKey);
+      break;
+    }
+    // Written only between collections, so a crash never leaves a meta
+    // value and its nodes in different layouts.
+    bool inOldCollection = std::any_of(metas.begin(), metas.end(), [](const auto& meta) { return meta.second; });
+    if (inOldCollection || BatchSize(updates) < (4 << 20)) continue;
+    s = Write(&updates);
+    if (!s.ok()) break;
+    updates.Clear();
+  }
+  if (s.ok()) s = iter->status();
+  delete iter;
+  db_->ReleaseSnapshot(options.snapshot);
+  if (!s.ok()) return s;
+  return Write(&updates);
+}
+
+Status Redis::EncodeValue(const Slice& key, const Slice& value, std::string* raw) noexcept {
+  if (!value_log_ || value.size() < *min_blob_size_ || defers_separation_) {
+    if (value_log_ && value.size() >= *min_blob_size_) deferred_keys_.insert(key.ToString());
+    raw->assign(1, kString);
+    raw->append(value.data(), value.size());
+    return Status::OK();
+  }
+  std::string pointer;
+  Status s = value_log_->Append(key, value, &pointer);
+  if (!s.ok()) return s;
+  raw->assign(1, kValuePointer);
+  raw->append(pointer);
+  return Status::OK();
+}
+
+Status Redis::SeparateBuffered(const Redis& view, WriteBatch* updates) noexcept {
+  const std::set<std::string>& deferred = view.deferred_keys_;
+  ValueEncoder encoder([this, &deferred](const Slice& key, const Slice& value, std::string* raw) {
+    if (!deferred.count(key.ToString()) || value.empty() || value[0] != kString) {
+      raw->assign(value.data(), value.size());
+      return Status::OK();
+    }
+    return EncodeValue(key, Slice(value.data() + 1, value.size() - 1), raw);
+  }, updates);
+  Status s = static_cast<TransactionDB*>(view.db_)->updates()->Iterate(&encoder);
+  if (s.ok()) s = encoder.status();
+  return s;
+}
+
+Status Redis::LoadValue(std::string* raw) noexcept {
+  if (raw->empty() || (*raw)[0] != kValuePointer) return Status::OK();
+  if (!value_log_) return Status::Corruption("Value pointer without a value log");
+  std::string value;
+  Status s = value_log_->Read(Slice(raw->data() + 1, raw->size() - 1), &value);
+  if (!s.ok()) return s;
+  raw->assign(1, kString);
+  raw->append(value);
+  return Status::OK();
+}
+
+Status Redis::PointsTo(const Slice& key, const Slice& pointer, bool* isLive) noexcept {
+  std::string raw;
+  Status s = db_->Get(ReadOptions(), key, &raw);
+  *isLive = s.ok() && raw.size() == 1 + pointer.size() && raw[0] == kValuePointer && Slice(raw.data() + 1, pointer.size()) == pointer;
+  if (s.IsNotFound()) return Status::OK();
+  return s;
+}
+
+ReadOptions Redis::ReadOptionsAt(const DB_ENGINE::Snapshot* snapshot) noexcept {
+  ReadOptions options;
+  options.snapshot = snapshot;
+  return options;
+}
+
+bool Redis::IsBulkRead(const Slice& key, const DB_ENGINE::Snapshot* snapshot) noexcept {
+  if (!bulk_read_threshold_) return false;
+  std::string rawMetaValue;
+  Status s = db_->Get(ReadOptionsAt(snapshot), key, &rawMetaValue);
+  if (!s.ok() || rawMetaValue.size() < sizeof(uint64_t)) return false;
+  return DecodeFixed64(rawMetaValue.data()) >= bulk_read_threshold_;
+}
+
+#ifdef ROCKSDB
+
+Status Redis::MultiGetNodes(const ReadOptions& options,
+                            const std::vector<std::string>& nodeKeys,
+                            uint64_t,
+                            std::vector<std::optional<std::string>>* values) noexcept {
+  values->assign(nodeKeys.size(), std::nullopt);
+  if (nodeKeys.empty()) return Status::OK();
+  std::vector<Slice> keys(nodeKeys.begin(), nodeKeys.end());
+  std::vector<DB_ENGINE::PinnableSlice> pinnedValues(keys.size());
+  std::vector<Status> statuses(keys.size());
+  ReadOptions multiGetOptions(options);
+  multiGetOptions.async_io = async_io_;
+  db_->MultiGet(multiGetOptions, db_->DefaultColumnFamily(), keys.size(), keys.data(),
+                pinnedValues.data(), statuses.data(), true);
+  for (size_t c = 0; c < keys.size(); c++) {
+    if (statuses[c].ok()) {
+      (*values)[c] = pinnedValues[c].ToString();
+    } else if (!statuses[c].IsNotFound()) {
+      return statuses[c];
+    }
+  }
+  return Status::OK();
+}
+
+#else
+
+// Walking a collection costs about a step per element, looking a node up
+// about as much as this many steps.
+static const uint64_t kStepsPerLookup = 16;
+
+Status Redis::MultiGetNodes(const ReadOptions& options,
+                            const std::vector<std::string>& nodeKeys,
+                            uint64_t len,
+                            std::vector<std::optional<std::string>>* values) noexcept {
+  values->assign(nodeKeys.size(), std::nullopt);
+  if (nodeKeys.empty()) return Status::OK();
+  if (len > nodeKeys.size() * kStepsPerLookup) {
+    std::string value;
+    for (size_t c = 0; c < nodeKeys.size(); c++) {
+      Status s = db_->Get(options, nodeKeys[c], &value);
+      if (s.ok()) {
+        (*values)[c] = std::move(value);
+      } else if (!s.IsNotFound()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+
+  Iterator* iter = db_->NewIterator(options);
+  iter->Seek(nodeKeys.front());
+  for (size_t c = 0; c < nodeKeys.size() && iter->Valid();) {
+    int cmp = iter->key().compare(nodeKeys[c]);
+    if (cmp < 0) {
+      iter->Next();
+      continue;
+    }
+    if (cmp == 0) (*values)[c] = iter->value().ToString();
+    c++;
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+#endif
+
+WriteOptions Redis::CurrentWriteOptions() const noexcept {
+  const Durability* scoped = DurabilityScope::Current();
+  return DurableWriteOptions(scoped ? *scoped : durability_);
+}
+
+Status Redis::Write(WriteBatch* updates) noexcept {
+  // A snapshot view shares db_ with its base, but neither its write queue
+  // nor its pauses, and computed the updates from a stale state.
+  if (snapshot_) return Status::NotSupported("Writes on a snapshot view");
+  Writer writer(updates, CurrentWriteOptions());
+  std::unique_lock<std::mutex> lock(write_mutex_);
+  writers_.push_back(&writer);
+  while (!writer.done && &writer != writers_.front()) writer.cv.wait(lock);
+  if (writer.done) return writer.status;
+
+  // The leader gives the callers arriving within the interval the chance
+  // to join its group, while the earlier ones already wait behind it.
+  if (commit_interval_) {
+    lock.unlock();
+    std::this_thread::sleep_for(std::chrono::microseconds(commit_interval_));
+    lock.lock();
+  }
+  while (paused_) writer.cv.wait(lock);
+  Writer* lastWriter;
+  WriteBatch* group = BuildGroup(&lastWriter);
+  writing_ = true;
+  lock.unlock();
+  Status s;
+  // The values a synced write points to must be as durable as the write.
+  if (writer.options.sync && value_log_) s = value_log_->Sync();
+  if (s.ok()) s = db_->Write(writer.options, group);
+  lock.lock();
+  writing_ = false;
+  if (paused_) idle_cv_.notify_all();
+  if (group == &group_) group_.Clear();
+
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready != &writer) {
+      ready->status = s;
+      ready->done = true;
+      ready->cv.notify_one();
+    }
+    if (ready == lastWriter) break;
+  }
+  if (!writers_.empty()) writers_.front()->cv.notify_one();
+  return s;
+}
+
+void Redis::PauseWrites() noexcept {
+  std::unique_lock<std::mutex> lock(write_mutex_);
+  while (paused_) idle_cv_.wait(lock);
+  paused_ = true;
+  while (writing_) idle_cv_.wait(lock);
+}
+
+void Redis::ResumeWrites() noexcept {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  paused_ = false;
+  idle_cv_.notify_all();
+  if (!writers_.empty()) writers_.front()->cv.notify_one();
+}
+
+WriteBatch* Redis::BuildGroup(Writer** lastWriter) noexcept {
+  Writer* first = writers_.front();
+  *lastWriter = first;
+  if (writers_.size() == 1) return first->updates;
+
+  // Bounds the group, and the delay of a small write by a large group.
+  size_t size = BatchSize(*first->updates);
+  size_t maxSize = size <= (128 << 10) ? size + (128 << 10) : 1 << 20;
+  // A batch that can not be merged is written alone.
+  if (!AppendBatch(*first->updates, &group_).ok()) return first->updates;
+  for (auto it = writers_.begin() + 1; it != writers_.end(); it++) {
+    if (!CanJoinGroup(first->options, (*it)->options)) break;
+    size += BatchSize(*(*it)->updates);
+    if (size > maxSize) break;
+    if (!AppendBatch(*(*it)->updates, &group_).ok()) break;
+    *lastWriter = *it;
+  }
+  return &group_;
+}
+
+Status Redis::SyncWAL() noexcept {
+#ifdef ROCKSDB
+  return db_->SyncWAL();
+#else
+  // LevelDB syncs the whole log behind a synced write, even an empty one.
+  WriteOptions options;
+  options.sync = true;
+  WriteBatch updates;
+  return db_->Write(options, &updates);
+#endif
+}
+
+Status Redis::Put(const Slice& key, const Slice& value) noexcept {
+  WriteBatch updates;
+  updates.Put(key, value);
+  return Write(&updates);
+}
+
+#ifdef ROCKSDB
+Status Redis::Merge(const Slice& key, const Slice& value) noexcept {
+  WriteBatch updates;
+  updates.Merge(key, value);
+  return Write(&updates);
 }
+#endif
 
 }
\ No newline at end of file
@@ -1,21 +1,267 @@
 #ifndef MERODIS_REDIS_H
 #define MERODIS_REDIS_H
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "merodis/merodis.h"
 
+#ifdef ROCKSDB
+#include "rocksdb/table.h"
+#else
+#include "leveldb/cache.h"
+#include "leveldb/filter_policy.h"
+#endif
+
 namespace merodis {
 
+typedef std::vector<std::pair<std::string, std::string>> KeyValues;
+
+class ValueLog;
+
 class Redis {
 public:
   Redis() noexcept;
   virtual ~Redis() noexcept;
 
-  virtual Status Open(const Options& options, const std::string& db_path) noexcept;
+  virtual Status Open(const Options& options, const TypeOptions& typeOptions, const std::string& db_path) noexcept;
+  virtual Status Open(DB* db) noexcept;
+  // Shares the storage of base, reading it at a snapshot pinned until this
+  // data type is deleted.
+  virtual Status OpenSnapshot(const Redis& base) noexcept;
+  // Shares the storage of base, overlaid by the writes of this data type,
+  // which are only buffered until committed into base by CommitTransaction,
+  // or by AppendTransaction and WriteShared. The buffered values stay
+  // inline, separated only by the commit, so a value log collected
+  // meanwhile can not drop them.
+  virtual Status OpenTransaction(const Redis& base) noexcept;
+  // Commits the writes buffered by view, a transaction view of this data
+  // type, in one write.
+  Status CommitTransaction(Redis* view) noexcept;
+  // In single_db mode, appends to shared the writes buffered by view, a
+  // transaction view of this data type, as the engine instance shared by
+  // all data types stores them. WriteShared then commits them at once.
+  Status AppendTransaction(Redis* view, WriteBatch* shared) noexcept;
+  Status WriteShared(WriteBatch* shared) noexcept;
+  // Whether this transaction view buffered any write.
+  bool HasBufferedWrites() noexcept;
+  // Drops the writes buffered by this transaction view.
+  void DiscardTransaction() noexcept;
+  // Appends the keys and values storing record, a key new to the data
+  // type, to kvs, see BulkLoader.
+  virtual Status EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept;
+  // Keeps the values of at least minBlobSize bytes out of the engine, in
+  // the value log at valueLogPath, see TypeOptions::min_blob_size. Without
+  // valueLogPath, for in_memory instances, they all stay inline, stored
+  // the same way.
+  Status SeparateValues(uint64_t minBlobSize, const std::string& valueLogPath) noexcept;
+  // Whether SeparateValues has any effect: the data types storing values
+  // of any length tag them by their ValueType once it is called.
+  virtual bool SeparatesValues() const noexcept;
+  // Whether the values are stored tagged, SeparateValues having been
+  // called on a data type separating them.
+  bool TagsValues() const noexcept { return min_blob_size_.has_value(); }
+  // Moves the values still pointed to out of each sealed value log file
+  // where they make up at most maxLiveShare of its values, dropping the
+  // file. The commits of single_db transactions, which do not wait for
+  // PauseWrites, must then wait for commits, held exclusively meanwhile.
+  Status CollectValueLog(double maxLiveShare, std::shared_mutex* commits) noexcept;
+  // Links the value log into checkpoint_path, see ValueLog::Checkpoint.
+  Status CheckpointValueLog(const std::string& checkpoint_path) noexcept;
+  // Makes the writes wait, once those committing already are done, until
+  // ResumeWrites, so a checkpoint sees the same point of every data type.
+  // A second pause waits for the first to be resumed.
+  void PauseWrites() noexcept;
+  void ResumeWrites() noexcept;
+  // Flushes the memtable on RocksDB, so a checkpoint taken right after
+  // has little left to flush while the writes are paused.
+  Status FlushMemTable() noexcept;
+  // Writes a copy of the data type stored at db_path into checkpoint_path,
+  // see CheckpointDB.
+  Status CreateCheckpoint(const std::string& db_path, const std::string& checkpoint_path) noexcept;
+  // Reads the data type from its first key on, up to bytes of keys and
+  // values, filling the block cache. Only the meta key and first node of
+  // each collection are read, seeking past the other nodes.
+  Status WarmUp(uint64_t bytes) noexcept;
+  // Copies every key of the data type, read at a snapshot, into target.
+  Status CopyTo(Redis* target) noexcept;
+  // Whether the data type holds no key.
+  Status IsEmpty(bool* empty) noexcept;
+  // Deletes the nodes left unreachable by whole-key deletions, and then
+  // the meta values left of the deleted keys, holding commits exclusively
+  // to check them, see CollectValueLog.
+  virtual Status ReclaimStaleVersions(std::shared_mutex* commits) noexcept;
+  // Rewrites the keys left in the layout of an earlier release, once per
+  // instance, see Merodis::Open.
+  virtual Status UpgradeLayout() noexcept;
+  void SetBulkReadThreshold(uint64_t threshold) noexcept { bulk_read_threshold_ = threshold; }
+  void SetCommitInterval(uint64_t micros) noexcept { commit_interval_ = micros; }
+  void SetDurability(Durability durability) noexcept { durability_ = durability; }
+#ifdef ROCKSDB
+  void SetAsyncIO(bool asyncIO) noexcept { async_io_ = asyncIO; }
+#endif
+  // Makes the writes returned so far survive a crash of the machine.
+  Status SyncWAL() noexcept;
 
 protected:
+  friend class BulkLoader;
+
+  // Options of the point lookups at snapshot, the latest state if null.
+  static ReadOptions ReadOptionsAt(const DB_ENGINE::Snapshot* snapshot) noexcept;
+  // Whether reading the whole collection at key, whose meta value starts
+  // with its length, is a bulk read, see Options::bulk_read_threshold.
+  bool IsBulkRead(const Slice& key, const DB_ENGINE::Snapshot* snapshot) noexcept;
+  // Reads the values of nodeKeys, sorted and distinct node keys of one
+  // collection of len elements, into values, null where absent. RocksDB
+  // batches the lookups by MultiGet. LevelDB looks them up one by one
+  // unless they are dense enough in the collection to walk it instead,
+  // the only use of len. The lookups must share the snapshot of options.
+  Status MultiGetNodes(const ReadOptions& options,
+                       const std::vector<std::string>& nodeKeys,
+                       uint64_t len,
+                       std::vector<std::optional<std::string>>* values) noexcept;
+  // Whether rawKey, holding value and following metaKey with one of
+  // NodeSeparators, is a node of the collection at metaKey, and not the
+  // meta key of another collection whose key extends metaKey. The node
+  // keys of metaKey hold its version after the separator if versioned.
+  // Meta values hold the length and the version, or the length alone if
+  // legacyMetas, as before versions, see AddNodeVersions. Reads at options.
+  virtual Status IsNodeOf(const Slice& metaKey,
+                          const Slice& rawKey,
+                          const Slice& value,
+                          bool versioned,
+                          bool legacyMetas,
+                          const ReadOptions& options,
+                          bool* isNode) noexcept;
+  // Deletes the nodes of the sets or zsets of this data type older than
+  // the version in the meta value of their key, which holds the length
+  // and then the version. The keys are told apart by IsNodeOf, each meta
+  // key being one that is no node of the meta keys it extends. The meta
+  // values of length 0 none of whose nodes was kept are then deleted too,
+  // see DeleteBareMetas.
+  Status ReclaimStaleNodes(std::shared_mutex* commits) noexcept;
+  // Deletes the meta values of metas, each with the version read when all
+  // of its nodes were deleted, that still hold length 0 and that version:
+  // recreating the key since would start from it, its older nodes being
+  // left. The writes, and the commits if given, wait meanwhile.
+  Status DeleteBareMetas(std::vector<std::pair<std::string, uint64_t>>* metas,
+                         std::shared_mutex* commits) noexcept;
+  // Moves the sets or zsets of this data type stored before versions to
+  // version 0: their 8-byte meta values, holding the length alone, gain
+  // the version, and their node keys gain it right after the separator.
+  // Keys already versioned are left as they are.
+  Status AddNodeVersions() noexcept;
+  // Commits updates in one engine write together with the batches queued
+  // by concurrent callers, see Options::commit_interval, as durable as the
+  // current DurabilityScope or else Options::durability asks for.
+  Status Write(WriteBatch* updates) noexcept;
+  Status Put(const Slice& key, const Slice& value) noexcept;
+  // The bytes that follow the key of a collection in the keys of its
+  // nodes, none for the data types without nodes.
+  virtual std::string NodeSeparators() const noexcept;
+  // Encodes value, stored at key, into raw: inline as kString, or as a
+  // kValuePointer into the value log if it holds min_blob_size_ bytes.
+  Status EncodeValue(const Slice& key, const Slice& value, std::string* raw) noexcept;
+  // Copies the writes buffered by view, a transaction view, into updates,
+  // with the values the view kept inline encoded by EncodeValue.
+  Status SeparateBuffered(const Redis& view, WriteBatch* updates) noexcept;
+  // Replaces raw, if a kValuePointer, by the kString of the value it points to.
+  Status LoadValue(std::string* raw) noexcept;
+#ifdef ROCKSDB
+  Status Merge(const Slice& key, const Slice& value) noexcept;
+#endif
+  // Whether this is a transaction view, whose buffered batches take no
+  // range deletions, see RangeDeletion.
+  bool IsTransactionView() const noexcept { return defers_separation_; }
+  // Whether the writes made now are to be synced, see CurrentWriteOptions.
+  bool SyncsWrites() const noexcept { return CurrentWriteOptions().sync; }
+
   DB* db_;
+  // The snapshot read by a view opened by OpenSnapshot, which does not own
+  // db_, or null.
+  const DB_ENGINE::Snapshot* snapshot_;
+  uint64_t bulk_read_threshold_;
+  uint64_t commit_interval_;
+  Durability durability_;
+  // Set if the separable values are tagged, see SeparateValues.
+  std::optional<uint64_t> min_blob_size_;
+  std::shared_ptr<ValueLog> value_log_;
+  // Set on a transaction view, whose values stay inline until committed.
+  bool defers_separation_ = false;
+  // The keys of the values a transaction view kept inline that are long
+  // enough to be separated, told by their writers, as a meta key may look
+  // like a node key.
+  std::set<std::string> deferred_keys_;
+#ifdef ROCKSDB
+  // See Options::async_io.
+  bool async_io_ = false;
+#else
+  // Owned by the data type, as LevelDB does not take their ownership.
+  DB_ENGINE::Cache* block_cache_ = nullptr;
+  const DB_ENGINE::FilterPolicy* filter_policy_ = nullptr;
+#endif
+
+private:
+  struct Writer;
+  // The options of a write, as durable as the current DurabilityScope or
+  // else durability_ asks for.
+  WriteOptions CurrentWriteOptions() const noexcept;
+  // Merges the batches queued behind the leader at the front of writers_
+  // into group_, returning the batch to write and its last writer.
+  WriteBatch* BuildGroup(Writer** lastWriter) noexcept;
+  // Whether the latest value stored at key is pointer.
+  Status PointsTo(const Slice& key, const Slice& pointer, bool* isLive) noexcept;
+
+  std::mutex write_mutex_;
+  std::deque<Writer*> writers_;
+  WriteBatch group_;
+  bool paused_ = false;
+  // Whether a leader is writing its group to the engine.
+  bool writing_ = false;
+  std::condition_variable idle_cv_;
 };
 
+// Pins the state read by one command made of several reads, unless the
+// data type already reads a snapshot, which the command then reads too.
+class ScopedSnapshot {
+public:
+  ScopedSnapshot(DB* db, const DB_ENGINE::Snapshot* snapshot) noexcept:
+    db_(db),
+    owned_(!snapshot),
+    snapshot_(snapshot ? snapshot : db->GetSnapshot()) {}
+  ScopedSnapshot(const ScopedSnapshot&) = delete;
+  ScopedSnapshot& operator=(const ScopedSnapshot&) = delete;
+  ~ScopedSnapshot() noexcept { if (owned_) db_->ReleaseSnapshot(snapshot_); }
+
+  const DB_ENGINE::Snapshot* get() const noexcept { return snapshot_; }
+
+private:
+  DB* db_;
+  bool owned_;
+  const DB_ENGINE::Snapshot* snapshot_;
+};
+
+#ifdef ROCKSDB
+// The table options options was given, the defaults where its tables are
+// not block based.
+DB_ENGINE::BlockBasedTableOptions TableOptionsOf(const Options& options) noexcept;
+// Applies the overrides of one data type onto the options of the column
+// family storing it and the options of its tables.
+void ApplyTypeOptions(const Options& options,
+                      const TypeOptions& typeOptions,
+                      DB_ENGINE::ColumnFamilyOptions* familyOptions,
+                      DB_ENGINE::BlockBasedTableOptions* tableOptions) noexcept;
+#endif
+
 }
 
 
@@ -1,6 +1,11 @@
 #ifndef MERODIS_REDIS_HASH_H
 #define MERODIS_REDIS_HASH_H
 
+#include <array>
+#include <functional>
+#include <mutex>
+#include <string_view>
+
 #include "redis.h"
 #include "util/coding.h"
 
@@ -13,7 +18,7 @@ public:
 
   virtual Status HLen(const Slice& key, uint64_t* len) = 0;
   virtual Status HGet(const Slice& key, const Slice& hashKey, std::string* value) = 0;
-  virtual Status HMGet(const Slice& key, const std::vector<Slice>& hashKeys, std::vector<std::string>* values) = 0;
+  virtual Status HMGet(const Slice& key, const std::vector<Slice>& hashKeys, ValueOpts* values) = 0;
   virtual Status HGetAll(const Slice& key, std::map<std::string, std::string>* kvs) = 0;
   virtual Status HKeys(const Slice& key, std::vector<std::string>* keys) = 0;
   virtual Status HVals(const Slice& key, std::vector<std::string>* values) = 0;
@@ -22,6 +27,19 @@ public:
   virtual Status HSet(const Slice& key, const std::map<Slice, Slice>& kvs, uint64_t* count) = 0;
   virtual Status HDel(const Slice& key, const Slice& hashKey, uint64_t* count) = 0;
   virtual Status HDel(const Slice& key, const std::set<Slice>& hashKeys, uint64_t* count) = 0;
+
+protected:
+  // The writes to the fields of the keys hashed to a stripe take turns on
+  // its mutex, from counting the fields they add or delete to their write,
+  // so the length stored matches the fields stored.
+  std::mutex& StripeOf(const Slice& key) noexcept {
+    return stripes_[std::hash<std::string_view>()(std::string_view(key.data(), key.size())) % kStripes];
+  }
+
+private:
+  static constexpr size_t kStripes = 64;
+
+  std::array<std::mutex, kStripes> stripes_;
 };
 
 }
@@ -2,20 +2,74 @@
 
 #include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <set>
 
+#include "layout.h"
+#include "util/coding.h"
+
 namespace merodis {
 
 RedisHashBasicImpl::RedisHashBasicImpl() noexcept = default;
 
 RedisHashBasicImpl::~RedisHashBasicImpl() noexcept = default;
 
+Status RedisHashBasicImpl::EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept {
+  if (record.values.size() != record.members.size()) {
+    return Status::InvalidArgument("Every field of a hash needs a value");
+  }
+  if (record.members.empty()) return Status::OK();
+  HashMetaValue metaValue;
+  metaValue.len = record.members.size();
+  kvs->emplace_back(record.key, metaValue.Encode());
+  for (size_t c = 0; c < record.members.size(); c++) {
+    std::string nodeKey = HashNodeKey(record.key, record.members[c]).Encode().ToString();
+    std::string value = record.values[c];
+    if (min_blob_size_) {
+      Status s = EncodeValue(nodeKey, record.values[c], &value);
+      if (!s.ok()) return s;
+    }
+    kvs->emplace_back(std::move(nodeKey), std::move(value));
+  }
+  return Status::OK();
+}
+
+bool RedisHashBasicImpl::SeparatesValues() const noexcept {
+  return true;
+}
+
+std::string RedisHashBasicImpl::NodeSeparators() const noexcept {
+  return std::string(1, '\0');
+}
+
+Status RedisHashBasicImpl::PutValue(const Slice& nodeKey, const Slice& value, WriteBatch* updates) noexcept {
+  if (!min_blob_size_) {
+    updates->Put(nodeKey, value);
+    return Status::OK();
+  }
+  std::string raw;
+  Status s = EncodeValue(nodeKey, value, &raw);
+  if (!s.ok()) return s;
+  updates->Put(nodeKey, raw);
+  return Status::OK();
+}
+
+Status RedisHashBasicImpl::DecodeValue(std::string* value) noexcept {
+  if (!min_blob_size_) return Status::OK();
+  Status s = LoadValue(value);
+  if (!s.ok()) return s;
+  value->erase(0, 1);
+  return Status::OK();
+}
+
 Status RedisHashBasicImpl::HLen(const Slice& key,
                                 uint64_t* len) {
   std::string rawHashMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawHashMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawHashMetaValue);
   if (s.ok()) {
     HashMetaValue metaValue(rawHashMetaValue);
     *len = metaValue.len;
@@ -29,47 +83,73 @@ Status RedisHashBasicImpl::HLen(const Slice& key,
 Status RedisHashBasicImpl::HGet(const Slice& key,
                                 const Slice& hashKey,
                                 std::string* value) {
-  return db_->Get(ReadOptions(), HashNodeKey(key, hashKey).Encode(), value);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), HashNodeKey(key, hashKey).Encode(), value);
+  if (!s.ok()) return s;
+  return DecodeValue(value);
 }
 
 Status RedisHashBasicImpl::HMGet(const Slice& key,
                                  const std::vector<Slice>& hashKeys,
-                                 std::vector<std::string>* values){
-  std::map<Slice, Slice> kvs;
-  for (auto const& k: hashKeys) kvs[k] = "";
-
-  Iterator* iter = db_->NewIterator(ReadOptions());
-  for (auto const& [k, _] : kvs) {
-    iter->Seek(HashNodeKey(key, k).Encode());
-    if (!iter->Valid()) break;
-    kvs[k] = iter->value();
+                                 ValueOpts* values){
+  // The distinct fields in order, each with the position of its node key.
+  std::map<Slice, size_t> positions;
+  for (auto const& k: hashKeys) positions.emplace(k, 0);
+  std::vector<std::string> nodeKeys;
+  nodeKeys.reserve(positions.size());
+  for (auto& [k, position]: positions) {
+    position = nodeKeys.size();
+    nodeKeys.push_back(HashNodeKey(key, k).Encode().ToString());
   }
-  delete iter;
 
+  ScopedSnapshot snapshot(db_, snapshot_);
+  NodeScanOptions options(key, snapshot.get());
+  Status s;
+  uint64_t len = 0;
+#ifndef ROCKSDB
+  std::string rawHashMetaValue;
+  s = db_->Get(options, key, &rawHashMetaValue);
+  if (s.ok()) len = HashMetaValue(rawHashMetaValue).len;
+  if (!s.ok() && !s.IsNotFound()) return s;
+#endif
+  std::vector<std::optional<std::string>> nodeValues;
+  s = MultiGetNodes(options, nodeKeys, len, &nodeValues);
+  if (!s.ok()) return s;
+
+  for (auto& nodeValue: nodeValues) {
+    if (!nodeValue) continue;
+    s = DecodeValue(&*nodeValue);
+    if (!s.ok()) return s;
+  }
   values->reserve(values->size() + hashKeys.size());
-  for (const auto& k: hashKeys) values->emplace_back(kvs[k].ToString());
+  for (const auto& k: hashKeys) values->push_back(nodeValues[positions[k]]);
   return Status::OK();
 }
 
 Status RedisHashBasicImpl::HGetAll(const Slice& key, std::map<std::string, std::string>* kvs) {
-  Iterator* iter = db_->NewIterator(ReadOptions());
+  NodeScanOptions options(key, snapshot_, IsBulkRead(key, snapshot_));
+  Iterator* iter = db_->NewIterator(options);
   iter->Seek(key);
   if (!iter->Valid() || iter->key() != key) {
     delete iter;
     return Status::OK();
   }
   iter->Next();
+  Status s;
   for (; iter->Valid(); iter->Next()) {
     if (iter->key().size() <= key.size() || iter->key()[key.size()] != 0) break;
     HashNodeKey nodeKey(iter->key(), key.size());
-    kvs->insert({nodeKey.hashKey().ToString(), iter->value().ToString()});
+    std::string value = iter->value().ToString();
+    s = DecodeValue(&value);
+    if (!s.ok()) break;
+    kvs->insert({nodeKey.hashKey().ToString(), std::move(value)});
   }
   delete iter;
-  return Status::OK();
+  return s;
 }
 
 Status RedisHashBasicImpl::HKeys(const Slice& key, std::vector<std::string>* keys) {
-  Iterator* iter = db_->NewIterator(ReadOptions());
+  NodeScanOptions options(key, snapshot_, IsBulkRead(key, snapshot_));
+  Iterator* iter = db_->NewIterator(options);
   iter->Seek(key);
   if (!iter->Valid() || iter->key() != key) {
     delete iter;
@@ -86,25 +166,29 @@ Status RedisHashBasicImpl::HKeys(const Slice& key, std::vector<std::string>* key
 }
 
 Status RedisHashBasicImpl::HVals(const Slice& key, std::vector<std::string>* values) {
-  Iterator* iter = db_->NewIterator(ReadOptions());
+  NodeScanOptions options(key, snapshot_, IsBulkRead(key, snapshot_));
+  Iterator* iter = db_->NewIterator(options);
   iter->Seek(key);
   if (!iter->Valid() || iter->key() != key) {
     delete iter;
     return Status::OK();
   }
   iter->Next();
+  Status s;
   for (; iter->Valid(); iter->Next()) {
     if (iter->key().size() <= key.size() || iter->key()[key.size()] != 0) break;
-    HashNodeKey nodeKey(iter->key(), key.size());
-    values->push_back(iter->value().ToString());
+    std::string value = iter->value().ToString();
+    s = DecodeValue(&value);
+    if (!s.ok()) break;
+    values->push_back(std::move(value));
   }
   delete iter;
-  return Status::OK();
+  return s;
 }
 
 Status RedisHashBasicImpl::HExists(const Slice& key, const Slice& hashKey, bool* exists) {
   std::string _;
-  Status s = db_->Get(ReadOptions(), HashNodeKey(key, hashKey).Encode(), &_);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), HashNodeKey(key, hashKey).Encode(), &_);
   if (s.ok()) {
     *exists = true;
   } else if (s.IsNotFound()) {
@@ -118,100 +202,122 @@ Status RedisHashBasicImpl::HSet(const Slice& key,
                                 const Slice& hashKey,
                                 const Slice& value,
                                 uint64_t* count) {
-  std::string rawHashMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawHashMetaValue);
-  HashMetaValue metaValue;
-  if (s.ok()) metaValue = HashMetaValue(rawHashMetaValue);
-
+  std::lock_guard<std::mutex> lock(StripeOf(key));
   WriteBatch updates;
   HashNodeKey nodeKey(key, hashKey);
-  updates.Put(nodeKey.Encode(), value);
+  Status s = PutValue(nodeKey.Encode(), value, &updates);
+  if (!s.ok()) return s;
 
   *count = 1 - CountKeysIntersection(key, nodeKey);
   if (*count) {
-    metaValue.len += 1;
-    updates.Put(key, metaValue.Encode());
+    s = AddLen(key, 1, &updates);
+    if (!s.ok()) return s;
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisHashBasicImpl::HSet(const Slice& key,
                                 const std::map<Slice, Slice>& kvs,
                                 uint64_t* count) {
-  std::string rawHashMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawHashMetaValue);
-  HashMetaValue metaValue;
-  if (s.ok()) metaValue = HashMetaValue(rawHashMetaValue);
+  std::lock_guard<std::mutex> lock(StripeOf(key));
   WriteBatch updates;
-
   for (const auto&[k, v]: kvs) {
     HashNodeKey nodeKey(key, k);
-    updates.Put(nodeKey.Encode(), v);
+    Status s = PutValue(nodeKey.Encode(), v, &updates);
+    if (!s.ok()) return s;
   }
 
-  *count = kvs.size() - (metaValue.len ? CountKeysIntersection(key, kvs) : 0);
-  if (*count) {
-    metaValue.len += *count;
-    updates.Put(key, metaValue.Encode());
-  }
-  return db_->Write(WriteOptions(), &updates);
+#ifdef ROCKSDB
+  // The fields looked up alone tell the ones added, whose count is merged.
+  *count = kvs.size() - CountKeysIntersection(key, kvs);
+  if (*count) AddLen(key, 0, static_cast<int64_t>(*count), &updates);
+#else
+  // The length is read for the meta value anyway, and saves the fields
+  // scan of a hash holding none.
+  uint64_t len;
+  Status s = HLen(key, &len);
+  if (!s.ok()) return s;
+  *count = kvs.size() - (len ? CountKeysIntersection(key, kvs) : 0);
+  if (*count) AddLen(key, len, static_cast<int64_t>(*count), &updates);
+#endif
+  return Write(&updates);
 }
 
 Status RedisHashBasicImpl::HDel(const Slice& key,
                                 const Slice& hashKey,
                                 uint64_t* count) {
-  std::string rawHashMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawHashMetaValue);
-  HashMetaValue metaValue;
-  if (s.ok()) metaValue = HashMetaValue(rawHashMetaValue);
-
+  std::lock_guard<std::mutex> lock(StripeOf(key));
   WriteBatch updates;
   HashNodeKey nodeKey(key, hashKey);
   updates.Delete(nodeKey.Encode());
 
   *count = CountKeysIntersection(key, nodeKey);
   if (*count) {
-    metaValue.len -= 1;
-    updates.Put(key, metaValue.Encode());
+    Status s = AddLen(key, -1, &updates);
+    if (!s.ok()) return s;
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisHashBasicImpl::HDel(const Slice& key,
                                 const std::set<Slice>& hashKeys,
                                 uint64_t* count) {
-  std::string rawHashMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawHashMetaValue);
-  HashMetaValue metaValue;
-  if (s.ok()) metaValue = HashMetaValue(rawHashMetaValue);
+  std::lock_guard<std::mutex> lock(StripeOf(key));
   WriteBatch updates;
-
   for (const auto& k: hashKeys) {
     HashNodeKey nodeKey(key, k);
     updates.Delete(nodeKey.Encode());
   }
 
-  *count = metaValue.len ? CountKeysIntersection(key, hashKeys) : 0;
-  if (*count) {
-    metaValue.len -= *count;
-    updates.Put(key, metaValue.Encode());
-  }
-  return db_->Write(WriteOptions(), &updates);
+#ifdef ROCKSDB
+  *count = CountKeysIntersection(key, hashKeys);
+  if (*count) AddLen(key, 0, -static_cast<int64_t>(*count), &updates);
+#else
+  uint64_t len;
+  Status s = HLen(key, &len);
+  if (!s.ok()) return s;
+  *count = len ? CountKeysIntersection(key, hashKeys) : 0;
+  if (*count) AddLen(key, len, -static_cast<int64_t>(*count), &updates);
+#endif
+  return Write(&updates);
+}
+
+Status RedisHashBasicImpl::AddLen(const Slice& key, int64_t delta, WriteBatch* updates) {
+  uint64_t len = 0;
+#ifndef ROCKSDB
+  Status s = HLen(key, &len);
+  if (!s.ok()) return s;
+#endif
+  AddLen(key, len, delta, updates);
+  return Status::OK();
+}
+
+void RedisHashBasicImpl::AddLen(const Slice& key, uint64_t len, int64_t delta, WriteBatch* updates) {
+#ifdef ROCKSDB
+  std::string rawDelta(sizeof(int64_t), 0);
+  EncodeFixed64(rawDelta.data(), delta);
+  updates->Merge(key, rawDelta);
+#else
+  HashMetaValue metaValue;
+  metaValue.len = len + delta;
+  updates->Put(key, metaValue.Encode());
+#endif
 }
 
 uint64_t RedisHashBasicImpl::CountKeysIntersection(const Slice& key, const HashNodeKey& nodeKey) {
   std::string _;
-  Status s = db_->Get(ReadOptions(), nodeKey.Encode(), &_);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), nodeKey.Encode(), &_);
   return s.ok();
 }
 
 uint64_t RedisHashBasicImpl::CountKeysIntersection(const Slice& key, const std::set<Slice>& hashKeys) {
   uint64_t count = 0;
-  Iterator* iter = db_->NewIterator(ReadOptions());
-  iter->Seek(key);
-  iter->Next();
+  HashNodeKey prefix(key, "");
+  NodeScanOptions options(key, snapshot_);
+  Iterator* iter = db_->NewIterator(options);
+  iter->Seek(prefix.Encode());
   std::set<Slice>::const_iterator updatesIter = hashKeys.cbegin();
-  while (iter->Valid() && updatesIter != hashKeys.cend()) {
+  while (iter->Valid() && iter->key().starts_with(prefix.Encode()) && updatesIter != hashKeys.cend()) {
     int cmp = updatesIter->compare({iter->key().data() + key.size() + 1,
                                     iter->key().size() - key.size() - 1});
     if (cmp == 0) {
@@ -230,11 +336,12 @@ uint64_t RedisHashBasicImpl::CountKeysIntersection(const Slice& key, const std::
 
 uint64_t RedisHashBasicImpl::CountKeysIntersection(const Slice& key, const std::map<Slice, Slice>& kvs) {
   uint64_t count = 0;
-  Iterator* iter = db_->NewIterator(ReadOptions());
-  iter->Seek(key);
-  iter->Next();
+  HashNodeKey prefix(key, "");
+  NodeScanOptions options(key, snapshot_);
+  Iterator* iter = db_->NewIterator(options);
+  iter->Seek(prefix.Encode());
   std::map<Slice, Slice>::const_iterator updatesIter = kvs.cbegin();
-  while (iter->Valid() && updatesIter != kvs.cend()) {
+  while (iter->Valid() && iter->key().starts_with(prefix.Encode()) && updatesIter != kvs.cend()) {
     int cmp = updatesIter->first.compare({iter->key().data() + key.size() + 1,
                                           iter->key().size() - key.size() - 1});
     if (cmp == 0) {
@@ -61,9 +61,11 @@ public:
   RedisHashBasicImpl() noexcept;
   ~RedisHashBasicImpl() noexcept final;
 
+  Status EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept override;
+
   Status HLen(const Slice& key, uint64_t* len) final;
   Status HGet(const Slice& key, const Slice& hashKey, std::string* value) final;
-  Status HMGet(const Slice& key, const std::vector<Slice>& hashKeys, std::vector<std::string>* values) final;
+  Status HMGet(const Slice& key, const std::vector<Slice>& hashKeys, ValueOpts* values) final;
   Status HGetAll(const Slice& key, std::map<std::string, std::string>* kvs) final;
   Status HKeys(const Slice& key, std::vector<std::string>* keys) final;
   Status HVals(const Slice& key, std::vector<std::string>* values) final;
@@ -73,7 +75,24 @@ public:
   Status HDel(const Slice& key, const Slice& hashKey, uint64_t* count) final;
   Status HDel(const Slice& key, const std::set<Slice>& hashKeys, uint64_t* count) final;
 
+protected:
+  // The values of the fields, at the node keys, are tagged, the meta values
+  // are not.
+  bool SeparatesValues() const noexcept override;
+  std::string NodeSeparators() const noexcept override;
+
 private:
+  // Puts value, the value of the field at nodeKey, into updates, tagged
+  // and maybe separated if the values are, see Redis::SeparateValues.
+  Status PutValue(const Slice& nodeKey, const Slice& value, WriteBatch* updates) noexcept;
+  // Turns a value put by PutValue back into the value of the field.
+  Status DecodeValue(std::string* value) noexcept;
+  // Adds delta to the length in the meta value of the hash. On RocksDB the
+  // delta is merged, without reading the meta value, which LevelDB reads.
+  Status AddLen(const Slice& key, int64_t delta, WriteBatch* updates);
+  // AddLen, the length already read as len, which RocksDB ignores and
+  // merges delta.
+  void AddLen(const Slice& key, uint64_t len, int64_t delta, WriteBatch* updates);
   uint64_t CountKeysIntersection(const Slice& key, const HashNodeKey& hashKey);
   uint64_t CountKeysIntersection(const Slice& key, const std::set<Slice>& hashKeys);
   uint64_t CountKeysIntersection(const Slice& key, const std::map<Slice, Slice>& kvs);
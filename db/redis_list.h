@@ -2,6 +2,7 @@
 #define MERODIS_REDIS_LIST_H
 
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -27,6 +28,30 @@ public:
   virtual Status LInsert(const Slice& key, const BeforeOrAfter& beforeOrAfter, const Slice& pivotValue, const Slice& value) noexcept = 0;
   virtual Status LRem(const Slice& key, int64_t count, const Slice& value, uint64_t* removedCount) noexcept = 0;
   virtual Status LMove(const Slice& srcKey, const Slice& dstKey, enum Side srcSide, enum Side dstSide, std::string* value) noexcept = 0;
+  // beforeWait runs once BPop finds keys empty and is about to wait.
+  virtual Status BPop(const std::vector<Slice>& keys,
+                      uint64_t timeout,
+                      enum Side side,
+                      std::string* key,
+                      std::string* value,
+                      const std::function<void()>& beforeWait) noexcept = 0;
+  // LMove, waiting up to timeout milliseconds, forever if 0, for srcKey to
+  // get an element. beforeWait runs each time BLMove finds srcKey empty
+  // and is about to wait, afterWait each time it wakes up to move an
+  // element stored meanwhile.
+  virtual Status BLMove(const Slice& srcKey,
+                        const Slice& dstKey,
+                        enum Side srcSide,
+                        enum Side dstSide,
+                        uint64_t timeout,
+                        std::string* value,
+                        const std::function<void()>& beforeWait,
+                        const std::function<void()>& afterWait) noexcept = 0;
+  // Serves the callers of BPop and BLMove waiting on key from the elements
+  // stored there, e.g. by the commit of a transaction.
+  virtual Status ServeWaiters(const Slice& key) noexcept = 0;
+  // The callers of BPop and BLMove waiting on key.
+  virtual uint64_t Waiters(const Slice& key) noexcept = 0;
 };
 
 }
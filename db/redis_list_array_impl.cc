@@ -3,7 +3,10 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string_view>
 
 #include <iostream>
 
@@ -14,26 +17,40 @@ namespace merodis {
 
 ListMetaValue::ListMetaValue() noexcept:
   leftIndex(InitIndex + 1),
-  rightIndex(InitIndex) {}
+  rightIndex(InitIndex),
+  leftmostIndex(leftIndex),
+  rightmostIndex(rightIndex) {}
 
 ListMetaValue::ListMetaValue(uint64_t leftIndex, uint64_t rightIndex) noexcept:
   leftIndex(leftIndex),
-  rightIndex(rightIndex) {}
+  rightIndex(rightIndex),
+  leftmostIndex(leftIndex),
+  rightmostIndex(rightIndex) {}
 
 ListMetaValue::ListMetaValue(const std::string& rawValue) noexcept {
   leftIndex = DecodeFixed64(rawValue.data());
   rightIndex = DecodeFixed64(rawValue.data() + sizeof(leftIndex));
+  leftmostIndex = leftIndex;
+  rightmostIndex = rightIndex;
+  if (rawValue.size() < sizeof(uint64_t) * 4) return;
+  leftmostIndex = DecodeFixed64(rawValue.data() + sizeof(uint64_t) * 2);
+  rightmostIndex = DecodeFixed64(rawValue.data() + sizeof(uint64_t) * 3);
 }
 
 uint64_t ListMetaValue::Length() const {
   return rightIndex - leftIndex + 1;
 }
 
-Slice ListMetaValue::Encode() const {
-  char* rawMetaValue = new char[sizeof(ListMetaValue)];
-  EncodeFixed64(rawMetaValue, leftIndex);
-  EncodeFixed64(rawMetaValue + sizeof(leftIndex), rightIndex);
-  return Slice{rawMetaValue, sizeof(ListMetaValue)};
+std::string ListMetaValue::Encode() const {
+  bool holdsRetired = leftmostIndex < leftIndex || rightmostIndex > rightIndex;
+  std::string rawMetaValue(sizeof(uint64_t) * (holdsRetired ? 4 : 2), 0);
+  EncodeFixed64(rawMetaValue.data(), leftIndex);
+  EncodeFixed64(rawMetaValue.data() + sizeof(leftIndex), rightIndex);
+  if (holdsRetired) {
+    EncodeFixed64(rawMetaValue.data() + sizeof(uint64_t) * 2, leftmostIndex);
+    EncodeFixed64(rawMetaValue.data() + sizeof(uint64_t) * 3, rightmostIndex);
+  }
+  return rawMetaValue;
 }
 
 ListNodeKey::ListNodeKey(Slice key, uint64_t index) noexcept:
@@ -52,14 +69,51 @@ std::string ListNodeKey::Encode() const {
   return rawListNodeKey;
 }
 
+RedisListArrayImpl::Waiter::Waiter(enum Side side, bool moves) noexcept:
+  side(side),
+  moves(moves),
+  served(false) {}
+
 RedisListArrayImpl::RedisListArrayImpl() noexcept = default;
 
 RedisListArrayImpl::~RedisListArrayImpl() noexcept = default;
 
+Status RedisListArrayImpl::Open(const Options& options, const TypeOptions& typeOptions, const std::string& db_path) noexcept {
+  stripes_ = std::make_shared<Stripes>();
+  return Redis::Open(options, typeOptions, db_path);
+}
+
+Status RedisListArrayImpl::Open(DB* db) noexcept {
+  stripes_ = std::make_shared<Stripes>();
+  return Redis::Open(db);
+}
+
+Status RedisListArrayImpl::OpenSnapshot(const Redis& base) noexcept {
+  stripes_ = static_cast<const RedisListArrayImpl&>(base).stripes_;
+  return Redis::OpenSnapshot(base);
+}
+
+Status RedisListArrayImpl::OpenTransaction(const Redis& base) noexcept {
+  stripes_ = static_cast<const RedisListArrayImpl&>(base).stripes_;
+  return Redis::OpenTransaction(base);
+}
+
+Status RedisListArrayImpl::EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept {
+  if (record.members.empty()) return Status::OK();
+  ListMetaValue metaValue;
+  uint64_t currentIndex = metaValue.rightIndex + 1;
+  metaValue.rightIndex += record.members.size();
+  kvs->emplace_back(record.key, metaValue.Encode());
+  for (auto it = record.members.begin(); it != record.members.end(); it++, currentIndex++) {
+    kvs->emplace_back(ListNodeKey(record.key, currentIndex).Encode(), *it);
+  }
+  return Status::OK();
+}
+
 Status RedisListArrayImpl::LLen(const Slice& key,
                                 uint64_t* len) noexcept {
   std::string rawListMetaValue;
-  merodis::Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  merodis::Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
 
   if (s.ok()) {
     ListMetaValue metaValue(rawListMetaValue);
@@ -77,7 +131,7 @@ Status RedisListArrayImpl::LIndex(const Slice& key,
                                   UserIndex index,
                                   std::string* value) noexcept {
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
@@ -86,7 +140,7 @@ Status RedisListArrayImpl::LIndex(const Slice& key,
     return Status::InvalidArgument("Index out of range");
   }
   ListNodeKey nodeKey(key, internalIndex);
-  return db_->Get(ReadOptions(), nodeKey.Encode(), value);
+  return db_->Get(ReadOptionsAt(snapshot_), nodeKey.Encode(), value);
 }
 
 Status RedisListArrayImpl::LPos(const Slice& key,
@@ -95,12 +149,13 @@ Status RedisListArrayImpl::LPos(const Slice& key,
                                 int64_t count,
                                 int64_t maxlen,
                                 std::vector<uint64_t>* indices) noexcept {
+  ScopedSnapshot snapshot(db_, snapshot_);
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot.get()), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
-  Iterator* iter = db_->NewIterator(ReadOptions());
+  Iterator* iter = db_->NewIterator(ReadOptionsAt(snapshot.get()));
   uint64_t current;
   uint64_t currentCount = 0;
   indices->reserve(indices->size() + count);
@@ -145,8 +200,9 @@ Status RedisListArrayImpl::LRange(const Slice& key,
                                   UserIndex from,
                                   UserIndex to,
                                   std::vector<std::string>* values) noexcept {
+  ScopedSnapshot snapshot(db_, snapshot_);
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot.get()), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
@@ -156,7 +212,7 @@ Status RedisListArrayImpl::LRange(const Slice& key,
 
   values->reserve(to_ - from_ + 1);
   uint64_t current_ = from_;
-  Iterator* iter = db_->NewIterator(ReadOptions());
+  Iterator* iter = db_->NewIterator(ReadOptionsAt(snapshot.get()));
   ListNodeKey firstKey(key, from_);
   for (iter->Seek(firstKey.Encode()); iter->Valid() && current_ <= to_; iter->Next(), current_++) {
     values->emplace_back(iter->value().ToString());
@@ -166,8 +222,9 @@ Status RedisListArrayImpl::LRange(const Slice& key,
 }
 
 Status RedisListArrayImpl::LSet(const Slice& key, UserIndex index, const Slice& value) noexcept {
+  StripeLock lock(this, key);
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
@@ -176,7 +233,7 @@ Status RedisListArrayImpl::LSet(const Slice& key, UserIndex index, const Slice&
     return Status::InvalidArgument("Index out of range");
   }
   ListNodeKey nodeKey(key, internalIndex);
-  return db_->Put(WriteOptions(), nodeKey.Encode(), value);
+  return lock.Unlock(Put(nodeKey.Encode(), value));
 }
 
 Status RedisListArrayImpl::Push(const Slice& key,
@@ -190,17 +247,55 @@ Status RedisListArrayImpl::Push(const Slice& key,
                                 const std::vector<Slice>& values,
                                 bool createListIfNotFound,
                                 enum Side side) noexcept {
+  Stripe& stripe = StripeOf(key);
+  StripeLock lock(this, key);
+  auto queue = !ServesWaiters() || stripe.waiters.empty() ? stripe.waiters.end() : stripe.waiters.find(key.ToString());
+  if (queue == stripe.waiters.end()) return lock.Unlock(PushNodes(key, values, createListIfNotFound, side));
+
+  lock.SyncLocked();
+  Status s;
+  if (queue->second.mayHoldElements) {
+    s = PushNodes(key, values, createListIfNotFound, side);
+    if (!s.ok()) return s;
+    return Serve(key);
+  }
+  // The list is empty, but may not exist, which only the pushes creating
+  // lists look past.
+  if (!createListIfNotFound) {
+    std::string rawListMetaValue;
+    s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
+    if (!s.ok()) return s;
+  }
+  std::vector<Slice> remaining;
+  bool handedOff = HandOff(&queue->second.waiters, key, values, side, &remaining);
+  if (!handedOff) {
+    s = PushNodes(key, values, createListIfNotFound, side);
+  } else if (!remaining.empty()) {
+    s = PushNodes(key, remaining, true, kRight);
+  }
+  if (queue->second.waiters.empty()) {
+    stripe.waiters.erase(queue);
+  } else if (!handedOff || !remaining.empty()) {
+    queue->second.mayHoldElements = true;
+  }
+  return s;
+}
+
+Status RedisListArrayImpl::PushNodes(const Slice& key,
+                                     const std::vector<Slice>& values,
+                                     bool createListIfNotFound,
+                                     enum Side side) noexcept {
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
   if (!(s.ok() || s.IsNotFound() && createListIfNotFound)) return s;
 
   ListMetaValue metaValue;
   if (s.ok()) metaValue = ListMetaValue(rawListMetaValue);
 
+  const ListMetaValue sourceMetaValue = metaValue;
   WriteBatch updates;
   if (side == kLeft) {
     metaValue.leftIndex -= values.size();
-    updates.Put(key, metaValue.Encode());
     uint64_t currentIndex = metaValue.leftIndex;
     for (auto it = values.rbegin(); it != values.rend(); it++, currentIndex++) {
       updates.Put(ListNodeKey(key, currentIndex).Encode(), *it);
@@ -208,46 +303,61 @@ Status RedisListArrayImpl::Push(const Slice& key,
   } else {
     uint64_t currentIndex = metaValue.rightIndex + 1;
     metaValue.rightIndex += values.size();
-    updates.Put(key, metaValue.Encode());
     for (auto it = values.begin(); it != values.end(); it++, currentIndex++) {
       updates.Put(ListNodeKey(key, currentIndex).Encode(), *it);
     }
   }
-  return db_->Write(WriteOptions(), &updates);
+  DeleteOrphanNodes(key, sourceMetaValue, &metaValue, &updates);
+  updates.Put(key, metaValue.Encode());
+  return Write(&updates);
 }
 
 Status RedisListArrayImpl::Pop(const Slice& key,
                                std::string* value,
                                enum Side side) noexcept {
+  StripeLock lock(this, key);
+  bool popped;
+  Status s = PopNode(key, side, value, &popped);
+  return popped ? lock.Unlock(s) : s;
+}
+
+Status RedisListArrayImpl::PopNode(const Slice& key,
+                                   enum Side side,
+                                   std::string* value,
+                                   bool* popped) noexcept {
+  *popped = false;
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
   if (!metaValue.Length()) return Status::OK();
-  if (side == kLeft) {
-    ListNodeKey nodeKey(key, metaValue.leftIndex);
-    s = db_->Get(ReadOptions(), nodeKey.Encode(), value);
-    if (!s.ok()) return s;
-    metaValue.leftIndex += 1;
-  } else {
-    ListNodeKey nodeKey(key, metaValue.rightIndex);
-    s = db_->Get(ReadOptions(), nodeKey.Encode(), value);
-    if (!s.ok()) return s;
-    metaValue.rightIndex -= 1;
-  }
-  return db_->Put(WriteOptions(), key, metaValue.Encode());
+  ListNodeKey nodeKey(key, side == kLeft ? metaValue.leftIndex : metaValue.rightIndex);
+  s = db_->Get(ReadOptionsAt(snapshot_), nodeKey.Encode(), value);
+  if (!s.ok()) return s;
+  const ListMetaValue sourceMetaValue = metaValue;
+  side == kLeft ? metaValue.leftIndex += 1 : metaValue.rightIndex -= 1;
+
+  WriteBatch updates;
+  updates.Delete(nodeKey.Encode());
+  DeleteOrphanNodes(key, sourceMetaValue, &metaValue, &updates);
+  updates.Put(key, metaValue.Encode());
+  s = Write(&updates);
+  *popped = s.ok();
+  return s;
 }
 
 Status RedisListArrayImpl::Pop(const Slice& key,
                                uint64_t count,
                                std::vector<std::string>* values,
                                enum Side side) noexcept {
+  StripeLock lock(this, key);
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
+  ListMetaValue sourceMetaValue = metaValue;
   if (side == kLeft) {
     s = LRange(key, 0, int64_t(count - 1), values);
     if (!s.ok()) return s;
@@ -257,34 +367,44 @@ Status RedisListArrayImpl::Pop(const Slice& key,
     if (!s.ok()) return s;
     metaValue.rightIndex -= std::min(count, metaValue.Length());
   }
-  s = db_->Put(WriteOptions(), key, metaValue.Encode());
-  return Status::OK();
+  WriteBatch updates;
+  DeleteOrphanNodes(key, sourceMetaValue, &metaValue, &updates);
+  updates.Put(key, metaValue.Encode());
+  return lock.Unlock(Write(&updates));
 }
 
 Status RedisListArrayImpl::LTrim(const Slice& key,
                                  UserIndex from,
                                  UserIndex to) noexcept {
+  StripeLock lock(this, key);
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
   ListMetaValue sourceMetaValue = metaValue;
   metaValue.leftIndex = std::max(sourceMetaValue.leftIndex, GetInternalIndex(from, sourceMetaValue));
   metaValue.rightIndex = std::min(sourceMetaValue.rightIndex, GetInternalIndex(to, sourceMetaValue));
-  return db_->Put(WriteOptions(), key, metaValue.Encode());
+  if (metaValue.rightIndex < metaValue.leftIndex) metaValue.rightIndex = metaValue.leftIndex - 1;
+
+  WriteBatch updates;
+  DeleteOrphanNodes(key, sourceMetaValue, &metaValue, &updates);
+  updates.Put(key, metaValue.Encode());
+  return lock.Unlock(Write(&updates));
 }
 
 Status RedisListArrayImpl::LInsert(const Slice& key,
                                    const BeforeOrAfter& beforeOrAfter,
                                    const Slice& pivotValue,
                                    const Slice& value) noexcept {
+  StripeLock lock(this, key);
+  ScopedSnapshot snapshot(db_, snapshot_);
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot.get()), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
-  Iterator* iter = db_->NewIterator(ReadOptions());
+  Iterator* iter = db_->NewIterator(ReadOptionsAt(snapshot.get()));
   uint64_t current = metaValue.leftIndex;
   ListNodeKey firstKey(key, current);
   uint64_t pivotIndex = 0;
@@ -312,25 +432,27 @@ Status RedisListArrayImpl::LInsert(const Slice& key,
     nodeKey.index += 1;
     updates.Put(nodeKey.Encode(), iter->value());
   }
+  const ListMetaValue sourceMetaValue = metaValue;
   metaValue.rightIndex += 1;
+  DeleteOrphanNodes(key, sourceMetaValue, &metaValue, &updates);
   updates.Put(key, metaValue.Encode());
-  s = db_->Write(WriteOptions(), &updates);
-
   delete iter;
-  return Status::OK();
+  return lock.Unlock(Write(&updates));
 }
 
 Status RedisListArrayImpl::LRem(const Slice& key,
                                 int64_t count,
                                 const Slice& value,
                                 uint64_t* removedCount) noexcept {
+  StripeLock lock(this, key);
+  ScopedSnapshot snapshot(db_, snapshot_);
   *removedCount = 0;
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot.get()), key, &rawListMetaValue);
   if (!s.ok()) return s;
   ListMetaValue metaValue(rawListMetaValue);
 
-  Iterator* iter = db_->NewIterator(ReadOptions());
+  Iterator* iter = db_->NewIterator(ReadOptionsAt(snapshot.get()));
   uint64_t current;
   ListNodeKey firstKey(key, metaValue.leftIndex);
   ListNodeKey lastKey(key, metaValue.rightIndex);
@@ -361,6 +483,7 @@ Status RedisListArrayImpl::LRem(const Slice& key,
     std::reverse(removedIndices.begin(), removedIndices.end());
   }
 
+  const ListMetaValue sourceMetaValue = metaValue;
   const std::vector<Block> blocks = GetBlocks(metaValue.leftIndex, metaValue.rightIndex, removedIndices);
   iter->SeekToFirst();
   iter->Seek(firstKey.Encode());
@@ -377,8 +500,9 @@ Status RedisListArrayImpl::LRem(const Slice& key,
     }
   }
   delete iter;
+  DeleteOrphanNodes(key, sourceMetaValue, &metaValue, &updates);
   updates.Put(key, metaValue.Encode());
-  return db_->Write(WriteOptions(), &updates);
+  return lock.Unlock(Write(&updates));
 }
 
 Status RedisListArrayImpl::LMove(const Slice& srcKey,
@@ -386,31 +510,322 @@ Status RedisListArrayImpl::LMove(const Slice& srcKey,
                                  enum Side srcSide,
                                  enum Side dstSide,
                                  std::string* value) noexcept {
+  std::vector<std::unique_lock<std::mutex>> locks = LockStripes({srcKey, dstKey});
+  return Move(srcKey, dstKey, srcSide, dstSide, value);
+}
+
+Status RedisListArrayImpl::Move(const Slice& srcKey,
+                                const Slice& dstKey,
+                                enum Side srcSide,
+                                enum Side dstSide,
+                                std::string* value) noexcept {
+  Stripe& stripe = StripeOf(dstKey);
+  auto queue = !ServesWaiters() || stripe.waiters.empty() ? stripe.waiters.end() : stripe.waiters.find(dstKey.ToString());
+  if (srcKey == dstKey || queue == stripe.waiters.end()) return MoveNode(srcKey, dstKey, srcSide, dstSide, value);
+
+  Status s;
+  if (queue->second.mayHoldElements) {
+    s = MoveNode(srcKey, dstKey, srcSide, dstSide, value);
+    if (!s.ok()) return s;
+    return Serve(dstKey);
+  }
+  // The element goes straight to the first waiter on dst, which is served
+  // only once the pop is stored, so the element is never only in memory.
+  std::deque<Waiter*>& waiters = queue->second.waiters;
+  std::unique_lock<std::mutex> waiterLock;
+  while (!waiters.empty()) {
+    waiterLock = std::unique_lock<std::mutex>(waiters.front()->mutex);
+    // Served through another of its keys.
+    if (!waiters.front()->served) break;
+    waiterLock.unlock();
+    waiters.pop_front();
+  }
+  // A mover moves the element itself, so it is stored in dst as for the
+  // waiters of a list holding elements.
+  if (waiters.empty() || waiters.front()->moves) {
+    if (waiterLock) waiterLock.unlock();
+    if (waiters.empty()) stripe.waiters.erase(queue);
+    s = MoveNode(srcKey, dstKey, srcSide, dstSide, value);
+    if (!s.ok()) return s;
+    return Serve(dstKey);
+  }
+  bool popped;
+  s = PopNode(srcKey, srcSide, value, &popped);
+  if (!s.ok()) return s;
+  if (!popped) return Status::NotFound("");
+  Waiter* waiter = waiters.front();
+  waiter->key = dstKey.ToString();
+  waiter->value = *value;
+  waiter->served = true;
+  waiter->cv.notify_one();
+  waiters.pop_front();
+  if (waiters.empty()) stripe.waiters.erase(queue);
+  return s;
+}
+
+Status RedisListArrayImpl::MoveNode(const Slice& srcKey,
+                                    const Slice& dstKey,
+                                    enum Side srcSide,
+                                    enum Side dstSide,
+                                    std::string* value) noexcept {
+  ScopedSnapshot snapshot(db_, snapshot_);
   if (srcKey == dstKey && srcSide == dstSide) return Status::OK();
 
   std::string rawListMetaValue;
-  Status s = db_->Get(ReadOptions(), srcKey, &rawListMetaValue);
+  Status s = db_->Get(ReadOptionsAt(snapshot.get()), srcKey, &rawListMetaValue);
   if (!s.ok()) return s;
   std::shared_ptr<ListMetaValue> srcMetaValue = std::make_shared<ListMetaValue>(rawListMetaValue);
   std::shared_ptr<ListMetaValue> dstMetaValue = srcMetaValue;
   if (srcKey != dstKey) {
-    s = db_->Get(ReadOptions(), dstKey, &rawListMetaValue);
+    s = db_->Get(ReadOptionsAt(snapshot.get()), dstKey, &rawListMetaValue);
     if (!s.ok() && !s.IsNotFound()) return s;
-    if (s.ok()) dstMetaValue = std::make_shared<ListMetaValue>(rawListMetaValue);
+    dstMetaValue = s.ok() ? std::make_shared<ListMetaValue>(rawListMetaValue) : std::make_shared<ListMetaValue>();
   }
 
+  const ListMetaValue srcSourceMetaValue = *srcMetaValue;
+  const ListMetaValue dstSourceMetaValue = *dstMetaValue;
   ListNodeKey srcNodeKey(srcKey, srcSide == kLeft ? srcMetaValue->leftIndex : srcMetaValue->rightIndex);
   ListNodeKey dstNodeKey(dstKey, dstSide == kLeft ? dstMetaValue->leftIndex - 1 : dstMetaValue->rightIndex + 1);
   srcSide == kLeft ? srcMetaValue->leftIndex += 1 : srcMetaValue->rightIndex -= 1;
   dstSide == kLeft ? dstMetaValue->leftIndex -= 1 : dstMetaValue->rightIndex += 1;
 
-  s = db_->Get(ReadOptions(), srcNodeKey.Encode(), value);
+  s = db_->Get(ReadOptionsAt(snapshot.get()), srcNodeKey.Encode(), value);
   if (!s.ok()) return s;
   WriteBatch updates;
+  updates.Delete(srcNodeKey.Encode());
   updates.Put(dstNodeKey.Encode(), *value);
+  DeleteOrphanNodes(srcKey, srcSourceMetaValue, srcMetaValue.get(), &updates);
   updates.Put(srcKey, srcMetaValue->Encode());
-  if (srcKey != dstKey) updates.Put(dstKey, dstMetaValue->Encode());
-  return db_->Write(WriteOptions(), &updates);
+  if (srcKey != dstKey) {
+    DeleteOrphanNodes(dstKey, dstSourceMetaValue, dstMetaValue.get(), &updates);
+    updates.Put(dstKey, dstMetaValue->Encode());
+  }
+  return Write(&updates);
+}
+
+Status RedisListArrayImpl::BPop(const std::vector<Slice>& keys,
+                                uint64_t timeout,
+                                enum Side side,
+                                std::string* key,
+                                std::string* value,
+                                const std::function<void()>& beforeWait) noexcept {
+  std::vector<std::unique_lock<std::mutex>> locks = LockStripes(keys);
+  for (const Slice& candidate: keys) {
+    bool popped;
+    Status s = PopNode(candidate, side, value, &popped);
+    if (!s.ok() && !s.IsNotFound()) return s;
+    if (popped) {
+      *key = candidate.ToString();
+      return Status::OK();
+    }
+  }
+  Waiter waiter(side);
+  if (!Wait(keys, timeout, &waiter, &locks, beforeWait)) return Status::NotFound("Timed out");
+  *key = std::move(waiter.key);
+  *value = std::move(waiter.value);
+  return Status::OK();
+}
+
+Status RedisListArrayImpl::BLMove(const Slice& srcKey,
+                                  const Slice& dstKey,
+                                  enum Side srcSide,
+                                  enum Side dstSide,
+                                  uint64_t timeout,
+                                  std::string* value,
+                                  const std::function<void()>& beforeWait,
+                                  const std::function<void()>& afterWait) noexcept {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+  while (true) {
+    std::vector<std::unique_lock<std::mutex>> locks = LockStripes({srcKey, dstKey});
+    Status s = Move(srcKey, dstKey, srcSide, dstSide, value);
+    // The waiters queued behind this one get the elements left.
+    if (s.ok()) return Serve(srcKey);
+    if (!s.IsNotFound()) return s;
+    uint64_t remaining = 0;
+    if (timeout) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) return Status::NotFound("Timed out");
+      remaining = left.count();
+    }
+    // Woken up once an element is stored, which another caller may still
+    // take first, sending this one back to wait.
+    Waiter waiter(srcSide, true);
+    if (!Wait({srcKey}, remaining, &waiter, &locks, beforeWait)) return Status::NotFound("Timed out");
+    afterWait();
+  }
+}
+
+Status RedisListArrayImpl::ServeWaiters(const Slice& key) noexcept {
+  std::lock_guard<std::mutex> lock(StripeOf(key).mutex);
+  return Serve(key);
+}
+
+Status RedisListArrayImpl::Serve(const Slice& key) noexcept {
+  Stripe& stripe = StripeOf(key);
+  auto queue = stripe.waiters.find(key.ToString());
+  if (queue == stripe.waiters.end()) return Status::OK();
+  Status s;
+  while (!queue->second.waiters.empty()) {
+    Waiter* waiter = queue->second.waiters.front();
+    std::lock_guard<std::mutex> waiterLock(waiter->mutex);
+    if (!waiter->served) {
+      bool popped;
+      if (waiter->moves) {
+        // Left stored for the BLMove to move.
+        std::string rawListMetaValue;
+        s = db_->Get(ReadOptionsAt(snapshot_), key, &rawListMetaValue);
+        popped = s.ok() && ListMetaValue(rawListMetaValue).Length();
+      } else {
+        s = PopNode(key, waiter->side, &waiter->value, &popped);
+      }
+      if (s.IsNotFound() || (s.ok() && !popped)) queue->second.mayHoldElements = false;
+      if (!s.ok() || !popped) break;
+      waiter->key = key.ToString();
+      waiter->served = true;
+      waiter->cv.notify_one();
+      if (waiter->moves) {
+        queue->second.waiters.pop_front();
+        queue->second.mayHoldElements = true;
+        break;
+      }
+    }
+    queue->second.waiters.pop_front();
+  }
+  if (queue->second.waiters.empty()) stripe.waiters.erase(queue);
+  return s.IsNotFound() ? Status::OK() : s;
+}
+
+uint64_t RedisListArrayImpl::Waiters(const Slice& key) noexcept {
+  Stripe& stripe = StripeOf(key);
+  std::lock_guard<std::mutex> lock(stripe.mutex);
+  auto queue = stripe.waiters.find(key.ToString());
+  if (queue == stripe.waiters.end()) return 0;
+  uint64_t waiters = 0;
+  for (Waiter* waiter: queue->second.waiters) {
+    std::lock_guard<std::mutex> waiterLock(waiter->mutex);
+    if (!waiter->served) waiters++;
+  }
+  return waiters;
+}
+
+RedisListArrayImpl::StripeLock::StripeLock(RedisListArrayImpl* db, const Slice& key) noexcept:
+  db_(db),
+  lock_(db->StripeOf(key).mutex) {
+  // A transaction view only buffers its writes.
+  if (!db->IsTransactionView() && db->SyncsWrites()) deferred_.emplace(kAsyncDurability);
+}
+
+Status RedisListArrayImpl::StripeLock::Unlock(const Status& s) noexcept {
+  bool deferred = deferred_.has_value();
+  deferred_.reset();
+  lock_.unlock();
+  if (!s.ok() || !deferred) return s;
+  return db_->SyncWAL();
+}
+
+void RedisListArrayImpl::StripeLock::SyncLocked() noexcept {
+  deferred_.reset();
+}
+
+RedisListArrayImpl::Stripe& RedisListArrayImpl::StripeOf(const Slice& key) noexcept {
+  return (*stripes_)[std::hash<std::string_view>()(std::string_view(key.data(), key.size())) % kStripes];
+}
+
+std::vector<std::unique_lock<std::mutex>> RedisListArrayImpl::LockStripes(const std::vector<Slice>& keys) noexcept {
+  std::vector<Stripe*> stripes;
+  stripes.reserve(keys.size());
+  for (const Slice& key: keys) stripes.push_back(&StripeOf(key));
+  std::sort(stripes.begin(), stripes.end());
+  stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+  std::vector<std::unique_lock<std::mutex>> locks;
+  locks.reserve(stripes.size());
+  for (Stripe* stripe: stripes) locks.emplace_back(stripe->mutex);
+  return locks;
+}
+
+bool RedisListArrayImpl::HandOff(std::deque<Waiter*>* queue,
+                                 const Slice& key,
+                                 const std::vector<Slice>& values,
+                                 enum Side side,
+                                 std::vector<Slice>* remaining) noexcept {
+  // The list as the push would leave it, being empty before.
+  std::deque<Slice> elements;
+  for (const Slice& value: values) side == kLeft ? elements.push_front(value) : elements.push_back(value);
+  bool handedOff = false;
+  while (!queue->empty() && !elements.empty()) {
+    Waiter* waiter = queue->front();
+    queue->pop_front();
+    std::lock_guard<std::mutex> lock(waiter->mutex);
+    // Served through another of its keys, or by an earlier value of values.
+    if (waiter->served) continue;
+    waiter->key = key.ToString();
+    if (waiter->moves) {
+      waiter->served = true;
+      waiter->cv.notify_one();
+      break;
+    }
+    waiter->value = (waiter->side == kLeft ? elements.front() : elements.back()).ToString();
+    waiter->side == kLeft ? elements.pop_front() : elements.pop_back();
+    waiter->served = true;
+    waiter->cv.notify_one();
+    handedOff = true;
+  }
+  remaining->assign(elements.begin(), elements.end());
+  return handedOff;
+}
+
+bool RedisListArrayImpl::Wait(const std::vector<Slice>& keys,
+                              uint64_t timeout,
+                              Waiter* waiter,
+                              std::vector<std::unique_lock<std::mutex>>* locks,
+                              const std::function<void()>& beforeWait) noexcept {
+  for (const Slice& key: keys) StripeOf(key).waiters[key.ToString()].waiters.push_back(waiter);
+  locks->clear();
+  beforeWait();
+  {
+    std::unique_lock<std::mutex> lock(waiter->mutex);
+    auto served = [waiter] { return waiter->served; };
+    if (timeout) {
+      waiter->cv.wait_for(lock, std::chrono::milliseconds(timeout), served);
+    } else {
+      waiter->cv.wait(lock, served);
+    }
+  }
+  // A push may still serve the waiter until it leaves every queue.
+  for (const Slice& key: keys) {
+    Stripe& stripe = StripeOf(key);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto queue = stripe.waiters.find(key.ToString());
+    if (queue == stripe.waiters.end()) continue;
+    std::deque<Waiter*>& waiters = queue->second.waiters;
+    waiters.erase(std::remove(waiters.begin(), waiters.end(), waiter), waiters.end());
+    if (waiters.empty()) stripe.waiters.erase(queue);
+  }
+  std::lock_guard<std::mutex> lock(waiter->mutex);
+  return waiter->served;
+}
+
+void RedisListArrayImpl::DeleteOrphanNodes(const Slice& key,
+                                           const ListMetaValue& sourceMetaValue,
+                                           ListMetaValue* metaValue,
+                                           WriteBatch* updates) noexcept {
+  uint64_t deletes = 0;
+  uint64_t leftEnd = std::min(sourceMetaValue.rightmostIndex, metaValue->leftIndex - 1);
+  uint64_t index = sourceMetaValue.leftmostIndex;
+  for (; index <= leftEnd && deletes < kMaxOrphanDeletes; index++, deletes++) {
+    updates->Delete(ListNodeKey(key, index).Encode());
+  }
+  metaValue->leftmostIndex = index > leftEnd ? metaValue->leftIndex : std::min(index, metaValue->leftIndex);
+  uint64_t rightStart = std::max(sourceMetaValue.leftmostIndex, metaValue->rightIndex + 1);
+  index = sourceMetaValue.rightmostIndex;
+  for (; index >= rightStart && deletes < kMaxOrphanDeletes; index--, deletes++) {
+    updates->Delete(ListNodeKey(key, index).Encode());
+  }
+  metaValue->rightmostIndex = index < rightStart ? metaValue->rightIndex : std::max(index, metaValue->rightIndex);
+}
+
+std::string RedisListArrayImpl::NodeSeparators() const noexcept {
+  return "\x7f\x80";
 }
 
 inline InternalIndex RedisListArrayImpl::GetInternalIndex(UserIndex userIndex, ListMetaValue metaValue) noexcept {
@@ -1,8 +1,15 @@
 #ifndef MERODIS_REDIS_LIST_ARRAY_IMPL_H
 #define MERODIS_REDIS_LIST_ARRAY_IMPL_H
 
+#include <array>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "redis_list.h"
@@ -22,10 +29,16 @@ struct ListMetaValue {
   ~ListMetaValue() noexcept = default;
 
   uint64_t Length() const;
-  Slice Encode() const;
+  // Holds the window alone unless nodes outside of it may still be stored.
+  std::string Encode() const;
 
   uint64_t leftIndex;
   uint64_t rightIndex;
+  // The outermost indices that may still hold a node retired from the
+  // window, left behind by the writes that retire more nodes than
+  // DeleteOrphanNodes deletes at once. The bounds of the window if none.
+  uint64_t leftmostIndex;
+  uint64_t rightmostIndex;
 };
 
 struct ListNodeKey {
@@ -47,6 +60,17 @@ public:
   RedisListArrayImpl() noexcept;
   ~RedisListArrayImpl() noexcept final;
 
+  Status Open(const Options& options, const TypeOptions& typeOptions, const std::string& db_path) noexcept override;
+  Status Open(DB* db) noexcept override;
+  // The views share the stripes of base, see Stripe.
+  Status OpenSnapshot(const Redis& base) noexcept override;
+  Status OpenTransaction(const Redis& base) noexcept override;
+
+  Status EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept override;
+  // The node indices start from the middle of their range, so the keys
+  // of the nodes follow the key of their list with '\x7f' or '\x80'.
+  std::string NodeSeparators() const noexcept override;
+
   Status LLen(const Slice& key, uint64_t* len) noexcept override;
   Status LIndex(const Slice& key, UserIndex index, std::string* value) noexcept final;
   Status LPos(const Slice& key, const Slice& value, int64_t rank, int64_t count, int64_t maxlen, std::vector<uint64_t>* indices) noexcept final;
@@ -60,10 +84,129 @@ public:
   Status LInsert(const Slice& key, const BeforeOrAfter& beforeOrAfter, const Slice& pivotValue, const Slice& value) noexcept final;
   Status LRem(const Slice& key, int64_t count, const Slice& value, uint64_t* removedCount) noexcept final;
   Status LMove(const Slice& srcKey, const Slice& dstKey, enum Side srcSide, enum Side dstSide, std::string* value) noexcept final;
+  Status BPop(const std::vector<Slice>& keys,
+              uint64_t timeout,
+              enum Side side,
+              std::string* key,
+              std::string* value,
+              const std::function<void()>& beforeWait) noexcept final;
+  Status BLMove(const Slice& srcKey,
+                const Slice& dstKey,
+                enum Side srcSide,
+                enum Side dstSide,
+                uint64_t timeout,
+                std::string* value,
+                const std::function<void()>& beforeWait,
+                const std::function<void()>& afterWait) noexcept final;
+  Status ServeWaiters(const Slice& key) noexcept final;
+  uint64_t Waiters(const Slice& key) noexcept final;
 
 private:
+  // A caller of BPop or BLMove waiting on its empty lists, registered on
+  // each of their keys until a push serves it or its timeout passes.
+  struct Waiter {
+    explicit Waiter(enum Side side, bool moves = false) noexcept;
+
+    enum Side side;
+    // Whether the waiter is a BLMove, which is only woken up when served
+    // and then moves the element itself, so that the element is stored in
+    // one of the lists all along. The push serving it stores the elements
+    // left from it on.
+    bool moves;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool served;
+    std::string key;
+    std::string value;
+  };
+  // The callers waiting on one list, oldest first. A list only has waiters
+  // while empty, as a push serves them before storing, or while holding
+  // the elements left for a BLMove woken up to move one.
+  struct WaiterQueue {
+    std::deque<Waiter*> waiters;
+    // Whether the list may hold such elements, which go to the waiters
+    // first. Otherwise it is known to be empty.
+    bool mayHoldElements = false;
+  };
+  // The writes to the lists hashed to a stripe take turns on its mutex,
+  // which also guards their waiter queues. Each write reads the meta value
+  // the previous one wrote, so the mutex is held across the engine write,
+  // and the stripes are many, so unrelated lists seldom wait on each other.
+  // The snapshot and transaction views share the stripes of their base,
+  // whose waiters they neither serve nor join.
+  struct Stripe {
+    std::mutex mutex;
+    std::unordered_map<std::string, WaiterQueue> waiters;
+  };
+  static constexpr size_t kStripes = 4096;
+  typedef std::array<Stripe, kStripes> Stripes;
+  // Holds the stripe of a list across a write to it, which is only synced,
+  // if it is to be, once Unlock releases the stripe, so the next writes to
+  // the list do not wait for the sync. The WAL keeps the writes in order,
+  // so none of them survives a crash without the ones it read. Not for the
+  // writes serving waiters, which hand the elements over at once.
+  class StripeLock {
+  public:
+    explicit StripeLock(RedisListArrayImpl* db, const Slice& key) noexcept;
+
+    // Releases the stripe, then syncs the write that returned s, if any.
+    Status Unlock(const Status& s) noexcept;
+    // Syncs the writes made from now on before Unlock releases the stripe.
+    void SyncLocked() noexcept;
+
+  private:
+    RedisListArrayImpl* db_;
+    std::unique_lock<std::mutex> lock_;
+    std::optional<DurabilityScope> deferred_;
+  };
+
+  Stripe& StripeOf(const Slice& key) noexcept;
+  // Whether this is no view, the only one to serve waiters.
+  bool ServesWaiters() const noexcept { return !snapshot_ && !IsTransactionView(); }
+  // Locks the stripes of keys, each once and in order.
+  std::vector<std::unique_lock<std::mutex>> LockStripes(const std::vector<Slice>& keys) noexcept;
+  // Hands the elements of values, pushed on side of key, to the waiters in
+  // queue, one each, up to the first BLMove, which is woken up instead, and
+  // leaves the rest in *remaining from left to right. Returns whether any
+  // was handed over.
+  static bool HandOff(std::deque<Waiter*>* queue,
+                      const Slice& key,
+                      const std::vector<Slice>& values,
+                      enum Side side,
+                      std::vector<Slice>* remaining) noexcept;
+  // Registers waiter on keys, releases locks, the stripes of keys, runs
+  // beforeWait and waits up to timeout milliseconds, forever if 0, to be
+  // served. Returns whether it was.
+  bool Wait(const std::vector<Slice>& keys,
+            uint64_t timeout,
+            Waiter* waiter,
+            std::vector<std::unique_lock<std::mutex>>* locks,
+            const std::function<void()>& beforeWait) noexcept;
+  // Push, Pop and LMove on the storage alone, with the stripes locked.
+  Status PushNodes(const Slice& key, const std::vector<Slice>& values, bool createListIfNotFound, enum Side side) noexcept;
+  Status PopNode(const Slice& key, enum Side side, std::string* value, bool* popped) noexcept;
+  Status MoveNode(const Slice& srcKey, const Slice& dstKey, enum Side srcSide, enum Side dstSide, std::string* value) noexcept;
+  // LMove, serving the waiters on dstKey, with the stripes locked.
+  Status Move(const Slice& srcKey, const Slice& dstKey, enum Side srcSide, enum Side dstSide, std::string* value) noexcept;
+  // ServeWaiters, with the stripe of key locked.
+  Status Serve(const Slice& key) noexcept;
+  // Deletes the nodes sourceMetaValue may still hold outside the window of
+  // metaValue, which are unreachable once metaValue is written, up to
+  // kMaxOrphanDeletes of them from the outermost in, so a trim of millions
+  // of elements stays one small write. The bounds of the nodes left are
+  // kept in metaValue, for the next writes to the list to delete. The
+  // stored keys can not be told apart from the keys of other lists they
+  // extend, so nothing else sweeps them.
+  static void DeleteOrphanNodes(const Slice& key,
+                                const ListMetaValue& sourceMetaValue,
+                                ListMetaValue* metaValue,
+                                WriteBatch* updates) noexcept;
   static inline InternalIndex GetInternalIndex(UserIndex userIndex, ListMetaValue meta) noexcept;
   static inline bool IsValidInternalIndex(InternalIndex internalIndex, ListMetaValue meta) noexcept;
+
+  static constexpr uint64_t kMaxOrphanDeletes = 4096;
+
+  std::shared_ptr<Stripes> stripes_;
 };
 
 }
@@ -3,11 +3,14 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <deque>
 #include <queue>
 #include <map>
+#include <optional>
 #include <set>
 #include <algorithm>
 
+#include "layout.h"
 #include "util/random.h"
 
 namespace merodis {
@@ -17,6 +20,17 @@ RedisSetBasicImpl::RedisSetBasicImpl() noexcept = default;
 //RedisSetBasicImpl::RedisSetBasicImpl(bool MemoryMeta) noexcept: MemoryMeta(MemoryMeta), len(0) {}
 //
 RedisSetBasicImpl::~RedisSetBasicImpl() noexcept = default;
+
+Status RedisSetBasicImpl::EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept {
+  if (record.members.empty()) return Status::OK();
+  SetMetaValue metaValue;
+  metaValue.len = record.members.size();
+  kvs->emplace_back(record.key, metaValue.Encode());
+  for (const auto& member: record.members) {
+    kvs->emplace_back(SetNodeKey(record.key, metaValue.version, member).Encode().ToString(), "");
+  }
+  return Status::OK();
+}
 //
 //Status RedisSetBasicImpl::Open(const Options& options, const std::string& db_path) noexcept {
 //  Status s = Redis::Open(options, db_path);
@@ -25,27 +39,46 @@ RedisSetBasicImpl::~RedisSetBasicImpl() noexcept = default;
 //}
 //
 Status RedisSetBasicImpl::Del(const Slice& key) {
-  Iterator* iter = db_->NewIterator(ReadOptions());
-  iter->Seek(key);
-  if (!iter->Valid() || iter->key() != key) {
-    delete iter;
-    return Status::OK();
-  }
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
+  if (s.IsNotFound()) return Status::OK();
+  if (!s.ok()) return s;
+  metaValue.len = 0;
+  metaValue.version += 1;
+  return Put(key, metaValue.Encode());
+}
 
-  WriteBatch updates;
-  updates.Delete(iter->key());
-  for (iter->Next(); iter->Valid() && IsMemberKey(iter->key(), key.size()); iter->Next()) {
-    updates.Delete(iter->key());
-  }
-  delete iter;
-  return db_->Write(WriteOptions(), &updates);
+Status RedisSetBasicImpl::ReclaimStaleVersions(std::shared_mutex* commits) noexcept {
+  return ReclaimStaleNodes(commits);
+}
+
+Status RedisSetBasicImpl::UpgradeLayout() noexcept {
+  return AddNodeVersions();
+}
+
+Status RedisSetBasicImpl::IsNodeOf(const Slice& metaKey,
+                                   const Slice& rawKey,
+                                   const Slice& value,
+                                   bool versioned,
+                                   bool,
+                                   const ReadOptions&,
+                                   bool* isNode) noexcept {
+  size_t prefixSize = metaKey.size() + 1 + (versioned ? sizeof(uint64_t) : 0);
+  *isNode = rawKey[metaKey.size()] == '\0' && rawKey.size() >= prefixSize && value.empty();
+  return Status::OK();
+}
+
+std::string RedisSetBasicImpl::NodeSeparators() const noexcept {
+  return std::string(1, '\0');
 }
 
 Status RedisSetBasicImpl::SCard(const Slice& key,
                                 uint64_t* len) {
   std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
-  if (s.ok()) {
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawSetMetaValue);
+  if (s.ok() && !SetMetaValue::IsVersioned(rawSetMetaValue)) {
+    s = Status::Corruption("Set meta value without a version", key);
+  } else if (s.ok()) {
     SetMetaValue metaValue(rawSetMetaValue);
     *len = metaValue.len;
   } else if (s.IsNotFound()) {
@@ -58,54 +91,52 @@ Status RedisSetBasicImpl::SCard(const Slice& key,
 Status RedisSetBasicImpl::SIsMember(const Slice& key,
                                     const Slice& setKey,
                                     bool* isMember) {
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
+  *isMember = false;
+  if (s.IsNotFound()) return Status::OK();
+  if (!s.ok()) return s;
   std::string _;
-  SetNodeKey nodeKey(key, setKey);
-  *isMember = db_->Get(ReadOptions(), nodeKey.Encode(), &_).ok();
+  SetNodeKey nodeKey(key, metaValue.version, setKey);
+  *isMember = db_->Get(ReadOptionsAt(snapshot_), nodeKey.Encode(), &_).ok();
   return Status::OK();
 }
 
 Status RedisSetBasicImpl::SMIsMember(const Slice& key,
                                      const std::set<Slice>& keys,
                                      std::vector<bool>* isMembers) {
-  Iterator* iter = db_->NewIterator(ReadOptions());
-  iter->Seek(key);
-  iter->Next();
-  std::set<Slice>::const_iterator queryIter = keys.cbegin();
-  while (iter->Valid() && queryIter != keys.cend()) {
-    int cmp = queryIter->compare({iter->key().data() + key.size() + 1,
-                                  iter->key().size() - key.size() - 1});
-    if (cmp == 0) {
-      ++queryIter;
-      iter->Next();
-      isMembers->push_back(true);
-    } else if (cmp > 0) {
-      iter->Next();
-    } else {
-      ++queryIter;
-      isMembers->push_back(false);
-    }
+  ScopedSnapshot snapshot(db_, snapshot_);
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
+  if (s.IsNotFound()) {
+    isMembers->insert(isMembers->end(), keys.size(), false);
+    return Status::OK();
   }
-  if (queryIter != keys.cend()) {
-    std::vector<bool> falseVector(std::distance(queryIter, keys.cend()), false);
-    isMembers->insert(isMembers->end(), falseVector.begin(), falseVector.end());
+  if (!s.ok()) return s;
+  std::vector<std::string> nodeKeys;
+  nodeKeys.reserve(keys.size());
+  for (const auto& setKey: keys) {
+    nodeKeys.push_back(SetNodeKey(key, metaValue.version, setKey).Encode().ToString());
   }
-  delete iter;
+  NodeScanOptions options(key, snapshot.get());
+  std::vector<std::optional<std::string>> nodeValues;
+  s = MultiGetNodes(options, nodeKeys, metaValue.len, &nodeValues);
+  if (!s.ok()) return s;
+  for (const auto& nodeValue: nodeValues) isMembers->push_back(nodeValue.has_value());
   return Status::OK();
 }
 
 Status RedisSetBasicImpl::SMembers(const Slice& key,
                                    std::vector<std::string>* keys) {
-  Iterator* iter = db_->NewIterator(ReadOptions());
-  iter->Seek(key);
-  if (!iter->Valid() || iter->key() != key) {
+  NodeScanOptions options(key, snapshot_, IsBulkRead(key, snapshot_));
+  Iterator* iter = db_->NewIterator(options);
+  std::string prefix;
+  if (!SeekMembers(iter, key, &prefix)) {
     delete iter;
     return Status::OK();
   };
-  iter->Next();
-  for (; iter->Valid(); iter->Next()) {
-    if (iter->key().size() <= key.size() || iter->key()[key.size()] != 0) break;
-    SetNodeKey nodeKey(iter->key(), key.size());
-    keys->push_back(nodeKey.setKey().ToString());
+  for (; iter->Valid() && IsMemberKey(iter->key(), prefix); iter->Next()) {
+    keys->push_back(GetMember(iter, prefix.size()).ToString());
   }
   delete iter;
   return Status::OK();
@@ -113,23 +144,23 @@ Status RedisSetBasicImpl::SMembers(const Slice& key,
 
 Status RedisSetBasicImpl::SRandMember(const Slice& key,
                                       std::string* member) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
+  ScopedSnapshot snapshot(db_, snapshot_);
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
   if (!s.ok()) return s;
-  SetMetaValue metaValue = SetMetaValue(rawSetMetaValue);
 
   if (metaValue.len == 0) return Status::NotFound("empty set");
   uint64_t index = rand_uint64(0, metaValue.len - 1);
 
-  Iterator* iter = db_->NewIterator(ReadOptions());
-  iter->Seek(key);
-  iter->Next();
+  NodeScanOptions options(key, snapshot.get());
+  Iterator* iter = db_->NewIterator(options);
+  std::string prefix;
+  SeekMembers(iter, key, &prefix);
   while (index--) {
     assert(iter->Valid());
     iter->Next();
   }
-  SetNodeKey nodeKey(iter->key(), key.size());
-  *member = nodeKey.setKey().ToString();
+  *member = GetMember(iter, prefix.size()).ToString();
   delete iter;
   return Status::OK();
 }
@@ -137,10 +168,10 @@ Status RedisSetBasicImpl::SRandMember(const Slice& key,
 Status RedisSetBasicImpl::SRandMember(const Slice& key,
                                       int64_t count,
                                       std::vector<std::string>* members) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
+  ScopedSnapshot snapshot(db_, snapshot_);
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
   if (!s.ok()) return s;
-  SetMetaValue metaValue = SetMetaValue(rawSetMetaValue);
 
   if (count == 0) return Status::OK();
   std::vector<std::uint64_t> indices;
@@ -160,17 +191,17 @@ Status RedisSetBasicImpl::SRandMember(const Slice& key,
     offsets[c] = indices[c] - indices[c - 1];
   }
 
-  Iterator* iter = db_->NewIterator(ReadOptions());
-  iter->Seek(key);
-  iter->Next();
+  NodeScanOptions options(key, snapshot.get());
+  Iterator* iter = db_->NewIterator(options);
+  std::string prefix;
+  SeekMembers(iter, key, &prefix);
   for (auto offset: offsets) {
     while (offset) {
       assert(iter->Valid());
       iter->Next();
       offset--;
     }
-    SetNodeKey nodeKey(iter->key(), key.size());
-    members->push_back(nodeKey.setKey().ToString());
+    members->push_back(GetMember(iter, prefix.size()).ToString());
   }
   delete iter;
   std::shuffle(members->begin(), members->end(), std::mt19937{std::random_device{}()});
@@ -181,56 +212,55 @@ Status RedisSetBasicImpl::SRandMember(const Slice& key,
 Status RedisSetBasicImpl::SAdd(const Slice& key,
                                const Slice& setKey,
                                uint64_t* count) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
   SetMetaValue metaValue;
-  if (s.ok()) metaValue = SetMetaValue(rawSetMetaValue);
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
+  if (!s.ok() && !s.IsNotFound()) return s;
 
   WriteBatch updates;
-  SetNodeKey nodeKey(key, setKey);
+  SetNodeKey nodeKey(key, metaValue.version, setKey);
 
-  *count = 1 - CountKeyIntersection(key, nodeKey);
+  *count = 1 - CountKeyIntersection(key, nodeKey, snapshot_);
   if (*count == 0) return Status::OK();
   metaValue.len += 1;
   updates.Put(key, metaValue.Encode());
   updates.Put(nodeKey.Encode(), "");
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisSetBasicImpl::SAdd(const Slice& key,
                                const std::set<Slice>& keys,
                                uint64_t* count) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
+  ScopedSnapshot snapshot(db_, snapshot_);
   SetMetaValue metaValue;
-  if (s.ok()) metaValue = SetMetaValue(rawSetMetaValue);
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
+  if (!s.ok() && !s.IsNotFound()) return s;
   WriteBatch updates;
   *count = 0;
 
   std::set<Slice>::const_iterator updatesIter = keys.cbegin();
   if (metaValue.len) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
-    iter->Seek(key);
-    iter->Next();
-    while (iter->Valid() && updatesIter != keys.cend()) {
-      int cmp = updatesIter->compare({iter->key().data() + key.size() + 1,
-                                      iter->key().size() - key.size() - 1});
+    NodeScanOptions options(key, snapshot.get());
+    Iterator* iter = db_->NewIterator(options);
+    std::string prefix;
+    SeekMembers(iter, key, &prefix);
+    while (iter->Valid() && IsMemberKey(iter->key(), prefix) && updatesIter != keys.cend()) {
+      int cmp = updatesIter->compare(GetMember(iter, prefix.size()));
       if (cmp == 0) {
         ++updatesIter;
         iter->Next();
       } else if (cmp > 0) {
         iter->Next();
       } else {
-        ++updatesIter;
-        SetNodeKey nodeKey(key, *updatesIter);
+        SetNodeKey nodeKey(key, metaValue.version, *updatesIter);
         updates.Put(nodeKey.Encode(), "");
+        ++updatesIter;
         *count += 1;
       }
     }
     delete iter;
   }
   while (updatesIter != keys.cend()) {
-    SetNodeKey nodeKey(key, *updatesIter);
+    SetNodeKey nodeKey(key, metaValue.version, *updatesIter);
     updates.Put(nodeKey.Encode(), "");
     updatesIter++;
     *count += 1;
@@ -240,20 +270,19 @@ Status RedisSetBasicImpl::SAdd(const Slice& key,
     metaValue.len += *count;
     updates.Put(key, metaValue.Encode());
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisSetBasicImpl::SRem(const Slice& key,
                                const Slice& member,
                                uint64_t* count) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
   if (!s.ok()) return s;
-  SetMetaValue metaValue = SetMetaValue(rawSetMetaValue);
 
-  SetNodeKey nodeKey(key, member);
+  SetNodeKey nodeKey(key, metaValue.version, member);
   std::string _;
-  s = db_->Get(ReadOptions(), nodeKey.Encode(), &_);
+  s = db_->Get(ReadOptionsAt(snapshot_), nodeKey.Encode(), &_);
   if (!s.ok() && !s.IsNotFound()) return s;
   if (s.IsNotFound()) {
     *count = 0;
@@ -265,30 +294,29 @@ Status RedisSetBasicImpl::SRem(const Slice& key,
   metaValue.len -= 1;
   updates.Put(key, metaValue.Encode());
   updates.Delete(nodeKey.Encode());
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisSetBasicImpl::SRem(const Slice& key,
                                const std::set<Slice>& members,
                                uint64_t* count) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
+  ScopedSnapshot snapshot(db_, snapshot_);
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
   if (!s.ok()) return s;
-  SetMetaValue metaValue = SetMetaValue(rawSetMetaValue);
 
   WriteBatch updates;
   *count = 0;
 
   std::set<Slice>::const_iterator updatesIter = members.cbegin();
-  Iterator *iter = db_->NewIterator(ReadOptions());
-  iter->Seek(key);
-  iter->Next();
-  while (iter->Valid() && updatesIter != members.cend()) {
-    int cmp = updatesIter->compare({iter->key().data() + key.size() + 1,
-                                    iter->key().size() - key.size() - 1});
+  NodeScanOptions options(key, snapshot.get());
+  Iterator* iter = db_->NewIterator(options);
+  std::string prefix;
+  SeekMembers(iter, key, &prefix);
+  while (iter->Valid() && IsMemberKey(iter->key(), prefix) && updatesIter != members.cend()) {
+    int cmp = updatesIter->compare(GetMember(iter, prefix.size()));
     if (cmp == 0) {
-      SetNodeKey nodeKey(key, *updatesIter);
-      updates.Delete(nodeKey.Encode());
+      updates.Delete(iter->key());
       *count += 1;
       ++updatesIter;
       iter->Next();
@@ -303,15 +331,14 @@ Status RedisSetBasicImpl::SRem(const Slice& key,
     metaValue.len -= *count;
     updates.Put(key, metaValue.Encode());
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisSetBasicImpl::SPop(const Slice& key,
                                std::string* member) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
   if (!s.ok()) return s;
-  SetMetaValue metaValue = SetMetaValue(rawSetMetaValue);
 
   s = SRandMember(key, member);
   if (!s.ok()) return s;
@@ -319,18 +346,17 @@ Status RedisSetBasicImpl::SPop(const Slice& key,
   WriteBatch updates;
   metaValue.len -= 1;
   updates.Put(key, metaValue.Encode());
-  SetNodeKey nodeKey(key, *member);
+  SetNodeKey nodeKey(key, metaValue.version, *member);
   updates.Delete(nodeKey.Encode());
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisSetBasicImpl::SPop(const Slice& key,
                                uint64_t count,
                                std::vector<std::string>* members) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawSetMetaValue);
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
   if (!s.ok()) return s;
-  SetMetaValue metaValue = SetMetaValue(rawSetMetaValue);
 
   s = SRandMember(key, (int64_t)count, members);
   if (!s.ok()) return s;
@@ -340,23 +366,23 @@ Status RedisSetBasicImpl::SPop(const Slice& key,
   metaValue.len -= members->size();
   updates.Put(key, metaValue.Encode());
   for (const auto& member: *members) {
-    SetNodeKey nodeKey(key, member);
+    SetNodeKey nodeKey(key, metaValue.version, member);
     updates.Delete(nodeKey.Encode());
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisSetBasicImpl::SMove(const Slice& srcKey,
                                 const Slice& dstKey,
                                 const Slice& member,
                                 uint64_t* count) {
-  std::string rawSetMetaValue;
-  Status s = db_->Get(ReadOptions(), srcKey, &rawSetMetaValue);
+  ScopedSnapshot snapshot(db_, snapshot_);
+  SetMetaValue metaValue;
+  Status s = GetMetaValue(srcKey, &metaValue, snapshot.get());
   if (!s.ok()) return s;
-  SetMetaValue metaValue = SetMetaValue(rawSetMetaValue);
-  SetNodeKey nodeKey(srcKey, member);
+  SetNodeKey nodeKey(srcKey, metaValue.version, member);
   std::string _;
-  s = db_->Get(ReadOptions(), nodeKey.Encode(), &_);
+  s = db_->Get(ReadOptionsAt(snapshot.get()), nodeKey.Encode(), &_);
   if (!s.ok() && !s.IsNotFound()) return s;
   if (s.IsNotFound()) {
     *count = 0;
@@ -368,71 +394,77 @@ Status RedisSetBasicImpl::SMove(const Slice& srcKey,
   updates.Put(srcKey, metaValue.Encode());
   updates.Delete(nodeKey.Encode());
 
-  s = db_->Get(ReadOptions(), dstKey, &rawSetMetaValue);
-  if (s.ok()) metaValue = SetMetaValue(rawSetMetaValue);
-  nodeKey = SetNodeKey(dstKey, member);
-  if (!CountKeyIntersection(dstKey, nodeKey)) {
+  if (dstKey != srcKey) {
+    metaValue = SetMetaValue();
+    s = GetMetaValue(dstKey, &metaValue, snapshot.get());
+    if (!s.ok() && !s.IsNotFound()) return s;
+  }
+  nodeKey = SetNodeKey(dstKey, metaValue.version, member);
+  if (!CountKeyIntersection(dstKey, nodeKey, snapshot.get())) {
     metaValue.len += 1;
     updates.Put(dstKey, metaValue.Encode());
     updates.Put(nodeKey.Encode(), "");
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisSetBasicImpl::SUnion(const std::vector<Slice>& keys, std::vector<std::string>* members) {
-  std::map<Iterator*, Slice> iter2key;
+  ScopedSnapshot snapshot(db_, snapshot_);
+  std::deque<NodeScanOptions> options;
+  std::map<Iterator*, std::string> iter2prefix;
   for (const auto& key: keys) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
-    iter->Seek(key);
-    if (iter->Valid() && iter->key() == key) {
-      iter->Next();
-      iter2key[iter] = key;
+    options.emplace_back(key, snapshot.get(), IsBulkRead(key, snapshot.get()));
+    Iterator* iter = db_->NewIterator(options.back());
+    std::string prefix;
+    if (SeekMembers(iter, key, &prefix) && iter->Valid() && IsMemberKey(iter->key(), prefix)) {
+      iter2prefix[iter] = prefix;
     } else {
       delete iter;
     }
   }
-  SetIteratorComparator cmp(iter2key);
+  SetIteratorComparator cmp(iter2prefix);
   std::priority_queue<Iterator*, std::vector<Iterator*>, decltype(cmp)> iters(cmp);
-  for (const auto& [key, _]: iter2key) {
+  for (const auto& [key, _]: iter2prefix) {
     iters.push(key);
   }
 
   while (!iters.empty()) {
     Iterator* top = iters.top();
     iters.pop();
-    Slice topKey = iter2key[top];
-    SetNodeKey nodeKey(top->key(), topKey.size());
-    std::string newMember = nodeKey.setKey().ToString();
+    const std::string& topPrefix = iter2prefix[top];
+    std::string newMember = GetMember(top, topPrefix.size()).ToString();
     if (members->empty() || members->back() != newMember) {
       members->push_back(newMember);
     }
     top->Next();
-    if (top->Valid() && IsMemberKey(top->key(), topKey.size())) {
+    if (top->Valid() && IsMemberKey(top->key(), topPrefix)) {
       iters.push(top);
     }
   }
-  for (const auto& [iter, _]: iter2key) delete iter;
+  for (const auto& [iter, _]: iter2prefix) delete iter;
   return Status::OK();
 }
 
 Status RedisSetBasicImpl::SInter(const std::vector<Slice>& keys, std::vector<std::string>* members) {
-  std::map<Iterator*, Slice> iter2key;
+  ScopedSnapshot snapshot(db_, snapshot_);
+  std::deque<NodeScanOptions> options;
+  std::map<Iterator*, std::string> iter2prefix;
   for (const auto& key: keys) {
-    Iterator* iter = db_->NewIterator(ReadOptions());
-    iter->Seek(key);
-    if (!iter->Valid() || iter->key() != key) {
-      for (const auto& [k, _]: iter2key) {
+    options.emplace_back(key, snapshot.get(), IsBulkRead(key, snapshot.get()));
+    Iterator* iter = db_->NewIterator(options.back());
+    std::string prefix;
+    if (!SeekMembers(iter, key, &prefix) || !iter->Valid() || !IsMemberKey(iter->key(), prefix)) {
+      for (const auto& [k, _]: iter2prefix) {
         delete k;
       }
       delete iter;
       return Status::OK();
     }
-    iter->Next();
-    iter2key[iter] = key;
+    iter2prefix[iter] = prefix;
   }
-  SetIteratorComparator cmp(iter2key);
+  SetIteratorComparator cmp(iter2prefix);
   std::priority_queue<Iterator*, std::vector<Iterator*>, decltype(cmp)> iters(cmp);
-  for (const auto& [key, _]: iter2key) {
+  for (const auto& [key, _]: iter2prefix) {
     iters.push(key);
   }
 
@@ -442,9 +474,8 @@ Status RedisSetBasicImpl::SInter(const std::vector<Slice>& keys, std::vector<std
   while (!iters.empty()) {
     Iterator* top = iters.top();
     iters.pop();
-    Slice topKey = iter2key[top];
-    SetNodeKey nodeKey(top->key(), topKey.size());
-    std::string minMember = nodeKey.setKey().ToString();
+    const std::string& topPrefix = iter2prefix[top];
+    std::string minMember = GetMember(top, topPrefix.size()).ToString();
     if (minMember == currentMinMember) {
       minMemberCounter += 1;
       if (minMemberCounter == keys.size()) {
@@ -456,44 +487,45 @@ Status RedisSetBasicImpl::SInter(const std::vector<Slice>& keys, std::vector<std
     }
 
     top->Next();
-    if (top->Valid() && IsMemberKey(top->key(), topKey.size())) {
+    if (top->Valid() && IsMemberKey(top->key(), topPrefix)) {
       iters.push(top);
     }
   }
-  for (const auto& [iter, _]: iter2key) delete iter;
+  for (const auto& [iter, _]: iter2prefix) delete iter;
   return Status::OK();
 }
 
 Status RedisSetBasicImpl::SDiff(const std::vector<Slice>& keys, std::vector<std::string>* members) {
-  Iterator* baseIter = db_->NewIterator(ReadOptions());
-  Slice baseKey = keys.front();
-  baseIter->Seek(baseKey);
-  if (!baseIter->Valid() || baseIter->key() != baseKey) {
+  ScopedSnapshot snapshot(db_, snapshot_);
+  std::deque<NodeScanOptions> options;
+  options.emplace_back(keys.front(), snapshot.get(), IsBulkRead(keys.front(), snapshot.get()));
+  Iterator* baseIter = db_->NewIterator(options.back());
+  std::string basePrefix;
+  if (!SeekMembers(baseIter, keys.front(), &basePrefix)) {
     delete baseIter;
     return Status::OK();
   }
-  baseIter->Next();
 
-  std::map<Iterator*, Slice> iter2key;
+  std::map<Iterator*, std::string> iter2prefix;
   for (auto it = std::next(keys.begin()); it != keys.end(); it++) {
-    Slice key = *it;
-    Iterator* iter = db_->NewIterator(ReadOptions());
-    iter->Seek(key);
-    if (iter->Valid() && iter->key() == key) {
-      iter->Next();
-      iter2key[iter] = key;
+    options.emplace_back(*it, snapshot.get());
+    Iterator* iter = db_->NewIterator(options.back());
+    std::string prefix;
+    if (SeekMembers(iter, *it, &prefix)) {
+      iter2prefix[iter] = prefix;
     } else {
       delete iter;
     }
   }
 
-  while (baseIter->Valid() && IsMemberKey(baseIter->key(), baseKey.size())) {
+  std::string memberKey;
+  while (baseIter->Valid() && IsMemberKey(baseIter->key(), basePrefix)) {
     bool save = true;
-    Slice baseMember = GetMember(baseIter, baseKey.size());
-    for (const auto& [iter, key]: iter2key) {
-      SetNodeKey nodeKey(key, baseMember);
-      iter->Seek(nodeKey.Encode());
-      if (GetMember(iter, key.size()) == baseMember) {
+    Slice baseMember = GetMember(baseIter, basePrefix.size());
+    for (const auto& [iter, prefix]: iter2prefix) {
+      memberKey.assign(prefix).append(baseMember.data(), baseMember.size());
+      iter->Seek(memberKey);
+      if (iter->Valid() && iter->key() == memberKey) {
         save = false;
         break;
       }
@@ -502,7 +534,7 @@ Status RedisSetBasicImpl::SDiff(const std::vector<Slice>& keys, std::vector<std:
     baseIter->Next();
   }
   delete baseIter;
-  for (const auto& [iter, _]: iter2key) {
+  for (const auto& [iter, _]: iter2prefix) {
     delete iter;
   }
   return Status::OK();
@@ -542,18 +574,40 @@ Status RedisSetBasicImpl::SDiffStore(const std::vector<Slice>& keys, const Slice
 }
 
 
-Slice RedisSetBasicImpl::GetMember(Iterator* iter, uint64_t keySize) {
-  return Slice{iter->key().data() + keySize + 1, iter->key().size() - keySize - 1};
+Status RedisSetBasicImpl::GetMetaValue(const Slice& key,
+                                       SetMetaValue* metaValue,
+                                       const DB_ENGINE::Snapshot* snapshot) {
+  std::string rawSetMetaValue;
+  Status s = db_->Get(ReadOptionsAt(snapshot), key, &rawSetMetaValue);
+  if (!s.ok()) return s;
+  if (!SetMetaValue::IsVersioned(rawSetMetaValue)) return Status::Corruption("Set meta value without a version", key);
+  *metaValue = SetMetaValue(rawSetMetaValue);
+  return s;
+}
+
+bool RedisSetBasicImpl::SeekMembers(Iterator* iter, const Slice& key, std::string* prefix) {
+  iter->Seek(key);
+  if (!iter->Valid() || iter->key() != key || !SetMetaValue::IsVersioned(iter->value())) return false;
+  SetMetaValue metaValue(iter->value().ToString());
+  *prefix = SetNodeKey(key, metaValue.version, "").Encode().ToString();
+  iter->Seek(*prefix);
+  return true;
+}
+
+Slice RedisSetBasicImpl::GetMember(Iterator* iter, uint64_t prefixSize) {
+  return Slice{iter->key().data() + prefixSize, iter->key().size() - prefixSize};
 }
 
-uint64_t RedisSetBasicImpl::CountKeyIntersection(const Slice& key, const SetNodeKey& nodeKey) {
+uint64_t RedisSetBasicImpl::CountKeyIntersection(const Slice& key,
+                                                 const SetNodeKey& nodeKey,
+                                                 const DB_ENGINE::Snapshot* snapshot) {
   std::string _;
-  Status s = db_->Get(ReadOptions(), nodeKey.Encode(), &_);
+  Status s = db_->Get(ReadOptionsAt(snapshot), nodeKey.Encode(), &_);
   return s.ok();
 }
 
-bool RedisSetBasicImpl::IsMemberKey(const Slice& iterKey, uint64_t keySize) {
-  return iterKey.size() > keySize && iterKey[keySize] == 0;
+bool RedisSetBasicImpl::IsMemberKey(const Slice& iterKey, const Slice& prefix) {
+  return iterKey.starts_with(prefix);
 }
 
 //void RedisSetBasicImpl::ReloadLens() {
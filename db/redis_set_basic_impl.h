@@ -14,55 +14,69 @@ namespace merodis {
 
 class SetIteratorComparator {
 public:
-  explicit SetIteratorComparator(std::map<Iterator*, Slice>& iter2key): iter2key(iter2key) {}
+  explicit SetIteratorComparator(std::map<Iterator*, std::string>& iter2prefix): iter2prefix(iter2prefix) {}
 
   bool operator()(Iterator* iter1, Iterator* iter2) {
-    Slice key1 = iter2key[iter1];
-    Slice key2 = iter2key[iter2];
-    Slice member1(iter1->key().data() + key1.size() + 1, iter1->key().size() - key1.size() - 1);
-    Slice member2(iter2->key().data() + key2.size() + 1, iter2->key().size() - key2.size() - 1);
+    size_t prefixSize1 = iter2prefix[iter1].size();
+    size_t prefixSize2 = iter2prefix[iter2].size();
+    Slice member1(iter1->key().data() + prefixSize1, iter1->key().size() - prefixSize1);
+    Slice member2(iter2->key().data() + prefixSize2, iter2->key().size() - prefixSize2);
     return member2 < member1;
   };
 
 private:
-  std::map<Iterator*, Slice> iter2key;
+  std::map<Iterator*, std::string> iter2prefix;
 };
 
+// Deleting a set only bumps its version, which the member keys carry right
+// after the separator. Members of older versions are left unreachable until
+// ReclaimStaleVersions deletes them.
 struct SetMetaValue {
-  explicit SetMetaValue() noexcept : len(0) {};
+  explicit SetMetaValue() noexcept : len(0), version(0) {};
   explicit SetMetaValue(const std::string& rawValue) noexcept {
     len = DecodeFixed64(rawValue.data());
+    version = DecodeFixed64(rawValue.data() + sizeof(len));
   }
   ~SetMetaValue() noexcept = default;
+  // Meta values of the layout before versions hold the length alone, and
+  // are moved to version 0 when the instance opens, see UpgradeLayout, and
+  // are otherwise rejected rather than read past their end.
+  static bool IsVersioned(const Slice& rawValue) noexcept {
+    return rawValue.size() == sizeof(uint64_t) * 2;
+  }
   std::string Encode() noexcept {
-    std::string rawValue(sizeof(int64_t), 0);
+    std::string rawValue(sizeof(len) + sizeof(version), 0);
     EncodeFixed64(rawValue.data(), len);
+    EncodeFixed64(rawValue.data() + sizeof(len), version);
     return rawValue;
   }
 
   uint64_t len;
+  uint64_t version;
 };
 
 struct SetNodeKey {
   explicit SetNodeKey() noexcept = default;
-  explicit SetNodeKey(const Slice& key, const Slice& setKey) noexcept :
+  explicit SetNodeKey(const Slice& key, uint64_t version, const Slice& setKey) noexcept :
     keySize_(key.size()),
     setKeySize_(setKey.size()),
-    data_(keySize_ + 1 + setKeySize_, 0) {
+    data_(keySize_ + 1 + sizeof(version) + setKeySize_, 0) {
     memcpy(data_.data(), key.data(), keySize_);
     data_[keySize_] = '\0';
-    memcpy(data_.data() + keySize_ + 1, setKey.data(), setKeySize_);
+    EncodeFixed64(data_.data() + keySize_ + 1, version);
+    memcpy(data_.data() + keySize_ + 1 + sizeof(version), setKey.data(), setKeySize_);
   }
   explicit SetNodeKey(const Slice& rawSetNodeKey, size_t keySize) noexcept :
     keySize_(keySize),
-    setKeySize_(rawSetNodeKey.size() - keySize_ - 1),
+    setKeySize_(rawSetNodeKey.size() - keySize_ - 1 - sizeof(uint64_t)),
     data_(rawSetNodeKey.ToString()) {
   }
   ~SetNodeKey() noexcept = default;
 
   size_t size() const { return data_.size(); }
   Slice key() const { return {data_.data(), keySize_}; }
-  Slice setKey() const { return {data_.data() + keySize_ + 1, setKeySize_}; }
+  uint64_t version() const { return DecodeFixed64(data_.data() + keySize_ + 1); }
+  Slice setKey() const { return {data_.data() + data_.size() - setKeySize_, setKeySize_}; }
   Slice Encode() const { return data_; }
 
 private:
@@ -79,7 +93,11 @@ public:
   ~RedisSetBasicImpl() noexcept final;
 //  Status Open(const Options& options, const std::string& db_path) noexcept override;
 
+  Status EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept override;
   Status Del(const Slice& key);
+  Status ReclaimStaleVersions(std::shared_mutex* commits) noexcept override;
+  Status UpgradeLayout() noexcept override;
+  std::string NodeSeparators() const noexcept override;
 
   Status SCard(const Slice& key, uint64_t* len) final;
   Status SIsMember(const Slice& key, const Slice& setKey, bool* isMember) final;
@@ -101,10 +119,22 @@ public:
   Status SInterStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count) final;
   Status SDiffStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count) final;
 
+protected:
+  // Member keys hold nothing, and meta values never do.
+  Status IsNodeOf(const Slice& metaKey,
+                  const Slice& rawKey,
+                  const Slice& value,
+                  bool versioned,
+                  bool legacyMetas,
+                  const ReadOptions& options,
+                  bool* isNode) noexcept override;
+
 private:
-  Slice GetMember(Iterator* iter, uint64_t keySize);
-  uint64_t CountKeyIntersection(const Slice& key, const SetNodeKey& nodeKey);
-  static bool IsMemberKey(const Slice& iterKey, uint64_t keySize);
+  Status GetMetaValue(const Slice& key, SetMetaValue* metaValue, const DB_ENGINE::Snapshot* snapshot);
+  static bool SeekMembers(Iterator* iter, const Slice& key, std::string* prefix);
+  static Slice GetMember(Iterator* iter, uint64_t prefixSize);
+  uint64_t CountKeyIntersection(const Slice& key, const SetNodeKey& nodeKey, const DB_ENGINE::Snapshot* snapshot);
+  static bool IsMemberKey(const Slice& iterKey, const Slice& prefix);
 //  void ReloadLens();
 //  bool MemoryMeta;
 //  std::map<std::string, uint64_t> lens;
@@ -1,8 +1,12 @@
 #ifndef MERODIS_REDIS_STRING_H
 #define MERODIS_REDIS_STRING_H
 
+#include <array>
 #include <cstdint>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <string_view>
 
 #include "redis.h"
 
@@ -19,6 +23,19 @@ public:
   virtual Status IncrBy(const Slice& key, int64_t increment, int64_t* result) noexcept = 0;
   virtual Status Decr(const Slice& key, int64_t* result) noexcept = 0;
   virtual Status DecrBy(const Slice& key, int64_t decrement, int64_t* result) noexcept = 0;
+
+protected:
+  // The increments of the keys hashed to a stripe take turns on its mutex,
+  // from their read to their write, so the sum an increment returns is
+  // the one it stores and no increment in between is lost, blind or not.
+  std::mutex& StripeOf(const Slice& key) noexcept {
+    return stripes_[std::hash<std::string_view>()(std::string_view(key.data(), key.size())) % kStripes];
+  }
+
+private:
+  static constexpr size_t kStripes = 64;
+
+  std::array<std::mutex, kStripes> stripes_;
 };
 
 }
@@ -2,6 +2,7 @@
 
 #include <cerrno>
 #include <cstdint>
+#include <mutex>
 #include <string>
 
 #include "util/number.h"
@@ -12,14 +13,20 @@ RedisStringBasicImpl::RedisStringBasicImpl() noexcept = default;
 
 RedisStringBasicImpl::~RedisStringBasicImpl() noexcept = default;
 
+Status RedisStringBasicImpl::EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept {
+  if (record.members.size() != 1) return Status::InvalidArgument("A string holds one value");
+  kvs->emplace_back(record.key, record.members[0]);
+  return Status::OK();
+}
+
 Status RedisStringBasicImpl::Get(const Slice& key,
                                  std::string* value) noexcept {
-  return db_->Get(ReadOptions(), key, value);
+  return db_->Get(ReadOptionsAt(snapshot_), key, value);
 }
 
 Status RedisStringBasicImpl::Set(const Slice& key,
                                  const Slice& value) noexcept {
-  return db_->Put(WriteOptions(), key, value);
+  return Put(key, value);
 }
 
 Status RedisStringBasicImpl::Incr(const Slice& key,
@@ -30,8 +37,11 @@ Status RedisStringBasicImpl::Incr(const Slice& key,
 Status RedisStringBasicImpl::IncrBy(const Slice& key,
                                     int64_t increment,
                                     int64_t* result) noexcept {
+  std::lock_guard<std::mutex> lock(StripeOf(key));
+  int64_t sum;
+  if (!result) result = &sum;
   std::string value;
-  Status s = db_->Get(ReadOptions(), key, &value);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &value);
   if (!s.ok() && !s.IsNotFound()) return s;
   if (s.IsNotFound()) value = "0";
 
@@ -56,7 +66,7 @@ Status RedisStringBasicImpl::IncrBy(const Slice& key,
       *result = n;
       return Status::InvalidArgument("Result underflow");
   }
-  return db_->Put(WriteOptions(), key, std::to_string(*result));
+  return Put(key, std::to_string(*result));
 }
 
 Status RedisStringBasicImpl::Decr(const Slice& key,
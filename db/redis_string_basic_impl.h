@@ -14,6 +14,8 @@ public:
   RedisStringBasicImpl() noexcept;
   ~RedisStringBasicImpl() noexcept final;
 
+  Status EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept override;
+
   Status Get(const Slice& key, std::string* value) noexcept final;
   Status Set(const Slice& key, const Slice& value) noexcept final;
   Status Incr(const Slice& key, int64_t* result) noexcept final;
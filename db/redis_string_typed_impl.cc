@@ -1,7 +1,10 @@
 #include "redis_string_typed_impl.h"
 
 #include <cstdint>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <variant>
 
 #include "layout.h"
 #include "util/number.h"
@@ -13,9 +16,33 @@ RedisStringTypedImpl::RedisStringTypedImpl() noexcept = default;
 
 RedisStringTypedImpl::~RedisStringTypedImpl() noexcept = default;
 
+Status RedisStringTypedImpl::EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept {
+  if (record.members.size() != 1) return Status::InvalidArgument("A string holds one value");
+  std::string raw;
+  Status s = EncodeString(record.key, record.members[0], &raw);
+  if (!s.ok()) return s;
+  kvs->emplace_back(record.key, std::move(raw));
+  return Status::OK();
+}
+
+bool RedisStringTypedImpl::SeparatesValues() const noexcept {
+  return true;
+}
+
+Status RedisStringTypedImpl::EncodeString(const Slice& key, const Slice& value, std::string* raw) noexcept {
+  TypedValue typedValue(value);
+  // Integers are never long enough to be separated.
+  if (!min_blob_size_ || std::holds_alternative<int64_t>(typedValue.value)) {
+    *raw = typedValue.Encode();
+    return Status::OK();
+  }
+  return EncodeValue(key, value, raw);
+}
+
 Status RedisStringTypedImpl::Get(const Slice& key, std::string* value) noexcept {
   std::string raw;
-  Status s = db_->Get(ReadOptions(), key, &raw);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &raw);
+  if (s.ok()) s = LoadValue(&raw);
   if (!s.ok()) return s;
   TypedValue typedValue;
   typedValue.parse(raw);
@@ -24,8 +51,10 @@ Status RedisStringTypedImpl::Get(const Slice& key, std::string* value) noexcept
 }
 
 Status RedisStringTypedImpl::Set(const Slice& key, const Slice& value) noexcept {
-  TypedValue typedValue(value);
-  return db_->Put(WriteOptions(), key, typedValue.Encode());
+  std::string raw;
+  Status s = EncodeString(key, value, &raw);
+  if (!s.ok()) return s;
+  return Put(key, raw);
 }
 
 Status RedisStringTypedImpl::Incr(const Slice& key, int64_t* result) noexcept {
@@ -33,8 +62,19 @@ Status RedisStringTypedImpl::Incr(const Slice& key, int64_t* result) noexcept {
 }
 
 Status RedisStringTypedImpl::IncrBy(const Slice& key, int64_t increment, int64_t* result) noexcept {
+  std::lock_guard<std::mutex> lock(StripeOf(key));
+#ifdef ROCKSDB
+  // The merge operator adds the increment on read, dropping it there if
+  // it overflows, so the callers not waiting for the result skip the
+  // read. The merge still takes the stripe, or an increment reading the
+  // key before it would store a sum without it.
+  if (!result) return Merge(key, TypedValue(increment).Encode());
+#endif
+  int64_t sum;
+  if (!result) result = &sum;
   std::string raw;
-  Status s = db_->Get(ReadOptions(), key, &raw);
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &raw);
+  if (s.ok()) s = LoadValue(&raw);
   if (!s.ok() && !s.IsNotFound()) return s;
   TypedValue typedValue;
   if (s.IsNotFound()) {
@@ -70,7 +110,7 @@ Status RedisStringTypedImpl::IncrBy(const Slice& key, int64_t increment, int64_t
   }, typedValue.value);
   if (!s.ok()) return s;
   typedValue.value = *result;
-  return db_->Put(WriteOptions(), key, typedValue.Encode());
+  return Put(key, typedValue.Encode());
 }
 
 Status RedisStringTypedImpl::Decr(const Slice& key, int64_t* result) noexcept {
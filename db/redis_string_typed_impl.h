@@ -14,12 +14,22 @@ public:
   RedisStringTypedImpl() noexcept;
   ~RedisStringTypedImpl() noexcept final;
 
+  Status EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept override;
+
   Status Get(const Slice& key, std::string* value) noexcept final;
   Status Set(const Slice& key, const Slice& value) noexcept final;
   Status Incr(const Slice& key, int64_t* result) noexcept final;
   Status IncrBy(const Slice& key, int64_t increment, int64_t* result) noexcept final;
   Status Decr(const Slice& key, int64_t* result) noexcept final;
   Status DecrBy(const Slice& key, int64_t decrement, int64_t* result) noexcept final;
+
+protected:
+  bool SeparatesValues() const noexcept override;
+
+private:
+  // Encodes value into raw, separated if long enough, see
+  // Redis::SeparateValues.
+  Status EncodeString(const Slice& key, const Slice& value, std::string* raw) noexcept;
 };
 
 }
@@ -4,32 +4,95 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <optional>
 #include <set>
 #include <utility>
 #include <algorithm>
 
+#include "range_deletion.h"
+
 namespace merodis {
 
 RedisZSetBasicImpl::RedisZSetBasicImpl() noexcept = default;
 RedisZSetBasicImpl::~RedisZSetBasicImpl() noexcept = default;
 
+Status RedisZSetBasicImpl::EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept {
+  if (record.scores.size() != record.members.size()) {
+    return Status::InvalidArgument("Every member of a zset needs a score");
+  }
+  if (record.members.empty()) return Status::OK();
+  ZSetMetaValue metaValue;
+  metaValue.len = record.members.size();
+  kvs->emplace_back(record.key, metaValue.Encode());
+  for (size_t c = 0; c < record.members.size(); c++) {
+    const std::string& member = record.members[c];
+    int64_t score = record.scores[c];
+    kvs->emplace_back(ZSetMemberKey(record.key, metaValue.version, member).Encode().ToString(),
+                      ZSetMemberValue(score).Encode());
+    kvs->emplace_back(ZSetScoredMemberKey(record.key, metaValue.version, member, score).Encode().ToString(), "");
+  }
+  return Status::OK();
+}
+
 Status RedisZSetBasicImpl::Del(const Slice& key) {
-  WriteBatch updates;
-  ScoredMemberIterator smIter(db_, key);
-  if (!smIter.Valid()) return Status::OK();
-  updates.Delete(smIter.key());
+  ZSetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
+  if (s.IsNotFound()) return Status::OK();
+  if (!s.ok()) return s;
+  metaValue.len = 0;
+  metaValue.version += 1;
+  return Put(key, metaValue.Encode());
+}
 
-  for (smIter.Next(); smIter.Valid(); smIter.Next()) {
-    updates.Delete(smIter.key());
-    updates.Delete(ZSetMemberKey(key, smIter.member()).Encode());
+Status RedisZSetBasicImpl::ReclaimStaleVersions(std::shared_mutex* commits) noexcept {
+  return ReclaimStaleNodes(commits);
+}
+
+Status RedisZSetBasicImpl::UpgradeLayout() noexcept {
+  return AddNodeVersions();
+}
+
+Status RedisZSetBasicImpl::IsNodeOf(const Slice& metaKey,
+                                    const Slice& rawKey,
+                                    const Slice& value,
+                                    bool versioned,
+                                    bool legacyMetas,
+                                    const ReadOptions& options,
+                                    bool* isNode) noexcept {
+  size_t prefixSize = metaKey.size() + 1 + (versioned ? sizeof(uint64_t) : 0);
+  *isNode = false;
+  if (rawKey[metaKey.size()] == '\0') {
+    *isNode = rawKey.size() >= prefixSize + sizeof(int64_t) && value.empty();
+    return Status::OK();
   }
-  return db_->Write(WriteOptions(), &updates);
+  if (rawKey[metaKey.size()] != '\xff' || rawKey.size() < prefixSize || value.size() != sizeof(int64_t)) {
+    return Status::OK();
+  }
+  if (!legacyMetas) {
+    *isNode = true;
+    return Status::OK();
+  }
+  std::string scoredMemberKey(rawKey.data(), prefixSize);
+  scoredMemberKey[metaKey.size()] = '\0';
+  scoredMemberKey.append(value.data(), value.size());
+  scoredMemberKey.append(rawKey.data() + prefixSize, rawKey.size() - prefixSize);
+  std::string ignored;
+  Status s = db_->Get(options, scoredMemberKey, &ignored);
+  *isNode = s.ok();
+  if (s.IsNotFound()) s = Status::OK();
+  return s;
+}
+
+std::string RedisZSetBasicImpl::NodeSeparators() const noexcept {
+  return std::string("\0\xff", 2);
 }
 
 Status RedisZSetBasicImpl::ZCard(const Slice& key, uint64_t* len){
   std::string rawZSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawZSetMetaValue);
-  if (s.ok()) {
+  Status s = db_->Get(ReadOptionsAt(snapshot_), key, &rawZSetMetaValue);
+  if (s.ok() && !ZSetMetaValue::IsVersioned(rawZSetMetaValue)) {
+    s = Status::Corruption("ZSet meta value without a version", key);
+  } else if (s.ok()) {
     ZSetMetaValue metaValue(rawZSetMetaValue);
     *len = metaValue.len;
   } else if (s.IsNotFound()) {
@@ -42,9 +105,12 @@ Status RedisZSetBasicImpl::ZCard(const Slice& key, uint64_t* len){
 Status RedisZSetBasicImpl::ZScore(const Slice& key,
                                   const Slice& member,
                                   int64_t* score){
-  ZSetMemberKey memberKey(key, member);
+  ZSetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
+  if (!s.ok()) return s;
+  ZSetMemberKey memberKey(key, metaValue.version, member);
   std::string rawMemberValue;
-  Status s = db_->Get(ReadOptions(), memberKey.Encode(), &rawMemberValue);
+  s = db_->Get(ReadOptionsAt(snapshot_), memberKey.Encode(), &rawMemberValue);
   if (!s.ok()) return s;
   ZSetMemberValue memberValue(rawMemberValue);
   *score = memberValue.score();
@@ -54,30 +120,33 @@ Status RedisZSetBasicImpl::ZScore(const Slice& key,
 Status RedisZSetBasicImpl::ZMScore(const Slice& key,
                                    const std::vector<Slice>& members,
                                    ScoreOpts* scores){
-  std::map<Slice, std::optional<int64_t>> member2score;
-  for (auto& member: members) member2score[member] = std::nullopt;
-  MemberIterator mIter(db_, key);
-  if (!mIter.Valid()) {
-    *scores = ScoreOpts(members.size(), std::nullopt);
+  ScopedSnapshot snapshot(db_, snapshot_);
+  ZSetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
+  if (s.IsNotFound()) {
+    scores->insert(scores->end(), members.size(), std::nullopt);
     return Status::OK();
   }
+  if (!s.ok()) return s;
+  // The distinct members in order, each with the position of its key.
+  std::map<Slice, size_t> positions;
+  for (auto& member: members) positions.emplace(member, 0);
+  std::vector<std::string> memberKeys;
+  memberKeys.reserve(positions.size());
+  for (auto& [member, position]: positions) {
+    position = memberKeys.size();
+    memberKeys.push_back(ZSetMemberKey(key, metaValue.version, member).Encode().ToString());
+  }
+  NodeScanOptions options(key, snapshot.get(), false, '\xff');
+  std::vector<std::optional<std::string>> memberValues;
+  s = MultiGetNodes(options, memberKeys, metaValue.len, &memberValues);
+  if (!s.ok()) return s;
 
-  auto queryIter = member2score.begin();
-  while (mIter.Valid() && queryIter != member2score.end()) {
-    int r = queryIter->first.compare(mIter.member());
-    if (r == 0) {
-      queryIter->second = mIter.score();
-      ++queryIter;
-      mIter.Next();
-    } else if (r > 0) {
-      mIter.Next();
-    } else {
-      ++queryIter;
-    }
+  scores->reserve(scores->size() + members.size());
+  for (auto& member: members) {
+    const auto& memberValue = memberValues[positions[member]];
+    scores->push_back(memberValue ? std::optional(ZSetMemberValue(*memberValue).score()) : std::nullopt);
   }
-
-  scores->reserve(members.size());
-  for (auto& member: members) scores->push_back(member2score[member]);
   return Status::OK();
 }
 
@@ -99,7 +168,7 @@ Status RedisZSetBasicImpl::ZCount(const Slice& key,
                                   uint64_t* count){
   *count = 0;
   if (minScore > maxScore) return Status::OK();
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot_, key);
   if (!smIter.Valid()) return Status::OK();
   smIter.Next();
   for (; smIter.Valid() && smIter.score() < minScore; smIter.Next());
@@ -113,7 +182,7 @@ Status RedisZSetBasicImpl::ZLexCount(const Slice& key,
                                      uint64_t* count){
   *count = 0;
   if (minLex > maxLex) return Status::OK();
-  MemberIterator mIter(db_, key);
+  MemberIterator mIter(db_, snapshot_, key);
   if (!mIter.Valid()) return Status::OK();
   for (; mIter.Valid() && mIter.member() < minLex; mIter.Next());
   for (; mIter.Valid() && mIter.member() <= maxLex; mIter.Next(), *count += 1);
@@ -124,7 +193,7 @@ Status RedisZSetBasicImpl::ZRange(const Slice& key,
                                   int64_t minRank,
                                   int64_t maxRank,
                                   Members* members){
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot_, key);
   if (!smIter.Valid()) return Status::OK();
   ZSetMetaValue metaValue(smIter.value().ToString());
   int64_t size = static_cast<int64_t>(metaValue.len);
@@ -145,7 +214,7 @@ Status RedisZSetBasicImpl::ZRangeByScore(const Slice& key,
                                          int64_t maxScore,
                                          Members* members){
   if (minScore > maxScore) return Status::OK();
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot_, key);
   if (!smIter.Valid()) return Status::OK();
   smIter.Next();
   for (; smIter.Valid() && smIter.score() < minScore; smIter.Next());
@@ -160,7 +229,7 @@ Status RedisZSetBasicImpl::ZRangeByLex(const Slice& key,
                                        const Slice& maxLex,
                                        Members* members){
   if (minLex > maxLex) return Status::OK();
-  MemberIterator mIter(db_, key);
+  MemberIterator mIter(db_, snapshot_, key);
   if (!mIter.Valid()) return Status::OK();
   for (; mIter.Valid() && mIter.member() < minLex; mIter.Next());
   for (; mIter.Valid() && mIter.member() <= maxLex; mIter.Next()) {
@@ -173,7 +242,7 @@ Status RedisZSetBasicImpl::ZRangeWithScores(const Slice& key,
                                             int64_t minRank,
                                             int64_t maxRank,
                                             ScoredMembers* scoredMembers){
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot_, key);
   if (!smIter.Valid()) return Status::OK();
   ZSetMetaValue metaValue(smIter.value().ToString());
   int64_t size = static_cast<int64_t>(metaValue.len);
@@ -194,7 +263,7 @@ Status RedisZSetBasicImpl::ZRangeByScoreWithScores(const Slice& key,
                                                    int64_t maxScore,
                                                    ScoredMembers* scoredMembers){
   if (minScore > maxScore) return Status::OK();
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot_, key);
   if (!smIter.Valid()) return Status::OK();
   smIter.Next();
   for (; smIter.Valid() && smIter.score() < minScore; smIter.Next());
@@ -209,7 +278,7 @@ Status RedisZSetBasicImpl::ZRangeByLexWithScores(const Slice& key,
                                                  const Slice& maxLex,
                                                  ScoredMembers* scoredMembers){
   if (minLex > maxLex) return Status::OK();
-  MemberIterator mIter(db_, key);
+  MemberIterator mIter(db_, snapshot_, key);
   if (!mIter.Valid()) return Status::OK();
   for (; mIter.Valid() && mIter.member() < minLex; mIter.Next());
   for (; mIter.Valid() && mIter.member() <= maxLex; mIter.Next()) {
@@ -281,25 +350,24 @@ Status RedisZSetBasicImpl::ZRevRangeByLexWithScores(const Slice& key,
 Status RedisZSetBasicImpl::ZAdd(const Slice& key,
                                 const std::pair<Slice, int64_t>& scoredMember,
                                 uint64_t* count){
-  std::string rawZSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawZSetMetaValue);
   ZSetMetaValue zsetMetaValue;
-  if (s.ok()) zsetMetaValue = ZSetMetaValue(rawZSetMetaValue);
+  Status s = GetMetaValue(key, &zsetMetaValue, snapshot_);
+  if (!s.ok() && !s.IsNotFound()) return s;
 
   WriteBatch updates;
   const auto& [member, score] = scoredMember;
-  ZSetMemberKey memberKey(key, member);
+  ZSetMemberKey memberKey(key, zsetMetaValue.version, member);
   ZSetMemberValue memberValue(score);
-  ZSetScoredMemberKey scoredMemberKey(key, scoredMember);
+  ZSetScoredMemberKey scoredMemberKey(key, zsetMetaValue.version, scoredMember);
 
   std::string rawMemberValue;
-  s = db_->Get(ReadOptions(), memberKey.Encode(), &rawMemberValue);
+  s = db_->Get(ReadOptionsAt(snapshot_), memberKey.Encode(), &rawMemberValue);
   if (s.ok()) {
     *count = 0;
     ZSetMemberValue oldMemberValue(rawMemberValue);
     int64_t oldScore = oldMemberValue.score();
     if (oldScore == score) return Status::OK();
-    ZSetScoredMemberKey oldScoredMemberKey(key, member, oldScore);
+    ZSetScoredMemberKey oldScoredMemberKey(key, zsetMetaValue.version, member, oldScore);
     updates.Delete(oldScoredMemberKey.Encode());
   } else {
     *count = 1;
@@ -308,21 +376,21 @@ Status RedisZSetBasicImpl::ZAdd(const Slice& key,
   }
   updates.Put(memberKey.Encode(), memberValue.Encode());
   updates.Put(scoredMemberKey.Encode(), "");
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisZSetBasicImpl::ZAdd(const Slice& key,
                                 const std::map<Slice, int64_t>& scoredMembers,
                                 uint64_t* count){
+  ScopedSnapshot snapshot(db_, snapshot_);
   *count = 0;
   if (scoredMembers.empty()) return Status::OK();
-  std::string rawZSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawZSetMetaValue);
   ZSetMetaValue zsetMetaValue;
-  if (s.ok()) zsetMetaValue = ZSetMetaValue(rawZSetMetaValue);
+  Status s = GetMetaValue(key, &zsetMetaValue, snapshot.get());
+  if (!s.ok() && !s.IsNotFound()) return s;
 
   WriteBatch updates;
-  MemberIterator mIter(db_, key);
+  MemberIterator mIter(db_, snapshot.get(), key);
   auto updatesIter = scoredMembers.cbegin();
   while (updatesIter != scoredMembers.cend()) {
     const auto [member, score] = *updatesIter;
@@ -335,15 +403,15 @@ Status RedisZSetBasicImpl::ZAdd(const Slice& key,
           mIter.Next();
           continue;
         }
-        ZSetScoredMemberKey oldScoredMemberKey(key, member, oldScore);
+        ZSetScoredMemberKey oldScoredMemberKey(key, zsetMetaValue.version, member, oldScore);
         updates.Delete(oldScoredMemberKey.Encode());
         mIter.Next();
       } else {
         *count += 1;
       }
-      ZSetMemberKey memberKey(key, member);
+      ZSetMemberKey memberKey(key, zsetMetaValue.version, member);
       ZSetMemberValue memberValue(score);
-      ZSetScoredMemberKey scoredMemberKey(key, member, score);
+      ZSetScoredMemberKey scoredMemberKey(key, zsetMetaValue.version, member, score);
       updates.Put(memberKey.Encode(), memberValue.Encode());
       updates.Put(scoredMemberKey.Encode(), "");
       ++updatesIter;
@@ -356,7 +424,7 @@ Status RedisZSetBasicImpl::ZAdd(const Slice& key,
     zsetMetaValue.len += *count;
     updates.Put(key, zsetMetaValue.Encode());
   }
-  db_->Write(WriteOptions(), &updates);
+  Write(&updates);
   return Status::OK();
 }
 
@@ -364,46 +432,45 @@ Status RedisZSetBasicImpl::ZRem(const Slice& key,
                                 const Slice& member,
                                 uint64_t* count){
   *count = 0;
-  std::string rawZSetMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawZSetMetaValue);
-  if (!s.ok()) return Status::OK();
-  ZSetMetaValue metaValue(rawZSetMetaValue);
+  ZSetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot_);
+  if (s.IsNotFound()) return Status::OK();
+  if (!s.ok()) return s;
 
   WriteBatch updates;
-  ZSetMemberKey memberKey(key, member);
+  ZSetMemberKey memberKey(key, metaValue.version, member);
   std::string rawMemberValue;
-  s = db_->Get(ReadOptions(), memberKey.Encode(), &rawMemberValue);
+  s = db_->Get(ReadOptionsAt(snapshot_), memberKey.Encode(), &rawMemberValue);
   if (!s.ok()) return Status::OK();
   ZSetMemberValue memberValue(rawMemberValue);
-  ZSetScoredMemberKey scoredMemberKey(key, member, memberValue.score());
+  ZSetScoredMemberKey scoredMemberKey(key, metaValue.version, member, memberValue.score());
   updates.Delete(memberKey.Encode());
   updates.Delete(scoredMemberKey.Encode());
   *count = 1;
   metaValue.len -= 1;
   updates.Put(key, metaValue.Encode());
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisZSetBasicImpl::ZRem(const Slice& key,
                                 const std::set<Slice>& members,
                                 uint64_t* count){
+  ScopedSnapshot snapshot(db_, snapshot_);
   *count = 0;
   if (members.empty()) return Status::OK();
-  std::string rawMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawMetaValue);
   ZSetMetaValue metaValue;
-  if (s.ok()) metaValue = ZSetMetaValue(rawMetaValue);
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
+  if (!s.ok() && !s.IsNotFound()) return s;
 
   WriteBatch updates;
-  MemberIterator mIter(db_, key);
+  MemberIterator mIter(db_, snapshot.get(), key);
   auto updatesIter = members.cbegin();
   while (mIter.Valid() && updatesIter != members.cend())  {
     const auto member = *updatesIter;
     int r = updatesIter->compare(mIter.member());
     if (r == 0) {
-      ZSetMemberKey memberKey(key, member);
-      ZSetScoredMemberKey scoredMemberKey(key, member, mIter.score());
-      updates.Delete(memberKey.Encode());
+      ZSetScoredMemberKey scoredMemberKey(key, metaValue.version, member, mIter.score());
+      updates.Delete(mIter.key());
       updates.Delete(scoredMemberKey.Encode());
       *count += 1;
       mIter.Next();
@@ -418,7 +485,7 @@ Status RedisZSetBasicImpl::ZRem(const Slice& key,
     metaValue.len -= *count;
     updates.Put(key, metaValue.Encode());
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisZSetBasicImpl::ZPopMax(const Slice& key,
@@ -436,7 +503,7 @@ Status RedisZSetBasicImpl::ZRemRangeByRank(const Slice& key,
                                            int64_t maxRank,
                                            uint64_t* count){
   *count = 0;
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot_, key);
   if (!smIter.Valid()) return Status::OK();
   ZSetMetaValue metaValue(smIter.value().ToString());
   int64_t size = static_cast<int64_t>(metaValue.len);
@@ -446,18 +513,22 @@ Status RedisZSetBasicImpl::ZRemRangeByRank(const Slice& key,
   if (rangeSize < 0) return Status::OK();
   smIter.Next();
 
+  // The removed members are a run of the scored member keys alone, their
+  // member keys are scattered and deleted one by one.
   WriteBatch updates;
+  RangeDeletion deletion(&updates, !IsTransactionView());
   for (; smIter.Valid() && lower--; smIter.Next());
   for (; smIter.Valid() && rangeSize--; smIter.Next()) {
-    updates.Delete(smIter.key());
-    updates.Delete(ZSetMemberKey(key, smIter.member()).Encode());
+    deletion.Delete(smIter.key());
+    updates.Delete(ZSetMemberKey(key, smIter.version(), smIter.member()).Encode());
     *count += 1;
   }
+  deletion.Finish();
   if (*count) {
     metaValue.len -= *count;
     updates.Put(key, metaValue.Encode());
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisZSetBasicImpl::ZRemRangeByScore(const Slice& key,
@@ -466,50 +537,57 @@ Status RedisZSetBasicImpl::ZRemRangeByScore(const Slice& key,
                                             uint64_t* count){
   *count = 0;
   if (minScore > maxScore) return Status::OK();
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot_, key);
   if (!smIter.Valid()) return Status::OK();
   ZSetMetaValue metaValue(smIter.value().ToString());
   smIter.Next();
 
+  // As in ZRemRangeByRank, only the scored member keys are a run.
   WriteBatch updates;
+  RangeDeletion deletion(&updates, !IsTransactionView());
   for (; smIter.Valid() && smIter.score() < minScore; smIter.Next());
   for (; smIter.Valid() && smIter.score() <= maxScore; smIter.Next()) {
-    updates.Delete(smIter.key());
-    updates.Delete(ZSetMemberKey(key, smIter.member()).Encode());
+    deletion.Delete(smIter.key());
+    updates.Delete(ZSetMemberKey(key, smIter.version(), smIter.member()).Encode());
     *count += 1;
   }
+  deletion.Finish();
   if (*count) {
     metaValue.len -= *count;
     updates.Put(key, metaValue.Encode());
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisZSetBasicImpl::ZRemRangeByLex(const Slice& key,
                                           const Slice& minLex,
                                           const Slice& maxLex,
                                           uint64_t* count){
+  ScopedSnapshot snapshot(db_, snapshot_);
   *count = 0;
   if (minLex > maxLex) return Status::OK();
-  std::string rawMetaValue;
-  Status s = db_->Get(ReadOptions(), key, &rawMetaValue);
-  if (!s.ok()) return Status::OK();
-  ZSetMetaValue metaValue(rawMetaValue);
-  MemberIterator mIter(db_, key);
+  ZSetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
+  if (s.IsNotFound()) return Status::OK();
+  if (!s.ok()) return s;
+  MemberIterator mIter(db_, snapshot.get(), key);
   if (!mIter.Valid()) return Status::OK();
 
+  // The member keys are the run here, the scored member keys scattered.
   WriteBatch updates;
+  RangeDeletion deletion(&updates, !IsTransactionView());
   for (; mIter.Valid() && mIter.member() < minLex; mIter.Next());
   for (; mIter.Valid() && mIter.member() <= maxLex; mIter.Next()) {
-    updates.Delete(mIter.key());
-    updates.Delete(ZSetScoredMemberKey(key, mIter.member(), mIter.score()).Encode());
+    deletion.Delete(mIter.key());
+    updates.Delete(ZSetScoredMemberKey(key, mIter.version(), mIter.member(), mIter.score()).Encode());
     *count += 1;
   }
+  deletion.Finish();
   if (*count) {
     metaValue.len -= *count;
     updates.Put(key, metaValue.Encode());
   }
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
 }
 
 Status RedisZSetBasicImpl::ZUnion(const std::vector<Slice>& keys,
@@ -620,14 +698,18 @@ Status RedisZSetBasicImpl::ZRankInternal(const Slice& key,
                                          const Slice& member,
                                          uint64_t* rank,
                                          bool rev) {
-  ZSetMemberKey memberKey(key, member);
+  ScopedSnapshot snapshot(db_, snapshot_);
+  ZSetMetaValue metaValue;
+  Status s = GetMetaValue(key, &metaValue, snapshot.get());
+  if (!s.ok()) return s;
+  ZSetMemberKey memberKey(key, metaValue.version, member);
   std::string rawMemberValue;
-  Status s = db_->Get(ReadOptions(), memberKey.Encode(), &rawMemberValue);
+  s = db_->Get(ReadOptionsAt(snapshot.get()), memberKey.Encode(), &rawMemberValue);
   if (!s.ok()) return s;
 
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot.get(), key);
   if (!smIter.Valid()) return Status::NotFound("empty zset");
-  ZSetMetaValue metaValue(smIter.value().ToString());
+  metaValue = ZSetMetaValue(smIter.value().ToString());
   smIter.Next();
   for (*rank = 0;
        smIter.Valid() && smIter.member() != member;
@@ -639,7 +721,7 @@ Status RedisZSetBasicImpl::ZRankInternal(const Slice& key,
 Status RedisZSetBasicImpl::ZPop(const Slice& key,
                                 ScoredMember* scoredMember,
                                 MinOrMax minOrMax) {
-  ScoredMemberIterator smIter(db_, key);
+  ScoredMemberIterator smIter(db_, snapshot_, key);
   if (!smIter.Valid()) return Status::OK();
   ZSetMetaValue metaValue(smIter.value().ToString());
   minOrMax == kMin ? smIter.Next() : smIter.SeekToLast();
@@ -648,16 +730,28 @@ Status RedisZSetBasicImpl::ZPop(const Slice& key,
   WriteBatch updates;
   *scoredMember = ScoredMember(smIter.member().ToString(), smIter.score());
   updates.Delete(smIter.key());
-  updates.Delete(ZSetMemberKey(key, smIter.member()).Encode());
+  updates.Delete(ZSetMemberKey(key, smIter.version(), smIter.member()).Encode());
   metaValue.len -= 1;
   updates.Put(key, metaValue.Encode());
-  return db_->Write(WriteOptions(), &updates);
+  return Write(&updates);
+}
+
+Status RedisZSetBasicImpl::GetMetaValue(const Slice& key,
+                                        ZSetMetaValue* metaValue,
+                                        const DB_ENGINE::Snapshot* snapshot) {
+  std::string rawZSetMetaValue;
+  Status s = db_->Get(ReadOptionsAt(snapshot), key, &rawZSetMetaValue);
+  if (!s.ok()) return s;
+  if (!ZSetMetaValue::IsVersioned(rawZSetMetaValue)) return Status::Corruption("ZSet meta value without a version", key);
+  *metaValue = ZSetMetaValue(rawZSetMetaValue);
+  return s;
 }
 
 Member2Score RedisZSetBasicImpl::ZUnionAsMap(const std::vector<Slice>& keys){
+  ScopedSnapshot snapshot(db_, snapshot_);
   Member2Score member2score;
   for (const auto& key: keys) {
-    MemberIterator mIter(db_, key);
+    MemberIterator mIter(db_, snapshot.get(), key, IsBulkRead(key, snapshot.get()));
     if (!mIter.Valid()) continue;
     for (; mIter.Valid(); mIter.Next()) {
       member2score[mIter.member().ToString()] += mIter.score();
@@ -667,8 +761,9 @@ Member2Score RedisZSetBasicImpl::ZUnionAsMap(const std::vector<Slice>& keys){
 }
 
 Member2Score RedisZSetBasicImpl::ZInterAsMap(const std::vector<Slice>& keys){
+  ScopedSnapshot snapshot(db_, snapshot_);
   Member2Score member2score;
-  MemberIterator frontIter(db_, keys.front());
+  MemberIterator frontIter(db_, snapshot.get(), keys.front(), IsBulkRead(keys.front(), snapshot.get()));
   if (!frontIter.Valid()) return {};
   for (; frontIter.Valid(); frontIter.Next()) {
     member2score[frontIter.member().ToString()] += frontIter.score();
@@ -676,11 +771,11 @@ Member2Score RedisZSetBasicImpl::ZInterAsMap(const std::vector<Slice>& keys){
 
   for (auto it = std::next(keys.begin()); it != keys.end(); it++) {
     Slice key = *it;
-    MemberIterator mIter(db_, key);
+    MemberIterator mIter(db_, snapshot.get(), key);
     if (!mIter.Valid()) return {};
     for (auto mit = member2score.cbegin(); mit != member2score.cend(); ) {
       Slice member = mit->first;
-      mIter.Seek(ZSetMemberKey(key, member.ToString()).Encode());
+      mIter.SeekMember(member);
       if (!mIter.Valid()) break;
       if (mIter.member() == mit->first) {
         member2score[member.ToString()] += mIter.score();
@@ -694,8 +789,9 @@ Member2Score RedisZSetBasicImpl::ZInterAsMap(const std::vector<Slice>& keys){
 }
 
 Member2Score RedisZSetBasicImpl::ZDiffAsMap(const std::vector<Slice>& keys){
+  ScopedSnapshot snapshot(db_, snapshot_);
   Member2Score member2score;
-  MemberIterator frontIter(db_, keys.front());
+  MemberIterator frontIter(db_, snapshot.get(), keys.front(), IsBulkRead(keys.front(), snapshot.get()));
   if (!frontIter.Valid()) return {};
   for (; frontIter.Valid(); frontIter.Next()) {
     member2score[frontIter.member().ToString()] += frontIter.score();
@@ -703,11 +799,11 @@ Member2Score RedisZSetBasicImpl::ZDiffAsMap(const std::vector<Slice>& keys){
 
   for (auto it = std::next(keys.begin()); it != keys.end(); it++) {
     Slice key = *it;
-    MemberIterator mIter(db_, key);
+    MemberIterator mIter(db_, snapshot.get(), key);
     if (!mIter.Valid()) continue;
     for (auto mit = member2score.cbegin(); mit != member2score.cend(); ) {
       Slice member = mit->first;
-      mIter.Seek(ZSetMemberKey(key, member.ToString()).Encode());
+      mIter.SeekMember(member);
       if (!mIter.Valid()) break;
       mIter.member() == mit->first ? member2score.erase(mit++): mit++;
     }
@@ -11,48 +11,63 @@
 
 #include "redis_zset.h"
 #include "iterator_decorator.h"
+#include "layout.h"
 #include "util/coding.h"
 
 namespace merodis {
 
 static uint64_t ScoreOffset = std::numeric_limits<int64_t>::min();
 
+// Deleting a zset only bumps its version, which the member and scored
+// member keys carry right after their separators. Members of older versions
+// are left unreachable until ReclaimStaleVersions deletes them.
 struct ZSetMetaValue {
-  explicit ZSetMetaValue() noexcept: len(0) {};
+  explicit ZSetMetaValue() noexcept: len(0), version(0) {};
   explicit ZSetMetaValue(const std::string& rawValue) noexcept {
     len = DecodeFixed64(rawValue.data());
+    version = DecodeFixed64(rawValue.data() + sizeof(len));
   }
   ~ZSetMetaValue() noexcept = default;
+  // Meta values of the layout before versions hold the length alone, and
+  // are moved to version 0 when the instance opens, see UpgradeLayout, and
+  // are otherwise rejected rather than read past their end.
+  static bool IsVersioned(const Slice& rawValue) noexcept {
+    return rawValue.size() == sizeof(uint64_t) * 2;
+  }
   std::string Encode() noexcept {
-    std::string rawValue(sizeof(int64_t), 0);
+    std::string rawValue(sizeof(len) + sizeof(version), 0);
     EncodeFixed64(rawValue.data(), len);
+    EncodeFixed64(rawValue.data() + sizeof(len), version);
     return rawValue;
   }
 
   uint64_t len;
+  uint64_t version;
 };
 
 
 struct ZSetMemberKey {
   explicit ZSetMemberKey() noexcept = default;
-  explicit ZSetMemberKey(const Slice& key, const Slice& member) noexcept:
+  explicit ZSetMemberKey(const Slice& key, uint64_t version, const Slice& member) noexcept:
     keySize_(key.size()),
     memberSize_(member.size()),
-    data_(keySize_ + 1 + memberSize_, 0) {
+    data_(keySize_ + 1 + sizeof(version) + memberSize_, 0) {
     memcpy(data_.data(), key.data(), keySize_);
     data_[keySize_] = static_cast<char>(0xff);
-    memcpy(data_.data() + keySize_ + 1, member.data(), memberSize_);
+    EncodeFixed64(data_.data() + keySize_ + 1, version);
+    memcpy(data_.data() + keySize_ + 1 + sizeof(version), member.data(), memberSize_);
   }
   explicit ZSetMemberKey(const Slice& rawZSetMemberKey, size_t keySize) noexcept:
     keySize_(keySize),
-    memberSize_(rawZSetMemberKey.size() - keySize_ - 1),
+    memberSize_(rawZSetMemberKey.size() - keySize_ - 1 - sizeof(uint64_t)),
     data_(rawZSetMemberKey.ToString()) {
   }
   ~ZSetMemberKey() noexcept = default;
 
   size_t size() const { return data_.size(); }
   Slice key() const { return {data_.data(), keySize_}; }
-  Slice member() const { return {data_.data() + keySize_ + 1, memberSize_}; }
+  uint64_t version() const { return DecodeFixed64(data_.data() + keySize_ + 1); }
+  Slice member() const { return {data_.data() + data_.size() - memberSize_, memberSize_}; }
   Slice Encode() const { return data_; }
 
 private:
@@ -84,29 +99,31 @@ private:
 
 struct ZSetScoredMemberKey {
   explicit ZSetScoredMemberKey() noexcept = default;
-  explicit ZSetScoredMemberKey(const Slice& key, const Slice& member, int64_t score) noexcept:
+  explicit ZSetScoredMemberKey(const Slice& key, uint64_t version, const Slice& member, int64_t score) noexcept:
     keySize_(key.size()),
     memberSize_(member.size()),
-    data_(keySize_ + 1 + sizeof(int64_t) + memberSize_, 0) {
+    data_(keySize_ + 1 + sizeof(version) + sizeof(int64_t) + memberSize_, 0) {
     memcpy(data_.data(), key.data(), keySize_);
     data_[keySize_] = '\0';
-    EncodeFixed64(data_.data() + keySize_ + 1, score + ScoreOffset);
-    memcpy(data_.data() + keySize_ + sizeof(int64_t) + 1, member.data(), memberSize_);
+    EncodeFixed64(data_.data() + keySize_ + 1, version);
+    EncodeFixed64(data_.data() + keySize_ + 1 + sizeof(version), score + ScoreOffset);
+    memcpy(data_.data() + keySize_ + 1 + sizeof(version) + sizeof(int64_t), member.data(), memberSize_);
   }
-  explicit ZSetScoredMemberKey(const Slice& key, const std::pair<Slice, int64_t>& scoredMember) noexcept:
-    ZSetScoredMemberKey(key, scoredMember.first, scoredMember.second) {}
+  explicit ZSetScoredMemberKey(const Slice& key, uint64_t version, const std::pair<Slice, int64_t>& scoredMember) noexcept:
+    ZSetScoredMemberKey(key, version, scoredMember.first, scoredMember.second) {}
   explicit ZSetScoredMemberKey(const Slice& rawZSetScoredMemberKey, size_t keySize) noexcept:
     keySize_(keySize),
-    memberSize_(rawZSetScoredMemberKey.size() - keySize_ - sizeof(int64_t) - 1),
+    memberSize_(rawZSetScoredMemberKey.size() - keySize_ - 1 - sizeof(uint64_t) - sizeof(int64_t)),
     data_(rawZSetScoredMemberKey.ToString()) {
   }
   ~ZSetScoredMemberKey() noexcept = default;
 
   size_t size() const { return data_.size(); }
   Slice key() const { return {data_.data(), keySize_}; }
+  uint64_t version() const { return DecodeFixed64(data_.data() + keySize_ + 1); }
   Slice member() const { return {data_.data() + data_.size() - memberSize_, memberSize_}; }
-  int64_t score() const { return static_cast<int64_t>(DecodeFixed64(data_.data() + keySize_ + 1) - ScoreOffset); }
-  void score(int64_t score) { EncodeFixed64(data_.data() + keySize_ + 1, score + ScoreOffset); };
+  int64_t score() const { return static_cast<int64_t>(DecodeFixed64(data_.data() + keySize_ + 1 + sizeof(uint64_t)) - ScoreOffset); }
+  void score(int64_t score) { EncodeFixed64(data_.data() + keySize_ + 1 + sizeof(uint64_t), score + ScoreOffset); };
   Slice Encode() { return data_; }
 
 private:
@@ -115,18 +132,22 @@ private:
   std::string data_;
 };
 
+// Starts at the meta key of the zset, which Next leaves for the scored
+// member keys of its current version.
 class ScoredMemberIterator: public IteratorDecorator {
 public:
-  explicit ScoredMemberIterator(DB* db, const Slice& setKey):
-    IteratorDecorator(db->NewIterator(ReadOptions())),
-    setKey_(setKey) {
+  explicit ScoredMemberIterator(DB* db, const DB_ENGINE::Snapshot* snapshot, const Slice& setKey):
+    IteratorDecorator(nullptr),
+    options_(setKey, snapshot),
+    atMeta_(true),
+    version_(0) {
+    iter_ = db->NewIterator(options_);
     iter_->Seek(setKey);
-    valid_ = iter_->Valid() && iter_->key() == setKey;
+    valid_ = iter_->Valid() && iter_->key() == setKey && ZSetMetaValue::IsVersioned(iter_->value());
+    if (valid_) version_ = ZSetMetaValue(iter_->value().ToString()).version;
+    prefix_ = ZSetScoredMemberKey(setKey, version_, "", 0).Encode().ToString();
+    prefix_.resize(prefix_.size() - sizeof(int64_t));
   }
-  explicit ScoredMemberIterator(Iterator* iter, const Slice& setKey):
-    IteratorDecorator(iter),
-    setKey_(setKey),
-    valid_(iter_->Valid() && IsScoredMemberKey()) {}
   ScoredMemberIterator(const ScoredMemberIterator&) = delete;
   ScoredMemberIterator& operator=(const ScoredMemberIterator&) = delete;
   ~ScoredMemberIterator() override = default;
@@ -134,53 +155,55 @@ public:
   bool Valid() const override { return valid_; }
   void Next() override {
     assert(valid_);
-    iter_->Next();
-    valid_ = iter_->Valid() && IsScoredMemberKey();
+    atMeta_ ? iter_->Seek(prefix_) : iter_->Next();
+    atMeta_ = false;
+    valid_ = iter_->Valid() && iter_->key().starts_with(prefix_);
   }
   void SeekToLast() override {
     assert(valid_);
-    std::string memberKeyPrefix(setKey_.size() + 1, 0);
-    memcpy(memberKeyPrefix.data(), setKey_.data(), setKey_.size());
-    memberKeyPrefix[setKey_.size()] = (char)0xff;
-    iter_->Seek(memberKeyPrefix);
-    if (!iter_->Valid()) {
-      valid_ = false;
-      return;
-    }
-    iter_->Prev();
-    valid_ = iter_->Valid();
+    std::string limit(prefix_);
+    EncodeFixed64(limit.data() + limit.size() - sizeof(version_), version_ + 1);
+#ifdef ROCKSDB
+    iter_->SeekForPrev(limit);
+#else
+    iter_->Seek(limit);
+    iter_->Valid() ? iter_->Prev() : iter_->SeekToLast();
+#endif
+    atMeta_ = false;
+    valid_ = iter_->Valid() && iter_->key().starts_with(prefix_);
   };
+  uint64_t version() const { return version_; }
   int64_t score() const {
-    return static_cast<int64_t>(DecodeFixed64(key().data() + setKey_.size() + 1) - ScoreOffset);
+    return static_cast<int64_t>(DecodeFixed64(key().data() + prefix_.size()) - ScoreOffset);
   };
   Slice member() const {
-    size_t memberSize = key().size() - setKey_.size() - 1 - sizeof(uint64_t);
-    return {key().data() + key().size() - memberSize, memberSize};
+    size_t memberOffset = prefix_.size() + sizeof(int64_t);
+    return {key().data() + memberOffset, key().size() - memberOffset};
   }
 
 private:
-  Slice setKey_;
+  NodeScanOptions options_;
+  std::string prefix_;
+  bool atMeta_;
   bool valid_;
-  bool IsScoredMemberKey() const {
-    return key().size() > setKey_.size() && key()[setKey_.size()] == 0;
-  }
+  uint64_t version_;
 };
 
 class MemberIterator: public IteratorDecorator {
 public:
-  explicit MemberIterator(DB* db, const Slice& setKey):
-    IteratorDecorator(db->NewIterator(ReadOptions())),
-    setKey_(setKey) {
-    std::string memberKeyPrefix(setKey.size() + 1, 0);
-    memcpy(memberKeyPrefix.data(), setKey_.data(), setKey_.size());
-    memberKeyPrefix[setKey.size()] = (char)0xff;
-    iter_->Seek(memberKeyPrefix);
-    valid_ = iter_->Valid() && iter_->key().starts_with(memberKeyPrefix);
+  explicit MemberIterator(DB* db, const DB_ENGINE::Snapshot* snapshot, const Slice& setKey, bool bulk = false):
+    IteratorDecorator(nullptr),
+    options_(setKey, snapshot, bulk, '\xff'),
+    version_(0) {
+    iter_ = db->NewIterator(options_);
+    iter_->Seek(setKey);
+    valid_ = iter_->Valid() && iter_->key() == setKey && ZSetMetaValue::IsVersioned(iter_->value());
+    if (!valid_) return;
+    version_ = ZSetMetaValue(iter_->value().ToString()).version;
+    prefix_ = ZSetMemberKey(setKey, version_, "").Encode().ToString();
+    iter_->Seek(prefix_);
+    valid_ = iter_->Valid() && iter_->key().starts_with(prefix_);
   }
-  explicit MemberIterator(Iterator* iter, const Slice& setKey):
-    IteratorDecorator(iter),
-    setKey_(setKey),
-    valid_(iter_->Valid() && IsMemberKey()) {};
   MemberIterator(const MemberIterator&) = delete;
   MemberIterator& operator=(const MemberIterator&) = delete;
   ~MemberIterator() override = default;
@@ -189,21 +212,28 @@ public:
   void Next() override {
     assert(valid_);
     iter_->Next();
-    valid_ = iter_->Valid() && IsMemberKey();
+    valid_ = iter_->Valid() && iter_->key().starts_with(prefix_);
+  }
+  // Seeks the first member not less than member, on a zset that exists.
+  void SeekMember(const Slice& member) {
+    std::string memberKey(prefix_);
+    memberKey.append(member.data(), member.size());
+    iter_->Seek(memberKey);
+    valid_ = iter_->Valid() && iter_->key().starts_with(prefix_);
   }
+  uint64_t version() const { return version_; }
   Slice member() const {
-    return {key().data() + setKey_.size() + 1, key().size() - setKey_.size() - 1};
+    return {key().data() + prefix_.size(), key().size() - prefix_.size()};
   }
   int64_t score() const {
     return static_cast<int64_t>(DecodeFixed64(value().data()) - ScoreOffset);
   };
 
 private:
-  Slice setKey_;
+  NodeScanOptions options_;
+  std::string prefix_;
   bool valid_;
-  bool IsMemberKey() const {
-    return key().size() > setKey_.size() && key()[setKey_.size()] == (char)0xff;
-  }
+  uint64_t version_;
 };
 
 
@@ -212,7 +242,12 @@ public:
   RedisZSetBasicImpl() noexcept;
   ~RedisZSetBasicImpl() noexcept final;
 
+  Status EncodeRecord(const BulkRecord& record, KeyValues* kvs) noexcept override;
+
   Status Del(const Slice& key);
+  Status ReclaimStaleVersions(std::shared_mutex* commits) noexcept override;
+  Status UpgradeLayout() noexcept override;
+  std::string NodeSeparators() const noexcept override;
 
   Status ZCard(const Slice& key, uint64_t* len) final;
   Status ZScore(const Slice& key, const Slice& member, int64_t* score) final;
@@ -254,7 +289,20 @@ public:
   Status ZInterStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count) final;
   Status ZDiffStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count) final;
 
+protected:
+  // Scored member keys hold nothing and member keys the score, 8 bytes
+  // as the meta values before versions, so with legacyMetas a member key
+  // is only taken as one if its scored member key is stored too.
+  Status IsNodeOf(const Slice& metaKey,
+                  const Slice& rawKey,
+                  const Slice& value,
+                  bool versioned,
+                  bool legacyMetas,
+                  const ReadOptions& options,
+                  bool* isNode) noexcept override;
+
 private:
+  Status GetMetaValue(const Slice& key, ZSetMetaValue* metaValue, const DB_ENGINE::Snapshot* snapshot);
   Status ZRankInternal(const Slice& key, const Slice& member, uint64_t* rank, bool rev);
   Status ZPop(const Slice& key, ScoredMember* scoredMember, MinOrMax minOrMax);
   Member2Score ZUnionAsMap(const std::vector<Slice>& keys);
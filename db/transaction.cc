@@ -0,0 +1,346 @@
+#include "transaction.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace merodis {
+
+std::vector<std::unique_lock<std::mutex>> KeyVersions::Lock(const std::vector<Slice>& keys) noexcept {
+  std::vector<size_t> stripes;
+  stripes.reserve(keys.size());
+  for (const Slice& key: keys) stripes.push_back(StripeOf(key));
+  std::sort(stripes.begin(), stripes.end());
+  stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+  std::vector<std::unique_lock<std::mutex>> locks;
+  locks.reserve(stripes.size());
+  for (size_t stripe: stripes) locks.emplace_back(stripes_[stripe].mutex);
+  return locks;
+}
+
+uint64_t KeyVersions::Version(const Slice& key) const noexcept {
+  return stripes_[StripeOf(key)].version.load(std::memory_order_acquire);
+}
+
+void KeyVersions::Bump(const Slice& key) noexcept {
+  stripes_[StripeOf(key)].version.fetch_add(1, std::memory_order_release);
+}
+
+void KeyVersions::BeginWrite(const std::vector<Slice>& keys) noexcept {
+  std::vector<std::unique_lock<std::mutex>> locks = Lock(keys);
+  for (const Slice& key: keys) {
+    stripes_[StripeOf(key)].writes.fetch_add(1, std::memory_order_relaxed);
+    Bump(key);
+  }
+}
+
+void KeyVersions::EndWrite(const std::vector<Slice>& keys) noexcept {
+  // Bumped first, so a commit seeing the write over sees the bump too.
+  for (const Slice& key: keys) {
+    Bump(key);
+    stripes_[StripeOf(key)].writes.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+bool KeyVersions::Writing(const Slice& key) const noexcept {
+  return stripes_[StripeOf(key)].writes.load(std::memory_order_acquire) > 0;
+}
+
+size_t KeyVersions::StripeOf(const Slice& key) const noexcept {
+  return std::hash<std::string_view>()(std::string_view(key.data(), key.size())) % kStripes;
+}
+
+void TransactionState::Watch(const KeyVersions& versions, const Slice& key, bool written) noexcept {
+  auto watched = keys.try_emplace(key.ToString(), WatchedKey{versions.Version(key), written});
+  if (written) watched.first->second.written = true;
+}
+
+WriteScope::WriteScope(KeyVersions* versions, TransactionState* transaction, const std::vector<Slice>& keys) noexcept:
+  versions_(nullptr),
+  writing_(false) {
+  // Snapshot views have no versions, as they do not write.
+  if (!versions) return;
+  if (transaction) {
+    for (const Slice& key: keys) transaction->Watch(*versions, key, true);
+    return;
+  }
+  versions_ = versions;
+  keys_ = keys;
+  Reacquire();
+}
+
+WriteScope::~WriteScope() noexcept {
+  Release();
+}
+
+void WriteScope::Release() noexcept {
+  if (!writing_) return;
+  versions_->EndWrite(keys_);
+  writing_ = false;
+}
+
+void WriteScope::Reacquire() noexcept {
+  if (!versions_ || writing_) return;
+  versions_->BeginWrite(keys_);
+  writing_ = true;
+}
+
+#ifdef ROCKSDB
+
+class BufferAppender : public WriteBatch::Handler {
+public:
+  BufferAppender(DB_ENGINE::ColumnFamilyHandle* family, DB_ENGINE::WriteBatchWithIndex* buffer):
+    family_(family), buffer_(buffer) {}
+
+  Status PutCF(uint32_t, const Slice& key, const Slice& value) override {
+    return buffer_->Put(family_, key, value);
+  }
+  Status DeleteCF(uint32_t, const Slice& key) override {
+    return buffer_->Delete(family_, key);
+  }
+  Status SingleDeleteCF(uint32_t, const Slice& key) override {
+    return buffer_->SingleDelete(family_, key);
+  }
+  Status DeleteRangeCF(uint32_t, const Slice& beginKey, const Slice& endKey) override {
+    return buffer_->DeleteRange(family_, beginKey, endKey);
+  }
+  Status MergeCF(uint32_t, const Slice& key, const Slice& value) override {
+    return buffer_->Merge(family_, key, value);
+  }
+
+private:
+  DB_ENGINE::ColumnFamilyHandle* family_;
+  DB_ENGINE::WriteBatchWithIndex* buffer_;
+};
+
+// The view does not own the instance of the data type.
+TransactionDB::TransactionDB(DB* base) noexcept:
+  StackableDB(std::shared_ptr<DB>(base, [](DB*) {})),
+  buffer_(DB_ENGINE::BytewiseComparator(), 0, true) {}
+
+Status TransactionDB::Get(const ReadOptions& options,
+                          DB_ENGINE::ColumnFamilyHandle* family,
+                          const Slice& key,
+                          DB_ENGINE::PinnableSlice* value) {
+  return buffer_.GetFromBatchAndDB(db_, options, family, key, value);
+}
+
+void TransactionDB::MultiGet(const ReadOptions& options,
+                             DB_ENGINE::ColumnFamilyHandle* family,
+                             size_t n,
+                             const Slice* keys,
+                             DB_ENGINE::PinnableSlice* values,
+                             Status* statuses,
+                             bool sortedInput) {
+  buffer_.MultiGetFromBatchAndDB(db_, options, family, n, keys, values, statuses, sortedInput);
+}
+
+Iterator* TransactionDB::NewIterator(const ReadOptions& options, DB_ENGINE::ColumnFamilyHandle* family) {
+  return buffer_.NewIteratorWithBase(family, db_->NewIterator(options, family), &options);
+}
+
+// The buffer takes no range deletions, which the data types write as point
+// deletions on a transaction view instead, see RangeDeletion.
+Status TransactionDB::Write(const WriteOptions&, WriteBatch* updates) {
+  BufferAppender appender(DefaultColumnFamily(), &buffer_);
+  return updates->Iterate(&appender);
+}
+
+bool TransactionDB::empty() noexcept {
+  return buffer_.GetWriteBatch()->Count() == 0;
+}
+
+WriteBatch* TransactionDB::updates() noexcept {
+  return buffer_.GetWriteBatch();
+}
+
+void TransactionDB::Clear() noexcept {
+  buffer_.Clear();
+}
+
+#else
+
+// Merges the buffer of a transaction view into an iterator over the
+// instance, the buffered value of a key hiding the stored one.
+class TransactionIterator : public Iterator {
+public:
+  TransactionIterator(Iterator* base, const TransactionDB::Buffer* buffer):
+    base_(base),
+    buffer_(buffer),
+    delta_(buffer->end()),
+    forward_(true),
+    current_(kNone) {}
+  TransactionIterator(const TransactionIterator&) = delete;
+  TransactionIterator& operator=(const TransactionIterator&) = delete;
+  ~TransactionIterator() override { delete base_; }
+
+  bool Valid() const override { return current_ != kNone; }
+  void SeekToFirst() override {
+    forward_ = true;
+    base_->SeekToFirst();
+    delta_ = buffer_->begin();
+    Settle();
+  }
+  void SeekToLast() override {
+    forward_ = false;
+    base_->SeekToLast();
+    delta_ = buffer_->empty() ? buffer_->end() : std::prev(buffer_->end());
+    Settle();
+  }
+  void Seek(const Slice& target) override {
+    forward_ = true;
+    base_->Seek(target);
+    delta_ = buffer_->lower_bound(target.ToString());
+    Settle();
+  }
+  void Next() override {
+    if (!forward_) Seek(key().ToString());
+    Skip();
+    Settle();
+  }
+  void Prev() override {
+    if (forward_) SeekAtOrBefore(key().ToString());
+    Skip();
+    Settle();
+  }
+  Slice key() const override { return current_ == kBase ? base_->key() : Slice(delta_->first); }
+  Slice value() const override { return current_ == kBase ? base_->value() : Slice(*delta_->second); }
+  Status status() const override { return base_->status(); }
+
+private:
+  // Which of the two iterators is at the current key, both when the
+  // buffered value hides a stored one.
+  enum Current {kNone, kBase, kDelta, kBoth};
+
+  // Positions both iterators backwards, at the last key up to target.
+  void SeekAtOrBefore(const std::string& target) {
+    forward_ = false;
+    base_->Seek(target);
+    if (!base_->Valid()) {
+      base_->SeekToLast();
+    } else if (base_->key().compare(target) > 0) {
+      base_->Prev();
+    }
+    auto after = buffer_->upper_bound(target);
+    delta_ = after == buffer_->begin() ? buffer_->end() : std::prev(after);
+    Settle();
+  }
+  // Moves past the current key in the current direction.
+  void Skip() {
+    if (current_ == kBase || current_ == kBoth) forward_ ? base_->Next() : base_->Prev();
+    if (current_ == kDelta || current_ == kBoth) {
+      if (forward_) {
+        ++delta_;
+      } else {
+        delta_ = delta_ == buffer_->begin() ? buffer_->end() : std::prev(delta_);
+      }
+    }
+  }
+  // Settles on the next key in the current direction, skipping the keys
+  // deleted by the buffer.
+  void Settle() {
+    while (true) {
+      bool hasBase = base_->Valid();
+      if (delta_ == buffer_->end()) {
+        current_ = hasBase ? kBase : kNone;
+        return;
+      }
+      int order = hasBase ? Slice(delta_->first).compare(base_->key()) : 0;
+      if (hasBase && (forward_ ? order > 0 : order < 0)) {
+        current_ = kBase;
+        return;
+      }
+      current_ = hasBase && order == 0 ? kBoth : kDelta;
+      if (delta_->second) return;
+      Skip();
+    }
+  }
+
+  Iterator* base_;
+  const TransactionDB::Buffer* buffer_;
+  TransactionDB::Buffer::const_iterator delta_;
+  bool forward_;
+  Current current_;
+};
+
+class BufferAppender : public WriteBatch::Handler {
+public:
+  explicit BufferAppender(TransactionDB::Buffer* buffer): buffer_(buffer) {}
+
+  void Put(const Slice& key, const Slice& value) override {
+    (*buffer_)[key.ToString()] = value.ToString();
+  }
+  void Delete(const Slice& key) override {
+    (*buffer_)[key.ToString()] = std::nullopt;
+  }
+
+private:
+  TransactionDB::Buffer* buffer_;
+};
+
+TransactionDB::TransactionDB(DB* base) noexcept:
+  base_(base) {}
+
+Status TransactionDB::Put(const WriteOptions& options, const Slice& key, const Slice& value) {
+  WriteBatch updates;
+  updates.Put(key, value);
+  return Write(options, &updates);
+}
+
+Status TransactionDB::Delete(const WriteOptions& options, const Slice& key) {
+  WriteBatch updates;
+  updates.Delete(key);
+  return Write(options, &updates);
+}
+
+Status TransactionDB::Write(const WriteOptions&, WriteBatch* updates) {
+  BufferAppender appender(&buffer_);
+  Status s = updates->Iterate(&appender);
+  if (!s.ok()) return s;
+  updates_.Append(*updates);
+  return Status::OK();
+}
+
+Status TransactionDB::Get(const ReadOptions& options, const Slice& key, std::string* value) {
+  auto buffered = buffer_.find(key.ToString());
+  if (buffered == buffer_.end()) return base_->Get(options, key, value);
+  if (!buffered->second) return Status::NotFound("");
+  *value = *buffered->second;
+  return Status::OK();
+}
+
+Iterator* TransactionDB::NewIterator(const ReadOptions& options) {
+  return new TransactionIterator(base_->NewIterator(options), &buffer_);
+}
+
+const DB_ENGINE::Snapshot* TransactionDB::GetSnapshot() {
+  return base_->GetSnapshot();
+}
+
+void TransactionDB::ReleaseSnapshot(const DB_ENGINE::Snapshot* snapshot) {
+  base_->ReleaseSnapshot(snapshot);
+}
+
+bool TransactionDB::GetProperty(const Slice& property, std::string* value) {
+  return base_->GetProperty(property, value);
+}
+
+void TransactionDB::GetApproximateSizes(const DB_ENGINE::Range* range, int n, uint64_t* sizes) {
+  base_->GetApproximateSizes(range, n, sizes);
+}
+
+void TransactionDB::CompactRange(const Slice* begin, const Slice* end) {
+  base_->CompactRange(begin, end);
+}
+
+void TransactionDB::Clear() noexcept {
+  buffer_.clear();
+  updates_.Clear();
+}
+
+#endif
+
+}
\ No newline at end of file
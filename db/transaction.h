@@ -0,0 +1,181 @@
+#ifndef MERODIS_TRANSACTION_H
+#define MERODIS_TRANSACTION_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "merodis/merodis.h"
+
+#ifdef ROCKSDB
+#include "rocksdb/utilities/stackable_db.h"
+#include "rocksdb/utilities/write_batch_with_index.h"
+#endif
+
+namespace merodis {
+
+// The versions of the keys of an instance, bumped by every write of a key
+// and checked by the commits of its transactions, see
+// Merodis::BeginTransaction. Keys hashed to the same stripe share its lock,
+// version and count of writes under way, which costs a spurious conflict
+// now and then. The lock is only held across the engine write by commits.
+class KeyVersions {
+public:
+  KeyVersions() noexcept = default;
+  KeyVersions(const KeyVersions&) = delete;
+  KeyVersions& operator=(const KeyVersions&) = delete;
+  ~KeyVersions() noexcept = default;
+
+  // Locks the stripes of keys, each once and in order.
+  std::vector<std::unique_lock<std::mutex>> Lock(const std::vector<Slice>& keys) noexcept;
+  uint64_t Version(const Slice& key) const noexcept;
+  // Bumps the version of key, whose stripe the caller locked.
+  void Bump(const Slice& key) noexcept;
+  // Bumps the versions of keys and counts their writes as under way, once
+  // the commits holding their stripes are done.
+  void BeginWrite(const std::vector<Slice>& keys) noexcept;
+  // Bumps the versions of keys again and ends their writes.
+  void EndWrite(const std::vector<Slice>& keys) noexcept;
+  // Whether a write of key is under way, which a commit watching it must
+  // not overlap.
+  bool Writing(const Slice& key) const noexcept;
+
+  // Held shared by the commits of the transactions and exclusively while
+  // a checkpoint is taken, so a checkpoint holds all of a commit or none,
+  // and while a value log is collected, see Redis::CollectValueLog.
+  std::shared_mutex commits;
+
+private:
+  struct Stripe {
+    std::mutex mutex;
+    std::atomic<uint64_t> version{0};
+    std::atomic<uint32_t> writes{0};
+  };
+  static constexpr size_t kStripes = 4096;
+
+  size_t StripeOf(const Slice& key) const noexcept;
+
+  std::array<Stripe, kStripes> stripes_;
+};
+
+// The keys a transaction view watches, each with its version when first
+// watched or written.
+struct TransactionState {
+  struct WatchedKey {
+    uint64_t version;
+    bool written;
+  };
+
+  explicit TransactionState(Merodis* base) noexcept: base(base) {}
+
+  // Watches key unless it is already, at versions.
+  void Watch(const KeyVersions& versions, const Slice& key, bool written) noexcept;
+
+  // The instance the transaction commits into.
+  Merodis* base;
+  std::unordered_map<std::string, WatchedKey> keys;
+};
+
+// Covers one command writing keys. On an instance, it bumps the versions
+// of the keys before and after the command and marks it under way, so the
+// commits watching them fail rather than overlap it, without locking the
+// keys across the engine write. On a transaction view, it watches the keys
+// from before the command reads them on.
+class WriteScope {
+public:
+  WriteScope(KeyVersions* versions, TransactionState* transaction, const std::vector<Slice>& keys) noexcept;
+  WriteScope(const WriteScope&) = delete;
+  WriteScope& operator=(const WriteScope&) = delete;
+  ~WriteScope() noexcept;
+
+  // Ends the write of the keys, for a command that has not written them
+  // yet and will not until it calls Reacquire.
+  void Release() noexcept;
+  // Starts the write of the keys again after Release, to write them.
+  void Reacquire() noexcept;
+
+private:
+  KeyVersions* versions_;
+  std::vector<Slice> keys_;
+  bool writing_;
+};
+
+// The engine instance of one data type as a transaction view sees it: the
+// instance overlaid by the writes of the view, which are only buffered
+// until committed by writing updates() into the instance.
+#ifdef ROCKSDB
+class TransactionDB final : public DB_ENGINE::StackableDB {
+public:
+  explicit TransactionDB(DB* base) noexcept;
+  TransactionDB(const TransactionDB&) = delete;
+  TransactionDB& operator=(const TransactionDB&) = delete;
+  ~TransactionDB() noexcept override = default;
+
+  using DB_ENGINE::StackableDB::Get;
+  Status Get(const ReadOptions& options,
+             DB_ENGINE::ColumnFamilyHandle* family,
+             const Slice& key,
+             DB_ENGINE::PinnableSlice* value) override;
+  using DB_ENGINE::StackableDB::MultiGet;
+  void MultiGet(const ReadOptions& options,
+                DB_ENGINE::ColumnFamilyHandle* family,
+                size_t n,
+                const Slice* keys,
+                DB_ENGINE::PinnableSlice* values,
+                Status* statuses,
+                bool sortedInput) override;
+  using DB_ENGINE::StackableDB::NewIterator;
+  Iterator* NewIterator(const ReadOptions& options, DB_ENGINE::ColumnFamilyHandle* family) override;
+  using DB_ENGINE::StackableDB::Write;
+  Status Write(const WriteOptions& options, WriteBatch* updates) override;
+
+  bool empty() noexcept;
+  WriteBatch* updates() noexcept;
+  void Clear() noexcept;
+
+private:
+  DB_ENGINE::WriteBatchWithIndex buffer_;
+};
+#else
+class TransactionDB final : public DB {
+public:
+  // The latest value of each key written, null where deleted.
+  typedef std::map<std::string, std::optional<std::string>> Buffer;
+
+  explicit TransactionDB(DB* base) noexcept;
+  TransactionDB(const TransactionDB&) = delete;
+  TransactionDB& operator=(const TransactionDB&) = delete;
+  ~TransactionDB() noexcept override = default;
+
+  Status Put(const WriteOptions& options, const Slice& key, const Slice& value) override;
+  Status Delete(const WriteOptions& options, const Slice& key) override;
+  Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  Status Get(const ReadOptions& options, const Slice& key, std::string* value) override;
+  Iterator* NewIterator(const ReadOptions& options) override;
+  const DB_ENGINE::Snapshot* GetSnapshot() override;
+  void ReleaseSnapshot(const DB_ENGINE::Snapshot* snapshot) override;
+  bool GetProperty(const Slice& property, std::string* value) override;
+  void GetApproximateSizes(const DB_ENGINE::Range* range, int n, uint64_t* sizes) override;
+  void CompactRange(const Slice* begin, const Slice* end) override;
+
+  bool empty() const noexcept { return buffer_.empty(); }
+  WriteBatch* updates() noexcept { return &updates_; }
+  void Clear() noexcept;
+
+private:
+  DB* base_;
+  Buffer buffer_;
+  WriteBatch updates_;
+};
+#endif
+
+}
+
+#endif //MERODIS_TRANSACTION_H
@@ -0,0 +1,231 @@
+#include "value_log.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "util/coding.h"
+
+namespace merodis {
+
+namespace fs = std::filesystem;
+
+static const char* const kFileSuffix = ".vlog";
+static constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+
+static Status IOError(const std::string& path) noexcept {
+  return Status::IOError(path, std::strerror(errno));
+}
+
+struct ValueLog::File {
+  explicit File(int fd) noexcept: fd(fd) {}
+  ~File() noexcept { ::close(fd); }
+
+  Status ReadAt(uint64_t offset, size_t size, std::string* data) const noexcept {
+    data->resize(size);
+    size_t read = 0;
+    while (read < size) {
+      ssize_t n = ::pread(fd, data->data() + read, size - read, static_cast<off_t>(offset + read));
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) return Status::IOError("value log", std::strerror(errno));
+      if (n == 0) return Status::Corruption("value log", "truncated record");
+      read += n;
+    }
+    return Status::OK();
+  }
+
+  int fd;
+};
+
+ValueLog::ValueLog() noexcept:
+  max_file_size_(0),
+  current_(0),
+  current_size_(0),
+  pins_(0) {}
+
+ValueLog::~ValueLog() noexcept = default;
+
+std::string ValueLog::FileName(uint64_t number) const noexcept {
+  return dir_ + "/" + std::to_string(number) + kFileSuffix;
+}
+
+Status ValueLog::Open(const std::string& dir, uint64_t max_file_size) noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  dir_ = dir;
+  max_file_size_ = max_file_size;
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  if (ec) return Status::IOError(dir, ec.message());
+  for (fs::directory_iterator iter(dir, ec), end; !ec && iter != end; iter.increment(ec)) {
+    std::string name = iter->path().filename().string();
+    if (iter->path().extension() != kFileSuffix) continue;
+    uint64_t number = std::strtoull(name.c_str(), nullptr, 10);
+    int fd = ::open(FileName(number).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return IOError(FileName(number));
+    files_.emplace(number, std::make_shared<File>(fd));
+  }
+  if (ec) return Status::IOError(dir, ec.message());
+  return NewFile();
+}
+
+Status ValueLog::NewFile() noexcept {
+  if (!files_.empty() && ::fdatasync(files_.rbegin()->second->fd) != 0) return IOError(FileName(current_));
+  uint64_t number = files_.empty() ? 1 : files_.rbegin()->first + 1;
+  int fd = ::open(FileName(number).c_str(), O_RDWR | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) return IOError(FileName(number));
+  files_.emplace(number, std::make_shared<File>(fd));
+  current_ = number;
+  current_size_ = 0;
+  return Status::OK();
+}
+
+Status ValueLog::Append(const Slice& key, const Slice& value, std::string* pointer) noexcept {
+  std::string record(kHeaderSize, 0);
+  EncodeFixed32(record.data(), key.size());
+  EncodeFixed32(record.data() + sizeof(uint32_t), value.size());
+  record.append(key.data(), key.size());
+  record.append(value.data(), value.size());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (current_size_ >= max_file_size_) {
+    Status s = NewFile();
+    if (!s.ok()) return s;
+  }
+  int fd = files_[current_]->fd;
+  size_t written = 0;
+  while (written < record.size()) {
+    ssize_t n = ::write(fd, record.data() + written, record.size() - written);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      Status s = IOError(FileName(current_));
+      // The bytes written would shift the records appended after them, so
+      // they are cut off, or else the file is sealed, left ending in what
+      // Scan takes for a torn append, and the next append opens another.
+      if (written && ::ftruncate(fd, static_cast<off_t>(current_size_)) != 0) current_size_ = max_file_size_;
+      return s;
+    }
+    written += n;
+  }
+  pointer->resize(kPointerSize);
+  EncodeFixed64(pointer->data(), current_);
+  EncodeFixed64(pointer->data() + sizeof(uint64_t), current_size_ + kHeaderSize + key.size());
+  EncodeFixed32(pointer->data() + 2 * sizeof(uint64_t), value.size());
+  current_size_ += record.size();
+  return Status::OK();
+}
+
+Status ValueLog::Read(const Slice& pointer, std::string* value) noexcept {
+  if (pointer.size() != kPointerSize) return Status::Corruption("value log", "bad pointer");
+  uint64_t number = DecodeFixed64(pointer.data());
+  std::shared_ptr<File> file;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = files_.find(number);
+    if (iter == files_.end()) return Status::Corruption(FileName(number), "missing");
+    file = iter->second;
+  }
+  return file->ReadAt(DecodeFixed64(pointer.data() + sizeof(uint64_t)),
+                      DecodeFixed32(pointer.data() + 2 * sizeof(uint64_t)),
+                      value);
+}
+
+Status ValueLog::Sync() noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (::fdatasync(files_[current_]->fd) != 0) return IOError(FileName(current_));
+  return Status::OK();
+}
+
+std::vector<uint64_t> ValueLog::SealedFiles() noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<uint64_t> numbers;
+  for (const auto& [number, _]: files_) {
+    if (number == current_ || std::count(dropped_.begin(), dropped_.end(), number)) continue;
+    numbers.push_back(number);
+  }
+  return numbers;
+}
+
+Status ValueLog::Scan(uint64_t number,
+                      const std::function<Status(const Slice& key, const Slice& value, const Slice& pointer)>& visit) noexcept {
+  std::shared_ptr<File> file;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = files_.find(number);
+    if (iter == files_.end() || number == current_) return Status::InvalidArgument(FileName(number), "not sealed");
+    file = iter->second;
+  }
+  off_t size = ::lseek(file->fd, 0, SEEK_END);
+  if (size < 0) return IOError(FileName(number));
+  std::string header, record, pointer(kPointerSize, 0);
+  EncodeFixed64(pointer.data(), number);
+  uint64_t offset = 0;
+  while (offset + kHeaderSize <= static_cast<uint64_t>(size)) {
+    Status s = file->ReadAt(offset, kHeaderSize, &header);
+    if (!s.ok()) return s;
+    uint32_t keySize = DecodeFixed32(header.data());
+    uint32_t valueSize = DecodeFixed32(header.data() + sizeof(uint32_t));
+    // Left by a crash in the middle of an append.
+    if (offset + kHeaderSize + keySize + valueSize > static_cast<uint64_t>(size)) break;
+    s = file->ReadAt(offset + kHeaderSize, keySize + valueSize, &record);
+    if (!s.ok()) return s;
+    EncodeFixed64(pointer.data() + sizeof(uint64_t), offset + kHeaderSize + keySize);
+    EncodeFixed32(pointer.data() + 2 * sizeof(uint64_t), valueSize);
+    s = visit(Slice(record.data(), keySize), Slice(record.data() + keySize, valueSize), pointer);
+    if (!s.ok()) return s;
+    offset += kHeaderSize + keySize + valueSize;
+  }
+  return Status::OK();
+}
+
+void ValueLog::Drop(uint64_t number) noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  dropped_.push_back(number);
+}
+
+Status ValueLog::DeleteDropped() noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pins_) return Status::OK();
+  for (uint64_t number: dropped_) {
+    files_.erase(number);
+    if (::unlink(FileName(number).c_str()) != 0 && errno != ENOENT) return IOError(FileName(number));
+  }
+  dropped_.clear();
+  return Status::OK();
+}
+
+Status ValueLog::Checkpoint(const std::string& dir) noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (current_size_) {
+    Status s = NewFile();
+    if (!s.ok()) return s;
+  }
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  if (ec) return Status::IOError(dir, ec.message());
+  for (const auto& [number, _]: files_) {
+    if (number == current_ || std::count(dropped_.begin(), dropped_.end(), number)) continue;
+    fs::create_hard_link(FileName(number), dir + "/" + std::to_string(number) + kFileSuffix, ec);
+    if (ec) return Status::IOError(FileName(number), ec.message());
+  }
+  return Status::OK();
+}
+
+void ValueLog::Pin() noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pins_++;
+}
+
+void ValueLog::Unpin() noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pins_--;
+}
+
+}
\ No newline at end of file
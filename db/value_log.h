@@ -0,0 +1,79 @@
+#ifndef MERODIS_VALUE_LOG_H
+#define MERODIS_VALUE_LOG_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "merodis/merodis.h"
+
+namespace merodis {
+
+// The values of one data type kept out of its LSM tree, which stores a
+// pointer to them instead, see TypeOptions::min_blob_size. The values are
+// appended to numbered files, each record made of
+//
+//   key length (fixed32) | value length (fixed32) | key | value
+//
+// with key the engine key pointing to the value. A file is sealed once it
+// grows past max_file_size, or by Seal, and never written again. Sealed
+// files are rewritten by Redis::CollectValueLog, which leaves the values
+// still pointed to in the current file and deletes the rest.
+class ValueLog {
+public:
+  ValueLog() noexcept;
+  ValueLog(const ValueLog&) = delete;
+  ValueLog& operator=(const ValueLog&) = delete;
+  ~ValueLog() noexcept;
+
+  // Opens the log in dir, sealing the files there and appending to a new one.
+  Status Open(const std::string& dir, uint64_t max_file_size = 64 << 20) noexcept;
+  // Appends value, stored at key, setting *pointer to where it lands.
+  Status Append(const Slice& key, const Slice& value, std::string* pointer) noexcept;
+  Status Read(const Slice& pointer, std::string* value) noexcept;
+  // Makes the values appended so far survive a crash of the machine.
+  Status Sync() noexcept;
+  // The numbers of the sealed files, oldest first.
+  std::vector<uint64_t> SealedFiles() noexcept;
+  // Calls visit on the records of a sealed file, with the pointer to each
+  // value, stopping at the first record the file ends within.
+  Status Scan(uint64_t number,
+              const std::function<Status(const Slice& key, const Slice& value, const Slice& pointer)>& visit) noexcept;
+  // Drops the sealed file number, deleted once no snapshot is pinned and
+  // the next collection starts, as reads may still follow its pointers.
+  void Drop(uint64_t number) noexcept;
+  // Deletes the files dropped so far, unless a snapshot is pinned.
+  Status DeleteDropped() noexcept;
+  // Seals the current file and hard links every sealed file into dir.
+  Status Checkpoint(const std::string& dir) noexcept;
+  // Keeps the dropped files while a view reading a snapshot is open.
+  void Pin() noexcept;
+  void Unpin() noexcept;
+
+  static constexpr size_t kPointerSize = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+private:
+  struct File;
+
+  std::string FileName(uint64_t number) const noexcept;
+  // Starts a new current file. Requires mutex_.
+  Status NewFile() noexcept;
+
+  std::mutex mutex_;
+  std::string dir_;
+  uint64_t max_file_size_;
+  std::map<uint64_t, std::shared_ptr<File>> files_;
+  // The file appended to, the last of files_.
+  uint64_t current_;
+  uint64_t current_size_;
+  std::vector<uint64_t> dropped_;
+  int pins_;
+};
+
+}
+
+#endif //MERODIS_VALUE_LOG_H
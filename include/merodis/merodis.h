@@ -1,10 +1,14 @@
 #ifndef MERODIS_MERODIS_H
 #define MERODIS_MERODIS_H
 
+#include <condition_variable>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <utility>
 #include <optional>
 
@@ -39,6 +43,7 @@ typedef int64_t Score;
 typedef std::vector<Member> Members;
 typedef std::vector<Score> Scores;
 typedef std::vector<std::optional<Score>> ScoreOpts;
+typedef std::vector<std::optional<std::string>> ValueOpts;
 typedef std::map<Member, Score> Member2Score;
 typedef std::pair<Member, Score> ScoredMember;
 typedef std::vector<ScoredMember> ScoredMembers;
@@ -71,14 +76,229 @@ enum SetImpl {
 enum ZSetImpl {
   kZSetBasicImpl,
 };
+// The engine storing the data types, see Options::engine.
+enum Engine {
+  kLevelDBEngine,
+  kRocksDBEngine,
+};
+enum DataType {
+  kStringType,
+  kListType,
+  kHashType,
+  kSetType,
+  kZSetType,
+};
+// How far the writes are made durable before they return.
+enum Durability {
+  // Appended to the WAL, surviving a crash of the process but not of the
+  // machine.
+  kAsyncDurability,
+  // Appended to the WAL, which is synced before returning.
+  kSyncDurability,
+  // Appended to the WAL, which a background thread syncs every
+  // Options::sync_interval, bounding the writes a crash of the machine
+  // loses.
+  kPeriodicSyncDurability,
+  // Not written to the WAL, so a crash of the process loses the writes not
+  // flushed yet. Meant for data that can be rebuilt, such as caches. LevelDB
+  // always writes the WAL, which this then behaves as kAsyncDurability.
+  kNoWALDurability,
+};
+
+// Engine options of the storage of one data type. Unset fields fall back
+// to the engine options shared by all data types. On LevelDB in single_db
+// mode the data types share one set of tables, which take the largest
+// bloom_bits of them, and the fields marked below are ignored.
+struct TypeOptions {
+  // Bits per key of the bloom filter, 0 disables the filter.
+  std::optional<int> bloom_bits;
+  // Also filter the scans over one hash, set or zset by the prefix bloom of
+  // its user key. RocksDB only.
+  bool prefix_bloom = false;
+  // Ignored on LevelDB in single_db mode.
+  std::optional<size_t> block_size;
+  // Ignored on LevelDB in single_db mode.
+  std::optional<DB_ENGINE::CompressionType> compression;
+  // Ignored on LevelDB in single_db mode.
+  std::optional<size_t> write_buffer_size;
+  // Share of Options::block_cache_size reserved for this data type.
+  // Ignored on LevelDB in single_db mode, where the data types share one
+  // block cache of that capacity.
+  std::optional<double> cache_share;
+  // Values of at least this many bytes are kept out of the LSM tree, which
+  // stores a pointer in their place, so compactions do not rewrite them.
+  // RocksDB keeps them in BlobDB files, garbage collected by compactions.
+  // LevelDB keeps the values of typed strings and hash fields in a value
+  // log next to the data type, collected by Merodis::CollectValueLogs. On
+  // LevelDB the values are then stored tagged, so the option must stay set,
+  // or unset, for the life of the data type. The LAYOUT file records it and
+  // Merodis::Open fails with InvalidArgument on a change unless the data
+  // type is empty.
+  std::optional<uint64_t> min_blob_size;
+#ifdef ROCKSDB
+  // Resolves the merges written by the data type. Set by Merodis::Open for
+  // the implementations writing merges, RocksDB only.
+  std::shared_ptr<DB_ENGINE::MergeOperator> merge_operator;
+#endif
+};
 
 struct Options : public EngineOptions {
+  // The engine storing the instance, the one Merodis is compiled against,
+  // whose types the API takes. Open fails with NotSupported on an engine
+  // the build lacks, see SupportsEngine, and with InvalidArgument on an
+  // instance another engine stores.
+#ifdef ROCKSDB
+  enum Engine engine = kRocksDBEngine;
+#else
+  enum Engine engine = kLevelDBEngine;
+#endif
   enum StringImpl string_impl = kStringTypedImpl;
   enum ListImpl list_impl = kListArrayImpl;
   enum HashImpl hash_impl = kHashBasicImpl;
   enum SetImpl set_impl = kSetBasicImpl;
   enum ZSetImpl zset_impl = kZSetBasicImpl;
   bool set_memory_meta = false;
+  // Keep all data types in one engine instance instead of one per type,
+  // so they share a single WAL, memtable and block cache.
+  bool single_db = false;
+  // Capacity of the block cache split by TypeOptions::cache_share. In
+  // single_db mode, the data types without a share of their own use one
+  // block cache of this capacity, which RocksDB also charges for the
+  // memtables of all of them, and LevelDB skips if block_cache is set.
+  // Otherwise, on LevelDB, the data types without a share keep the block
+  // cache of the engine options.
+  size_t block_cache_size = 64 << 20;
+  // Reads of whole hashes, sets and zsets (HGetAll, HKeys, HVals, SMembers
+  // and the set and zset algebra) holding at least this many elements
+  // bypass the block cache, so a single large one does not evict the hot
+  // working set. 0 disables the check, which costs a meta read per key.
+  uint64_t bulk_read_threshold = 0;
+  // Writes of concurrent callers to the same data type are committed
+  // together by one engine write. The caller leading a group waits this
+  // many microseconds for more writes to join it, trading the latency of
+  // every write for fewer, larger commits, which pays off with synced
+  // writes. 0 commits whatever is queued right away.
+  uint64_t commit_interval = 0;
+  // Reads each data type from its first key on through the block cache
+  // before Open returns, up to its share of block_cache_size, so the first
+  // requests after a restart do not all miss the cache. The reads seek from
+  // meta value to meta value, past the nodes of each collection, loading
+  // the index and filter blocks of the tables they reach. On RocksDB those
+  // blocks are then kept in the block cache, pinned for level 0.
+  bool warm_up = false;
+  // Keeps the data in memory only, for caches where nothing needs to
+  // outlive the instance unless saved by Merodis::SaveTo. The engines keep
+  // their files in memory, and the WAL is skipped where the engine allows
+  // it.
+  bool in_memory = false;
+  // Durability of the writes not made under a DurabilityScope.
+  enum Durability durability = kAsyncDurability;
+  // Milliseconds between the WAL syncs of kPeriodicSyncDurability.
+  uint64_t sync_interval = 1000;
+#ifdef ROCKSDB
+  // Lets the batched lookups of HMGet, SMIsMember and ZMScore keep their
+  // table reads in flight together, through io_uring where RocksDB is
+  // built with liburing, instead of reading the blocks one by one.
+  bool async_io = false;
+#endif
+
+  // Unset by default, so every data type takes the engine options above.
+  TypeOptions string_options;
+  TypeOptions list_options;
+  TypeOptions hash_options;
+  TypeOptions set_options;
+  TypeOptions zset_options;
+
+  // Sets the type options to a profile suited to each data type, over the
+  // filter_policy, compression and block_size of the engine options.
+  // Strings are pure point lookups. Hashes, sets and zsets mix point
+  // lookups with scans over one collection, where sets and zsets store
+  // empty or 8-byte values that are not worth compressing. Lists are read
+  // by long sequential scans, which favor large blocks over filters.
+  // On LevelDB in single_db mode all data types share the same tables,
+  // which only take the largest bloom_bits of them.
+  void OptimizeForDataTypes() noexcept;
+};
+
+// Overrides Options::durability for the writes made by the calling thread
+// while the scope is alive, e.g. syncing the writes of one command:
+//
+//   {
+//     DurabilityScope sync(kSyncDurability);
+//     db.IncrBy("balance", 10, nullptr);
+//   }
+//
+// kPeriodicSyncDurability only takes effect when it is also the default of
+// the instance, which then runs the syncing thread.
+class DurabilityScope {
+public:
+  explicit DurabilityScope(Durability durability) noexcept;
+  DurabilityScope(const DurabilityScope&) = delete;
+  DurabilityScope& operator=(const DurabilityScope&) = delete;
+  ~DurabilityScope() noexcept;
+
+  // The durability of the innermost scope alive on the calling thread, or
+  // null outside of any.
+  static const Durability* Current() noexcept;
+
+private:
+  Durability durability_;
+  const DurabilityScope* outer_;
+};
+
+// One key of a bulk load, see BulkLoader.
+struct BulkRecord {
+  enum DataType type;
+  std::string key;
+  // The value of a string, the elements of a list in order, or the fields
+  // of a hash or the members of a set or zset, without duplicates.
+  std::vector<std::string> members;
+  // The values of the fields of a hash, in the order of members.
+  std::vector<std::string> values;
+  // The scores of the members of a zset, in the order of members.
+  Scores scores;
+};
+
+class Merodis;
+
+// Loads large amounts of data into a Merodis instance far faster than
+// writing it by commands. Records are encoded without reading the meta
+// values, buffered and sorted in runs of about buffer_size bytes. On
+// RocksDB each run is written by SstFileWriter into a table file under
+// work_path, and Finish ingests them all. LevelDB can not ingest tables,
+// so each run is written in large sorted batches instead.
+//
+// Every key must be new to its data type, even deleted sets and zsets
+// keep theirs, and added once. The keys are checked in sorted passes, the
+// keys of a run against the stored ones as the run is written, and on
+// RocksDB the runs against each other in Finish, so either the Add writing
+// the run or Finish fails with InvalidArgument otherwise.
+// Nothing is visible before Finish returns on RocksDB. The loaded keys
+// bump no key versions and serve no blocked pops, so load while no
+// transaction watches them and no pop blocks on them.
+class BulkLoader {
+public:
+  BulkLoader(Merodis* db, const std::string& work_path, size_t buffer_size = 64 << 20) noexcept;
+  BulkLoader(const BulkLoader&) = delete;
+  BulkLoader& operator=(const BulkLoader&) = delete;
+  ~BulkLoader() noexcept;
+
+  Status Add(const BulkRecord& record) noexcept;
+  Status Finish() noexcept;
+
+private:
+  // Sorts the buffered records and writes them as runs.
+  Status Flush() noexcept;
+
+  Merodis* db_;
+  std::string work_path_;
+  size_t buffer_size_;
+  size_t buffered_size_;
+  std::vector<std::vector<std::pair<std::string, std::string>>> buffers_;
+  std::vector<std::vector<std::string>> files_;
+  // The keys of the records buffered for each data type.
+  std::vector<std::vector<std::string>> keys_;
+  uint64_t file_number_;
 };
 
 class RedisString;
@@ -86,18 +306,84 @@ class RedisList;
 class RedisHash;
 class RedisSet;
 class RedisZSet;
+class KeyVersions;
+struct TransactionState;
 
 class Merodis {
 public:
   Merodis() noexcept;
   ~Merodis() noexcept;
 
+  // Opens the instance at db_path. An instance is opened once; opening it
+  // again fails with InvalidArgument. The first open of an instance written
+  // before sets and zsets carried versions rewrites them all, once.
   Status Open(const Options& options, const std::string& db_path) noexcept;
   static Status DestroyDB(const std::string& db_path, Options options) noexcept;
+  // Whether this build opens the instances stored by engine.
+  static bool SupportsEngine(Engine engine) noexcept;
+  // Deleting a whole set or zset leaves its members in place, unreachable.
+  // Call this periodically, off the request path, to reclaim their space.
+  // The deleted key keeps a meta value, of length 0 and the next version,
+  // so that recreating the key starts from it and the members of the older
+  // versions stay unreachable. This deletes that meta value once it has
+  // deleted those members, unless the key was written meanwhile.
+  // The list nodes left behind by the trims, pops and removals retiring
+  // more elements than one write deletes are deleted by the next writes to
+  // their list instead.
+  Status ReclaimStaleVersions() noexcept;
+  // Rewrites the value log files, see TypeOptions::min_blob_size, where at
+  // most max_live_share of the values are still pointed to, moving those
+  // to the current file. The files are deleted by the next call made while
+  // no snapshot is open. Call it periodically, off the request path.
+  // Writes to the data type wait while the pointers of a file are moved.
+  Status CollectValueLogs(double max_live_share = 0.5) noexcept;
+  // Opens *snapshot, a read-only view pinning the current state of each
+  // data type. Its reads keep seeing that state, however long they run,
+  // without blocking the writers. Its writes and blocking pops fail with
+  // NotSupported. It must be released by ReleaseSnapshot before this
+  // instance is closed.
+  Status GetSnapshot(Merodis** snapshot) noexcept;
+  static void ReleaseSnapshot(Merodis* snapshot) noexcept;
+  // Opens *transaction, a view reading this instance overlaid by its own
+  // writes, which are only buffered until Commit writes them all at once.
+  // Commit fails with NotFound, writing nothing, if a key the view wrote
+  // or watched was written meanwhile by another caller, as EXEC after
+  // WATCH does. Either way the view then starts over on the current state.
+  // Only in single_db mode may a commit write several data types, at once;
+  // else such a commit fails with NotSupported, writing nothing, as the
+  // data types would be written one by one. It must be released by
+  // ReleaseTransaction before this instance is closed.
+  Status BeginTransaction(Merodis** transaction) noexcept;
+  static void ReleaseTransaction(Merodis* transaction) noexcept;
+  Status Watch(const Slice& key) noexcept;
+  Status Commit() noexcept;
+  // Copies the data into a new instance on disk at db_path, which LoadFrom
+  // copies back, e.g. to bring an in_memory instance over a restart. Each
+  // data type is copied at a snapshot of its own, so writes made meanwhile
+  // may reach the copy of one data type and miss another. LoadFrom only
+  // loads into an empty instance, failing with InvalidArgument otherwise,
+  // as the keys it holds would mix with the loaded ones.
+  Status SaveTo(const std::string& db_path) noexcept;
+  Status LoadFrom(const std::string& db_path) noexcept;
+  // Writes a copy of the instance into checkpoint_path, on the same file
+  // system, which opens as an instance of its own. The table files are
+  // hard linked and the writes only wait while the rest is copied, so
+  // every data type is copied at the same point.
+  Status CreateCheckpoint(const std::string& checkpoint_path) noexcept;
+  // Backs the instance up into backup_path as the backup *backup_id,
+  // copying only the table files that the earlier backups there lack.
+  Status CreateBackup(const std::string& backup_path, uint64_t* backup_id) noexcept;
+  static Status RestoreBackup(const std::string& backup_path, uint64_t backup_id, const std::string& db_path) noexcept;
+  static Status DeleteBackup(const std::string& backup_path, uint64_t backup_id) noexcept;
 
   // String Operators
   Status Get(const Slice& key, std::string* value) noexcept;
   Status Set(const Slice& key, const Slice& value) noexcept;
+  // The result of Incr, IncrBy, Decr and DecrBy may be null when the caller
+  // does not need it, which on RocksDB turns them into blind writes, merged
+  // on read. A blind write can not fail as a read one does: an increment
+  // of a value that is not an integer, or that would overflow it, returns
+  // OK and is dropped when merged, leaving the value untouched.
   Status Incr(const Slice& key, int64_t* result) noexcept;
   Status IncrBy(const Slice& key, int64_t increment, int64_t* result) noexcept;
   Status Decr(const Slice& key, int64_t* result) noexcept;
@@ -125,11 +411,24 @@ public:
   Status LInsert(const Slice& key, const BeforeOrAfter& beforeOrAfter, const Slice& pivotValue, const Slice& value) noexcept;
   Status LRem(const Slice& key, int64_t count, const Slice& value, uint64_t* removedCount) noexcept;
   Status LMove(const Slice& srcKey, const Slice& dstKey, enum Side srcSide, enum Side dstSide, std::string* value) noexcept;
+  // BLPop and BRPop pop from the first of keys holding elements into *key
+  // and *value, and BLMove moves as LMove. With all of them empty, they
+  // wait up to timeout milliseconds, forever if 0, for a push to hand an
+  // element over, the callers waiting longest first, and return NotFound
+  // if none comes. BLMove is woken up instead to move the element itself,
+  // which thus stays in one of the lists all along. They are not supported
+  // in a transaction.
+  Status BLPop(const std::vector<Slice>& keys, uint64_t timeout, std::string* key, std::string* value) noexcept;
+  Status BRPop(const std::vector<Slice>& keys, uint64_t timeout, std::string* key, std::string* value) noexcept;
+  Status BLMove(const Slice& srcKey, const Slice& dstKey, enum Side srcSide, enum Side dstSide, uint64_t timeout, std::string* value) noexcept;
+  // The callers of BLPop, BRPop and BLMove waiting on key.
+  uint64_t BlockedOn(const Slice& key) noexcept;
 
   // Hash Operators
   Status HLen(const Slice& key, uint64_t* len);
   Status HGet(const Slice& key, const Slice& hashKey, std::string* value);
-  Status HMGet(const Slice& key, const std::vector<Slice>& hashKeys, std::vector<std::string>* values);
+  // Appends the value of each field to values, std::nullopt if missing.
+  Status HMGet(const Slice& key, const std::vector<Slice>& hashKeys, ValueOpts* values);
   Status HGetAll(const Slice& key, std::map<std::string, std::string>* kvs);
   Status HKeys(const Slice& key, std::vector<std::string>* keys);
   Status HVals(const Slice& key, std::vector<std::string>* values);
@@ -202,11 +501,29 @@ public:
   Status ZDiffStore(const std::vector<Slice>& keys, const Slice& dstKey, uint64_t* count);
 
 private:
+  friend class BulkLoader;
+
+  void NewDataTypes() noexcept;
+  void SyncPeriodically() noexcept;
+  Status BPop(const std::vector<Slice>& keys, uint64_t timeout, enum Side side, std::string* key, std::string* value) noexcept;
+
+  Options options_;
+  std::string db_path_;
+  // The memory holding the files of an in_memory instance.
+  std::unique_ptr<DB_ENGINE::Env> env_;
   RedisString* string_db_;
   RedisList* list_db_;
   RedisHash* hash_db_;
   RedisSet* set_db_;
   RedisZSet* zset_db_;
+  std::thread sync_thread_;
+  std::mutex sync_mutex_;
+  std::condition_variable sync_cv_;
+  bool closing_;
+  // Shared by the instance and its transaction views, none for snapshots.
+  std::shared_ptr<KeyVersions> versions_;
+  // Set on a transaction view only.
+  std::unique_ptr<TransactionState> transaction_;
 };
 
 }
@@ -0,0 +1,857 @@
+#include "command.h"
+
+#include <cctype>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "resp.h"
+#include "util/number.h"
+
+namespace merodis {
+
+static bool ReplyStatus(std::string* reply, const Status& s) noexcept {
+  if (s.ok()) return true;
+  AppendError(reply, "ERR " + s.ToString());
+  return false;
+}
+
+static bool ParseInteger(const Slice& arg, int64_t* n, std::string* reply) noexcept {
+  if (SliceToInt64(arg, *n) == 0) return true;
+  AppendError(reply, "ERR value is not an integer or out of range");
+  return false;
+}
+
+// Parses a score bound of ZCOUNT and ZRANGEBYSCORE. The scores being
+// integers, an exclusive bound is the inclusive one next to it.
+static bool ParseScoreBound(const Slice& arg, bool isMin, int64_t* score, std::string* reply) noexcept {
+  if (arg == "-inf") {
+    *score = std::numeric_limits<int64_t>::min();
+    return true;
+  }
+  if (arg == "+inf" || arg == "inf") {
+    *score = std::numeric_limits<int64_t>::max();
+    return true;
+  }
+  bool exclusive = !arg.empty() && arg[0] == '(';
+  Slice bound = exclusive ? Slice(arg.data() + 1, arg.size() - 1) : arg;
+  if (SliceToInt64(bound, *score) != 0) {
+    AppendError(reply, "ERR min or max is not an integer");
+    return false;
+  }
+  if (exclusive && *score == (isMin ? std::numeric_limits<int64_t>::max() : std::numeric_limits<int64_t>::min())) {
+    AppendError(reply, "ERR min or max is out of range");
+    return false;
+  }
+  if (exclusive) *score += isMin ? 1 : -1;
+  return true;
+}
+
+// Parses a lex bound of ZRANGEBYLEX and the like, which Merodis only takes
+// inclusive.
+static bool ParseLexBound(const Slice& arg, std::string* lex, std::string* reply) noexcept {
+  if (arg == "-") {
+    lex->clear();
+  } else if (arg == "+") {
+    lex->assign(256, '\xff');
+  } else if (!arg.empty() && arg[0] == '[') {
+    lex->assign(arg.data() + 1, arg.size() - 1);
+  } else {
+    AppendError(reply, "ERR min or max not valid string range item");
+    return false;
+  }
+  return true;
+}
+
+static bool ParseSide(const Slice& arg, enum Side* side, std::string* reply) noexcept {
+  std::string name = arg.ToString();
+  for (char& c: name) c = static_cast<char>(tolower(c));
+  if (name == "left") {
+    *side = kLeft;
+  } else if (name == "right") {
+    *side = kRight;
+  } else {
+    AppendError(reply, "ERR syntax error");
+    return false;
+  }
+  return true;
+}
+
+static bool EqualsIgnoreCase(const Slice& arg, const char* word) noexcept {
+  size_t size = strlen(word);
+  if (arg.size() != size) return false;
+  for (size_t c = 0; c < size; c++) {
+    if (tolower(arg[c]) != word[c]) return false;
+  }
+  return true;
+}
+
+static void AppendBulkStrings(std::string* reply, const std::vector<std::string>& values) noexcept {
+  AppendArrayHeader(reply, values.size());
+  for (const auto& value: values) AppendBulkString(reply, value);
+}
+
+static void AppendScoredMembers(std::string* reply, const ScoredMembers& scoredMembers) noexcept {
+  AppendArrayHeader(reply, 2 * scoredMembers.size());
+  for (const auto& [member, score]: scoredMembers) {
+    AppendBulkString(reply, member);
+    AppendBulkString(reply, std::to_string(score));
+  }
+}
+
+static std::vector<Slice> Tail(const std::vector<Slice>& args, size_t from) noexcept {
+  return {args.begin() + from, args.end()};
+}
+
+// Connection
+static void Ping(Merodis*, const std::vector<Slice>& args, std::string* reply) {
+  if (args.size() > 2) return AppendError(reply, "ERR wrong number of arguments for 'ping' command");
+  if (args.size() == 2) return AppendBulkString(reply, args[1]);
+  AppendSimpleString(reply, "PONG");
+}
+
+static void Echo(Merodis*, const std::vector<Slice>& args, std::string* reply) {
+  AppendBulkString(reply, args[1]);
+}
+
+static void Select(Merodis*, const std::vector<Slice>& args, std::string* reply) {
+  if (args[1] != "0") return AppendError(reply, "ERR DB index is out of range");
+  AppendSimpleString(reply, "OK");
+}
+
+// Answered emptily, for the clients asking before they start.
+static void EmptyArray(Merodis*, const std::vector<Slice>&, std::string* reply) {
+  AppendArrayHeader(reply, 0);
+}
+
+// String
+static void Get(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::string value;
+  Status s = db->Get(args[1], &value);
+  if (s.IsNotFound()) return AppendNull(reply);
+  if (ReplyStatus(reply, s)) AppendBulkString(reply, value);
+}
+
+static void Set(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  if (args.size() != 3) return AppendError(reply, "ERR syntax error");
+  if (ReplyStatus(reply, db->Set(args[1], args[2]))) AppendSimpleString(reply, "OK");
+}
+
+static void IncrBy(Merodis* db, const Slice& key, int64_t increment, std::string* reply) {
+  int64_t result;
+  if (ReplyStatus(reply, db->IncrBy(key, increment, &result))) AppendInteger(reply, result);
+}
+
+static void Incr(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  IncrBy(db, args[1], 1, reply);
+}
+
+static void IncrBy(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t increment;
+  if (ParseInteger(args[2], &increment, reply)) IncrBy(db, args[1], increment, reply);
+}
+
+static void Decr(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  IncrBy(db, args[1], -1, reply);
+}
+
+static void DecrBy(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t decrement;
+  if (!ParseInteger(args[2], &decrement, reply)) return;
+  if (decrement == std::numeric_limits<int64_t>::min()) return AppendError(reply, "ERR decrement would overflow");
+  IncrBy(db, args[1], -decrement, reply);
+}
+
+// List
+static void AppendLLen(Merodis* db, const Slice& key, std::string* reply) {
+  uint64_t len;
+  if (ReplyStatus(reply, db->LLen(key, &len))) AppendInteger(reply, static_cast<int64_t>(len));
+}
+
+static void LLen(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  AppendLLen(db, args[1], reply);
+}
+
+static void LIndex(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t index;
+  if (!ParseInteger(args[2], &index, reply)) return;
+  std::string value;
+  Status s = db->LIndex(args[1], index, &value);
+  if (s.IsNotFound() || s.IsInvalidArgument()) return AppendNull(reply);
+  if (ReplyStatus(reply, s)) AppendBulkString(reply, value);
+}
+
+static void LRange(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t from, to;
+  if (!ParseInteger(args[2], &from, reply) || !ParseInteger(args[3], &to, reply)) return;
+  std::vector<std::string> values;
+  Status s = db->LRange(args[1], from, to, &values);
+  if (s.IsNotFound()) s = Status::OK();
+  if (ReplyStatus(reply, s)) AppendBulkStrings(reply, values);
+}
+
+static void LSet(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t index;
+  if (!ParseInteger(args[2], &index, reply)) return;
+  Status s = db->LSet(args[1], index, args[3]);
+  if (s.IsNotFound()) return AppendError(reply, "ERR no such key");
+  if (s.IsInvalidArgument()) return AppendError(reply, "ERR index out of range");
+  if (ReplyStatus(reply, s)) AppendSimpleString(reply, "OK");
+}
+
+static void LPush(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  if (ReplyStatus(reply, db->LPush(args[1], Tail(args, 2)))) AppendLLen(db, args[1], reply);
+}
+
+static void LPushX(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  Status s = db->LPushX(args[1], Tail(args, 2));
+  if (s.IsNotFound()) return AppendInteger(reply, 0);
+  if (ReplyStatus(reply, s)) AppendLLen(db, args[1], reply);
+}
+
+static void RPush(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  if (ReplyStatus(reply, db->RPush(args[1], Tail(args, 2)))) AppendLLen(db, args[1], reply);
+}
+
+static void RPushX(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  Status s = db->RPushX(args[1], Tail(args, 2));
+  if (s.IsNotFound()) return AppendInteger(reply, 0);
+  if (ReplyStatus(reply, s)) AppendLLen(db, args[1], reply);
+}
+
+static void Pop(Merodis* db, const std::vector<Slice>& args, enum Side side, std::string* reply) {
+  if (args.size() > 3) return AppendError(reply, "ERR syntax error");
+  uint64_t len;
+  Status s = db->LLen(args[1], &len);
+  if (s.IsNotFound() || (s.ok() && len == 0)) return args.size() == 3 ? AppendNullArray(reply) : AppendNull(reply);
+  if (!ReplyStatus(reply, s)) return;
+  if (args.size() == 2) {
+    std::string value;
+    s = side == kLeft ? db->LPop(args[1], &value) : db->RPop(args[1], &value);
+    if (ReplyStatus(reply, s)) AppendBulkString(reply, value);
+    return;
+  }
+  int64_t count;
+  if (!ParseInteger(args[2], &count, reply)) return;
+  if (count < 0) return AppendError(reply, "ERR value is out of range, must be positive");
+  std::vector<std::string> values;
+  if (count) {
+    s = side == kLeft ? db->LPop(args[1], count, &values) : db->RPop(args[1], count, &values);
+  }
+  if (ReplyStatus(reply, s)) AppendBulkStrings(reply, values);
+}
+
+static void LPop(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  Pop(db, args, kLeft, reply);
+}
+
+static void RPop(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  Pop(db, args, kRight, reply);
+}
+
+static void LTrim(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t from, to;
+  if (!ParseInteger(args[2], &from, reply) || !ParseInteger(args[3], &to, reply)) return;
+  Status s = db->LTrim(args[1], from, to);
+  if (s.IsNotFound()) s = Status::OK();
+  if (ReplyStatus(reply, s)) AppendSimpleString(reply, "OK");
+}
+
+static void LInsert(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  enum BeforeOrAfter beforeOrAfter;
+  if (EqualsIgnoreCase(args[2], "before")) {
+    beforeOrAfter = kBefore;
+  } else if (EqualsIgnoreCase(args[2], "after")) {
+    beforeOrAfter = kAfter;
+  } else {
+    return AppendError(reply, "ERR syntax error");
+  }
+  uint64_t len;
+  Status s = db->LLen(args[1], &len);
+  if (s.IsNotFound() || (s.ok() && len == 0)) return AppendInteger(reply, 0);
+  if (!ReplyStatus(reply, s)) return;
+  s = db->LInsert(args[1], beforeOrAfter, args[3], args[4]);
+  if (s.IsNotFound()) return AppendInteger(reply, -1);
+  if (ReplyStatus(reply, s)) AppendLLen(db, args[1], reply);
+}
+
+static void LRem(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t count;
+  if (!ParseInteger(args[2], &count, reply)) return;
+  uint64_t removedCount = 0;
+  Status s = db->LRem(args[1], count, args[3], &removedCount);
+  if (s.IsNotFound()) s = Status::OK();
+  if (ReplyStatus(reply, s)) AppendInteger(reply, static_cast<int64_t>(removedCount));
+}
+
+static void LMove(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  enum Side srcSide, dstSide;
+  if (!ParseSide(args[3], &srcSide, reply) || !ParseSide(args[4], &dstSide, reply)) return;
+  uint64_t len;
+  Status s = db->LLen(args[1], &len);
+  if (s.IsNotFound() || (s.ok() && len == 0)) return AppendNull(reply);
+  if (!ReplyStatus(reply, s)) return;
+  std::string value;
+  s = db->LMove(args[1], args[2], srcSide, dstSide, &value);
+  if (ReplyStatus(reply, s)) AppendBulkString(reply, value);
+}
+
+// Hash
+static void HLen(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t len;
+  if (ReplyStatus(reply, db->HLen(args[1], &len))) AppendInteger(reply, static_cast<int64_t>(len));
+}
+
+static void HGet(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::string value;
+  Status s = db->HGet(args[1], args[2], &value);
+  if (s.IsNotFound()) return AppendNull(reply);
+  if (ReplyStatus(reply, s)) AppendBulkString(reply, value);
+}
+
+static void HMGet(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ValueOpts values;
+  if (!ReplyStatus(reply, db->HMGet(args[1], Tail(args, 2), &values))) return;
+  AppendArrayHeader(reply, values.size());
+  for (const auto& value: values) {
+    value ? AppendBulkString(reply, *value) : AppendNull(reply);
+  }
+}
+
+static void HGetAll(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::map<std::string, std::string> kvs;
+  if (!ReplyStatus(reply, db->HGetAll(args[1], &kvs))) return;
+  AppendArrayHeader(reply, 2 * kvs.size());
+  for (const auto& [k, v]: kvs) {
+    AppendBulkString(reply, k);
+    AppendBulkString(reply, v);
+  }
+}
+
+static void HKeys(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::vector<std::string> keys;
+  if (ReplyStatus(reply, db->HKeys(args[1], &keys))) AppendBulkStrings(reply, keys);
+}
+
+static void HVals(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::vector<std::string> values;
+  if (ReplyStatus(reply, db->HVals(args[1], &values))) AppendBulkStrings(reply, values);
+}
+
+static void HExists(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  bool exists;
+  if (ReplyStatus(reply, db->HExists(args[1], args[2], &exists))) AppendInteger(reply, exists);
+}
+
+static bool HSetFields(Merodis* db, const std::vector<Slice>& args, uint64_t* count, std::string* reply) {
+  if (args.size() % 2) {
+    AppendError(reply, "ERR wrong number of arguments for 'hset' command");
+    return false;
+  }
+  std::map<Slice, Slice> kvs;
+  // The last value of a field set twice wins.
+  for (size_t c = 2; c < args.size(); c += 2) kvs[args[c]] = args[c + 1];
+  return ReplyStatus(reply, db->HSet(args[1], kvs, count));
+}
+
+static void HSet(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t count;
+  if (HSetFields(db, args, &count, reply)) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void HMSet(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t count;
+  if (HSetFields(db, args, &count, reply)) AppendSimpleString(reply, "OK");
+}
+
+static void HDel(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::set<Slice> fields(args.begin() + 2, args.end());
+  uint64_t count;
+  if (ReplyStatus(reply, db->HDel(args[1], fields, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+// Set
+static void SCard(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t len;
+  if (ReplyStatus(reply, db->SCard(args[1], &len))) AppendInteger(reply, static_cast<int64_t>(len));
+}
+
+static void SIsMember(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  bool isMember;
+  if (ReplyStatus(reply, db->SIsMember(args[1], args[2], &isMember))) AppendInteger(reply, isMember);
+}
+
+static void SMIsMember(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::set<Slice> members(args.begin() + 2, args.end());
+  std::vector<bool> isMembers;
+  if (!ReplyStatus(reply, db->SMIsMember(args[1], members, &isMembers))) return;
+  // The answers follow the sorted members, and the reply the arguments.
+  std::map<Slice, bool> answers;
+  size_t c = 0;
+  for (const auto& member: members) answers[member] = isMembers[c++];
+  AppendArrayHeader(reply, args.size() - 2);
+  for (size_t i = 2; i < args.size(); i++) AppendInteger(reply, answers[args[i]]);
+}
+
+static void SMembers(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::vector<std::string> members;
+  if (ReplyStatus(reply, db->SMembers(args[1], &members))) AppendBulkStrings(reply, members);
+}
+
+static void SRandMember(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  if (args.size() > 3) return AppendError(reply, "ERR syntax error");
+  if (args.size() == 2) {
+    std::string member;
+    Status s = db->SRandMember(args[1], &member);
+    if (s.IsNotFound()) return AppendNull(reply);
+    if (ReplyStatus(reply, s)) AppendBulkString(reply, member);
+    return;
+  }
+  int64_t count;
+  if (!ParseInteger(args[2], &count, reply)) return;
+  std::vector<std::string> members;
+  Status s = db->SRandMember(args[1], count, &members);
+  if (s.IsNotFound()) s = Status::OK();
+  if (ReplyStatus(reply, s)) AppendBulkStrings(reply, members);
+}
+
+static void SAdd(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::set<Slice> members(args.begin() + 2, args.end());
+  uint64_t count;
+  if (ReplyStatus(reply, db->SAdd(args[1], members, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void SRem(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::set<Slice> members(args.begin() + 2, args.end());
+  uint64_t count;
+  if (ReplyStatus(reply, db->SRem(args[1], members, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void SPop(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  if (args.size() > 3) return AppendError(reply, "ERR syntax error");
+  if (args.size() == 2) {
+    std::string member;
+    Status s = db->SPop(args[1], &member);
+    if (s.IsNotFound()) return AppendNull(reply);
+    if (ReplyStatus(reply, s)) AppendBulkString(reply, member);
+    return;
+  }
+  int64_t count;
+  if (!ParseInteger(args[2], &count, reply)) return;
+  if (count < 0) return AppendError(reply, "ERR value is out of range, must be positive");
+  std::vector<std::string> members;
+  Status s = db->SPop(args[1], count, &members);
+  if (s.IsNotFound()) s = Status::OK();
+  if (ReplyStatus(reply, s)) AppendBulkStrings(reply, members);
+}
+
+static void SMove(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t count;
+  if (ReplyStatus(reply, db->SMove(args[1], args[2], args[3], &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void SUnion(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::vector<std::string> members;
+  if (ReplyStatus(reply, db->SUnion(Tail(args, 1), &members))) AppendBulkStrings(reply, members);
+}
+
+static void SInter(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::vector<std::string> members;
+  if (ReplyStatus(reply, db->SInter(Tail(args, 1), &members))) AppendBulkStrings(reply, members);
+}
+
+static void SDiff(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::vector<std::string> members;
+  if (ReplyStatus(reply, db->SDiff(Tail(args, 1), &members))) AppendBulkStrings(reply, members);
+}
+
+static void SUnionStore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t count;
+  if (ReplyStatus(reply, db->SUnionStore(Tail(args, 2), args[1], &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void SInterStore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t count;
+  if (ReplyStatus(reply, db->SInterStore(Tail(args, 2), args[1], &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void SDiffStore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t count;
+  if (ReplyStatus(reply, db->SDiffStore(Tail(args, 2), args[1], &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+// ZSet
+static void ZCard(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t len;
+  if (ReplyStatus(reply, db->ZCard(args[1], &len))) AppendInteger(reply, static_cast<int64_t>(len));
+}
+
+static void ZScore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t score;
+  Status s = db->ZScore(args[1], args[2], &score);
+  if (s.IsNotFound()) return AppendNull(reply);
+  if (ReplyStatus(reply, s)) AppendBulkString(reply, std::to_string(score));
+}
+
+static void ZMScore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ScoreOpts scores;
+  if (!ReplyStatus(reply, db->ZMScore(args[1], Tail(args, 2), &scores))) return;
+  AppendArrayHeader(reply, scores.size());
+  for (const auto& score: scores) {
+    score ? AppendBulkString(reply, std::to_string(*score)) : AppendNull(reply);
+  }
+}
+
+static void ZRank(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t rank;
+  Status s = db->ZRank(args[1], args[2], &rank);
+  if (s.IsNotFound()) return AppendNull(reply);
+  if (ReplyStatus(reply, s)) AppendInteger(reply, static_cast<int64_t>(rank));
+}
+
+static void ZRevRank(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  uint64_t rank;
+  Status s = db->ZRevRank(args[1], args[2], &rank);
+  if (s.IsNotFound()) return AppendNull(reply);
+  if (ReplyStatus(reply, s)) AppendInteger(reply, static_cast<int64_t>(rank));
+}
+
+static void ZCount(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t minScore, maxScore;
+  if (!ParseScoreBound(args[2], true, &minScore, reply) || !ParseScoreBound(args[3], false, &maxScore, reply)) return;
+  uint64_t count;
+  if (ReplyStatus(reply, db->ZCount(args[1], minScore, maxScore, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void ZLexCount(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::string minLex, maxLex;
+  if (!ParseLexBound(args[2], &minLex, reply) || !ParseLexBound(args[3], &maxLex, reply)) return;
+  uint64_t count;
+  if (ReplyStatus(reply, db->ZLexCount(args[1], minLex, maxLex, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+// Whether the range command in args ends by WITHSCORES, the only option
+// taken.
+static bool ParseWithScores(const std::vector<Slice>& args, size_t position, bool* withScores, std::string* reply) {
+  *withScores = args.size() == position + 1 && EqualsIgnoreCase(args[position], "withscores");
+  if (args.size() == position || *withScores) return true;
+  AppendError(reply, "ERR syntax error");
+  return false;
+}
+
+static void ZRangeByRank(Merodis* db, const std::vector<Slice>& args, bool reverse, std::string* reply) {
+  int64_t minRank, maxRank;
+  bool withScores;
+  if (!ParseInteger(args[2], &minRank, reply) || !ParseInteger(args[3], &maxRank, reply)) return;
+  if (!ParseWithScores(args, 4, &withScores, reply)) return;
+  if (withScores) {
+    ScoredMembers scoredMembers;
+    Status s = reverse ? db->ZRevRangeWithScores(args[1], minRank, maxRank, &scoredMembers)
+                       : db->ZRangeWithScores(args[1], minRank, maxRank, &scoredMembers);
+    if (ReplyStatus(reply, s)) AppendScoredMembers(reply, scoredMembers);
+  } else {
+    Members members;
+    Status s = reverse ? db->ZRevRange(args[1], minRank, maxRank, &members)
+                       : db->ZRange(args[1], minRank, maxRank, &members);
+    if (ReplyStatus(reply, s)) AppendBulkStrings(reply, members);
+  }
+}
+
+static void ZRange(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZRangeByRank(db, args, false, reply);
+}
+
+static void ZRevRange(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZRangeByRank(db, args, true, reply);
+}
+
+// ZREVRANGEBYSCORE takes the maximum first.
+static void ZRangeByScore(Merodis* db, const std::vector<Slice>& args, bool reverse, std::string* reply) {
+  int64_t minScore, maxScore;
+  bool withScores;
+  if (!ParseScoreBound(args[reverse ? 3 : 2], true, &minScore, reply)) return;
+  if (!ParseScoreBound(args[reverse ? 2 : 3], false, &maxScore, reply)) return;
+  if (!ParseWithScores(args, 4, &withScores, reply)) return;
+  if (withScores) {
+    ScoredMembers scoredMembers;
+    Status s = reverse ? db->ZRevRangeByScoreWithScores(args[1], minScore, maxScore, &scoredMembers)
+                       : db->ZRangeByScoreWithScores(args[1], minScore, maxScore, &scoredMembers);
+    if (ReplyStatus(reply, s)) AppendScoredMembers(reply, scoredMembers);
+  } else {
+    Members members;
+    Status s = reverse ? db->ZRevRangeByScore(args[1], minScore, maxScore, &members)
+                       : db->ZRangeByScore(args[1], minScore, maxScore, &members);
+    if (ReplyStatus(reply, s)) AppendBulkStrings(reply, members);
+  }
+}
+
+static void ZRangeByScore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZRangeByScore(db, args, false, reply);
+}
+
+static void ZRevRangeByScore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZRangeByScore(db, args, true, reply);
+}
+
+static void ZRangeByLex(Merodis* db, const std::vector<Slice>& args, bool reverse, std::string* reply) {
+  std::string minLex, maxLex;
+  if (!ParseLexBound(args[reverse ? 3 : 2], &minLex, reply)) return;
+  if (!ParseLexBound(args[reverse ? 2 : 3], &maxLex, reply)) return;
+  Members members;
+  Status s = reverse ? db->ZRevRangeByLex(args[1], minLex, maxLex, &members)
+                     : db->ZRangeByLex(args[1], minLex, maxLex, &members);
+  if (ReplyStatus(reply, s)) AppendBulkStrings(reply, members);
+}
+
+static void ZRangeByLex(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZRangeByLex(db, args, false, reply);
+}
+
+static void ZRevRangeByLex(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZRangeByLex(db, args, true, reply);
+}
+
+static void ZAdd(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  if (args.size() % 2) return AppendError(reply, "ERR syntax error");
+  std::map<Slice, int64_t> scoredMembers;
+  for (size_t c = 2; c < args.size(); c += 2) {
+    int64_t score;
+    if (!ParseInteger(args[c], &score, reply)) return;
+    scoredMembers[args[c + 1]] = score;
+  }
+  uint64_t count;
+  if (ReplyStatus(reply, db->ZAdd(args[1], scoredMembers, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void ZRem(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::set<Slice> members(args.begin() + 2, args.end());
+  uint64_t count;
+  if (ReplyStatus(reply, db->ZRem(args[1], members, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void ZPop(Merodis* db, const std::vector<Slice>& args, enum MinOrMax minOrMax, std::string* reply) {
+  ScoredMember scoredMember;
+  Status s = minOrMax == kMax ? db->ZPopMax(args[1], &scoredMember) : db->ZPopMin(args[1], &scoredMember);
+  if (s.IsNotFound()) return AppendArrayHeader(reply, 0);
+  if (ReplyStatus(reply, s)) AppendScoredMembers(reply, {scoredMember});
+}
+
+static void ZPopMax(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZPop(db, args, kMax, reply);
+}
+
+static void ZPopMin(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZPop(db, args, kMin, reply);
+}
+
+static void ZRemRangeByRank(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t minRank, maxRank;
+  if (!ParseInteger(args[2], &minRank, reply) || !ParseInteger(args[3], &maxRank, reply)) return;
+  uint64_t count;
+  if (ReplyStatus(reply, db->ZRemRangeByRank(args[1], minRank, maxRank, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void ZRemRangeByScore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  int64_t minScore, maxScore;
+  if (!ParseScoreBound(args[2], true, &minScore, reply) || !ParseScoreBound(args[3], false, &maxScore, reply)) return;
+  uint64_t count;
+  if (ReplyStatus(reply, db->ZRemRangeByScore(args[1], minScore, maxScore, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void ZRemRangeByLex(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  std::string minLex, maxLex;
+  if (!ParseLexBound(args[2], &minLex, reply) || !ParseLexBound(args[3], &maxLex, reply)) return;
+  uint64_t count;
+  if (ReplyStatus(reply, db->ZRemRangeByLex(args[1], minLex, maxLex, &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+// Reads the numkeys keys of ZUNION and the like starting at args[position],
+// setting *end past them.
+static bool ParseKeys(const std::vector<Slice>& args, size_t position, std::vector<Slice>* keys, size_t* end, std::string* reply) {
+  int64_t numKeys;
+  if (!ParseInteger(args[position], &numKeys, reply)) return false;
+  if (numKeys <= 0 || static_cast<size_t>(numKeys) > args.size() - position - 1) {
+    AppendError(reply, "ERR syntax error");
+    return false;
+  }
+  keys->assign(args.begin() + position + 1, args.begin() + position + 1 + numKeys);
+  *end = position + 1 + numKeys;
+  return true;
+}
+
+typedef Status (Merodis::*ZAlgebra)(const std::vector<Slice>&, Members*);
+typedef Status (Merodis::*ZAlgebraWithScores)(const std::vector<Slice>&, ScoredMembers*);
+typedef Status (Merodis::*ZAlgebraStore)(const std::vector<Slice>&, const Slice&, uint64_t*);
+
+static void ZAlgebraCommand(Merodis* db, const std::vector<Slice>& args,
+                            ZAlgebra algebra, ZAlgebraWithScores algebraWithScores, std::string* reply) {
+  std::vector<Slice> keys;
+  size_t end;
+  bool withScores;
+  if (!ParseKeys(args, 1, &keys, &end, reply) || !ParseWithScores(args, end, &withScores, reply)) return;
+  if (withScores) {
+    ScoredMembers scoredMembers;
+    if (ReplyStatus(reply, (db->*algebraWithScores)(keys, &scoredMembers))) AppendScoredMembers(reply, scoredMembers);
+  } else {
+    Members members;
+    if (ReplyStatus(reply, (db->*algebra)(keys, &members))) AppendBulkStrings(reply, members);
+  }
+}
+
+static void ZAlgebraStoreCommand(Merodis* db, const std::vector<Slice>& args, ZAlgebraStore algebra, std::string* reply) {
+  std::vector<Slice> keys;
+  size_t end;
+  if (!ParseKeys(args, 2, &keys, &end, reply)) return;
+  if (end != args.size()) return AppendError(reply, "ERR syntax error");
+  uint64_t count;
+  if (ReplyStatus(reply, (db->*algebra)(keys, args[1], &count))) AppendInteger(reply, static_cast<int64_t>(count));
+}
+
+static void ZUnion(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZAlgebraCommand(db, args, &Merodis::ZUnion, &Merodis::ZUnionWithScores, reply);
+}
+
+static void ZInter(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZAlgebraCommand(db, args, &Merodis::ZInter, &Merodis::ZInterWithScores, reply);
+}
+
+static void ZDiff(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZAlgebraCommand(db, args, &Merodis::ZDiff, &Merodis::ZDiffWithScores, reply);
+}
+
+static void ZUnionStore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZAlgebraStoreCommand(db, args, &Merodis::ZUnionStore, reply);
+}
+
+static void ZInterStore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZAlgebraStoreCommand(db, args, &Merodis::ZInterStore, reply);
+}
+
+static void ZDiffStore(Merodis* db, const std::vector<Slice>& args, std::string* reply) {
+  ZAlgebraStoreCommand(db, args, &Merodis::ZDiffStore, reply);
+}
+
+CommandTable::CommandTable() noexcept:
+  commands_ {
+    {"ping", {Ping, -1}},
+    {"echo", {Echo, 2}},
+    {"select", {Select, 2}},
+    {"command", {EmptyArray, -1}},
+    {"config", {EmptyArray, -2}},
+
+    {"get", {Get, 2}},
+    {"set", {Set, -3}},
+    {"incr", {Incr, 2}},
+    {"incrby", {IncrBy, 3}},
+    {"decr", {Decr, 2}},
+    {"decrby", {DecrBy, 3}},
+
+    {"llen", {LLen, 2}},
+    {"lindex", {LIndex, 3}},
+    {"lrange", {LRange, 4}},
+    {"lset", {LSet, 4}},
+    {"lpush", {LPush, -3}},
+    {"lpushx", {LPushX, -3}},
+    {"rpush", {RPush, -3}},
+    {"rpushx", {RPushX, -3}},
+    {"lpop", {LPop, -2}},
+    {"rpop", {RPop, -2}},
+    {"ltrim", {LTrim, 4}},
+    {"linsert", {LInsert, 5}},
+    {"lrem", {LRem, 4}},
+    {"lmove", {LMove, 5}},
+
+    {"hlen", {HLen, 2}},
+    {"hget", {HGet, 3}},
+    {"hmget", {HMGet, -3}},
+    {"hgetall", {HGetAll, 2}},
+    {"hkeys", {HKeys, 2}},
+    {"hvals", {HVals, 2}},
+    {"hexists", {HExists, 3}},
+    {"hset", {HSet, -4}},
+    {"hmset", {HMSet, -4}},
+    {"hdel", {HDel, -3}},
+
+    {"scard", {SCard, 2}},
+    {"sismember", {SIsMember, 3}},
+    {"smismember", {SMIsMember, -3}},
+    {"smembers", {SMembers, 2}},
+    {"srandmember", {SRandMember, -2}},
+    {"sadd", {SAdd, -3}},
+    {"srem", {SRem, -3}},
+    {"spop", {SPop, -2}},
+    {"smove", {SMove, 4}},
+    {"sunion", {SUnion, -2}},
+    {"sinter", {SInter, -2}},
+    {"sdiff", {SDiff, -2}},
+    {"sunionstore", {SUnionStore, -3}},
+    {"sinterstore", {SInterStore, -3}},
+    {"sdiffstore", {SDiffStore, -3}},
+
+    {"zcard", {ZCard, 2}},
+    {"zscore", {ZScore, 3}},
+    {"zmscore", {ZMScore, -3}},
+    {"zrank", {ZRank, 3}},
+    {"zrevrank", {ZRevRank, 3}},
+    {"zcount", {ZCount, 4}},
+    {"zlexcount", {ZLexCount, 4}},
+    {"zrange", {ZRange, -4}},
+    {"zrevrange", {ZRevRange, -4}},
+    {"zrangebyscore", {ZRangeByScore, -4}},
+    {"zrevrangebyscore", {ZRevRangeByScore, -4}},
+    {"zrangebylex", {ZRangeByLex, 4}},
+    {"zrevrangebylex", {ZRevRangeByLex, 4}},
+    {"zadd", {ZAdd, -4}},
+    {"zrem", {ZRem, -3}},
+    {"zpopmax", {ZPopMax, 2}},
+    {"zpopmin", {ZPopMin, 2}},
+    {"zremrangebyrank", {ZRemRangeByRank, 4}},
+    {"zremrangebyscore", {ZRemRangeByScore, 4}},
+    {"zremrangebylex", {ZRemRangeByLex, 4}},
+    {"zunion", {ZUnion, -3}},
+    {"zinter", {ZInter, -3}},
+    {"zdiff", {ZDiff, -3}},
+    {"zunionstore", {ZUnionStore, -4}},
+    {"zinterstore", {ZInterStore, -4}},
+    {"zdiffstore", {ZDiffStore, -4}},
+  } {
+  for (const char* name: {"ping", "echo", "select", "command", "config"}) {
+    commands_[name].scope = kNoKey;
+  }
+  for (const char* name: {"lmove", "smove", "sunionstore", "sinterstore", "sdiffstore",
+                          "zunionstore", "zinterstore", "zdiffstore"}) {
+    commands_[name].scope = kManyKeys;
+  }
+}
+
+const CommandTable::Command* CommandTable::Find(const Slice& name) const noexcept {
+  std::string lowerName = name.ToString();
+  for (char& c: lowerName) c = static_cast<char>(tolower(c));
+  auto iter = commands_.find(lowerName);
+  return iter == commands_.end() ? nullptr : &iter->second;
+}
+
+CommandTable::Scope CommandTable::GetScope(const std::vector<Slice>& args) const noexcept {
+  const Command* command = args.size() > 1 ? Find(args[0]) : nullptr;
+  return command ? command->scope : kNoKey;
+}
+
+void CommandTable::Execute(Merodis* db, const std::vector<Slice>& args, std::string* reply) const noexcept {
+  if (args.empty()) return;
+  const Command* command = Find(args[0]);
+  if (!command) {
+    return AppendError(reply, "ERR unknown command '" + args[0].ToString() + "'");
+  }
+  int argc = static_cast<int>(args.size());
+  if (command->arity > 0 ? argc != command->arity : argc < -command->arity) {
+    std::string name = args[0].ToString();
+    for (char& c: name) c = static_cast<char>(tolower(c));
+    return AppendError(reply, "ERR wrong number of arguments for '" + name + "' command");
+  }
+  command->handler(db, args, reply);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef MERODIS_COMMAND_H
+#define MERODIS_COMMAND_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "merodis/merodis.h"
+
+namespace merodis {
+
+// The Redis commands served by Merodis, each run by the Merodis method of
+// the same name.
+class CommandTable {
+public:
+  CommandTable() noexcept;
+
+  // The keys the command in args touches, deciding where the server may
+  // run it concurrently with others.
+  enum Scope {
+    // None, as PING, or the command is unknown.
+    kNoKey,
+    // The key at args[1], or the keys it reads along with it.
+    kOneKey,
+    // Writes to several keys, as LMOVE or SUNIONSTORE.
+    kManyKeys,
+  };
+  Scope GetScope(const std::vector<Slice>& args) const noexcept;
+
+  // Runs the command in args, its name first, on db, appending its RESP
+  // reply to reply.
+  void Execute(Merodis* db, const std::vector<Slice>& args, std::string* reply) const noexcept;
+
+private:
+  typedef void (*Handler)(Merodis* db, const std::vector<Slice>& args, std::string* reply);
+  struct Command {
+    Handler handler;
+    // The number of arguments, the name included, or its opposite for the
+    // least number of them.
+    int arity;
+    Scope scope = kOneKey;
+  };
+
+  // The command named by args[0], or null.
+  const Command* Find(const Slice& name) const noexcept;
+
+  std::unordered_map<std::string, Command> commands_;
+};
+
+}
+
+#endif //MERODIS_COMMAND_H
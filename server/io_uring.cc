@@ -0,0 +1,137 @@
+#include "io_uring.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+namespace merodis {
+
+static int Setup(unsigned entries, io_uring_params* params) noexcept {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int Enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) noexcept {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int Register(int fd, unsigned opcode, void* arg, unsigned nrArgs) noexcept {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+template <typename T>
+static T* At(void* ring, uint32_t offset) noexcept {
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+IoUring::IoUring() noexcept:
+  fd_(-1),
+  sq_ring_(MAP_FAILED),
+  sq_ring_size_(0),
+  cq_ring_(MAP_FAILED),
+  cq_ring_size_(0),
+  sqes_(nullptr),
+  sqes_size_(0),
+  sq_head_(nullptr),
+  sq_tail_(nullptr),
+  sq_array_(nullptr),
+  sq_mask_(0),
+  sq_entries_(0),
+  sqe_tail_(0),
+  cq_head_(nullptr),
+  cq_tail_(nullptr),
+  cq_mask_(0),
+  cqes_(nullptr) {}
+
+IoUring::~IoUring() noexcept {
+  if (sqes_) ::munmap(sqes_, sqes_size_);
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_ != MAP_FAILED) ::munmap(sq_ring_, sq_ring_size_);
+  if (fd_ >= 0) ::close(fd_);
+}
+
+Status IoUring::Init(unsigned entries) noexcept {
+  io_uring_params params{};
+  fd_ = Setup(entries, &params);
+  if (fd_ < 0) return Status::NotSupported("io_uring_setup", std::strerror(errno));
+
+  // The probe, older than none of the operations, tells which are there.
+  size_t probeSize = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  auto* probe = static_cast<io_uring_probe*>(calloc(1, probeSize));
+  if (!probe) return Status::IOError("calloc", std::strerror(ENOMEM));
+  bool supported = Register(fd_, IORING_REGISTER_PROBE, probe, 256) == 0;
+  for (int op: {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_POLL_ADD}) {
+    supported = supported && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  }
+  free(probe);
+  if (!supported) return Status::NotSupported("io_uring lacks the network operations");
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) return Status::IOError("mmap", std::strerror(errno));
+  cq_ring_ = singleMmap ? sq_ring_ : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+  if (cq_ring_ == MAP_FAILED) return Status::IOError("mmap", std::strerror(errno));
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) return Status::IOError("mmap", std::strerror(errno));
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  sq_head_ = At<unsigned>(sq_ring_, params.sq_off.head);
+  sq_tail_ = At<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_array_ = At<unsigned>(sq_ring_, params.sq_off.array);
+  sq_mask_ = *At<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+  sqe_tail_ = *sq_tail_;
+  cq_head_ = At<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_ = At<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_mask_ = *At<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = At<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+  return Status::OK();
+}
+
+io_uring_sqe* IoUring::GetSqe() noexcept {
+  unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (sqe_tail_ - head >= sq_entries_) return nullptr;
+  io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[sqe_tail_ & sq_mask_] = sqe_tail_ & sq_mask_;
+  sqe_tail_++;
+  return sqe;
+}
+
+Status IoUring::Submit(unsigned waitNr) noexcept {
+  __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+  // Those the kernel has not taken yet, e.g. left by an interrupted call.
+  unsigned toSubmit = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (!toSubmit && !waitNr) return Status::OK();
+  if (Enter(fd_, toSubmit, waitNr, waitNr ? IORING_ENTER_GETEVENTS : 0) < 0 && errno != EINTR) {
+    // EBUSY and EAGAIN ask to reap completions before submitting more.
+    if (errno == EBUSY || errno == EAGAIN) return Status::OK();
+    return Status::IOError("io_uring_enter", std::strerror(errno));
+  }
+  return Status::OK();
+}
+
+void IoUring::ForEachCompletion(const std::function<void(const io_uring_cqe&)>& handle) noexcept {
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    io_uring_cqe cqe = cqes_[head & cq_mask_];
+    // Freed first, so handle may submit the next operation on a full ring.
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    handle(cqe);
+  }
+}
+
+}
\ No newline at end of file
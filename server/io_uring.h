@@ -0,0 +1,58 @@
+#ifndef MERODIS_IO_URING_H
+#define MERODIS_IO_URING_H
+
+#include <cstdint>
+#include <functional>
+
+#include "merodis/merodis.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace merodis {
+
+// A submission and completion queue pair of io_uring, driven through the
+// system calls directly, so the server builds without liburing.
+class IoUring {
+public:
+  IoUring() noexcept;
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+  ~IoUring() noexcept;
+
+  // Sets up a ring of entries submissions, or returns NotSupported when
+  // the kernel lacks io_uring or one of the operations the server needs:
+  // accept, recv, send and poll.
+  Status Init(unsigned entries) noexcept;
+  // A zeroed submission to fill, null while the queue is full until the
+  // next Submit.
+  io_uring_sqe* GetSqe() noexcept;
+  // Submits the queued submissions and waits for waitNr completions.
+  Status Submit(unsigned waitNr) noexcept;
+  // Passes each completion ready to handle, then frees them.
+  void ForEachCompletion(const std::function<void(const io_uring_cqe&)>& handle) noexcept;
+
+private:
+  int fd_;
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned* sq_array_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  // The submissions handed out by GetSqe, ahead of *sq_tail_ until Submit.
+  unsigned sqe_tail_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+};
+
+}
+
+#endif //MERODIS_IO_URING_H
@@ -0,0 +1,93 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "merodis/merodis.h"
+#include "server.h"
+
+using namespace merodis;
+
+static Server* server = nullptr;
+
+static void HandleSignal(int) {
+  if (server) server->Stop();
+}
+
+static void PrintUsage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [--bind ADDRESS] [--port PORT] [--dir PATH] [--in-memory]\n"
+          "       [--io-threads N] [--worker-threads N] [--pin-threads] [--io-uring]\n"
+          "  --bind            address to listen on, 127.0.0.1 by default\n"
+          "  --port            port to listen on, 6379 by default\n"
+          "  --dir             directory of the database, ./merodis-data by default\n"
+          "  --in-memory       keep the database in memory, as a cache\n"
+          "  --io-threads      threads serving the clients, 1 by default\n"
+          "  --worker-threads  threads running the commands, sharded by key,\n"
+          "                    none by default to run them on the I/O thread,\n"
+          "                    at least one with several I/O threads\n"
+          "  --pin-threads     pin each thread to a CPU\n"
+          "  --io-uring        serve the sockets through io_uring where the kernel\n"
+          "                    has it, instead of epoll\n",
+          program);
+}
+
+int main(int argc, char** argv) {
+  ServerOptions serverOptions;
+  Options options;
+  options.create_if_missing = true;
+  // The server sets no engine options of its own to keep.
+  options.OptimizeForDataTypes();
+  std::string db_path = "./merodis-data";
+  for (int c = 1; c < argc; c++) {
+    bool hasValue = c + 1 < argc;
+    if (!strcmp(argv[c], "--bind") && hasValue) {
+      serverOptions.bind = argv[++c];
+    } else if (!strcmp(argv[c], "--port") && hasValue) {
+      serverOptions.port = static_cast<uint16_t>(atoi(argv[++c]));
+    } else if (!strcmp(argv[c], "--dir") && hasValue) {
+      db_path = argv[++c];
+    } else if (!strcmp(argv[c], "--in-memory")) {
+      options.in_memory = true;
+    } else if (!strcmp(argv[c], "--io-threads") && hasValue) {
+      serverOptions.io_threads = atoi(argv[++c]);
+    } else if (!strcmp(argv[c], "--worker-threads") && hasValue) {
+      serverOptions.worker_threads = atoi(argv[++c]);
+    } else if (!strcmp(argv[c], "--pin-threads")) {
+      serverOptions.pin_threads = true;
+    } else if (!strcmp(argv[c], "--io-uring")) {
+      serverOptions.io_backend = kIoUringBackend;
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  Merodis db;
+  Status s = db.Open(options, db_path);
+  if (!s.ok()) {
+    fprintf(stderr, "Cannot open %s: %s\n", db_path.c_str(), s.ToString().c_str());
+    return 1;
+  }
+  Server instance(&db, serverOptions);
+  s = instance.Listen();
+  if (!s.ok()) {
+    fprintf(stderr, "Cannot listen on %s:%u: %s\n",
+            serverOptions.bind.c_str(), serverOptions.port, s.ToString().c_str());
+    return 1;
+  }
+  server = &instance;
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stderr, "Serving %s on %s:%u over %s\n", db_path.c_str(), serverOptions.bind.c_str(), instance.port(),
+          instance.backend() == kIoUringBackend ? "io_uring" : "epoll");
+  s = instance.Run();
+  server = nullptr;
+  if (!s.ok()) {
+    fprintf(stderr, "Server failed: %s\n", s.ToString().c_str());
+    return 1;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "resp.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace merodis {
+
+static const size_t kMaxBulkLength = 512 << 20;
+static const size_t kMaxArguments = 1 << 20;
+// Longest inline command.
+static const size_t kMaxInlineLength = 64 << 10;
+
+// Reads the decimal at the start of the line at data, ending by "\r\n"
+// before end, into *n and points *next past the line. Returns
+// kRespIncomplete until the line is whole.
+static RespParseResult ParseLength(const char* data, const char* end, int64_t* n, const char** next) noexcept {
+  const char* cr = static_cast<const char*>(memchr(data, '\r', end - data));
+  if (!cr || cr + 1 == end) {
+    return end - data > 32 ? kRespError : kRespIncomplete;
+  }
+  if (cr[1] != '\n' || cr == data) return kRespError;
+  bool negative = *data == '-';
+  const char* p = negative ? data + 1 : data;
+  if (p == cr || cr - p > 18) return kRespError;
+  int64_t value = 0;
+  for (; p < cr; p++) {
+    if (*p < '0' || *p > '9') return kRespError;
+    value = value * 10 + (*p - '0');
+  }
+  *n = negative ? -value : value;
+  *next = cr + 2;
+  return kRespRequest;
+}
+
+static RespParseResult ParseInline(const char* data,
+                                   size_t size,
+                                   std::vector<Slice>* args,
+                                   size_t* consumed,
+                                   std::string* error) noexcept {
+  const char* lf = static_cast<const char*>(memchr(data, '\n', size));
+  if (!lf) {
+    if (size <= kMaxInlineLength) return kRespIncomplete;
+    *error = "Protocol error: too big inline request";
+    return kRespError;
+  }
+  const char* end = lf > data && lf[-1] == '\r' ? lf - 1 : lf;
+  for (const char* p = data; p < end;) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    const char* start = p;
+    while (p < end && *p != ' ' && *p != '\t') p++;
+    if (p > start) args->emplace_back(start, p - start);
+  }
+  *consumed = lf + 1 - data;
+  return kRespRequest;
+}
+
+RespParseResult ParseRequest(const char* data,
+                             size_t size,
+                             std::vector<Slice>* args,
+                             size_t* consumed,
+                             std::string* error) noexcept {
+  args->clear();
+  if (size == 0) return kRespIncomplete;
+  if (*data != '*') return ParseInline(data, size, args, consumed, error);
+
+  const char* end = data + size;
+  const char* p;
+  int64_t count;
+  RespParseResult result = ParseLength(data + 1, end, &count, &p);
+  if (result != kRespRequest || count > static_cast<int64_t>(kMaxArguments)) {
+    if (result == kRespIncomplete) return result;
+    *error = "Protocol error: invalid multibulk length";
+    return kRespError;
+  }
+  for (int64_t c = 0; c < count; c++) {
+    if (p == end) return kRespIncomplete;
+    if (*p != '$') {
+      *error = "Protocol error: expected '$', got '" + std::string(1, *p) + "'";
+      return kRespError;
+    }
+    int64_t length;
+    result = ParseLength(p + 1, end, &length, &p);
+    if (result != kRespRequest || length < 0 || length > static_cast<int64_t>(kMaxBulkLength)) {
+      if (result == kRespIncomplete) return result;
+      *error = "Protocol error: invalid bulk length";
+      return kRespError;
+    }
+    if (end - p < length + 2) return kRespIncomplete;
+    if (p[length] != '\r' || p[length + 1] != '\n') {
+      *error = "Protocol error: bulk string not ended by CRLF";
+      return kRespError;
+    }
+    args->emplace_back(p, length);
+    p += length + 2;
+  }
+  *consumed = p - data;
+  return kRespRequest;
+}
+
+void AppendSimpleString(std::string* out, const Slice& s) noexcept {
+  out->push_back('+');
+  out->append(s.data(), s.size());
+  out->append("\r\n");
+}
+
+void AppendError(std::string* out, const Slice& message) noexcept {
+  out->push_back('-');
+  // A line break would end the error early.
+  for (size_t c = 0; c < message.size(); c++) {
+    out->push_back(message[c] == '\r' || message[c] == '\n' ? ' ' : message[c]);
+  }
+  out->append("\r\n");
+}
+
+void AppendInteger(std::string* out, int64_t n) noexcept {
+  out->push_back(':');
+  out->append(std::to_string(n));
+  out->append("\r\n");
+}
+
+void AppendBulkString(std::string* out, const Slice& s) noexcept {
+  out->push_back('$');
+  out->append(std::to_string(s.size()));
+  out->append("\r\n");
+  out->append(s.data(), s.size());
+  out->append("\r\n");
+}
+
+void AppendNull(std::string* out) noexcept {
+  out->append("$-1\r\n");
+}
+
+void AppendArrayHeader(std::string* out, size_t size) noexcept {
+  out->push_back('*');
+  out->append(std::to_string(size));
+  out->append("\r\n");
+}
+
+void AppendNullArray(std::string* out) noexcept {
+  out->append("*-1\r\n");
+}
+
+}
\ No newline at end of file
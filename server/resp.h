@@ -0,0 +1,41 @@
+#ifndef MERODIS_RESP_H
+#define MERODIS_RESP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "merodis/merodis.h"
+
+namespace merodis {
+
+enum RespParseResult {
+  kRespRequest,
+  kRespIncomplete,
+  kRespError,
+};
+
+// Parses the request at the start of the size bytes at data, either a RESP
+// array of bulk strings, as clients send them, or an inline command typed
+// into telnet. On kRespRequest, args points into data, valid as long as it
+// is, and consumed is the length of the request, after which the next one
+// of a pipeline starts. On kRespError, error tells the client why.
+RespParseResult ParseRequest(const char* data,
+                             size_t size,
+                             std::vector<Slice>* args,
+                             size_t* consumed,
+                             std::string* error) noexcept;
+
+// Append the RESP2 encoding of a reply to out.
+void AppendSimpleString(std::string* out, const Slice& s) noexcept;
+void AppendError(std::string* out, const Slice& message) noexcept;
+void AppendInteger(std::string* out, int64_t n) noexcept;
+void AppendBulkString(std::string* out, const Slice& s) noexcept;
+void AppendNull(std::string* out) noexcept;
+void AppendArrayHeader(std::string* out, size_t size) noexcept;
+void AppendNullArray(std::string* out) noexcept;
+
+}
+
+#endif //MERODIS_RESP_H
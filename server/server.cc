@@ -0,0 +1,724 @@
+#include "server.h"
+
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "io_uring.h"
+#include "resp.h"
+
+namespace merodis {
+
+static const size_t kReadSize = 16 << 10;
+static const int kMaxEvents = 256;
+// The requests of one client queued on the workers at most, past which the
+// next ones wait for replies.
+static const size_t kMaxInflight = 1024;
+static const unsigned kRingEntries = 4096;
+
+// The operations of io_uring, kept in the low bits of their user_data
+// above the descriptor they are on.
+enum RingOp : uint64_t {
+  kAcceptOp,
+  kStopOp,
+  kWakeOp,
+  kRecvOp,
+  kSendOp,
+};
+static const int kRingOpBits = 3;
+
+static Status IOError(const char* context) noexcept {
+  return Status::IOError(context, std::strerror(errno));
+}
+
+static void PinThread(std::thread* thread, int cpu) noexcept {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  pthread_setaffinity_np(thread->native_handle(), sizeof(cpus), &cpus);
+}
+
+// Lets a command writing several keys run alone: queued on every worker,
+// it runs on the last one to reach it while the others wait.
+struct Server::Barrier {
+  explicit Barrier(int workers) noexcept: waiting(workers) {}
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  int waiting;
+  bool done = false;
+};
+
+// A request run by a worker. Its arguments point into request, a copy of
+// the bytes received, as the input buffer moves on meanwhile.
+struct Server::Task {
+  IoThread* io_thread;
+  int fd;
+  std::string request;
+  std::vector<Slice> args;
+  std::string reply;
+  std::shared_ptr<Barrier> barrier;
+  std::atomic<bool> done {false};
+};
+
+struct Server::Connection {
+  explicit Connection(int fd) noexcept: fd(fd) {}
+  ~Connection() noexcept { ::close(fd); }
+
+  size_t pending() const noexcept { return output.size() - sent + sending.size() - sending_sent; }
+
+  int fd;
+  std::string input;
+  std::string output;
+  // The bytes of output already sent.
+  size_t sent = 0;
+  // On io_uring, the replies a send is in flight for, moved out of output
+  // so it can grow meanwhile, and the buffer of the recv in flight.
+  std::string sending;
+  size_t sending_sent = 0;
+  std::unique_ptr<char[]> recv_buffer;
+  bool receiving = false;
+  bool send_busy = false;
+  // Whether the connection is closed, waiting for its operations in
+  // flight on io_uring to complete before it is freed.
+  bool closed = false;
+  // The requests run by the workers, answered in this order.
+  std::deque<std::shared_ptr<Task>> inflight;
+  // The worker running the requests of inflight, or -1 for a barrier.
+  int worker = 0;
+  // Whether requests are left in input, held back by max_pending_reply or
+  // waiting for those in flight.
+  bool held = false;
+  // Whether the connection closes once output is sent, after QUIT or a
+  // protocol error.
+  bool closing = false;
+  uint32_t events = EPOLLIN;
+};
+
+class Server::Worker {
+public:
+  explicit Worker(Server* server) noexcept: server_(server) {}
+
+  void Start() noexcept { thread_ = std::thread([this] { Loop(); }); }
+  std::thread* thread() noexcept { return &thread_; }
+
+  void Push(std::shared_ptr<Task> task) noexcept {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  // Runs the tasks queued so far, then returns.
+  void Stop() noexcept {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) thread_.join();
+  }
+
+private:
+  void Loop() noexcept;
+
+  Server* server_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<Task>> tasks_;
+  bool stopping_ = false;
+};
+
+class Server::IoThread {
+public:
+  explicit IoThread(Server* server) noexcept: server_(server), epoll_fd_(-1), wake_fd_(-1) {}
+  ~IoThread() noexcept {
+    connections_.clear();
+    if (epoll_fd_ >= 0) ::close(epoll_fd_);
+    if (wake_fd_ >= 0) ::close(wake_fd_);
+  }
+
+  // Sets up the epoll loop, or with useIoUring the io_uring one.
+  Status Open(bool useIoUring) noexcept;
+  void Start() noexcept { thread_ = std::thread([this] { status_ = Loop(); }); }
+  std::thread* thread() noexcept { return &thread_; }
+  Status Join() noexcept {
+    if (thread_.joinable()) thread_.join();
+    return status_;
+  }
+  // Called by the worker having run task.
+  void Complete(const Task& task) noexcept;
+
+private:
+  Status Loop() noexcept;
+  Status LoopIoUring() noexcept;
+  // Serves the connections whose requests the workers completed.
+  void HandleCompleted() noexcept;
+  void Accept() noexcept;
+  // Reads what the client sent and runs its complete requests.
+  void HandleRead(Connection* conn) noexcept;
+  void ProcessInput(Connection* conn) noexcept;
+  // Queues the request args, the consumed bytes at data, on the worker
+  // owning its key, unless it waits for the requests in flight. Returns
+  // whether it is queued or run.
+  bool Dispatch(Connection* conn, const char* data, size_t consumed, const std::vector<Slice>& args) noexcept;
+  // Moves the replies of the requests done, in order, to output.
+  void CollectReplies(Connection* conn) noexcept;
+  // Sends the pending replies, polling for the socket to become writable
+  // while some are left.
+  void HandleWrite(Connection* conn) noexcept;
+  void UpdateEvents(Connection* conn) noexcept;
+  void Close(Connection* conn) noexcept;
+
+  // A submission to fill, submitting the queued ones first if it is full.
+  io_uring_sqe* NextSqe() noexcept;
+  void PostPoll(int fd, RingOp op) noexcept;
+  void PostAccept() noexcept;
+  void PostRecv(Connection* conn) noexcept;
+  void PostSend(Connection* conn) noexcept;
+  void HandleCompletion(const io_uring_cqe& cqe) noexcept;
+  // The io_uring counterpart of HandleWrite, also receiving the next
+  // requests once there is room for them.
+  void Pump(Connection* conn) noexcept;
+
+  Server* server_;
+  std::unique_ptr<IoUring> ring_;
+  // The recvs and sends in flight on ring_.
+  uint64_t ring_ops_ = 0;
+  bool stopping_ = false;
+  int epoll_fd_;
+  // Signaled by the workers once they complete tasks of this thread.
+  int wake_fd_;
+  std::thread thread_;
+  Status status_;
+  std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+  std::mutex completed_mutex_;
+  // The connections with requests completed since the last wake up.
+  std::vector<int> completed_;
+};
+
+void Server::Worker::Loop() noexcept {
+  for (;;) {
+    std::shared_ptr<Task> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    if (task->barrier) {
+      Barrier* barrier = task->barrier.get();
+      std::unique_lock<std::mutex> lock(barrier->mutex);
+      if (--barrier->waiting > 0) {
+        barrier->cv.wait(lock, [barrier] { return barrier->done; });
+        continue;
+      }
+      server_->commands_.Execute(server_->db_, task->args, &task->reply);
+      barrier->done = true;
+      barrier->cv.notify_all();
+    } else {
+      server_->commands_.Execute(server_->db_, task->args, &task->reply);
+    }
+    task->done.store(true, std::memory_order_release);
+    task->io_thread->Complete(*task);
+  }
+}
+
+Status Server::IoThread::Open(bool useIoUring) noexcept {
+  wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ < 0) return IOError("eventfd");
+  if (useIoUring) {
+    ring_ = std::make_unique<IoUring>();
+    return ring_->Init(kRingEntries);
+  }
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) return IOError("epoll_create1");
+  epoll_event event{};
+  // Only one of the I/O threads wakes up for a new client.
+  event.events = EPOLLIN | EPOLLEXCLUSIVE;
+  event.data.fd = server_->listen_fd_;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_->listen_fd_, &event) != 0) return IOError("epoll_ctl");
+  for (int fd: {server_->stop_fd_, wake_fd_}) {
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) return IOError("epoll_ctl");
+  }
+  return Status::OK();
+}
+
+void Server::IoThread::Complete(const Task& task) noexcept {
+  {
+    std::lock_guard<std::mutex> lock(completed_mutex_);
+    completed_.push_back(task.fd);
+  }
+  uint64_t one = 1;
+  ssize_t ignored = ::write(wake_fd_, &one, sizeof(one));
+  (void) ignored;
+}
+
+Status Server::IoThread::Loop() noexcept {
+  if (ring_) return LoopIoUring();
+  std::vector<epoll_event> events(kMaxEvents);
+  for (;;) {
+    int n = ::epoll_wait(epoll_fd_, events.data(), kMaxEvents, -1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return IOError("epoll_wait");
+    for (int c = 0; c < n; c++) {
+      int fd = events[c].data.fd;
+      // Left unread, so it wakes up every I/O thread.
+      if (fd == server_->stop_fd_) return Status::OK();
+      if (fd == server_->listen_fd_) {
+        Accept();
+        continue;
+      }
+      if (fd == wake_fd_) {
+        HandleCompleted();
+        continue;
+      }
+      // A connection closed earlier in this round is gone.
+      auto iter = connections_.find(fd);
+      if (iter == connections_.end()) continue;
+      Connection* conn = iter->second.get();
+      if (events[c].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        HandleRead(conn);
+      } else if (events[c].events & EPOLLOUT) {
+        HandleWrite(conn);
+      }
+    }
+  }
+}
+
+void Server::IoThread::HandleCompleted() noexcept {
+  uint64_t count;
+  ssize_t ignored = ::read(wake_fd_, &count, sizeof(count));
+  (void) ignored;
+  std::vector<int> completed;
+  {
+    std::lock_guard<std::mutex> lock(completed_mutex_);
+    completed.swap(completed_);
+  }
+  for (int fd: completed) {
+    auto iter = connections_.find(fd);
+    if (iter == connections_.end()) continue;
+    ring_ ? Pump(iter->second.get()) : HandleWrite(iter->second.get());
+  }
+}
+
+void Server::IoThread::Accept() noexcept {
+  for (;;) {
+    int fd = ::accept4(server_->listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      // EAGAIN once the queue is empty, or out of descriptors, retried on
+      // the next round.
+      return;
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+      ::close(fd);
+      continue;
+    }
+    connections_[fd] = std::make_unique<Connection>(fd);
+  }
+}
+
+void Server::IoThread::HandleRead(Connection* conn) noexcept {
+  for (;;) {
+    size_t size = conn->input.size();
+    conn->input.resize(size + kReadSize);
+    ssize_t n = ::read(conn->fd, conn->input.data() + size, kReadSize);
+    conn->input.resize(size + (n > 0 ? n : 0));
+    if (n > 0) continue;
+    if (n == 0) return Close(conn);
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+    return Close(conn);
+  }
+  ProcessInput(conn);
+  HandleWrite(conn);
+}
+
+void Server::IoThread::ProcessInput(Connection* conn) noexcept {
+  std::vector<Slice> args;
+  std::string error;
+  size_t offset = 0;
+  conn->held = false;
+  while (!conn->closing) {
+    if (conn->pending() >= server_->options_.max_pending_reply || conn->inflight.size() >= kMaxInflight) {
+      conn->held = offset < conn->input.size();
+      break;
+    }
+    size_t consumed;
+    const char* data = conn->input.data() + offset;
+    RespParseResult result = ParseRequest(data, conn->input.size() - offset, &args, &consumed, &error);
+    if (result == kRespIncomplete) break;
+    if (result == kRespError || (!args.empty() && args[0].size() == 4 && strncasecmp(args[0].data(), "quit", 4) == 0)) {
+      // Answered after the requests in flight.
+      if (!conn->inflight.empty()) {
+        conn->held = true;
+        break;
+      }
+      if (result == kRespError) {
+        AppendError(&conn->output, "ERR " + error);
+      } else {
+        AppendSimpleString(&conn->output, "OK");
+      }
+      conn->closing = true;
+      break;
+    }
+    if (!args.empty() && !Dispatch(conn, data, consumed, args)) {
+      conn->held = true;
+      break;
+    }
+    offset += consumed;
+  }
+  conn->input.erase(0, offset);
+}
+
+bool Server::IoThread::Dispatch(Connection* conn, const char* data, size_t consumed, const std::vector<Slice>& args) noexcept {
+  std::vector<std::unique_ptr<Worker>>& workers = server_->workers_;
+  CommandTable::Scope scope = workers.empty() ? CommandTable::kNoKey : server_->commands_.GetScope(args);
+  if (scope == CommandTable::kNoKey && conn->inflight.empty()) {
+    server_->commands_.Execute(server_->db_, args, &conn->output);
+    return true;
+  }
+  int worker = conn->worker;
+  if (scope == CommandTable::kOneKey) {
+    worker = static_cast<int>(std::hash<std::string_view>()({args[1].data(), args[1].size()}) % workers.size());
+  } else if (scope == CommandTable::kManyKeys) {
+    worker = -1;
+  }
+  // The requests of a client run on one worker at a time, and a barrier
+  // alone.
+  if (!conn->inflight.empty() && (worker == -1 || worker != conn->worker)) return false;
+
+  auto task = std::make_shared<Task>();
+  task->io_thread = this;
+  task->fd = conn->fd;
+  task->request.assign(data, consumed);
+  for (const Slice& arg: args) {
+    task->args.emplace_back(task->request.data() + (arg.data() - data), arg.size());
+  }
+  conn->inflight.push_back(task);
+  conn->worker = worker;
+  if (worker >= 0) {
+    workers[worker]->Push(std::move(task));
+    return true;
+  }
+  task->barrier = std::make_shared<Barrier>(static_cast<int>(workers.size()));
+  std::lock_guard<std::mutex> lock(server_->barrier_mutex_);
+  for (auto& each: workers) each->Push(task);
+  return true;
+}
+
+void Server::IoThread::CollectReplies(Connection* conn) noexcept {
+  while (!conn->inflight.empty() && conn->inflight.front()->done.load(std::memory_order_acquire)) {
+    conn->output.append(conn->inflight.front()->reply);
+    conn->inflight.pop_front();
+  }
+}
+
+void Server::IoThread::HandleWrite(Connection* conn) noexcept {
+  for (;;) {
+    CollectReplies(conn);
+    while (conn->pending()) {
+      ssize_t n = ::send(conn->fd, conn->output.data() + conn->sent, conn->pending(), MSG_NOSIGNAL);
+      if (n >= 0) {
+        conn->sent += n;
+        continue;
+      }
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return Close(conn);
+    }
+    if (!conn->pending()) {
+      conn->output.clear();
+      conn->sent = 0;
+    }
+    // The requests held back run once their replies have room, or the
+    // requests they wait for are done.
+    if (!conn->held || conn->pending() >= server_->options_.max_pending_reply) break;
+    size_t inflight = conn->inflight.size();
+    ProcessInput(conn);
+    if (!conn->pending() && conn->inflight.size() == inflight) break;
+  }
+  if (conn->closing && !conn->pending() && conn->inflight.empty()) return Close(conn);
+  UpdateEvents(conn);
+}
+
+void Server::IoThread::UpdateEvents(Connection* conn) noexcept {
+  uint32_t events = 0;
+  if (!conn->held && !conn->closing) events |= EPOLLIN;
+  if (conn->pending()) events |= EPOLLOUT;
+  if (events == conn->events) return;
+  epoll_event event{};
+  event.events = events;
+  event.data.fd = conn->fd;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->fd, &event) != 0) return Close(conn);
+  conn->events = events;
+}
+
+void Server::IoThread::Close(Connection* conn) noexcept {
+  if (!ring_) {
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn->fd, nullptr);
+  } else if (conn->receiving || conn->send_busy) {
+    // The kernel still writes into the buffers of the connection, until
+    // the shutdown completes its operations.
+    if (!conn->closed) ::shutdown(conn->fd, SHUT_RDWR);
+    conn->closed = true;
+    return;
+  }
+  connections_.erase(conn->fd);
+}
+
+Status Server::IoThread::LoopIoUring() noexcept {
+  PostAccept();
+  PostPoll(server_->stop_fd_, kStopOp);
+  PostPoll(wake_fd_, kWakeOp);
+  // After Stop, the connections are shut down and their operations in
+  // flight reaped before their buffers are freed.
+  while (!stopping_ || ring_ops_) {
+    Status s = ring_->Submit(1);
+    if (!s.ok()) return s;
+    ring_->ForEachCompletion([this](const io_uring_cqe& cqe) { HandleCompletion(cqe); });
+  }
+  return Status::OK();
+}
+
+io_uring_sqe* Server::IoThread::NextSqe() noexcept {
+  io_uring_sqe* sqe = ring_->GetSqe();
+  if (sqe) return sqe;
+  ring_->Submit(0);
+  return ring_->GetSqe();
+}
+
+void Server::IoThread::PostPoll(int fd, RingOp op) noexcept {
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll_events = POLLIN;
+  sqe->user_data = (static_cast<uint64_t>(fd) << kRingOpBits) | op;
+}
+
+void Server::IoThread::PostAccept() noexcept {
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = server_->listen_fd_;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = (static_cast<uint64_t>(server_->listen_fd_) << kRingOpBits) | kAcceptOp;
+}
+
+void Server::IoThread::PostRecv(Connection* conn) noexcept {
+  if (!conn->recv_buffer) conn->recv_buffer.reset(new char[kReadSize]);
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = conn->fd;
+  sqe->addr = reinterpret_cast<uint64_t>(conn->recv_buffer.get());
+  sqe->len = kReadSize;
+  sqe->user_data = (static_cast<uint64_t>(conn->fd) << kRingOpBits) | kRecvOp;
+  conn->receiving = true;
+  ring_ops_++;
+}
+
+void Server::IoThread::PostSend(Connection* conn) noexcept {
+  io_uring_sqe* sqe = NextSqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = conn->fd;
+  sqe->addr = reinterpret_cast<uint64_t>(conn->sending.data() + conn->sending_sent);
+  sqe->len = static_cast<uint32_t>(std::min<size_t>(conn->sending.size() - conn->sending_sent, UINT32_MAX));
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = (static_cast<uint64_t>(conn->fd) << kRingOpBits) | kSendOp;
+  conn->send_busy = true;
+  ring_ops_++;
+}
+
+void Server::IoThread::HandleCompletion(const io_uring_cqe& cqe) noexcept {
+  int fd = static_cast<int>(cqe.user_data >> kRingOpBits);
+  auto op = static_cast<RingOp>(cqe.user_data & ((1 << kRingOpBits) - 1));
+  if (op == kStopOp) {
+    stopping_ = true;
+    for (auto& [connFd, conn]: connections_) {
+      if (!conn->closed) ::shutdown(connFd, SHUT_RDWR);
+      conn->closed = true;
+    }
+    return;
+  }
+  if (op == kWakeOp) {
+    HandleCompleted();
+    if (!stopping_) PostPoll(wake_fd_, kWakeOp);
+    return;
+  }
+  if (op == kAcceptOp) {
+    if (stopping_) {
+      if (cqe.res >= 0) ::close(cqe.res);
+      return;
+    }
+    // Errors such as a client gone before being accepted only skip it.
+    if (cqe.res >= 0) {
+      int on = 1;
+      ::setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      auto conn = std::make_unique<Connection>(cqe.res);
+      PostRecv(conn.get());
+      connections_[cqe.res] = std::move(conn);
+    }
+    PostAccept();
+    return;
+  }
+
+  auto iter = connections_.find(fd);
+  if (iter == connections_.end()) return;
+  Connection* conn = iter->second.get();
+  ring_ops_--;
+  (op == kRecvOp ? conn->receiving : conn->send_busy) = false;
+  if (conn->closed) {
+    if (!conn->receiving && !conn->send_busy) connections_.erase(iter);
+    return;
+  }
+  bool retry = cqe.res == -EAGAIN || cqe.res == -EINTR;
+  if (op == kRecvOp) {
+    if (retry) return PostRecv(conn);
+    if (cqe.res <= 0) return Close(conn);
+    conn->input.append(conn->recv_buffer.get(), cqe.res);
+    ProcessInput(conn);
+  } else {
+    if (retry) return PostSend(conn);
+    if (cqe.res < 0) return Close(conn);
+    conn->sending_sent += cqe.res;
+    if (conn->sending_sent == conn->sending.size()) {
+      conn->sending.clear();
+      conn->sending_sent = 0;
+    }
+  }
+  Pump(conn);
+}
+
+void Server::IoThread::Pump(Connection* conn) noexcept {
+  if (conn->closed) return;
+  CollectReplies(conn);
+  if (conn->held && conn->pending() < server_->options_.max_pending_reply) {
+    ProcessInput(conn);
+    CollectReplies(conn);
+  }
+  if (!conn->send_busy) {
+    if (conn->sending.empty() && !conn->output.empty()) {
+      conn->sending.swap(conn->output);
+      conn->output.clear();
+    }
+    if (!conn->sending.empty()) PostSend(conn);
+  }
+  if (conn->closing && !conn->pending() && conn->inflight.empty()) return Close(conn);
+  if (!conn->receiving && !conn->held && !conn->closing) PostRecv(conn);
+}
+
+Server::Server(Merodis* db, const ServerOptions& options) noexcept:
+  db_(db),
+  options_(options),
+  listen_fd_(-1),
+  stop_fd_(-1),
+  port_(0),
+  backend_(options.io_backend) {}
+
+Server::~Server() noexcept {
+  io_threads_.clear();
+  workers_.clear();
+  if (listen_fd_ >= 0) ::close(listen_fd_);
+  if (stop_fd_ >= 0) ::close(stop_fd_);
+}
+
+Status Server::Listen() noexcept {
+  if (options_.io_threads < 1 || options_.worker_threads < 0) {
+    return Status::InvalidArgument("at least one I/O thread is needed");
+  }
+  if (options_.io_threads > 1 && options_.worker_threads == 0) {
+    return Status::InvalidArgument("several I/O threads need at least one worker");
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(options_.port);
+  if (inet_pton(AF_INET, options_.bind.c_str(), &address.sin_addr) != 1) {
+    return Status::InvalidArgument("invalid bind address", options_.bind);
+  }
+  listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) return IOError("socket");
+  int on = 1;
+  ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) return IOError("bind");
+  if (::listen(listen_fd_, options_.backlog) != 0) return IOError("listen");
+  socklen_t length = sizeof(address);
+  if (::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) return IOError("getsockname");
+  port_ = ntohs(address.sin_port);
+
+  stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (stop_fd_ < 0) return IOError("eventfd");
+  backend_ = options_.io_backend;
+  if (backend_ == kIoUringBackend && !IoUring().Init(1).ok()) backend_ = kEpollBackend;
+  for (int c = 0; c < options_.io_threads; c++) {
+    io_threads_.push_back(std::make_unique<IoThread>(this));
+    Status s = io_threads_.back()->Open(backend_ == kIoUringBackend);
+    if (!s.ok()) return s;
+  }
+  for (int c = 0; c < options_.worker_threads; c++) {
+    workers_.push_back(std::make_unique<Worker>(this));
+  }
+  return Status::OK();
+}
+
+Status Server::Run() noexcept {
+  if (io_threads_.empty()) return Status::InvalidArgument("the server does not listen");
+  int cpus = static_cast<int>(std::thread::hardware_concurrency());
+  int cpu = 0;
+  for (auto& worker: workers_) {
+    worker->Start();
+    if (options_.pin_threads && cpus > 0) PinThread(worker->thread(), (options_.io_threads + cpu++) % cpus);
+  }
+  cpu = 0;
+  for (auto& ioThread: io_threads_) {
+    ioThread->Start();
+    if (options_.pin_threads && cpus > 0) PinThread(ioThread->thread(), cpu++ % cpus);
+  }
+  Status s;
+  for (auto& ioThread: io_threads_) {
+    Status joined = ioThread->Join();
+    if (s.ok()) s = joined;
+  }
+  // The I/O threads outlive the workers, which complete their tasks.
+  for (auto& worker: workers_) worker->Stop();
+  return s;
+}
+
+void Server::Stop() noexcept {
+  uint64_t one = 1;
+  ssize_t ignored = ::write(stop_fd_, &one, sizeof(one));
+  (void) ignored;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef MERODIS_SERVER_H
+#define MERODIS_SERVER_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "merodis/merodis.h"
+#include "command.h"
+
+namespace merodis {
+
+enum IoBackend {
+  kEpollBackend,
+  // Submits the socket reads and writes through io_uring, several per
+  // system call, falling back to epoll where the kernel lacks it.
+  kIoUringBackend,
+};
+
+struct ServerOptions {
+  std::string bind = "127.0.0.1";
+  // Zero picks a free port, see Server::port.
+  uint16_t port = 6379;
+  int backlog = 511;
+  // Once a client has that many bytes of replies unsent, the server stops
+  // running its pipelined requests until they drain.
+  uint64_t max_pending_reply = 64 << 20;
+  // The threads reading, parsing and answering the clients, each running
+  // an epoll loop over its share of the connections.
+  int io_threads = 1;
+  // The threads running the commands, each owning the keys hashing to it,
+  // so the commands on one key run in order without locking. With none,
+  // the single I/O thread runs the commands itself; several I/O threads
+  // need at least one worker, as nothing would order their commands.
+  int worker_threads = 0;
+  // Pins the I/O threads, then the workers, to one CPU each in turn.
+  bool pin_threads = false;
+  enum IoBackend io_backend = kEpollBackend;
+};
+
+// Serves db to Redis clients over RESP2. The I/O threads share the
+// listening socket, each accepting clients into its own epoll loop over
+// non-blocking sockets, and hand each complete request, the pipelined ones
+// in a row, to the worker owning its key. The requests of one client only
+// run on one worker at a time, so they run and get answered in order.
+class Server {
+public:
+  Server(Merodis* db, const ServerOptions& options) noexcept;
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+  ~Server() noexcept;
+
+  // Binds and listens, so the clients can connect before Run.
+  Status Listen() noexcept;
+  // Serves the clients until Stop.
+  Status Run() noexcept;
+  // Makes Run return, from any thread or a signal handler.
+  void Stop() noexcept;
+  // The port listened to, once Listen returned.
+  uint16_t port() const noexcept { return port_; }
+  // The backend serving the clients, once Listen returned.
+  IoBackend backend() const noexcept { return backend_; }
+
+private:
+  struct Connection;
+  struct Task;
+  struct Barrier;
+  class Worker;
+  class IoThread;
+
+  Merodis* db_;
+  ServerOptions options_;
+  CommandTable commands_;
+  int listen_fd_;
+  int stop_fd_;
+  uint16_t port_;
+  IoBackend backend_;
+  std::vector<std::unique_ptr<IoThread>> io_threads_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // Held while queueing a barrier on every worker, so the workers see the
+  // barriers in the same order.
+  std::mutex barrier_mutex_;
+};
+
+}
+
+#endif //MERODIS_SERVER_H
@@ -0,0 +1,115 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class BulkLoaderTest : public RedisTest {
+public:
+  BulkLoaderTest() {
+    db.Open(options, db_path);
+  }
+
+  std::string work_path = db_path + "_bulk";
+};
+
+TEST_F(BulkLoaderTest, LoadsEveryType) {
+  // A small buffer spreads the records over several runs.
+  BulkLoader loader(&db, work_path, 64);
+  ASSERT_MERODIS_OK(loader.Add({kStringType, "key", {"string"}}));
+  ASSERT_MERODIS_OK(loader.Add({kListType, "key", {"l0", "l1", "l2"}}));
+  ASSERT_MERODIS_OK(loader.Add({kHashType, "key", {"f1", "f0"}, {"v1", "v0"}}));
+  ASSERT_MERODIS_OK(loader.Add({kSetType, "key", {"b", "a"}}));
+  ASSERT_MERODIS_OK(loader.Add({kZSetType, "key", {"x", "y"}, {}, {2, 1}}));
+  ASSERT_MERODIS_OK(loader.Add({kSetType, "other", {"c"}}));
+  ASSERT_MERODIS_OK(loader.Finish());
+
+  uint64_t count;
+  std::string value;
+  ASSERT_MERODIS_OK(db.Get("key", &value));
+  ASSERT_EQ(value, "string");
+  std::vector<std::string> values;
+  ASSERT_MERODIS_OK(db.LRange("key", 0, -1, &values));
+  ASSERT_EQ(values, LIST("l0", "l1", "l2"));
+  std::map<std::string, std::string> kvs;
+  ASSERT_MERODIS_OK(db.HGetAll("key", &kvs));
+  ASSERT_EQ(kvs, KVS({"f0", "v0"}, {"f1", "v1"}));
+  ASSERT_MERODIS_OK(db.HLen("key", &count));
+  ASSERT_EQ(count, 2);
+  std::vector<std::string> members;
+  ASSERT_MERODIS_OK(db.SUnion({"key", "other"}, &members));
+  ASSERT_EQ(members, LIST("a", "b", "c"));
+  ASSERT_MERODIS_OK(db.SCard("key", &count));
+  ASSERT_EQ(count, 2);
+  ScoredMembers scoredMembers;
+  ASSERT_MERODIS_OK(db.ZRangeWithScores("key", 0, -1, &scoredMembers));
+  ASSERT_EQ(scoredMembers, PAIRS({"y", 1}, {"x", 2}));
+
+  // The loaded keys take further commands.
+  ASSERT_MERODIS_OK(db.RPush("key", "l3"));
+  ASSERT_MERODIS_OK(db.LLen("key", &count));
+  ASSERT_EQ(count, 4);
+  ASSERT_MERODIS_OK(db.ZAdd("key", {"z", 0}, &count));
+  ASSERT_EQ(count, 1);
+}
+
+TEST_F(BulkLoaderTest, RejectsMalformedRecords) {
+  BulkLoader loader(&db, work_path);
+  ASSERT_TRUE(loader.Add({kStringType, "key", {"v0", "v1"}}).IsInvalidArgument());
+  ASSERT_TRUE(loader.Add({kHashType, "key", {"f0"}, {}}).IsInvalidArgument());
+  ASSERT_TRUE(loader.Add({kZSetType, "key", {"m0"}, {}, {}}).IsInvalidArgument());
+  ASSERT_MERODIS_OK(loader.Add({kSetType, "key", {"a"}}));
+  // Members added twice are found once the run is sorted.
+  ASSERT_MERODIS_OK(loader.Add({kSetType, "other", {"a", "a"}}));
+  ASSERT_TRUE(loader.Finish().IsInvalidArgument());
+}
+
+// The Add writing the run of a key added again fails, or else Finish.
+static Status AddAndFinish(BulkLoader* loader, const BulkRecord& record) {
+  Status s = loader->Add(record);
+  return s.ok() ? loader->Finish() : s;
+}
+
+TEST_F(BulkLoaderTest, RejectsKeysAddedAgain) {
+  uint64_t count;
+  ASSERT_MERODIS_OK(db.SAdd("stored", "a", &count));
+  {
+    // Added twice to one run.
+    BulkLoader loader(&db, work_path);
+    ASSERT_MERODIS_OK(loader.Add({kSetType, "key", {"a"}}));
+    ASSERT_TRUE(AddAndFinish(&loader, {kSetType, "key", {"b"}}).IsInvalidArgument());
+  }
+  {
+    // Added to runs of their own, as each record fills the buffer.
+    BulkLoader loader(&db, work_path, 1);
+    ASSERT_MERODIS_OK(loader.Add({kListType, "key", {"l0"}}));
+    ASSERT_MERODIS_OK(loader.Add({kListType, "other", {"l0"}}));
+    ASSERT_TRUE(AddAndFinish(&loader, {kListType, "key", {"l1"}}).IsInvalidArgument());
+  }
+  {
+    BulkLoader loader(&db, work_path, 1);
+    ASSERT_TRUE(AddAndFinish(&loader, {kSetType, "stored", {"b"}}).IsInvalidArgument());
+  }
+  ASSERT_MERODIS_OK(db.SCard("stored", &count));
+  ASSERT_EQ(count, 1);
+
+  BulkLoader loader(&db, work_path, 1);
+  ASSERT_MERODIS_OK(loader.Add({kSetType, "key", {"a"}}));
+  ASSERT_MERODIS_OK(loader.Add({kZSetType, "stored", {"a"}, {}, {1}}));
+  ASSERT_MERODIS_OK(loader.Finish());
+  ASSERT_MERODIS_OK(db.SCard("key", &count));
+  ASSERT_EQ(count, 1);
+  ASSERT_MERODIS_OK(db.ZCard("stored", &count));
+  ASSERT_EQ(count, 1);
+}
+
+}
+}
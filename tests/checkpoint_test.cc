@@ -0,0 +1,102 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class CheckpointTest : public RedisTest {
+public:
+  void SetUp() override {
+    Merodis::DestroyDB(checkpoint_path, Options());
+    Merodis::DestroyDB(restored_path, Options());
+    std::filesystem::remove_all(backup_path);
+    ASSERT_MERODIS_OK(db.Open(options, db_path));
+  }
+  ~CheckpointTest() override {
+    Merodis::DestroyDB(checkpoint_path, Options());
+    Merodis::DestroyDB(restored_path, Options());
+    std::filesystem::remove_all(backup_path);
+  }
+
+  std::string checkpoint_path = db_path + "_checkpoint";
+  std::string restored_path = db_path + "_restored";
+  std::string backup_path = db_path + "_backup";
+};
+
+TEST_F(CheckpointTest, OpensAsInstance) {
+  ASSERT_NO_FATAL_FAILURE(PutEveryType(&db));
+  ASSERT_MERODIS_OK(db.CreateCheckpoint(checkpoint_path));
+  ASSERT_MERODIS_OK(db.Set("key", "later"));
+
+  Merodis checkpoint;
+  ASSERT_MERODIS_OK(checkpoint.Open(options, checkpoint_path));
+  ASSERT_NO_FATAL_FAILURE(ExpectEveryType(&checkpoint));
+}
+
+TEST_F(CheckpointTest, SeesOnePointOfEveryType) {
+  // Each round sets the string before pushing onto the list, so a
+  // consistent checkpoint holds the string of the last round or the one
+  // after.
+  std::atomic<bool> stop = false;
+  std::thread writer([&] {
+    for (int c = 0; !stop; c++) {
+      db.Set("round", std::to_string(c));
+      db.RPush("rounds", std::to_string(c));
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  s = db.CreateCheckpoint(checkpoint_path);
+  stop = true;
+  writer.join();
+  ASSERT_MERODIS_OK(s);
+
+  Merodis checkpoint;
+  ASSERT_MERODIS_OK(checkpoint.Open(options, checkpoint_path));
+  std::string round;
+  ASSERT_MERODIS_OK(checkpoint.Get("round", &round));
+  uint64_t rounds;
+  ASSERT_MERODIS_OK(checkpoint.LLen("rounds", &rounds));
+  ASSERT_GE(rounds, std::stoull(round));
+  ASSERT_LE(rounds, std::stoull(round) + 1);
+}
+
+TEST_F(CheckpointTest, RestoresBackups) {
+  uint64_t count;
+  uint64_t first, second;
+  ASSERT_MERODIS_OK(db.HSet("key", "field", "first", &count));
+  ASSERT_MERODIS_OK(db.CreateBackup(backup_path, &first));
+  ASSERT_MERODIS_OK(db.HSet("key", "field", "second", &count));
+  ASSERT_MERODIS_OK(db.CreateBackup(backup_path, &second));
+  ASSERT_NE(first, second);
+
+  std::string value;
+  {
+    ASSERT_MERODIS_OK(Merodis::RestoreBackup(backup_path, first, restored_path));
+    Merodis restored;
+    ASSERT_MERODIS_OK(restored.Open(options, restored_path));
+    ASSERT_MERODIS_OK(restored.HGet("key", "field", &value));
+    ASSERT_EQ(value, "first");
+  }
+  Merodis::DestroyDB(restored_path, Options());
+
+  ASSERT_MERODIS_OK(Merodis::DeleteBackup(backup_path, first));
+  ASSERT_TRUE(Merodis::RestoreBackup(backup_path, first, restored_path).IsNotFound());
+  ASSERT_MERODIS_OK(Merodis::RestoreBackup(backup_path, second, restored_path));
+  Merodis restored;
+  ASSERT_MERODIS_OK(restored.Open(options, restored_path));
+  ASSERT_MERODIS_OK(restored.HGet("key", "field", &value));
+  ASSERT_EQ(value, "second");
+}
+
+}
+}
@@ -1,6 +1,12 @@
 #ifndef MERODIS_COMMON_H
 #define MERODIS_COMMON_H
 
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "merodis/merodis.h"
@@ -14,6 +20,35 @@ public:
     options.create_if_missing = true;
   }
 
+  // Stores a string, a list, a hash, a set and a zset, all at "key", into
+  // target, for ExpectEveryType to find wherever target's data is copied.
+  static void PutEveryType(merodis::Merodis* target) {
+    uint64_t count;
+    ASSERT_MERODIS_OK(target->Set("key", "string"));
+    ASSERT_MERODIS_OK(target->RPush("key", std::vector<merodis::Slice>{"l0", "l1"}));
+    ASSERT_MERODIS_OK(target->HSet("key", "field", "hash", &count));
+    ASSERT_MERODIS_OK(target->SAdd("key", std::set<merodis::Slice>{"a", "b"}, &count));
+    ASSERT_MERODIS_OK(target->ZAdd("key", {"member", 1}, &count));
+  }
+
+  static void ExpectEveryType(merodis::Merodis* target) {
+    std::string value;
+    ASSERT_MERODIS_OK(target->Get("key", &value));
+    ASSERT_EQ(value, "string");
+    std::vector<std::string> values;
+    ASSERT_MERODIS_OK(target->LRange("key", 0, -1, &values));
+    ASSERT_EQ(values, LIST("l0", "l1"));
+    std::map<std::string, std::string> kvs;
+    ASSERT_MERODIS_OK(target->HGetAll("key", &kvs));
+    ASSERT_EQ(kvs, KVS({"field", "hash"}));
+    std::vector<std::string> members;
+    ASSERT_MERODIS_OK(target->SMembers("key", &members));
+    ASSERT_EQ(members, LIST("a", "b"));
+    merodis::ScoredMembers scoredMembers;
+    ASSERT_MERODIS_OK(target->ZRangeWithScores("key", 0, -1, &scoredMembers));
+    ASSERT_EQ(scoredMembers, PAIRS({"member", 1}));
+  }
+
   std::string db_path = "/tmp/test";
   merodis::Options options;
   merodis::Merodis db;
@@ -0,0 +1,188 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+#ifdef ROCKSDB
+#include "rocksdb/statistics.h"
+#else
+#include "leveldb/env.h"
+#endif
+
+namespace merodis {
+namespace test {
+
+#ifndef ROCKSDB
+// Counts the syncs of the WAL files opened through it.
+class SyncCountingEnv : public DB_ENGINE::EnvWrapper {
+public:
+  SyncCountingEnv() : DB_ENGINE::EnvWrapper(DB_ENGINE::Env::Default()) {}
+
+  DB_ENGINE::Status NewWritableFile(const std::string& fname, DB_ENGINE::WritableFile** result) override {
+    return Wrap(fname, target()->NewWritableFile(fname, result), result);
+  }
+  DB_ENGINE::Status NewAppendableFile(const std::string& fname, DB_ENGINE::WritableFile** result) override {
+    return Wrap(fname, target()->NewAppendableFile(fname, result), result);
+  }
+
+  std::atomic<uint64_t> syncs{0};
+
+private:
+  class CountingFile : public DB_ENGINE::WritableFile {
+  public:
+    CountingFile(DB_ENGINE::WritableFile* file, std::atomic<uint64_t>* syncs) : file_(file), syncs_(syncs) {}
+    ~CountingFile() override { delete file_; }
+
+    DB_ENGINE::Status Append(const DB_ENGINE::Slice& data) override { return file_->Append(data); }
+    DB_ENGINE::Status Close() override { return file_->Close(); }
+    DB_ENGINE::Status Flush() override { return file_->Flush(); }
+    DB_ENGINE::Status Sync() override {
+      ++*syncs_;
+      return file_->Sync();
+    }
+
+  private:
+    DB_ENGINE::WritableFile* file_;
+    std::atomic<uint64_t>* syncs_;
+  };
+
+  DB_ENGINE::Status Wrap(const std::string& fname, DB_ENGINE::Status s, DB_ENGINE::WritableFile** result) {
+    static const std::string suffix = ".log";
+    bool isLog = fname.size() >= suffix.size() &&
+                 fname.compare(fname.size() - suffix.size(), suffix.size(), suffix) == 0;
+    if (s.ok() && isLog) *result = new CountingFile(*result, &syncs);
+    return s;
+  }
+};
+
+// Outlives the instances of every test.
+static SyncCountingEnv countingEnv;
+#endif
+
+class DurabilityTest : public RedisTest {
+public:
+  DurabilityTest() {
+    options.sync_interval = 1;
+#ifdef ROCKSDB
+    options.statistics = DB_ENGINE::CreateDBStatistics();
+#else
+    options.env = &countingEnv;
+#endif
+  }
+
+  void Open(Durability durability) {
+    options.durability = durability;
+    ASSERT_MERODIS_OK(db.Open(options, db_path));
+  }
+
+  uint64_t WALSyncs() {
+#ifdef ROCKSDB
+    return options.statistics->getTickerCount(DB_ENGINE::WAL_FILE_SYNCED);
+#else
+    return countingEnv.syncs;
+#endif
+  }
+
+  // Waits up to a second for the WAL to be synced after syncs.
+  bool WaitForWALSync(uint64_t syncs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (WALSyncs() == syncs) {
+      if (std::chrono::steady_clock::now() > deadline) return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  }
+};
+
+TEST_F(DurabilityTest, ScopesNest) {
+  ASSERT_EQ(DurabilityScope::Current(), nullptr);
+  {
+    DurabilityScope sync(kSyncDurability);
+    ASSERT_EQ(*DurabilityScope::Current(), kSyncDurability);
+    {
+      DurabilityScope noWAL(kNoWALDurability);
+      ASSERT_EQ(*DurabilityScope::Current(), kNoWALDurability);
+    }
+    ASSERT_EQ(*DurabilityScope::Current(), kSyncDurability);
+  }
+  ASSERT_EQ(DurabilityScope::Current(), nullptr);
+}
+
+TEST_F(DurabilityTest, SyncsOnlyTheWritesAskingFor) {
+  Open(kAsyncDurability);
+  uint64_t count;
+  uint64_t syncs = WALSyncs();
+  ASSERT_MERODIS_OK(db.Set("async", "v"));
+  {
+    DurabilityScope noWAL(kNoWALDurability);
+    ASSERT_MERODIS_OK(db.Set("cache", "v"));
+  }
+  ASSERT_EQ(WALSyncs(), syncs);
+
+  {
+    DurabilityScope sync(kSyncDurability);
+    ASSERT_MERODIS_OK(db.Set("sync", "v"));
+    ASSERT_GT(WALSyncs(), syncs);
+    syncs = WALSyncs();
+    ASSERT_MERODIS_OK(db.HSet("sync", "field", "v", &count));
+    ASSERT_GT(WALSyncs(), syncs);
+    // Synced once the stripe of the list is released.
+    syncs = WALSyncs();
+    ASSERT_MERODIS_OK(db.RPush("sync", std::vector<Slice>{"v"}));
+    ASSERT_GT(WALSyncs(), syncs);
+    syncs = WALSyncs();
+    std::string value;
+    ASSERT_MERODIS_OK(db.LPop("sync", &value));
+    ASSERT_GT(WALSyncs(), syncs);
+  }
+}
+
+TEST_F(DurabilityTest, SyncsPeriodically) {
+  Open(kPeriodicSyncDurability);
+  uint64_t syncs = WALSyncs();
+  ASSERT_MERODIS_OK(db.Set("async", "v"));
+  ASSERT_TRUE(WaitForWALSync(syncs));
+}
+
+TEST_F(DurabilityTest, WritesOfEveryDurability) {
+  Open(kPeriodicSyncDurability);
+  uint64_t count;
+  std::string value;
+  ASSERT_MERODIS_OK(db.Set("async", "v"));
+  {
+    DurabilityScope sync(kSyncDurability);
+    ASSERT_MERODIS_OK(db.Set("sync", "v"));
+    ASSERT_MERODIS_OK(db.HSet("sync", "field", "v", &count));
+  }
+  {
+    DurabilityScope noWAL(kNoWALDurability);
+    ASSERT_MERODIS_OK(db.Set("cache", "v"));
+    ASSERT_MERODIS_OK(db.SAdd("cache", "member", &count));
+  }
+
+  for (const char* key: {"async", "sync", "cache"}) {
+    ASSERT_MERODIS_OK(db.Get(key, &value));
+    ASSERT_EQ(value, "v");
+  }
+  ASSERT_MERODIS_OK(db.HGet("sync", "field", &value));
+  ASSERT_EQ(value, "v");
+  ASSERT_MERODIS_OK(db.SCard("cache", &count));
+  ASSERT_EQ(count, 1);
+}
+
+TEST_F(DurabilityTest, OpensOnce) {
+  Open(kPeriodicSyncDurability);
+  ASSERT_MERODIS_IS_INVALID_ARGUMENT(db.Open(options, db_path));
+  ASSERT_MERODIS_OK(db.Set("key", "v"));
+}
+
+}
+}
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string>
+#include <thread>
 #include <vector>
 #include <map>
 #include <set>
@@ -26,8 +27,8 @@ public:
     EXPECT_MERODIS_OK(db.HGet(key, hashKey, &value));
     return value;
   }
-  std::vector<std::string> HMGet(const Slice& key, const std::vector<Slice>& hashKeys) {
-    std::vector<std::string> values;
+  ValueOpts HMGet(const Slice& key, const std::vector<Slice>& hashKeys) {
+    ValueOpts values;
     EXPECT_MERODIS_OK(db.HMGet(key, hashKeys, &values));
     return values;
   }
@@ -74,7 +75,7 @@ public:
 
   uint64_t HLen() { return HLen(key_); }
   std::string HGet(const Slice& hashKey) { return HGet(key_, hashKey); }
-  std::vector<std::string> HMGet(const std::vector<Slice>& hashKeys) { return HMGet(key_, hashKeys); }
+  ValueOpts HMGet(const std::vector<Slice>& hashKeys) { return HMGet(key_, hashKeys); }
   std::map<std::string, std::string> HGetAll() { return HGetAll(key_); }
   std::vector<std::string> HKeys() { return HKeys(key_); }
   std::vector<std::string> HVals() { return HVals(key_); }
@@ -93,6 +94,7 @@ public:
   virtual void TestHVals();
   virtual void TestHDel();
   virtual void TestMultipleKeys();
+  virtual void TestConcurrentHSet();
 
 private:
   Slice key_;
@@ -144,10 +146,21 @@ void HashTest::TestHExists() {
 
 void HashTest::TestHMGet() {
   ASSERT_EQ(HSet({{"k0", "v0"}, {"k1", "v1"}, {"k2", "v2"}}), 3);
-  ASSERT_EQ(HMGet({"k0", "k2"}), LIST("v0", "v2"));
-  ASSERT_EQ(HMGet({"k1"}), LIST("v1"));
-  ASSERT_EQ(HMGet({"k2", "k0"}), LIST("v2", "v0"));
-  ASSERT_EQ(HMGet({"k2", "k1", "k1", "k2"}), LIST("v2", "v1", "v1", "v2"));
+  ASSERT_EQ(HMGet({"k0", "k2"}), (ValueOpts{"v0", "v2"}));
+  ASSERT_EQ(HMGet({"k1"}), (ValueOpts{"v1"}));
+  ASSERT_EQ(HMGet({"k2", "k0"}), (ValueOpts{"v2", "v0"}));
+  ASSERT_EQ(HMGet({"k2", "k1", "k1", "k2"}), (ValueOpts{"v2", "v1", "v1", "v2"}));
+  ASSERT_EQ(HMGet({"k", "k1", "k3"}), (ValueOpts{std::nullopt, "v1", std::nullopt}));
+  HSet("empty", "");
+  ASSERT_EQ(HMGet({"empty", "k"}), (ValueOpts{"", std::nullopt}));
+
+  // Few fields of a large hash are looked up rather than walked.
+  std::vector<std::string> fields;
+  for (int c = 0; c < 100; c++) fields.push_back("f" + std::to_string(c));
+  std::map<Slice, Slice> kvs;
+  for (const auto& field: fields) kvs[field] = field;
+  ASSERT_EQ(HSet(kvs), 100);
+  ASSERT_EQ(HMGet({"f7", "k0", "f", "f42"}), (ValueOpts{"f7", "v0", std::nullopt, "f42"}));
 }
 
 void HashTest::TestHGetAll() {
@@ -203,6 +216,34 @@ void HashTest::TestMultipleKeys() {
   ASSERT_EQ(HGetAll("k0"), KVS());
   ASSERT_EQ(HKeys("k0"), LIST());
   ASSERT_EQ(HVals("k0"), LIST());
+  ASSERT_EQ(HDel("k0", std::set<Slice>{"0", "1"}), 0);
+  ASSERT_EQ(HSet("k", {{"0", "0"}, {"1", "1"}}), 2);
+  ASSERT_EQ(HLen("k"), 2);
+  ASSERT_EQ(HLen("k1"), 2);
+}
+
+// Writers adding and deleting the same fields race on one hash, and each
+// field may count towards the length only once.
+void HashTest::TestConcurrentHSet() {
+  constexpr int kThreads = 8;
+  constexpr int kRounds = 200;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t]() {
+      uint64_t count;
+      for (int c = 0; c < kRounds; c++) {
+        std::string field = std::to_string(c);
+        if (t % 2) {
+          EXPECT_MERODIS_OK(db.HSet(key_, {{field, "v"}, {"shared", "v"}}, &count));
+        } else {
+          EXPECT_MERODIS_OK(db.HSet(key_, field, "v", &count));
+          EXPECT_MERODIS_OK(db.HDel(key_, std::set<Slice>{"shared"}, &count));
+        }
+      }
+    });
+  }
+  for (auto& thread: threads) thread.join();
+  ASSERT_EQ(HLen(), HKeys().size());
 }
 
 TEST_F(HashBasicImplTest, HSet) {
@@ -241,5 +282,9 @@ TEST_F(HashBasicImplTest, MultipleKeys) {
   TestMultipleKeys();
 }
 
+TEST_F(HashBasicImplTest, ConcurrentHSet) {
+  TestConcurrentHSet();
+}
+
 }
 }
\ No newline at end of file
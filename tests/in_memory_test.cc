@@ -0,0 +1,38 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class InMemoryTest : public RedisTest {
+public:
+  void SetUp() override {
+    Merodis::DestroyDB(saved_path, Options());
+    options.in_memory = true;
+    ASSERT_MERODIS_OK(db.Open(options, db_path));
+  }
+  ~InMemoryTest() override {
+    Merodis::DestroyDB(saved_path, Options());
+  }
+
+  std::string saved_path = db_path + "_saved";
+};
+
+TEST_F(InMemoryTest, SavesAndLoads) {
+  ASSERT_NO_FATAL_FAILURE(PutEveryType(&db));
+  ASSERT_MERODIS_OK(db.SaveTo(saved_path));
+
+  Merodis loaded;
+  ASSERT_MERODIS_OK(loaded.Open(options, db_path + "_loaded"));
+  ASSERT_MERODIS_OK(loaded.LoadFrom(saved_path));
+  ASSERT_MERODIS_IS_INVALID_ARGUMENT(loaded.LoadFrom(saved_path));
+  ASSERT_NO_FATAL_FAILURE(ExpectEveryType(&loaded));
+}
+
+}
+}
@@ -1,5 +1,8 @@
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -89,6 +92,13 @@ public:
     EXPECT_MERODIS_OK(db.LMove(srcKey, dstKey, srcSide, dstSide, &value));
     return value;
   }
+  // Runs pop on a thread of its own until it waits on key.
+  std::thread Blocked(const Slice& key, const std::function<void()>& pop) {
+    uint64_t waiters = db.BlockedOn(key);
+    std::thread thread(pop);
+    while (db.BlockedOn(key) == waiters) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return thread;
+  }
   uint64_t LLen() { return LLen(key_); }
   std::string LIndex(UserIndex index) { return LIndex(key_, index); }
   std::vector<uint64_t> LPos(const Slice& value, int64_t rank, int64_t count, int64_t maxlen) {
@@ -124,6 +134,8 @@ public:
   virtual void TestLInsert();
   virtual void TestLRem();
   virtual void TestLMove();
+  virtual void TestBPop();
+  virtual void TestBLMove();
 
 private:
   Slice key_;
@@ -415,6 +427,87 @@ void ListTest::TestLMove() {
 
   ASSERT_EQ(LMove("k2", "k2", kRight, kRight), "");
   ASSERT_EQ(List("k2"), LIST("b", "0", "a"));
+
+  ASSERT_EQ(LMove("k1", "k3", kLeft, kRight), "2");
+  ASSERT_EQ(LMove("k1", "k3", kLeft, kRight), "c");
+  ASSERT_EQ(List("k1"), LIST("1"));
+  ASSERT_EQ(List("k3"), LIST("2", "c"));
+}
+
+void ListTest::TestBPop() {
+  std::string key, value;
+  RPush("k1", {"a", "b"});
+  ASSERT_MERODIS_OK(db.BLPop({"k0", "k1"}, 0, &key, &value));
+  ASSERT_EQ(key, "k1");
+  ASSERT_EQ(value, "a");
+  ASSERT_TRUE(db.BLPop({"k0"}, 10, &key, &value).IsNotFound());
+
+  std::thread waiter = Blocked("k2", [&] { EXPECT_MERODIS_OK(db.BLPop({"k0", "k2"}, 0, &key, &value)); });
+  RPush("k2", {"x", "y"});
+  waiter.join();
+  ASSERT_EQ(key, "k2");
+  ASSERT_EQ(value, "x");
+  ASSERT_EQ(List("k2"), LIST("y"));
+
+  std::vector<std::string> values(3);
+  std::vector<std::thread> waiters;
+  for (int c = 0; c < 3; c++) {
+    waiters.push_back(Blocked("q", [&, c] {
+      std::string waiterKey;
+      EXPECT_MERODIS_OK(db.BRPop({"q"}, 5000, &waiterKey, &values[c]));
+    }));
+  }
+  LPush("q", {"1", "2"});
+  LPush("q", {"3", "4"});
+  for (auto& thread: waiters) thread.join();
+  ASSERT_EQ(values, LIST("1", "2", "3"));
+  ASSERT_EQ(List("q"), LIST("4"));
+}
+
+void ListTest::TestBLMove() {
+  std::string value;
+  RPush("src", "a");
+  ASSERT_MERODIS_OK(db.BLMove("src", "dst", kLeft, kRight, 0, &value));
+  ASSERT_EQ(value, "a");
+  ASSERT_TRUE(db.BLMove("src", "dst", kLeft, kRight, 10, &value).IsNotFound());
+
+  std::thread waiter = Blocked("src", [&] { EXPECT_MERODIS_OK(db.BLMove("src", "dst", kLeft, kRight, 0, &value)); });
+  RPush("src", "b");
+  waiter.join();
+  ASSERT_EQ(value, "b");
+  ASSERT_EQ(List("src"), LIST());
+  ASSERT_EQ(List("dst"), LIST("a", "b"));
+
+  // The mover takes the first element, the pop queued behind it the next.
+  std::string key, popped;
+  waiter = Blocked("src", [&] { EXPECT_MERODIS_OK(db.BLMove("src", "dst", kLeft, kRight, 0, &value)); });
+  std::thread pop = Blocked("src", [&] { EXPECT_MERODIS_OK(db.BLPop({"src"}, 0, &key, &popped)); });
+  RPush("src", {"c", "d", "e"});
+  waiter.join();
+  pop.join();
+  ASSERT_EQ(value, "c");
+  ASSERT_EQ(popped, "d");
+  ASSERT_EQ(List("src"), LIST("e"));
+  ASSERT_EQ(List("dst"), LIST("a", "b", "c"));
+  ASSERT_EQ(db.BlockedOn("src"), 0);
+  ASSERT_EQ(LPop("src"), "e");
+  ASSERT_EQ(RPop("dst"), "c");
+
+  waiter = Blocked("w", [&] { EXPECT_MERODIS_OK(db.BLPop({"w"}, 0, &key, &value)); });
+  ASSERT_EQ(LMove("dst", "w", kLeft, kRight), "a");
+  waiter.join();
+  ASSERT_EQ(value, "a");
+  ASSERT_EQ(List("dst"), LIST("b"));
+  ASSERT_EQ(LLen("w"), 0);
+
+  // A mover waiting on the destination finds the element stored there.
+  waiter = Blocked("w", [&] { EXPECT_MERODIS_OK(db.BLMove("w", "v", kLeft, kRight, 0, &value)); });
+  ASSERT_EQ(LMove("dst", "w", kLeft, kRight), "b");
+  waiter.join();
+  ASSERT_EQ(value, "b");
+  ASSERT_EQ(LLen("dst"), 0);
+  ASSERT_EQ(LLen("w"), 0);
+  ASSERT_EQ(List("v"), LIST("b"));
 }
 
 TEST_F(ListArrayImplTest, LIndex) {
@@ -465,5 +558,60 @@ TEST_F(ListArrayImplTest, LMove) {
   TestLMove();
 }
 
+TEST_F(ListArrayImplTest, BPop) {
+  TestBPop();
+}
+
+TEST_F(ListArrayImplTest, BLMove) {
+  TestBLMove();
+}
+
+TEST_F(ListArrayImplTest, DeletesTrimmedNodesOverWrites) {
+  std::vector<std::string> values;
+  for (int i = 0; i < 6000; i++) values.push_back(std::to_string(i));
+  ASSERT_MERODIS_OK(db.RPush("key", std::vector<Slice>(values.begin(), values.end())));
+  ASSERT_MERODIS_OK(db.RPush("key:other", "o"));
+  // More nodes retire than one write deletes, on both sides, so the next
+  // write deletes the rest.
+  LTrim(3000, 3001);
+  ASSERT_EQ(List(), LIST("3000", "3001"));
+  ASSERT_MERODIS_OK(db.LPush("key", "l"));
+  ASSERT_EQ(List(), LIST("l", "3000", "3001"));
+  ASSERT_EQ(LLen("key:other"), 1);
+  // Only the meta values and the nodes in the windows are left.
+  Merodis::DestroyDB("/tmp/test_saved", Options());
+  ASSERT_MERODIS_OK(db.SaveTo("/tmp/test_saved"));
+  DB* saved;
+  ASSERT_MERODIS_OK(DB::Open(EngineOptions(), "/tmp/test_saved/list", &saved));
+  Iterator* iter = saved->NewIterator(ReadOptions());
+  int keys = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) keys++;
+  delete iter;
+  delete saved;
+  Merodis::DestroyDB("/tmp/test_saved", Options());
+  ASSERT_EQ(keys, 6);
+  ASSERT_MERODIS_OK(db.RPush("key", "r"));
+  ASSERT_EQ(List(), LIST("l", "3000", "3001", "r"));
+  std::vector<std::string> popped;
+  ASSERT_MERODIS_OK(db.LPop("key", 3, &popped));
+  ASSERT_EQ(List(), LIST("r"));
+}
+
+TEST_F(ListArrayImplTest, ReclaimKeepsListsExtendingKey) {
+  std::vector<std::string> values;
+  for (int i = 0; i < 10000; i++) values.push_back(std::to_string(i));
+  ASSERT_MERODIS_OK(db.RPush("k", std::vector<Slice>(values.begin(), values.end())));
+  // As long as a node key of "k", of an index below the window.
+  const std::string other = "k12345678";
+  ASSERT_MERODIS_OK(db.RPush(other, {"a", "b"}));
+  LTrim("k", 9998, 9999);
+  ASSERT_MERODIS_OK(db.ReclaimStaleVersions());
+  ASSERT_EQ(LLen(other), 2);
+  ASSERT_EQ(List(other), LIST("a", "b"));
+  ASSERT_MERODIS_OK(db.RPush("k", "r"));
+  ASSERT_EQ(List("k"), LIST("9998", "9999", "r"));
+  ASSERT_EQ(List(other), LIST("a", "b"));
+}
+
 }
 }
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "util/coding.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class OpenTest : public RedisTest {
+public:
+  void Populate() {
+    Merodis previous;
+    uint64_t count;
+    ASSERT_MERODIS_OK(previous.Open(options, db_path));
+    ASSERT_MERODIS_OK(previous.Set("key", "string"));
+    ASSERT_MERODIS_OK(previous.RPush("key", std::vector<Slice>{"l0", "l1"}));
+    ASSERT_MERODIS_OK(previous.HSet("key", "field", "hash", &count));
+    ASSERT_MERODIS_OK(previous.SAdd("key", "member", &count));
+    ASSERT_MERODIS_OK(previous.ZAdd("key", {"member", 1}, &count));
+  }
+
+  void Verify() {
+    uint64_t count;
+    std::string value;
+    ASSERT_MERODIS_OK(db.Get("key", &value));
+    ASSERT_EQ(value, "string");
+    ASSERT_MERODIS_OK(db.LLen("key", &count));
+    ASSERT_EQ(count, 2);
+    ASSERT_MERODIS_OK(db.HGet("key", "field", &value));
+    ASSERT_EQ(value, "hash");
+    ASSERT_MERODIS_OK(db.SCard("key", &count));
+    ASSERT_EQ(count, 1);
+    ASSERT_MERODIS_OK(db.ZCard("key", &count));
+    ASSERT_EQ(count, 1);
+  }
+};
+
+TEST_F(OpenTest, RecoversEveryDataType) {
+  Populate();
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  Verify();
+}
+
+TEST_F(OpenTest, OptimizesForDataTypes) {
+  options.OptimizeForDataTypes();
+  ASSERT_EQ(options.set_options.compression, DB_ENGINE::kNoCompression);
+  ASSERT_FALSE(Options().set_options.compression);
+  Populate();
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  Verify();
+}
+
+TEST_F(OpenTest, OpensEveryEngineOfTheBuild) {
+  for (Engine engine: {kLevelDBEngine, kRocksDBEngine}) {
+    options.engine = engine;
+    if (!Merodis::SupportsEngine(engine)) {
+      Merodis unsupported;
+      ASSERT_MERODIS_IS_NOT_SUPPORTED(unsupported.Open(options, db_path));
+      continue;
+    }
+    for (bool singleDB: {false, true}) {
+      Merodis::DestroyDB(db_path, options);
+      options.single_db = singleDB;
+      {
+        Merodis previous;
+        ASSERT_MERODIS_OK(previous.Open(options, db_path));
+        ASSERT_NO_FATAL_FAILURE(PutEveryType(&previous));
+      }
+      Merodis reopened;
+      ASSERT_MERODIS_OK(reopened.Open(options, db_path));
+      ASSERT_NO_FATAL_FAILURE(ExpectEveryType(&reopened));
+    }
+  }
+}
+
+TEST_F(OpenTest, RefusesInstancesOfOtherEngines) {
+  {
+    Merodis previous;
+    ASSERT_MERODIS_OK(previous.Open(options, db_path));
+  }
+  std::ofstream(db_path + "/LAYOUT") << "versioned\nengine "
+                                    << (options.engine == kLevelDBEngine ? "rocksdb" : "leveldb") << "\n";
+  ASSERT_MERODIS_IS_INVALID_ARGUMENT(db.Open(options, db_path));
+}
+
+// Writes the keys the way sets and zsets were stored before versions.
+static void PutUnversioned(const std::string& path, const std::vector<std::pair<std::string, std::string>>& kvs) {
+  EngineOptions engineOptions;
+  engineOptions.create_if_missing = true;
+  DB* engine;
+  ASSERT_MERODIS_OK(DB::Open(engineOptions, path, &engine));
+  WriteBatch batch;
+  for (const auto& [key, value]: kvs) batch.Put(key, value);
+  ASSERT_MERODIS_OK(engine->Write(WriteOptions(), &batch));
+  delete engine;
+}
+
+static std::string Fixed64(uint64_t value) {
+  std::string raw(sizeof(uint64_t), 0);
+  EncodeFixed64(raw.data(), value);
+  return raw;
+}
+
+// Scores are stored offset to sort as unsigned.
+static std::string Score(int64_t score) {
+  return Fixed64(static_cast<uint64_t>(score) + (uint64_t(1) << 63));
+}
+
+TEST_F(OpenTest, UpgradesUnversionedSetsAndZSets) {
+  Populate();
+  std::filesystem::remove(db_path + "/LAYOUT");
+  PutUnversioned(db_path + "/set", {
+    {"old", Fixed64(2)},
+    {std::string("old\0a", 5), ""},
+    {std::string("old\0b", 5), ""},
+  });
+  PutUnversioned(db_path + "/zset", {
+    {"old", Fixed64(2)},
+    {std::string("old\0", 4) + Score(1) + "a", ""},
+    {std::string("old\0", 4) + Score(2) + "b", ""},
+    {"old\xff" "a", Score(1)},
+    {"old\xff" "b", Score(2)},
+  });
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  Verify();
+  uint64_t count;
+  bool isMember;
+  int64_t score;
+  std::vector<std::string> members;
+  Members zmembers;
+  ASSERT_MERODIS_OK(db.SCard("old", &count));
+  ASSERT_EQ(count, 2);
+  ASSERT_MERODIS_OK(db.SIsMember("old", "b", &isMember));
+  ASSERT_TRUE(isMember);
+  ASSERT_MERODIS_OK(db.SMembers("old", &members));
+  ASSERT_EQ(members, std::vector<std::string>({"a", "b"}));
+  ASSERT_MERODIS_OK(db.ZScore("old", "b", &score));
+  ASSERT_EQ(score, 2);
+  ASSERT_MERODIS_OK(db.ZRange("old", 0, -1, &zmembers));
+  ASSERT_EQ(zmembers, Members({"a", "b"}));
+  ASSERT_MERODIS_OK(db.ReclaimStaleVersions());
+  ASSERT_MERODIS_OK(db.SCard("old", &count));
+  ASSERT_EQ(count, 2);
+  ASSERT_MERODIS_OK(db.ZCard("old", &count));
+  ASSERT_EQ(count, 2);
+  ASSERT_MERODIS_OK(db.SRem("old", "a", &count));
+  ASSERT_MERODIS_OK(db.ZRem("old", "a", &count));
+  members.clear();
+  zmembers.clear();
+  ASSERT_MERODIS_OK(db.SMembers("old", &members));
+  ASSERT_EQ(members, std::vector<std::string>({"b"}));
+  ASSERT_MERODIS_OK(db.ZRange("old", 0, -1, &zmembers));
+  ASSERT_EQ(zmembers, Members({"b"}));
+}
+
+// The meta values before versions hold 8 bytes as the member keys of zsets
+// do, so a zset whose key extends another's with the member separator is
+// only told from a member by the scored member key it lacks.
+TEST_F(OpenTest, UpgradesZSetsExtendingKeys) {
+  Populate();
+  std::filesystem::remove(db_path + "/LAYOUT");
+  const std::string longKey("old\xff" "b", 5);
+  PutUnversioned(db_path + "/zset", {
+    {"old", Fixed64(1)},
+    {std::string("old\0", 4) + Score(1) + "a", ""},
+    {"old\xff" "a", Score(1)},
+    {longKey, Fixed64(1)},
+    {longKey + std::string(1, '\0') + Score(5) + "c", ""},
+    {longKey + "\xff" "c", Score(5)},
+  });
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  uint64_t count;
+  int64_t score;
+  Members members;
+  ASSERT_MERODIS_OK(db.ZCard("old", &count));
+  ASSERT_EQ(count, 1);
+  ASSERT_MERODIS_OK(db.ZRange("old", 0, -1, &members));
+  ASSERT_EQ(members, Members({"a"}));
+  ASSERT_MERODIS_OK(db.ZCard(longKey, &count));
+  ASSERT_EQ(count, 1);
+  ASSERT_MERODIS_OK(db.ZScore(longKey, "c", &score));
+  ASSERT_EQ(score, 5);
+  ASSERT_MERODIS_OK(db.ZRem("old", "a", &count));
+  ASSERT_MERODIS_OK(db.ZAdd("old", {"d", 2}, &count));
+  ASSERT_MERODIS_OK(db.ReclaimStaleVersions());
+  members.clear();
+  ASSERT_MERODIS_OK(db.ZRange("old", 0, -1, &members));
+  ASSERT_EQ(members, Members({"d"}));
+  ASSERT_MERODIS_OK(db.ZScore(longKey, "c", &score));
+  ASSERT_EQ(score, 5);
+}
+
+static std::vector<std::string> RawKeys(const std::string& path) {
+  std::vector<std::string> keys;
+  DB* engine;
+  Status s = DB::Open(EngineOptions(), path, &engine);
+  EXPECT_TRUE(s.ok()) << s.ToString();
+  if (!s.ok()) return keys;
+  Iterator* iter = engine->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) keys.push_back(iter->key().ToString());
+  delete iter;
+  delete engine;
+  return keys;
+}
+
+// Once their members are reclaimed, the sets and zsets deleted whole leave
+// no meta value behind, and recreating them starts over.
+TEST_F(OpenTest, ReclaimsMetaValuesOfDeletedKeys) {
+  {
+    Merodis previous;
+    uint64_t count;
+    ASSERT_MERODIS_OK(previous.Open(options, db_path));
+    ASSERT_MERODIS_OK(previous.SAdd("gone", std::set<Slice>{"a", "b"}, &count));
+    ASSERT_MERODIS_OK(previous.ZAdd("gone", {{"a", 1}, {"b", 2}}, &count));
+    ASSERT_MERODIS_OK(previous.SInterStore({"gone", "none"}, "gone", &count));
+    ASSERT_EQ(count, 0);
+    ASSERT_MERODIS_OK(previous.ZInterStore({"gone", "none"}, "gone", &count));
+    ASSERT_EQ(count, 0);
+    ASSERT_MERODIS_OK(previous.ReclaimStaleVersions());
+  }
+  ASSERT_EQ(RawKeys(db_path + "/set"), std::vector<std::string>());
+  ASSERT_EQ(RawKeys(db_path + "/zset"), std::vector<std::string>());
+
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  uint64_t count;
+  std::vector<std::string> members;
+  Members zmembers;
+  ASSERT_MERODIS_OK(db.SAdd("gone", "c", &count));
+  ASSERT_MERODIS_OK(db.ZAdd("gone", {"c", 3}, &count));
+  ASSERT_MERODIS_OK(db.SMembers("gone", &members));
+  ASSERT_EQ(members, std::vector<std::string>({"c"}));
+  ASSERT_MERODIS_OK(db.ZRange("gone", 0, -1, &zmembers));
+  ASSERT_EQ(zmembers, Members({"c"}));
+}
+
+TEST_F(OpenTest, WarmsUp) {
+  Populate();
+  options.warm_up = true;
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  Verify();
+}
+
+}
+}
@@ -0,0 +1,259 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "server/command.h"
+#include "server/resp.h"
+#include "server/server.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class ServerTest : public RedisTest {
+public:
+  // The reply of the command made of args.
+  std::string Run(const std::vector<Slice>& args) {
+    std::string reply;
+    commands.Execute(&db, args, &reply);
+    return reply;
+  }
+
+  // Sends requests to the server at port, in two writes, the first ending
+  // inside a request, and reads the replies until the server closes.
+  std::string Exchange(uint16_t port, const std::string& requests) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    EXPECT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    EXPECT_EQ(::write(fd, requests.data(), 10), 10);
+    EXPECT_EQ(::write(fd, requests.data() + 10, requests.size() - 10), requests.size() - 10);
+    std::string replies;
+    char buffer[4096];
+    for (ssize_t n; (n = ::read(fd, buffer, sizeof(buffer))) > 0;) replies.append(buffer, n);
+    ::close(fd);
+    return replies;
+  }
+
+  // Serves clients, each pipelining commands on its own key, on a key
+  // shared by all and on one it moves its values to, and checks their
+  // replies come in order. Skips the test where the kernel lacks the
+  // backend asked for.
+  void ServeClients(ServerOptions serverOptions) {
+    ASSERT_MERODIS_OK(db.Open(options, db_path));
+    serverOptions.port = 0;
+    Server server(&db, serverOptions);
+    ASSERT_MERODIS_OK(server.Listen());
+    if (server.backend() != serverOptions.io_backend) GTEST_SKIP() << "the backend is not available";
+    std::thread loop([&server] { ASSERT_MERODIS_OK(server.Run()); });
+
+    const int clients = 8, rounds = 200;
+    std::vector<std::string> replies(clients), expected(clients);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; i++) {
+      std::string requests;
+      std::string list = "l" + std::to_string(i);
+      for (int c = 0; c < rounds; c++) {
+        std::string value = std::to_string(i) + "_" + std::to_string(c);
+        requests += "INCR n" + std::to_string(i) + "\r\nSADD s " + value + "\r\n";
+        requests += "RPUSH " + list + " " + value + "\r\nLMOVE " + list + " m LEFT RIGHT\r\nLLEN " + list + "\r\n";
+        expected[i] += ":" + std::to_string(c + 1) + "\r\n:1\r\n:1\r\n";
+        expected[i] += "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n:0\r\n";
+      }
+      requests += "QUIT\r\n";
+      expected[i] += "+OK\r\n";
+      threads.emplace_back([this, &server, &replies, i, requests] { replies[i] = Exchange(server.port(), requests); });
+    }
+    for (auto& thread: threads) thread.join();
+    server.Stop();
+    loop.join();
+
+    for (int i = 0; i < clients; i++) ASSERT_EQ(replies[i], expected[i]);
+    uint64_t len;
+    ASSERT_MERODIS_OK(db.SCard("s", &len));
+    ASSERT_EQ(len, clients * rounds);
+    ASSERT_MERODIS_OK(db.LLen("m", &len));
+    ASSERT_EQ(len, clients * rounds);
+  }
+
+  CommandTable commands;
+};
+
+TEST_F(ServerTest, ParsesPipelinedRequests) {
+  std::string data = "*2\r\n$3\r\nGET\r\n$1\r\nk\r\n*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$0\r\n\r\n";
+  std::vector<Slice> args;
+  size_t consumed;
+  std::string error;
+  ASSERT_EQ(ParseRequest(data.data(), data.size(), &args, &consumed, &error), kRespRequest);
+  ASSERT_EQ(args, (std::vector<Slice>{"GET", "k"}));
+  ASSERT_EQ(consumed, 20);
+  ASSERT_EQ(ParseRequest(data.data() + consumed, data.size() - consumed, &args, &consumed, &error), kRespRequest);
+  ASSERT_EQ(args, (std::vector<Slice>{"SET", "k", ""}));
+  ASSERT_EQ(consumed, data.size() - 20);
+}
+
+TEST_F(ServerTest, WaitsForWholeRequests) {
+  std::string data = "*2\r\n$3\r\nGET\r\n$5\r\nkey";
+  std::vector<Slice> args;
+  size_t consumed;
+  std::string error;
+  for (size_t size = 0; size <= data.size(); size++) {
+    ASSERT_EQ(ParseRequest(data.data(), size, &args, &consumed, &error), kRespIncomplete);
+  }
+  data += "12\r\n";
+  ASSERT_EQ(ParseRequest(data.data(), data.size(), &args, &consumed, &error), kRespRequest);
+  ASSERT_EQ(args, (std::vector<Slice>{"GET", "key12"}));
+}
+
+TEST_F(ServerTest, ParsesInlineRequests) {
+  std::string data = "  SET  k v\r\nPING\n";
+  std::vector<Slice> args;
+  size_t consumed;
+  std::string error;
+  ASSERT_EQ(ParseRequest(data.data(), data.size(), &args, &consumed, &error), kRespRequest);
+  ASSERT_EQ(args, (std::vector<Slice>{"SET", "k", "v"}));
+  ASSERT_EQ(ParseRequest(data.data() + consumed, data.size() - consumed, &args, &consumed, &error), kRespRequest);
+  ASSERT_EQ(args, (std::vector<Slice>{"PING"}));
+}
+
+TEST_F(ServerTest, RejectsMalformedRequests) {
+  std::vector<Slice> args;
+  size_t consumed;
+  std::string error;
+  for (const std::string data: {"*1\r\n+GET\r\n", "*x\r\n", "*1\r\n$3\r\nGETX\r\n", "*1\r\n$-5\r\n"}) {
+    ASSERT_EQ(ParseRequest(data.data(), data.size(), &args, &consumed, &error), kRespError);
+    ASSERT_FALSE(error.empty());
+  }
+}
+
+TEST_F(ServerTest, RunsCommands) {
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  ASSERT_EQ(Run({"PING"}), "+PONG\r\n");
+  ASSERT_EQ(Run({"get", "k"}), "$-1\r\n");
+  ASSERT_EQ(Run({"SET", "k", "v"}), "+OK\r\n");
+  ASSERT_EQ(Run({"GET", "k"}), "$1\r\nv\r\n");
+  ASSERT_EQ(Run({"INCRBY", "n", "5"}), ":5\r\n");
+  ASSERT_EQ(Run({"INCRBY", "n", "x"}), "-ERR value is not an integer or out of range\r\n");
+  ASSERT_EQ(Run({"RPUSH", "l", "a", "b", "c"}), ":3\r\n");
+  ASSERT_EQ(Run({"LRANGE", "l", "0", "-1"}), "*3\r\n$1\r\na\r\n$1\r\nb\r\n$1\r\nc\r\n");
+  ASSERT_EQ(Run({"LPOP", "l", "2"}), "*2\r\n$1\r\na\r\n$1\r\nb\r\n");
+  ASSERT_EQ(Run({"LINDEX", "l", "5"}), "$-1\r\n");
+  ASSERT_EQ(Run({"HSET", "h", "f1", "v1", "f2", "v2"}), ":2\r\n");
+  ASSERT_EQ(Run({"HGET", "h", "f3"}), "$-1\r\n");
+  ASSERT_EQ(Run({"HMGET", "h", "f3", "f1"}), "*2\r\n$-1\r\n$2\r\nv1\r\n");
+  ASSERT_EQ(Run({"HGETALL", "h"}), "*4\r\n$2\r\nf1\r\n$2\r\nv1\r\n$2\r\nf2\r\n$2\r\nv2\r\n");
+  ASSERT_EQ(Run({"SADD", "s", "b", "a"}), ":2\r\n");
+  ASSERT_EQ(Run({"SMISMEMBER", "s", "c", "b"}), "*2\r\n:0\r\n:1\r\n");
+  ASSERT_EQ(Run({"ZADD", "z", "2", "b", "1", "a"}), ":2\r\n");
+  ASSERT_EQ(Run({"ZRANGE", "z", "0", "-1", "WITHSCORES"}), "*4\r\n$1\r\na\r\n$1\r\n1\r\n$1\r\nb\r\n$1\r\n2\r\n");
+  ASSERT_EQ(Run({"ZRANGEBYSCORE", "z", "(1", "+inf"}), "*1\r\n$1\r\nb\r\n");
+  ASSERT_EQ(Run({"ZRANGEBYLEX", "z", "-", "[a"}), "*1\r\n$1\r\na\r\n");
+  ASSERT_EQ(Run({"ZSCORE", "z", "c"}), "$-1\r\n");
+}
+
+TEST_F(ServerTest, RejectsUnknownCommands) {
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  ASSERT_EQ(Run({"NOPE"}), "-ERR unknown command 'NOPE'\r\n");
+  ASSERT_EQ(Run({"GET"}), "-ERR wrong number of arguments for 'get' command\r\n");
+  ASSERT_EQ(Run({"HSET", "h", "f"}), "-ERR wrong number of arguments for 'hset' command\r\n");
+}
+
+TEST_F(ServerTest, ServesPipelinedClients) {
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  ServerOptions serverOptions;
+  serverOptions.port = 0;
+  Server server(&db, serverOptions);
+  ASSERT_MERODIS_OK(server.Listen());
+  std::thread loop([&server] { ASSERT_MERODIS_OK(server.Run()); });
+
+  std::string requests;
+  std::string expected;
+  for (int c = 0; c < 1000; c++) {
+    requests += "*2\r\n$4\r\nINCR\r\n$1\r\nn\r\n";
+    expected += ":" + std::to_string(c + 1) + "\r\n";
+  }
+  requests += "QUIT\r\n";
+  expected += "+OK\r\n";
+  ASSERT_EQ(Exchange(server.port(), requests), expected);
+
+  server.Stop();
+  loop.join();
+}
+
+TEST_F(ServerTest, ShardsRequestsOnWorkers) {
+  ServerOptions serverOptions;
+  serverOptions.io_threads = 2;
+  serverOptions.worker_threads = 4;
+  ServeClients(serverOptions);
+}
+
+TEST_F(ServerTest, OrdersCommandsAcrossIoThreads) {
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  ServerOptions serverOptions;
+  serverOptions.port = 0;
+  serverOptions.io_threads = 2;
+  Server unordered(&db, serverOptions);
+  ASSERT_MERODIS_IS_INVALID_ARGUMENT(unordered.Listen());
+
+  serverOptions.worker_threads = 2;
+  Server server(&db, serverOptions);
+  ASSERT_MERODIS_OK(server.Listen());
+  std::thread loop([&server] { ASSERT_MERODIS_OK(server.Run()); });
+
+  // The clients spread over both I/O threads, all incrementing one key.
+  const int clients = 4, rounds = 500;
+  std::string requests;
+  for (int c = 0; c < rounds; c++) requests += "INCR n\r\n";
+  requests += "QUIT\r\n";
+  std::vector<std::string> replies(clients);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; i++) {
+    threads.emplace_back([this, &server, &replies, &requests, i] { replies[i] = Exchange(server.port(), requests); });
+  }
+  for (auto& thread: threads) thread.join();
+  server.Stop();
+  loop.join();
+
+  std::vector<bool> seen(clients * rounds + 1);
+  for (const auto& reply: replies) {
+    size_t position = 0;
+    int64_t previous = 0;
+    for (int c = 0; c < rounds; c++) {
+      ASSERT_EQ(reply[position], ':');
+      size_t end = reply.find("\r\n", position);
+      int64_t n = std::stoll(reply.substr(position + 1, end - position - 1));
+      ASSERT_GT(n, previous);
+      ASSERT_LE(n, clients * rounds);
+      ASSERT_FALSE(seen[n]);
+      seen[n] = true;
+      previous = n;
+      position = end + 2;
+    }
+    ASSERT_EQ(reply.substr(position), "+OK\r\n");
+  }
+  std::string value;
+  ASSERT_MERODIS_OK(db.Get("n", &value));
+  ASSERT_EQ(value, std::to_string(clients * rounds));
+}
+
+TEST_F(ServerTest, ServesOverIoUring) {
+  ServerOptions serverOptions;
+  serverOptions.io_threads = 2;
+  serverOptions.worker_threads = 2;
+  serverOptions.io_backend = kIoUringBackend;
+  ServeClients(serverOptions);
+}
+
+}
+}
@@ -0,0 +1,47 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class SingleDBTest : public RedisTest {
+public:
+  void SetUp() override {
+    options.single_db = true;
+    ASSERT_MERODIS_OK(db.Open(options, db_path));
+  }
+};
+
+TEST_F(SingleDBTest, TypesDoNotCollide) {
+  ASSERT_NO_FATAL_FAILURE(PutEveryType(&db));
+  ASSERT_NO_FATAL_FAILURE(ExpectEveryType(&db));
+}
+
+TEST_F(SingleDBTest, ScansStayInsideType) {
+  uint64_t count;
+  ASSERT_MERODIS_OK(db.SAdd("s", std::set<Slice>{"a", "b", "c"}, &count));
+  ASSERT_MERODIS_OK(db.ZAdd("s", std::map<Slice, int64_t>{{"x", 1}, {"y", 2}}, &count));
+  ASSERT_MERODIS_OK(db.HSet("t", std::map<Slice, Slice>{{"f", "v"}}, &count));
+
+  std::vector<std::string> members;
+  ASSERT_MERODIS_OK(db.SUnion({"s", "t"}, &members));
+  ASSERT_EQ(members, LIST("a", "b", "c"));
+  ScoredMember scoredMember;
+  ASSERT_MERODIS_OK(db.ZPopMax("s", &scoredMember));
+  ASSERT_EQ(scoredMember, PAIR("y", 2));
+  ASSERT_MERODIS_OK(db.ZCard("s", &count));
+  ASSERT_EQ(count, 1);
+  ASSERT_MERODIS_OK(db.SCard("s", &count));
+  ASSERT_EQ(count, 3);
+}
+
+}
+}
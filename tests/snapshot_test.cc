@@ -0,0 +1,77 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class SnapshotTest : public RedisTest {
+public:
+  void SetUp() override {
+    ASSERT_MERODIS_OK(db.Open(options, db_path));
+  }
+};
+
+TEST_F(SnapshotTest, ReadsPinnedState) {
+  uint64_t count;
+  ASSERT_NO_FATAL_FAILURE(PutEveryType(&db));
+  ASSERT_MERODIS_OK(db.SAdd("other", std::set<Slice>{"b", "c"}, &count));
+
+  Merodis* snapshot;
+  ASSERT_MERODIS_OK(db.GetSnapshot(&snapshot));
+  ASSERT_MERODIS_OK(db.Set("key", "later"));
+  ASSERT_MERODIS_OK(db.RPush("key", "l2"));
+  ASSERT_MERODIS_OK(db.HSet("key", "field", "later", &count));
+  ASSERT_MERODIS_OK(db.SAdd("key", "c", &count));
+  ASSERT_MERODIS_OK(db.SRem("other", "b", &count));
+  ASSERT_MERODIS_OK(db.ZAdd("key", {"member", 2}, &count));
+
+  ASSERT_NO_FATAL_FAILURE(ExpectEveryType(snapshot));
+  std::vector<std::string> members;
+  ASSERT_MERODIS_OK(snapshot->SInter({"key", "other"}, &members));
+  ASSERT_EQ(members, LIST("b"));
+  Merodis::ReleaseSnapshot(snapshot);
+
+  members.clear();
+  ASSERT_MERODIS_OK(db.SInter({"key", "other"}, &members));
+  ASSERT_EQ(members, LIST("c"));
+  int64_t score;
+  ASSERT_MERODIS_OK(db.ZScore("key", "member", &score));
+  ASSERT_EQ(score, 2);
+}
+
+TEST_F(SnapshotTest, RejectsWrites) {
+  uint64_t count;
+  std::string key, value;
+  ASSERT_MERODIS_OK(db.RPush("list", std::vector<Slice>{"l0", "l1"}));
+
+  Merodis* snapshot;
+  ASSERT_MERODIS_OK(db.GetSnapshot(&snapshot));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->Set("key", "v"));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->Incr("n", nullptr));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->RPush("list", "l2"));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->LPop("list", &value));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->HSet("key", "field", "h", &count));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->SAdd("key", "member", &count));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->ZAdd("key", {"member", 1}, &count));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->BLPop({"empty"}, 0, &key, &value));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(snapshot->BLMove("empty", "list", kLeft, kRight, 0, &value));
+  Merodis::ReleaseSnapshot(snapshot);
+
+  std::vector<std::string> values;
+  ASSERT_MERODIS_OK(db.LRange("list", 0, -1, &values));
+  ASSERT_EQ(values, LIST("l0", "l1"));
+  ASSERT_MERODIS_IS_NOT_FOUND(db.Get("key", &value));
+  ASSERT_MERODIS_IS_NOT_FOUND(db.Get("n", &value));
+  ASSERT_MERODIS_IS_NOT_FOUND(db.HGet("key", "field", &value));
+}
+
+}
+}
@@ -1,5 +1,7 @@
 #include <cstdint>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -54,6 +56,8 @@ public:
 
   virtual void TestGetSet();
   virtual void TestIncrDecr();
+  virtual void TestIncrWithoutResult();
+  virtual void TestConcurrentIncr();
 private:
   Slice key_;
 };
@@ -142,6 +146,58 @@ void StringTest::TestIncrDecr() {
   ASSERT_EQ(Get(), "-9223372036854775808");
 }
 
+void StringTest::TestIncrWithoutResult() {
+  Set("1");
+  ASSERT_MERODIS_OK(db.IncrBy("key", 2, nullptr));
+  ASSERT_MERODIS_OK(db.DecrBy("key", 4, nullptr));
+  ASSERT_MERODIS_OK(db.Incr("key", nullptr));
+  ASSERT_EQ(Get(), "0");
+  ASSERT_MERODIS_OK(db.Incr("nokey", nullptr));
+  ASSERT_EQ(Get("nokey"), "1");
+
+  // Failed increments leave the value untouched, even when the failure
+  // is only noticed on read, as a blind merge on RocksDB is.
+#ifdef ROCKSDB
+  bool merged = options.string_impl != kStringBasicImpl;
+#else
+  bool merged = false;
+#endif
+  auto assertFailed = [merged](const Status& s) {
+    if (merged) {
+      ASSERT_MERODIS_OK(s);
+    } else {
+      ASSERT_MERODIS_IS_INVALID_ARGUMENT(s);
+    }
+  };
+  Set("1xx");
+  assertFailed(db.Incr("key", nullptr));
+  ASSERT_EQ(Get(), "1xx");
+  Set("9223372036854775806");
+  ASSERT_MERODIS_OK(db.Incr("key", nullptr));
+  assertFailed(db.Incr("key", nullptr));
+  ASSERT_MERODIS_OK(db.Decr("key", nullptr));
+  ASSERT_EQ(Get(), "9223372036854775806");
+  ASSERT_EQ(Incr(), 9223372036854775807);
+}
+
+// Increments waiting for the sum and blind ones race on one key, and none
+// may be lost between the read and the write of another.
+void StringTest::TestConcurrentIncr() {
+  constexpr int kThreads = 8;
+  constexpr int kIncrements = 200;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t]() {
+      int64_t result;
+      for (int c = 0; c < kIncrements; c++) {
+        EXPECT_MERODIS_OK(db.Incr("key", t % 2 ? &result : nullptr));
+      }
+    });
+  }
+  for (auto& thread: threads) thread.join();
+  ASSERT_EQ(Get(), std::to_string(kThreads * kIncrements));
+}
+
 TEST_F(StringBasicImplTest, GetSet) {
   TestGetSet();
 }
@@ -150,6 +206,14 @@ TEST_F(StringBasicImplTest, IncrDecr) {
   TestIncrDecr();
 }
 
+TEST_F(StringBasicImplTest, IncrWithoutResult) {
+  TestIncrWithoutResult();
+}
+
+TEST_F(StringBasicImplTest, ConcurrentIncr) {
+  TestConcurrentIncr();
+}
+
 TEST_F(StringTypedImplTest, GetSet) {
   TestGetSet();
 }
@@ -158,5 +222,13 @@ TEST_F(StringTypedImplTest, IncrDecr) {
   TestIncrDecr();
 }
 
+TEST_F(StringTypedImplTest, IncrWithoutResult) {
+  TestIncrWithoutResult();
+}
+
+TEST_F(StringTypedImplTest, ConcurrentIncr) {
+  TestConcurrentIncr();
+}
+
 }
 }
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include <map>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class TransactionTest : public RedisTest {
+public:
+  // Pops a job off a queue and records it in a hash, in one transaction.
+  void TestCommitsAcrossTypes() {
+    uint64_t count;
+    std::string value;
+    ASSERT_MERODIS_OK(db.RPush("queue", std::vector<Slice>{"j0", "j1"}));
+
+    Merodis* transaction;
+    ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+    ASSERT_MERODIS_OK(transaction->LPop("queue", &value));
+    ASSERT_EQ(value, "j0");
+    ASSERT_MERODIS_OK(transaction->HSet("jobs", value, "running", &count));
+    ASSERT_MERODIS_OK(transaction->Incr("started", nullptr));
+
+    // Nothing reaches the instance before the commit.
+    uint64_t len;
+    ASSERT_MERODIS_OK(db.LLen("queue", &len));
+    ASSERT_EQ(len, 2);
+    ASSERT_MERODIS_IS_NOT_FOUND(db.HGet("jobs", "j0", &value));
+
+    ASSERT_MERODIS_OK(transaction->Commit());
+    Merodis::ReleaseTransaction(transaction);
+    std::vector<std::string> values;
+    ASSERT_MERODIS_OK(db.LRange("queue", 0, -1, &values));
+    ASSERT_EQ(values, LIST("j1"));
+    ASSERT_MERODIS_OK(db.HGet("jobs", "j0", &value));
+    ASSERT_EQ(value, "running");
+    ASSERT_MERODIS_OK(db.Get("started", &value));
+    ASSERT_EQ(value, "1");
+  }
+};
+
+TEST_F(TransactionTest, ReadsOwnWrites) {
+  options.single_db = true;
+  db.Open(options, db_path);
+  std::string value;
+  ASSERT_MERODIS_OK(db.RPush("key", std::vector<Slice>{"l0", "l1", "l2"}));
+  ASSERT_MERODIS_OK(db.Set("n", "5"));
+
+  Merodis* transaction;
+  ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+  ASSERT_MERODIS_OK(transaction->LPop("key", &value));
+  ASSERT_EQ(value, "l0");
+  ASSERT_MERODIS_OK(transaction->LPop("key", &value));
+  ASSERT_EQ(value, "l1");
+  ASSERT_MERODIS_OK(transaction->RPush("key", std::vector<Slice>{"l3", "l4"}));
+  std::vector<std::string> values;
+  ASSERT_MERODIS_OK(transaction->LRange("key", 0, -1, &values));
+  ASSERT_EQ(values, LIST("l2", "l3", "l4"));
+  int64_t result;
+  ASSERT_MERODIS_OK(transaction->Incr("n", &result));
+  ASSERT_MERODIS_OK(transaction->IncrBy("n", 2, &result));
+  ASSERT_EQ(result, 8);
+  ASSERT_MERODIS_OK(transaction->Commit());
+  Merodis::ReleaseTransaction(transaction);
+
+  values.clear();
+  ASSERT_MERODIS_OK(db.LRange("key", 0, -1, &values));
+  ASSERT_EQ(values, LIST("l2", "l3", "l4"));
+  ASSERT_MERODIS_OK(db.Get("n", &value));
+  ASSERT_EQ(value, "8");
+}
+
+TEST_F(TransactionTest, CommitsAcrossTypesInSingleDB) {
+  options.single_db = true;
+  db.Open(options, db_path);
+  TestCommitsAcrossTypes();
+}
+
+TEST_F(TransactionTest, RejectsCommitsAcrossTypes) {
+  db.Open(options, db_path);
+  uint64_t count;
+  std::string value;
+  ASSERT_MERODIS_OK(db.RPush("queue", std::vector<Slice>{"j0", "j1"}));
+
+  Merodis* transaction;
+  ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+  ASSERT_MERODIS_OK(transaction->LPop("queue", &value));
+  ASSERT_MERODIS_OK(transaction->HSet("jobs", value, "running", &count));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(transaction->Commit());
+  uint64_t len;
+  ASSERT_MERODIS_OK(db.LLen("queue", &len));
+  ASSERT_EQ(len, 2);
+  ASSERT_MERODIS_IS_NOT_FOUND(db.HGet("jobs", "j0", &value));
+
+  // Each data type still commits on its own.
+  ASSERT_MERODIS_OK(transaction->LPop("queue", &value));
+  ASSERT_MERODIS_OK(transaction->Commit());
+  ASSERT_MERODIS_OK(transaction->HSet("jobs", value, "running", &count));
+  ASSERT_MERODIS_OK(transaction->Commit());
+  Merodis::ReleaseTransaction(transaction);
+  ASSERT_MERODIS_OK(db.LLen("queue", &len));
+  ASSERT_EQ(len, 1);
+  ASSERT_MERODIS_OK(db.HGet("jobs", "j0", &value));
+  ASSERT_EQ(value, "running");
+}
+
+TEST_F(TransactionTest, FailsOnConflictingWrites) {
+  db.Open(options, db_path);
+  std::string value;
+  ASSERT_MERODIS_OK(db.RPush("queue", std::vector<Slice>{"j0", "j1"}));
+
+  Merodis* transaction;
+  ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+  ASSERT_MERODIS_OK(transaction->LPop("queue", &value));
+  ASSERT_EQ(value, "j0");
+  ASSERT_MERODIS_OK(transaction->Set("owner", "t"));
+  ASSERT_MERODIS_OK(db.LPop("queue", &value));
+  ASSERT_MERODIS_IS_NOT_FOUND(transaction->Commit());
+  ASSERT_MERODIS_IS_NOT_FOUND(db.Get("owner", &value));
+
+  // The view starts over on the current state.
+  ASSERT_MERODIS_OK(transaction->LPop("queue", &value));
+  ASSERT_EQ(value, "j1");
+  ASSERT_MERODIS_OK(transaction->Commit());
+  Merodis::ReleaseTransaction(transaction);
+  uint64_t len;
+  ASSERT_MERODIS_OK(db.LLen("queue", &len));
+  ASSERT_EQ(len, 0);
+}
+
+TEST_F(TransactionTest, FailsOnWatchedKeyChange) {
+  db.Open(options, db_path);
+  std::string value;
+  ASSERT_MERODIS_OK(db.Set("balance", "10"));
+
+  Merodis* transaction;
+  ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+  ASSERT_MERODIS_OK(transaction->Watch("balance"));
+  ASSERT_MERODIS_OK(transaction->Get("balance", &value));
+  ASSERT_MERODIS_OK(transaction->Set("audit", value));
+  ASSERT_MERODIS_OK(db.Set("balance", "0"));
+  ASSERT_MERODIS_IS_NOT_FOUND(transaction->Commit());
+  ASSERT_MERODIS_IS_NOT_FOUND(db.Get("audit", &value));
+
+  // Writes to keys neither watched nor written do not conflict.
+  ASSERT_MERODIS_OK(transaction->Watch("balance"));
+  ASSERT_MERODIS_OK(transaction->Set("audit", "0"));
+  ASSERT_MERODIS_OK(db.Set("other", "1"));
+  ASSERT_MERODIS_OK(transaction->Commit());
+  Merodis::ReleaseTransaction(transaction);
+  ASSERT_MERODIS_OK(db.Get("audit", &value));
+  ASSERT_EQ(value, "0");
+}
+
+TEST_F(TransactionTest, RemovesZSetRanges) {
+  db.Open(options, db_path);
+  uint64_t count;
+  ASSERT_MERODIS_OK(db.ZAdd("z", {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}, {"e", 5}, {"f", 6}}, &count));
+
+  Merodis* transaction;
+  ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+  ASSERT_MERODIS_OK(transaction->ZRemRangeByRank("z", 0, 1, &count));
+  ASSERT_EQ(count, 2);
+  ASSERT_MERODIS_OK(transaction->ZRemRangeByScore("z", 3, 4, &count));
+  ASSERT_EQ(count, 2);
+  ASSERT_MERODIS_OK(transaction->ZRemRangeByLex("z", "e", "e", &count));
+  ASSERT_EQ(count, 1);
+  Members members;
+  ASSERT_MERODIS_OK(transaction->ZRange("z", 0, -1, &members));
+  ASSERT_EQ(members, Members({"f"}));
+  ASSERT_MERODIS_OK(db.ZCard("z", &count));
+  ASSERT_EQ(count, 6);
+  ASSERT_MERODIS_OK(transaction->Commit());
+  Merodis::ReleaseTransaction(transaction);
+
+  members.clear();
+  ASSERT_MERODIS_OK(db.ZRange("z", 0, -1, &members));
+  ASSERT_EQ(members, Members({"f"}));
+  ASSERT_MERODIS_OK(db.ZCard("z", &count));
+  ASSERT_EQ(count, 1);
+}
+
+TEST_F(TransactionTest, ServesBlockedPops) {
+  db.Open(options, db_path);
+  std::string key, value;
+  std::thread pop([&] { ASSERT_MERODIS_OK(db.BLPop({"queue"}, 0, &key, &value)); });
+  while (!db.BlockedOn("queue")) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  Merodis* transaction;
+  ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+  ASSERT_MERODIS_IS_NOT_SUPPORTED(transaction->BLPop({"queue"}, 1, &key, &value));
+  ASSERT_MERODIS_OK(transaction->RPush("queue", std::vector<Slice>{"j0", "j1"}));
+  // The view shares the list stripes of db, but serves its waiters only
+  // through the commit.
+  ASSERT_EQ(db.BlockedOn("queue"), 1);
+  ASSERT_MERODIS_OK(transaction->Commit());
+  Merodis::ReleaseTransaction(transaction);
+  pop.join();
+  ASSERT_EQ(key, "queue");
+  ASSERT_EQ(value, "j0");
+  std::vector<std::string> values;
+  ASSERT_MERODIS_OK(db.LRange("queue", 0, -1, &values));
+  ASSERT_EQ(values, LIST("j1"));
+}
+
+TEST_F(TransactionTest, CommitsConcurrentIncrements) {
+  options.single_db = true;
+  db.Open(options, db_path);
+  const int threads = 4, rounds = 100;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back([this] {
+      Merodis* transaction;
+      ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+      for (int c = 0; c < rounds;) {
+        ASSERT_MERODIS_OK(transaction->Incr("n", nullptr));
+        ASSERT_MERODIS_OK(transaction->RPush("log", "x"));
+        Status s = transaction->Commit();
+        if (s.IsNotFound()) continue;
+        ASSERT_MERODIS_OK(s);
+        c++;
+      }
+      Merodis::ReleaseTransaction(transaction);
+    });
+  }
+  for (auto& worker: workers) worker.join();
+  std::string value;
+  ASSERT_MERODIS_OK(db.Get("n", &value));
+  ASSERT_EQ(value, std::to_string(threads * rounds));
+  uint64_t len;
+  ASSERT_MERODIS_OK(db.LLen("log", &len));
+  ASSERT_EQ(len, threads * rounds);
+}
+
+}
+}
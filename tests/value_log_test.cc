@@ -0,0 +1,189 @@
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class ValueLogTest : public RedisTest {
+public:
+  ValueLogTest() {
+    options.string_options.min_blob_size = 16;
+    options.hash_options.min_blob_size = 16;
+  }
+
+  // The bytes in the value log files of the data type.
+  uint64_t LogSize(const std::string& type) {
+    uint64_t size = 0;
+    std::error_code ec;
+    for (const auto& entry: std::filesystem::directory_iterator(db_path + "/" + type + "_values", ec)) {
+      size += entry.file_size();
+    }
+    return size;
+  }
+
+  std::string large = std::string(64, 'v');
+};
+
+TEST_F(ValueLogTest, ReadsSeparatedValues) {
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  uint64_t count;
+  std::string value;
+  ASSERT_MERODIS_OK(db.Set("small", "value"));
+  ASSERT_MERODIS_OK(db.Set("large", large));
+  ASSERT_MERODIS_OK(db.Set("n", "1"));
+  ASSERT_MERODIS_OK(db.HSet("key", {{"small", "value"}, {"large", large}}, &count));
+  ASSERT_GT(LogSize("string"), large.size());
+  ASSERT_LT(LogSize("string"), 2 * large.size());
+  ASSERT_GT(LogSize("hash"), large.size());
+  ASSERT_LT(LogSize("hash"), 2 * large.size());
+
+  ASSERT_MERODIS_OK(db.Get("small", &value));
+  ASSERT_EQ(value, "value");
+  ASSERT_MERODIS_OK(db.Get("large", &value));
+  ASSERT_EQ(value, large);
+  ASSERT_TRUE(db.Incr("large", nullptr).IsInvalidArgument());
+  int64_t n;
+  ASSERT_MERODIS_OK(db.Incr("n", &n));
+  ASSERT_EQ(n, 2);
+  ASSERT_MERODIS_OK(db.HGet("key", "large", &value));
+  ASSERT_EQ(value, large);
+  ValueOpts valueOpts;
+  ASSERT_MERODIS_OK(db.HMGet("key", {"small", "missing", "large"}, &valueOpts));
+  ASSERT_EQ(valueOpts, (ValueOpts{"value", std::nullopt, large}));
+  std::map<std::string, std::string> kvs;
+  ASSERT_MERODIS_OK(db.HGetAll("key", &kvs));
+  ASSERT_EQ(kvs, (std::map<std::string, std::string>{{"large", large}, {"small", "value"}}));
+  std::vector<std::string> values;
+  ASSERT_MERODIS_OK(db.HVals("key", &values));
+  ASSERT_EQ(values, LIST(large, "value"));
+}
+
+// The stored values are tagged or not after the option, recorded in LAYOUT.
+TEST_F(ValueLogTest, RefusesToChangeSeparationOfStoredValues) {
+  uint64_t count;
+  {
+    Merodis previous;
+    ASSERT_MERODIS_OK(previous.Open(options, db_path));
+    ASSERT_MERODIS_OK(previous.HSet("key", "field", large, &count));
+  }
+  Options unseparated = options;
+  unseparated.hash_options.min_blob_size.reset();
+#ifndef ROCKSDB
+  {
+    Merodis refused;
+    ASSERT_TRUE(refused.Open(unseparated, db_path).IsInvalidArgument());
+  }
+#endif
+  // The strings are empty, so they may change it.
+  unseparated.hash_options.min_blob_size = 16;
+  unseparated.string_options.min_blob_size.reset();
+  ASSERT_MERODIS_OK(db.Open(unseparated, db_path));
+  std::string value;
+  ASSERT_MERODIS_OK(db.HGet("key", "field", &value));
+  ASSERT_EQ(value, large);
+}
+
+TEST_F(ValueLogTest, CollectsOverwrittenValues) {
+  {
+    Merodis previous;
+    ASSERT_MERODIS_OK(previous.Open(options, db_path));
+    for (int c = 0; c < 100; c++) {
+      ASSERT_MERODIS_OK(previous.Set("key", large + std::to_string(c)));
+    }
+    ASSERT_MERODIS_OK(previous.Set("other", large));
+  }
+  // Reopening seals the file written so far.
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  uint64_t written = LogSize("string");
+  ASSERT_MERODIS_OK(db.CollectValueLogs());
+  ASSERT_MERODIS_OK(db.CollectValueLogs());
+  ASSERT_LT(LogSize("string") * 10, written);
+
+  std::string value;
+  ASSERT_MERODIS_OK(db.Get("key", &value));
+  ASSERT_EQ(value, large + "99");
+  ASSERT_MERODIS_OK(db.Get("other", &value));
+  ASSERT_EQ(value, large);
+}
+
+TEST_F(ValueLogTest, KeepsFilesReadBySnapshots) {
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  ASSERT_MERODIS_OK(db.Set("key", large));
+  ASSERT_MERODIS_OK(db.CreateCheckpoint(db_path + "_checkpoint"));
+  Merodis* snapshot;
+  ASSERT_MERODIS_OK(db.GetSnapshot(&snapshot));
+  ASSERT_MERODIS_OK(db.Set("key", "small"));
+  ASSERT_MERODIS_OK(db.CollectValueLogs());
+  ASSERT_MERODIS_OK(db.CollectValueLogs());
+
+  std::string value;
+  ASSERT_MERODIS_OK(snapshot->Get("key", &value));
+  ASSERT_EQ(value, large);
+  Merodis::ReleaseSnapshot(snapshot);
+
+  Merodis checkpoint;
+  ASSERT_MERODIS_OK(checkpoint.Open(options, db_path + "_checkpoint"));
+  ASSERT_MERODIS_OK(checkpoint.Get("key", &value));
+  ASSERT_EQ(value, large);
+  Merodis::DestroyDB(db_path + "_checkpoint", Options());
+}
+
+TEST_F(ValueLogTest, KeepsValuesBufferedByTransactions) {
+  options.single_db = true;
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  uint64_t count;
+  Merodis* transaction;
+  ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+  ASSERT_MERODIS_OK(transaction->Set("key", large));
+  ASSERT_MERODIS_OK(transaction->HSet("hash", "field", large, &count));
+  std::string value;
+  ASSERT_MERODIS_OK(transaction->Get("key", &value));
+  ASSERT_EQ(value, large);
+  // The checkpoint seals the files a buffered pointer would point into.
+  ASSERT_MERODIS_OK(db.CreateCheckpoint(db_path + "_sealed"));
+  Merodis::DestroyDB(db_path + "_sealed", Options());
+  ASSERT_MERODIS_OK(db.CollectValueLogs());
+  ASSERT_MERODIS_OK(db.CollectValueLogs());
+  ASSERT_MERODIS_OK(transaction->Commit());
+  Merodis::ReleaseTransaction(transaction);
+
+  ASSERT_MERODIS_OK(db.Get("key", &value));
+  ASSERT_EQ(value, large);
+  ASSERT_MERODIS_OK(db.HGet("hash", "field", &value));
+  ASSERT_EQ(value, large);
+  ASSERT_GT(LogSize("string"), large.size());
+  ASSERT_GT(LogSize("hash"), large.size());
+}
+
+// The meta key of a hash whose key holds '\0' looks like a node key, and
+// its 8-byte meta value like a tagged value long enough to be separated.
+TEST_F(ValueLogTest, KeepsMetaValuesOfTransactionsInline) {
+  options.hash_options.min_blob_size = 4;
+  ASSERT_MERODIS_OK(db.Open(options, db_path));
+  const std::string key("hash\0key", 8);
+  uint64_t count;
+  Merodis* transaction;
+  ASSERT_MERODIS_OK(db.BeginTransaction(&transaction));
+  ASSERT_MERODIS_OK(transaction->HSet(key, "field", large, &count));
+  ASSERT_MERODIS_OK(transaction->Commit());
+  Merodis::ReleaseTransaction(transaction);
+
+  ASSERT_MERODIS_OK(db.HLen(key, &count));
+  ASSERT_EQ(count, 1);
+  std::string value;
+  ASSERT_MERODIS_OK(db.HGet(key, "field", &value));
+  ASSERT_EQ(value, large);
+  ASSERT_GT(LogSize("hash"), large.size());
+}
+
+}
+}
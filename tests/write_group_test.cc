@@ -0,0 +1,55 @@
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "merodis/merodis.h"
+#include "common.h"
+#include "testutil.h"
+
+namespace merodis {
+namespace test {
+
+class WriteGroupTest : public RedisTest {
+public:
+  WriteGroupTest() {
+    options.commit_interval = 100;
+    db.Open(options, db_path);
+  }
+};
+
+TEST_F(WriteGroupTest, CommitsConcurrentWrites) {
+  const int threadCount = 8;
+  const int writeCount = 50;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < threadCount; t++) {
+    threads.emplace_back([this, t, writeCount] {
+      std::string key = "key" + std::to_string(t);
+      uint64_t count;
+      for (int c = 0; c < writeCount; c++) {
+        std::string member = std::to_string(c);
+        ASSERT_MERODIS_OK(db.HSet(key, member, member, &count));
+        ASSERT_MERODIS_OK(db.SAdd(key, member, &count));
+      }
+      ASSERT_MERODIS_OK(db.Set(key, "done"));
+    });
+  }
+  for (auto& thread: threads) thread.join();
+
+  for (int t = 0; t < threadCount; t++) {
+    std::string key = "key" + std::to_string(t);
+    uint64_t count;
+    std::string value;
+    ASSERT_MERODIS_OK(db.HLen(key, &count));
+    ASSERT_EQ(count, writeCount);
+    ASSERT_MERODIS_OK(db.SCard(key, &count));
+    ASSERT_EQ(count, writeCount);
+    ASSERT_MERODIS_OK(db.Get(key, &value));
+    ASSERT_EQ(value, "done");
+  }
+}
+
+}
+}
@@ -254,6 +254,7 @@ public:
   virtual void TestZUnion();
   virtual void TestZInter();
   virtual void TestZDiff();
+  virtual void TestKeysEndingInFF();
 
 private:
   Slice key_;
@@ -277,6 +278,15 @@ void ZSetTest::TestZMScore() {
   ASSERT_EQ(ZMScore({"-1", "0", "1"}), (ScoreOpts{-1, 0, 1}));
   ASSERT_EQ(ZMScore({"0", "2"}), (ScoreOpts{0, std::nullopt}));
   ASSERT_EQ(ZMScore({"-2", "2"}), (ScoreOpts{std::nullopt, std::nullopt}));
+  ASSERT_EQ(ZMScore({"1", "-1", "1"}), (ScoreOpts{1, -1, 1}));
+
+  // Few members of a large zset are looked up rather than walked.
+  std::vector<std::string> members;
+  for (int c = 0; c < 100; c++) members.push_back("m" + std::to_string(c));
+  std::map<Slice, int64_t> member2score;
+  for (int c = 0; c < 100; c++) member2score[members[c]] = c;
+  ASSERT_EQ(ZAdd(member2score), 100);
+  ASSERT_EQ(ZMScore({"m42", "m", "0"}), (ScoreOpts{42, std::nullopt, 0}));
 }
 
 void ZSetTest::TestZRank() {
@@ -643,6 +653,12 @@ void ZSetTest::TestZUnion() {
   ASSERT_EQ(ZRangeWithScores("zx", 0, -1), PAIRS({"a", 0}, {"b", 1}, {"c", 1}, {"d", 2}));
   ASSERT_EQ(ZUnionStore({"z0", "z3"}, "z0"), 4);
   ASSERT_EQ(ZRangeWithScores("z0", 0, -1), PAIRS({"a", 0}, {"c", 0}, {"b", 1}, {"d", 1}));
+
+  ASSERT_MERODIS_OK(db.ReclaimStaleVersions());
+  ASSERT_EQ(ZRangeWithScores("z0", 0, -1), PAIRS({"a", 0}, {"c", 0}, {"b", 1}, {"d", 1}));
+  ASSERT_EQ(ZRangeWithScores("zx", 0, -1), PAIRS({"a", 0}, {"b", 1}, {"c", 1}, {"d", 2}));
+  ASSERT_EQ(ZScore("z0", "d"), 1);
+  ASSERT_EQ(ZCard("z0"), 4);
 }
 
 void ZSetTest::TestZInter() {
@@ -681,6 +697,22 @@ void ZSetTest::TestZDiff() {
   ASSERT_EQ(ZDiffWithScores({"z0", "z1", "z2", "z3"}), PAIRS());
 }
 
+void ZSetTest::TestKeysEndingInFF() {
+  // The scans of a key ending in '\xff' bound their node keys with the
+  // next byte of the key up, not with a wrapped '\0'.
+  Slice key("k\xff", 2), longerKey("k\xff\xff", 3);
+  ASSERT_EQ(ZAdd(key, {{"a", 1}, {"b", 2}}), 2);
+  ASSERT_EQ(ZAdd(longerKey, {{"c", 3}}), 1);
+  ASSERT_EQ(ZAdd("l", {{"d", 4}}), 1);
+
+  ASSERT_EQ(ZCard(key), 2);
+  ASSERT_EQ(ZRange(key, 0, -1), LIST("a", "b"));
+  ASSERT_EQ(ZRevRange(key, 0, -1), LIST("b", "a"));
+  ASSERT_EQ(ZRangeByLex(key, "0", "z"), LIST("a", "b"));
+  ASSERT_EQ(ZRange(longerKey, 0, -1), LIST("c"));
+  ASSERT_EQ(ZRangeByScore(longerKey, minInt64, maxInt64), LIST("c"));
+}
+
 TEST_F(ZSetBasicImplTest, ZMScore) {
   TestZMScore();
 }
@@ -757,5 +789,9 @@ TEST_F(ZSetBasicImplTest, ZDiff) {
   TestZDiff();
 }
 
+TEST_F(ZSetBasicImplTest, KeysEndingInFF) {
+  TestKeysEndingInFF();
+}
+
 }
 }
\ No newline at end of file